@@ -37,8 +37,14 @@ func GetPackage() *denv.Package {
 	maintest.AddDependencies(cunittestpkg.GetMainLib())
 	maintest.AddDependency(testlib)
 
+	// benchmark application (source/bench/cpp)
+	mainbench := denv.SetupCppAppProject(mainpkg, name+"_bench")
+	mainbench.AddDependencies(cbasepkg.GetMainLib())
+	mainbench.AddDependency(mainlib)
+
 	mainpkg.AddMainLib(mainlib)
 	mainpkg.AddTestLib(testlib)
 	mainpkg.AddUnittest(maintest)
+	mainpkg.AddMainApp(mainbench)
 	return mainpkg
 }
@@ -0,0 +1,369 @@
+#include "ccore/c_target.h"
+#include "cbase/c_allocator.h"
+#include "cbase/c_base.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//
+// Benchmarks every HSHG operation on a set of reproducible scenarios. Every result is
+// written to stdout as one JSON object per line, so that runs can be diffed or plotted.
+//
+//   chshg_bench [--max <entities>] [--scenario <name>] [--ticks <n>]
+//   chshg_bench --small [--scenario <name>] [--ticks <n>]
+//
+// With '--small' only populations of 8 to 256 entities are run, once walking the grids
+// and once with hshg_set_brute_force_threshold(), to find where the brute force pays off.
+//
+
+using namespace ncore;
+
+namespace nbench
+{
+    // Wraps malloc to keep track of the peak number of bytes allocated
+    class counting_alloc_t : public alloc_t
+    {
+    public:
+        struct header_t
+        {
+            u64 m_size;
+            u64 m_pad;
+        };
+
+        virtual void* v_allocate(u32 size, u32 align)
+        {
+            header_t* header = (header_t*)malloc(sizeof(header_t) + size);
+            if (header == nullptr)
+                return nullptr;
+            header->m_size = size;
+            m_current += size;
+            if (m_current > m_peak)
+                m_peak = m_current;
+            return header + 1;
+        }
+
+        virtual void v_deallocate(void* p)
+        {
+            if (p == nullptr)
+                return;
+            header_t* header = (header_t*)p - 1;
+            m_current -= header->m_size;
+            free(header);
+        }
+
+        u64 m_current = 0;
+        u64 m_peak    = 0;
+    };
+
+    // xorshift, the same seed gives the same scenario on every platform
+    struct random_t
+    {
+        u32 m_state;
+
+        u32 next()
+        {
+            m_state ^= m_state << 13;
+            m_state ^= m_state >> 17;
+            m_state ^= m_state << 5;
+            return m_state;
+        }
+
+        f32 range(f32 lo, f32 hi) { return lo + (hi - lo) * ((f32)(next() >> 8) * (1.0f / 16777216.0f)); }
+    };
+
+    enum scenario_e
+    {
+        SCENARIO_UNIFORM,
+        SCENARIO_CLUSTERED,
+        SCENARIO_MIXED_RADIUS,
+        SCENARIO_FLAT,
+        SCENARIO_OUTLIERS,
+        SCENARIO_COUNT
+    };
+
+    static const char* s_scenario_names[SCENARIO_COUNT] = {"uniform", "clustered", "mixed_radius", "flat", "outliers"};
+
+    struct body_t
+    {
+        f32 x, y, z, r;
+        f32 vx, vy, vz;
+    };
+
+    // Entities are spread such that there are about 2 entities in every 8x8x8 cube
+    static void generate(scenario_e scenario, body_t* bodies, u32 count, f32 extent)
+    {
+        random_t rnd = {0x9e3779b9u + (u32)scenario * 7919u + count};
+
+        const u32 clusters = count / 64 + 1;
+        for (u32 i = 0; i < count; ++i)
+        {
+            body_t& b = bodies[i];
+            b.x       = rnd.range(0.0f, extent);
+            b.y       = rnd.range(0.0f, extent);
+            b.z       = rnd.range(0.0f, extent);
+            b.r       = rnd.range(0.5f, 2.0f);
+            b.vx      = rnd.range(-0.5f, 0.5f);
+            b.vy      = rnd.range(-0.5f, 0.5f);
+            b.vz      = rnd.range(-0.5f, 0.5f);
+
+            switch (scenario)
+            {
+                case SCENARIO_CLUSTERED:
+                {
+                    // a few dense blobs, every cluster center is picked by the same generator
+                    random_t cr = {0x1234567u + (rnd.next() % clusters) * 2654435761u};
+                    const f32 s = extent * 0.03f;
+                    b.x         = cr.range(0.0f, extent) + rnd.range(-s, s);
+                    b.y         = cr.range(0.0f, extent) + rnd.range(-s, s);
+                    b.z         = cr.range(0.0f, extent) + rnd.range(-s, s);
+                    break;
+                }
+                case SCENARIO_MIXED_RADIUS:
+                {
+                    // radii spread over 6 powers of 2, most of them small
+                    const u32 level = (rnd.next() & 0xFF) < 240 ? 0 : 1 + rnd.next() % 5;
+                    b.r             = rnd.range(0.5f, 1.0f) * (f32)(1 << level);
+                    break;
+                }
+                case SCENARIO_FLAT:
+                {
+                    b.z  = rnd.range(0.0f, 1.0f);
+                    b.vz = 0.0f;
+                    break;
+                }
+                case SCENARIO_OUTLIERS:
+                {
+                    // one in a thousand is bigger than the whole grid
+                    if (i % 1000 == 999)
+                        b.r = extent * 0.75f;
+                    break;
+                }
+                default: break;
+            }
+        }
+    }
+
+    class move_func_t : public nhshg::update_func_t
+    {
+    public:
+        body_t* m_bodies;
+
+        virtual void update(nhshg::index_t begin, nhshg::index_t end, nhshg::entity_t* entities, nhshg::index_t const* refs, nhshg::hshg_t* hshg)
+        {
+            for (nhshg::index_t i = begin; i < end; ++i)
+            {
+                const body_t& b = m_bodies[refs[i]];
+                entities[i].x += b.vx;
+                entities[i].y += b.vy;
+                entities[i].z += b.vz;
+                nhshg::hshg_move(hshg, i);
+            }
+        }
+    };
+
+    // Counts the candidate pairs, or with 'm_overlap' only those whose hypercubes overlap,
+    // the test the brute force path makes itself
+    class count_collide_func_t : public nhshg::collide_func_t
+    {
+    public:
+        u64  m_pairs   = 0;
+        bool m_overlap = false;
+
+        virtual void collide(nhshg::entity_t const* e1, nhshg::index_t e1_ref, nhshg::entity_t const* e2, nhshg::index_t e2_ref)
+        {
+            if (m_overlap)
+            {
+                const f32 r = e1->r + e2->r;
+                if (fabsf(e1->x - e2->x) > r || fabsf(e1->y - e2->y) > r || fabsf(e1->z - e2->z) > r)
+                    return;
+            }
+            ++m_pairs;
+        }
+    };
+
+    class count_query_func_t : public nhshg::query_func_t
+    {
+    public:
+        u64 m_hits = 0;
+
+        virtual void query(nhshg::entity_t const* e, nhshg::index_t e_ref) { ++m_hits; }
+    };
+
+    typedef std::chrono::steady_clock bench_clock_t;
+
+    static inline f64 elapsed_ns(bench_clock_t::time_point start) { return (f64)std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock_t::now() - start).count(); }
+
+    static void report(const char* scenario, u32 entities, const char* op, f64 ns, f64 per, u64 pairs, u64 peak)
+    {
+        const f64 pairs_per_sec = ns > 0.0 ? (f64)pairs * 1.0e9 / ns : 0.0;
+        printf("{\"scenario\":\"%s\",\"entities\":%u,\"op\":\"%s\",\"ns\":%.0f,\"ns_per_entity\":%.3f,\"pairs\":%llu,\"pairs_per_sec\":%.0f,\"peak_bytes\":%llu}\n", scenario, entities, op, ns, ns / per, (unsigned long long)pairs, pairs_per_sec, (unsigned long long)peak);
+        fflush(stdout);
+    }
+
+    static void run(scenario_e scenario, u32 count, u32 ticks)
+    {
+        const char* name = s_scenario_names[scenario];
+
+        // the finest grid has cells of 4 units, about twice the size of the common entity
+        const nhshg::cell_t side   = count <= 10000 ? 32 : (count <= 200000 ? 64 : 128);
+        const u32    cell_size = 4;
+        f32          extent    = 8.0f;
+        while (extent * extent * extent < (f32)count * 256.0f)
+            extent += 8.0f;
+
+        body_t* bodies = (body_t*)malloc(sizeof(body_t) * count);
+        generate(scenario, bodies, count, extent);
+
+        counting_alloc_t alloc;
+        nhshg::hshg_t*   hshg = nhshg::hshg_create(&alloc, side, cell_size, count);
+        if (hshg == nullptr)
+        {
+            printf("{\"scenario\":\"%s\",\"entities\":%u,\"error\":\"out of memory\"}\n", name, count);
+            free(bodies);
+            return;
+        }
+
+        bench_clock_t::time_point start = bench_clock_t::now();
+        for (u32 i = 0; i < count; ++i)
+            nhshg::hshg_insert(hshg, bodies[i].x, bodies[i].y, bodies[i].z, bodies[i].r, i);
+        report(name, count, "insert", elapsed_ns(start), count, 0, alloc.m_peak);
+
+        move_func_t move;
+        move.m_bodies = bodies;
+        start         = bench_clock_t::now();
+        for (u32 t = 0; t < ticks; ++t)
+            nhshg::hshg_update(hshg, &move);
+        report(name, count, "update_move", elapsed_ns(start), (f64)count * ticks, 0, alloc.m_peak);
+
+        count_collide_func_t collide;
+        start = bench_clock_t::now();
+        for (u32 t = 0; t < ticks; ++t)
+            nhshg::hshg_collide(hshg, &collide);
+        report(name, count, "collide", elapsed_ns(start), (f64)count * ticks, collide.m_pairs, alloc.m_peak);
+
+        // 1 query per 16 entities, boxes of 2x2 cells of the finest grid
+        random_t           rnd     = {0xC0FFEEu + count};
+        const u32          queries = count / 16 + 1;
+        count_query_func_t query;
+        start = bench_clock_t::now();
+        for (u32 q = 0; q < queries; ++q)
+        {
+            const f32 x = rnd.range(0.0f, extent);
+            const f32 y = rnd.range(0.0f, extent);
+            const f32 z = scenario == SCENARIO_FLAT ? 0.5f : rnd.range(0.0f, extent);
+            nhshg::hshg_query(hshg, x - 4.0f, y - 4.0f, z - 4.0f, x + 4.0f, y + 4.0f, z + 4.0f, &query);
+        }
+        report(name, count, "query", elapsed_ns(start), count, query.m_hits, alloc.m_peak);
+
+        start = bench_clock_t::now();
+        nhshg::hshg_optimize(hshg);
+        report(name, count, "optimize", elapsed_ns(start), count, 0, alloc.m_peak);
+
+        // collide once more to see what optimize() bought us
+        count_collide_func_t collide_opt;
+        start = bench_clock_t::now();
+        nhshg::hshg_collide(hshg, &collide_opt);
+        report(name, count, "collide_optimized", elapsed_ns(start), count, collide_opt.m_pairs, alloc.m_peak);
+
+        nhshg::hshg_free(hshg);
+        free(bodies);
+    }
+
+    // Collides and queries a small population, 'brute' selects the brute force path
+    static void run_small(scenario_e scenario, u32 count, u32 ticks, bool brute)
+    {
+        const char* name   = s_scenario_names[scenario];
+        f32         extent = 8.0f;
+        while (extent * extent * extent < (f32)count * 256.0f)
+            extent += 8.0f;
+
+        body_t* bodies = (body_t*)malloc(sizeof(body_t) * count);
+        generate(scenario, bodies, count, extent);
+
+        counting_alloc_t alloc;
+        nhshg::hshg_t*   hshg = nhshg::hshg_create(&alloc, 16, 4, count);
+        if (hshg == nullptr)
+        {
+            printf("{\"scenario\":\"%s\",\"entities\":%u,\"error\":\"out of memory\"}\n", name, count);
+            free(bodies);
+            return;
+        }
+        nhshg::hshg_set_brute_force_threshold(hshg, brute ? count : 0);
+        for (u32 i = 0; i < count; ++i)
+            nhshg::hshg_insert(hshg, bodies[i].x, bodies[i].y, bodies[i].z, bodies[i].r, i);
+
+        // small populations are far too fast to time one tick, repeat them
+        const u32 repeat = ticks * 4096;
+
+        // both paths pay for the overlap test, the grids hand out candidates that do not overlap
+        count_collide_func_t collide;
+        collide.m_overlap = true;
+
+        bench_clock_t::time_point start = bench_clock_t::now();
+        for (u32 t = 0; t < repeat; ++t)
+            nhshg::hshg_collide(hshg, &collide);
+        report(name, count, brute ? "collide_brute" : "collide_grid", elapsed_ns(start), (f64)count * repeat, collide.m_pairs, alloc.m_peak);
+
+        random_t           rnd = {0xC0FFEEu + count};
+        count_query_func_t query;
+        start = bench_clock_t::now();
+        for (u32 q = 0; q < repeat; ++q)
+        {
+            const f32 x = rnd.range(0.0f, extent);
+            const f32 y = rnd.range(0.0f, extent);
+            const f32 z = scenario == SCENARIO_FLAT ? 0.5f : rnd.range(0.0f, extent);
+            nhshg::hshg_query(hshg, x - 4.0f, y - 4.0f, z - 4.0f, x + 4.0f, y + 4.0f, z + 4.0f, &query);
+        }
+        report(name, count, brute ? "query_brute" : "query_grid", elapsed_ns(start), repeat, query.m_hits, alloc.m_peak);
+
+        nhshg::hshg_free(hshg);
+        free(bodies);
+    }
+}  // namespace nbench
+
+int main(int argc, char** argv)
+{
+    u32         max_entities = 1000000;
+    u32         ticks        = 4;
+    const char* only         = nullptr;
+    bool        small        = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--small") == 0)
+            small = true;
+        else if (i + 1 == argc)
+            break;  // the options below take a value
+        else if (strcmp(argv[i], "--max") == 0)
+            max_entities = (u32)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--ticks") == 0)
+            ticks = (u32)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--scenario") == 0)
+            only = argv[++i];
+    }
+
+    cbase::init();
+
+    for (s32 s = 0; s < nbench::SCENARIO_COUNT; ++s)
+    {
+        if (only != nullptr && strcmp(only, nbench::s_scenario_names[s]) != 0)
+            continue;
+        if (small)
+        {
+            for (u32 count = 8; count <= 256; count *= 2)
+            {
+                nbench::run_small((nbench::scenario_e)s, count, ticks, false);
+                nbench::run_small((nbench::scenario_e)s, count, ticks, true);
+            }
+            continue;
+        }
+        for (u32 count = 1000; count <= max_entities; count *= 10)
+            nbench::run((nbench::scenario_e)s, count, ticks);
+    }
+
+    cbase::exit();
+    return 0;
+}
@@ -5,129 +5,13 @@
 #include "cbase/c_float.h"
 #include "cbase/c_memory.h"
 #include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
 
 namespace ncore
 {
     namespace nhshg
     {
-        struct grid_t
-        {
-            grid_t();
-            grid_t(index_t* const _cells, const cell_t _cells_side);
-
-            DCORE_CLASS_PLACEMENT_NEW_DELETE
-
-            index_t* const  m_cells;
-            cell_t const    m_cells_side;
-            cell_sq_t const m_cells_sq;
-            cell_t const    m_cells_mask;   // for masking index_t to wrap around grid
-            u8 const        m_cells2d_log;  // number of bits to shift y
-            u8 const        m_cells3d_log;  // number of bits to shift z
-            u8              m_shift;
-            f32 const       m_inverse_cell_size;
-            index_t         m_entities_len;
-        };
-
-        // A cell will hold a doubly linked list of entities, this is a part of an entity
-        // used as a node in the doubly linked list.
-        struct entity_node_t
-        {
-            index_t m_next;
-            index_t m_prev;
-        };
-
-        class hshg_t
-        {
-        public:
-            hshg_t();
-            hshg_t(index_t* _cells, grid_t* _grids, u32 _size, cell_sq_t _cells_len, u8 _grids_len, cell_sq_t _grid_size, u32 _max_entities);
-
-            DCORE_CLASS_PLACEMENT_NEW_DELETE
-
-            //
-            //  Creates a new HSHG.
-            //
-            // \param side; the number of cells on the smallest grid's edge (must be a power of two!)
-            // \param size; smallest cell size in world units, e.g. 8 = 8 meters (must be a power of two!)
-            //
-            inline u8 calling() const { return m_bupdating | m_bcolliding | m_bquerying; }
-
-            inline void set_updating(bool value) { m_bupdating = value; }
-            inline void set_colliding(bool value) { m_bcolliding = value; }
-            inline void set_querying(bool value) { m_bquerying = value; }
-            inline void set_removed(bool value) { m_bremoved = value; }
-
-            inline bool is_updating() const { return m_bupdating; }
-            inline bool is_colliding() const { return m_bcolliding; }
-            inline bool is_querying() const { return m_bquerying; }
-            inline bool is_removed() const { return m_bremoved; }
-
-            void update_cache();
-
-            inline u8 get_grid(const f32 r) const
-            {
-                const u32 rounded = r + r;
-                if (rounded < m_cell_size)
-                {
-                    return 0;
-                }
-                const u8 grid = m_cell_log - math::g_countLeadingZeros(rounded) + 1;
-                return math::g_min(grid, (u8)(m_grids_len - 1));
-            }
-
-            index_t create_entity()
-            {
-                if (m_entities_used < m_entities_max)
-                    return m_entities_used++;
-
-                // No more free entities available
-                return c_invalid_index;
-            }
-
-            void insert_into_grid(const index_t entity_id);
-            void detach_from_grid(index_t entity_id);
-
-            void destroy_entity(index_t entity_id)
-            {
-                m_entities_used--;
-                m_free_entities.set_free(entity_id);
-                m_used_entities.set_used(entity_id);
-            }
-
-            entity_t*      m_entities;       // entities * 16 bytes
-            entity_node_t* m_entities_node;  // entities * 8 bytes
-            cell_sq_t*     m_entities_cell;  // entities * 4 bytes
-            u8*            m_entities_grid;  // entities * 1 byte
-            index_t*       m_entities_ref;   // entities * 4 bytes
-
-            index_t* const m_cells;
-
-            u8 const m_cell_log;
-            u8 const m_grids_len;
-
-            u8 m_bupdating : 1;
-            u8 m_bcolliding : 1;
-            u8 m_bquerying : 1;
-            u8 m_bremoved : 1;
-
-            u32 m_old_cache;
-            u32 m_new_cache;
-
-            cell_sq_t const m_grid_size;
-            f32 const       m_inverse_grid_size;
-            cell_sq_t const m_cells_len;
-            u32 const       m_cell_size;
-
-            binmap_t      m_free_entities;
-            binmap_t      m_used_entities;
-            index_t       m_entities_used;
-            index_t const m_entities_max;
-
-            grid_t*  m_grids;
-            alloc_t* m_allocator;
-        };
-
-        static u8 compute_max_grids(cell_t side)
+        u8 compute_max_grids(cell_t side)
         {
             u8 grids_len = 0;
             do
@@ -138,41 +22,17 @@ namespace ncore
             return grids_len;
         }
 
-        static cell_sq_t compute_max_cells(cell_t side)
+        cell_sq_t compute_max_cells(cell_t side)
         {
-            cell_sq_t cells_len = 0;
+            // counted wide, the overflow cell is added on top and must fit as well
+            u64 cells_len = 0;
             do
             {
-                const cell_sq_t cell_sq = cells_len + (cell_sq_t)side * side * side;
-                ASSERT(cell_sq > cells_len && "cell_sq_t must be set to a wider data type");
-                cells_len = cell_sq;
+                cells_len += (u64)side * side * side;
                 side >>= 1;
             } while (side >= 2);
-            return cells_len;
-        }
-
-        static cell_t grid_get_cell_1d(const grid_t* const grid, const f32 x)
-        {
-            const cell_t cell = math::abs(x) * grid->m_inverse_cell_size;
-            if (cell & grid->m_cells_side)
-            {
-                return grid->m_cells_mask - (cell & grid->m_cells_mask);
-            }
-            return cell & grid->m_cells_mask;
-        }
-
-        static cell_sq_t grid_get_idx(const grid_t* const grid, const cell_sq_t x, const cell_sq_t y, const cell_sq_t z) { return x | (y << grid->m_cells2d_log) | (z << grid->m_cells3d_log); }
-        static cell_t    idx_get_x(const grid_t* const grid, const cell_sq_t cell) { return cell & grid->m_cells_mask; }
-        static cell_t    idx_get_y(const grid_t* const grid, const cell_sq_t cell) { return (cell >> grid->m_cells2d_log) & grid->m_cells_mask; }
-        static cell_t    idx_get_z(const grid_t* const grid, const cell_sq_t cell) { return cell >> grid->m_cells3d_log; }
-
-        static cell_sq_t grid_get_cell(const grid_t* const grid, const f32 x, const f32 y, const f32 z)
-        {
-            const cell_t cell_x = grid_get_cell_1d(grid, x);
-            const cell_t cell_y = grid_get_cell_1d(grid, y);
-            const cell_t cell_z = grid_get_cell_1d(grid, z);
-
-            return grid_get_idx(grid, cell_x, cell_y, cell_z);
+            ASSERT(cells_len < (u64)(cell_sq_t)~(cell_sq_t)0 && "cell_sq_t must be set to a wider data type, do not define HSHG_CELL_16");
+            return (cell_sq_t)cells_len;
         }
 
         grid_t::grid_t()
@@ -188,24 +48,44 @@ namespace ncore
         {
         }
 
-        grid_t::grid_t(index_t* const _cells_array, const cell_t _cells_side)
+        grid_t::grid_t(index_t* const _cells_array, const cell_t _cells_side, const u32 _cell_size)
             : m_cells(_cells_array)
             , m_cells_side(_cells_side)
             , m_cells_sq((cell_sq_t)_cells_side * _cells_side)
             , m_cells_mask(_cells_side - 1)
-            , m_cells2d_log(math::g_countTrailingZeros(_cells_side) << 0)
-            , m_cells3d_log(math::g_countTrailingZeros(_cells_side) << 1)
+            , m_cells2d_log(math::g_countTrailingZeros((u32)_cells_side) << 0)
+            , m_cells3d_log(math::g_countTrailingZeros((u32)_cells_side) << 1)
             , m_shift(0)
-            , m_inverse_cell_size((f32)1.0 / _cells_side)
+            , m_inverse_cell_size((f32)1.0 / _cell_size)
             , m_entities_len(0)
         {
         }
 
+        grid_t::grid_t(const grid_t& _grid, index_t* const _cells_array)
+            : m_cells(_cells_array)
+            , m_cells_side(_grid.m_cells_side)
+            , m_cells_sq(_grid.m_cells_sq)
+            , m_cells_mask(_grid.m_cells_mask)
+            , m_cells2d_log(_grid.m_cells2d_log)
+            , m_cells3d_log(_grid.m_cells3d_log)
+            , m_shift(_grid.m_shift)
+            , m_inverse_cell_size(_grid.m_inverse_cell_size)
+            , m_entities_len(_grid.m_entities_len)
+        {
+        }
+
         hshg_t::hshg_t()
             : m_entities(nullptr)
             , m_entities_node(nullptr)
             , m_entities_grid(nullptr)
             , m_entities_ref(nullptr)
+            , m_entities_flags(nullptr)
+            , m_entities_vel(nullptr)
+            , m_entities_half(nullptr)
+            , m_entities_span(nullptr)
+            , m_entities_payload(nullptr)
+            , m_payload_size(0)
+            , m_entities_quant(nullptr)
             , m_cells(nullptr)
             , m_cell_log(0)
             , m_grids_len(0)
@@ -213,23 +93,69 @@ namespace ncore
             , m_bcolliding(0)
             , m_bquerying(0)
             , m_bremoved(0)
+            , m_bgrow(0)
+            , m_bawake_lost(1)
             , m_old_cache(0)
             , m_new_cache(0)
+            , m_views(0)
             , m_grid_size(0)
             , m_inverse_grid_size(0)
+            , m_quant_scale(0)
             , m_cells_len(0)
             , m_cell_size(0)
             , m_entities_used(0)
             , m_entities_max(0)
+            , m_inserted(nullptr)
+            , m_inserted_len(0)
+            , m_removed(nullptr)
+            , m_removed_len(0)
+            , m_ghosts_len(0)
+            , m_overflow(nullptr)
+            , m_overflow_len(0)
+            , m_overflow_cap(0)
+            , m_overflow_width(0)
+            , m_overflow_dirty(0)
+            , m_brute_force_threshold(0)
+            , m_crowd_threshold(0)
+            , m_crowds(nullptr)
+            , m_crowds_len(0)
+            , m_crowds_cap(0)
+            , m_crowd_entries(nullptr)
+            , m_crowd_entries_cap(0)
+            , m_span_cells(nullptr)
+            , m_span_nodes(nullptr)
+            , m_span_nodes_len(0)
+            , m_span_nodes_cap(0)
+            , m_span_nodes_free(c_invalid_index)
+            , m_span_nodes_free_len(0)
+            , m_span_stamp(0)
+            , m_sleep_ticks(0)
+            , m_awake(nullptr)
+            , m_awake_len(0)
+            , m_awake_cap(0)
             , m_grids(nullptr)
+            , m_observers(nullptr)
+            , m_allocator(nullptr)
+            , m_arena(nullptr)
         {
+            HSHG_STAT(nmem::memset(&m_stats, 0, sizeof(m_stats)));
+#ifdef HSHG_TRACE
+            m_trace = nullptr;
+#endif
         }
 
-        hshg_t::hshg_t(index_t* _cells, grid_t* _grids, u32 _size, cell_sq_t _cells_len, u8 _grids_len, cell_sq_t _grid_size, u32 _max_entities)
+        hshg_t::hshg_t(index_t* _cells, grid_t* _grids, u32 _size, cell_sq_t _cells_len, u8 _grids_len, u32 _grid_size, u32 _max_entities)
             : m_entities(nullptr)
             , m_entities_node(nullptr)
             , m_entities_grid(nullptr)
             , m_entities_ref(nullptr)
+            , m_entities_flags(nullptr)
+            , m_entities_vel(nullptr)
+            , m_entities_half(nullptr)
+            , m_entities_span(nullptr)
+            , m_entities_payload(nullptr)
+            , m_payload_size(0)
+            , m_entities_quant(nullptr)
             , m_cells(_cells)
             , m_cell_log(31 - math::g_countTrailingZeros(_size))
             , m_grids_len(_grids_len)
@@ -237,39 +163,123 @@ namespace ncore
             , m_bcolliding(0)
             , m_bquerying(0)
             , m_bremoved(0)
+            , m_bgrow(0)
+            , m_bawake_lost(1)
             , m_old_cache(0)
             , m_new_cache(0)
+            , m_views(0)
             , m_grid_size(_grid_size)
             , m_inverse_grid_size((f32)1.0 / _grid_size)
+            , m_quant_scale((f32)65536.0 / _grid_size)
             , m_cells_len(_cells_len)
             , m_cell_size(_size)
             , m_entities_used(0)
             , m_entities_max(_max_entities)
+            , m_inserted(nullptr)
+            , m_inserted_len(0)
+            , m_removed(nullptr)
+            , m_removed_len(0)
+            , m_ghosts_len(0)
+            , m_overflow(nullptr)
+            , m_overflow_len(0)
+            , m_overflow_cap(0)
+            , m_overflow_width(0)
+            , m_overflow_dirty(0)
+            , m_brute_force_threshold(0)
+            , m_crowd_threshold(0)
+            , m_crowds(nullptr)
+            , m_crowds_len(0)
+            , m_crowds_cap(0)
+            , m_crowd_entries(nullptr)
+            , m_crowd_entries_cap(0)
+            , m_span_cells(nullptr)
+            , m_span_nodes(nullptr)
+            , m_span_nodes_len(0)
+            , m_span_nodes_cap(0)
+            , m_span_nodes_free(c_invalid_index)
+            , m_span_nodes_free_len(0)
+            , m_span_stamp(0)
+            , m_sleep_ticks(0)
+            , m_awake(nullptr)
+            , m_awake_len(0)
+            , m_awake_cap(0)
             , m_grids(_grids)
+            , m_observers(nullptr)
+            , m_allocator(nullptr)
+            , m_arena(nullptr)
         {
+            HSHG_STAT(nmem::memset(&m_stats, 0, sizeof(m_stats)));
+#ifdef HSHG_TRACE
+            m_trace = nullptr;
+#endif
         }
 
-        hshg_t* hshg_create(alloc_t* allocator, const cell_t _side, const u32 _size, const u32 _max_entities)
+        void init_grids(grid_t* const grids, const u8 grids_len, index_t* const cells, const cell_t side, const u32 size)
         {
-            ASSERTS(math::ispo2(_side), "_side must be a power of 2!");
-            ASSERTS(math::ispo2(_size), "_size must be a power of 2!");
+            cell_sq_t idx   = 0;
+            u32       isize = size;
+            cell_t    iside = side;
+
+            // initialize array of grid_t
+            for (u8 i = 0; i < grids_len; ++i)
+            {
+                void* gridmem = grids + i;
+                new (gridmem) grid_t(cells + idx, iside, isize);
+                idx += (cell_sq_t)iside * iside * iside;
+                iside >>= 1;
+                isize <<= 1;
+            }
+
+            // the overflow grid, a single cell after the cells of the top grid
+            new (grids + grids_len) grid_t(cells + idx, 1, isize);
+        }
 
-            const cell_sq_t cells_len = compute_max_cells(_side);
-            index_t* const  cells     = g_allocate_array_and_memset<index_t>(allocator, cells_len, c_invalid_index);
+        // Allocates the cells of all grids and initializes the grids on top of them
+        static bool create_grids(alloc_t* allocator, const cell_t _side, const u32 _size, index_t*& _cells, grid_t*& _grids)
+        {
+            const cell_sq_t cells_len = compute_cells_len(_side);
+            index_t* const  cells     = g_allocate_array<index_t>(allocator, cells_len);
             if (cells == nullptr)
             {
-                return nullptr;
+                return false;
             }
 
-            const u8        grids_len = compute_max_grids(_side);
-            const cell_sq_t grid_size = (cell_sq_t)_side * _size;
-            grid_t*         grids     = g_allocate_array<grid_t>(allocator, grids_len);
+            // every byte 0xFF is c_invalid_index, whatever the width of index_t
+            nmem::memset(cells, 0xFFFFFFFF, sizeof(index_t) * cells_len);
+
+            const u8 grids_len = compute_max_grids(_side);
+            grid_t*  grids     = g_allocate_array<grid_t>(allocator, grids_len + 1);
             if (grids == nullptr)
             {
                 allocator->deallocate(cells);
+                return false;
+            }
+
+            init_grids(grids, grids_len, cells, _side, _size);
+
+            _cells = cells;
+            _grids = grids;
+            return true;
+        }
+
+        hshg_t* hshg_create(alloc_t* allocator, const cell_t _side, const u32 _size, const u32 _max_entities)
+        {
+            ASSERTS(math::ispo2(_side), "_side must be a power of 2!");
+            ASSERTS(math::ispo2(_size), "_size must be a power of 2!");
+            ASSERTS(_side <= c_max_side, "_side too large for cell_sq_t!");
+            ASSERTS(_max_entities <= c_invalid_index, "_max_entities too large for index_t!");
+
+            index_t* cells;
+            grid_t*  grids;
+            if (!create_grids(allocator, _side, _size, cells, grids))
+            {
                 return nullptr;
             }
 
+            const cell_sq_t cells_len = compute_cells_len(_side);
+            const u8        grids_len = compute_max_grids(_side);
+            const u32       grid_size = (u32)_side * _size;
+
             void*         instance_mem = allocator->allocate(sizeof(hshg_t));
             hshg_t* const hshg         = new (instance_mem) hshg_t(cells, grids, _size, cells_len, grids_len, grid_size, _max_entities);
             if (hshg == nullptr)
@@ -284,8 +294,11 @@ namespace ncore
             hshg->m_entities_node = g_allocate_array<entity_node_t>(allocator, _max_entities);
             hshg->m_entities_cell = g_allocate_array<cell_sq_t>(allocator, _max_entities);
             hshg->m_entities_grid = g_allocate_array<u8>(allocator, _max_entities);
-            hshg->m_entities_ref  = g_allocate_array<index_t>(allocator, _max_entities);
-            if (hshg->m_entities == nullptr || hshg->m_entities_node == nullptr || hshg->m_entities_grid == nullptr)
+            hshg->m_entities_ref   = g_allocate_array<index_t>(allocator, _max_entities);
+            hshg->m_entities_flags = g_allocate_array<u8>(allocator, _max_entities);
+            hshg->m_inserted       = g_allocate_array<index_t>(allocator, _max_entities);
+            hshg->m_removed        = g_allocate_array<index_t>(allocator, _max_entities);
+            if (hshg->m_entities == nullptr || hshg->m_entities_node == nullptr || hshg->m_entities_grid == nullptr || hshg->m_entities_flags == nullptr || hshg->m_inserted == nullptr || hshg->m_removed == nullptr)
             {
                 hshg_free(hshg);
                 return nullptr;
@@ -293,23 +306,123 @@ namespace ncore
 
             binmap_t::config_t cfg = binmap_t::config_t::compute(_max_entities);
             hshg->m_free_entities.init_all_used(cfg, allocator);
-            hshg->m_used_entities.init_all_free(cfg, allocator);
 
-            index_t idx   = 0;
-            u32     isize = _size;
-            cell_t  iside = _side;
+            return hshg;
+        }
 
-            // initialize array of grid_t
-            for (u8 i = 0; i < grids_len; ++i)
+        bool hshg_retune(hshg_t* const hshg, const cell_t _side, const u32 _size)
+        {
+            ASSERT(!hshg->calling() && "retune() may not be called from any callback");
+            ASSERT(!hshg->is_viewed() && "retune() may not be called while a view is acquired");
+            ASSERTS(math::ispo2(_side), "_side must be a power of 2!");
+            ASSERTS(math::ispo2(_size), "_size must be a power of 2!");
+            ASSERTS(_side <= c_max_side, "_side too large for cell_sq_t!");
+
+            index_t* cells;
+            grid_t*  grids;
+            if (!create_grids(hshg->m_allocator, _side, _size, cells, grids))
             {
-                void* gridmem = hshg->m_grids + i;
-                new (gridmem) grid_t(hshg->m_cells + idx, iside);
-                idx += (cell_sq_t)iside * iside * iside;
-                iside >>= 1;
-                isize <<= 1;
+                return false;
             }
 
-            return hshg;
+            // everything that can fail is done before the old grids are let go
+            const u32 grid_size = (u32)_side * _size;
+            index_t*  span_cells;
+            if (!hshg->prepare_spans(grids, grid_size, (f32)1.0 / grid_size, span_cells))
+            {
+                hshg->m_allocator->deallocate(cells);
+                hshg->m_allocator->deallocate(grids);
+                return false;
+            }
+
+            hshg->flush_removed();
+            hshg->compact();
+            hshg->set_removed(false);
+
+            hshg->m_allocator->deallocate(hshg->m_cells);
+            hshg->m_allocator->deallocate(hshg->m_grids);
+
+            hshg->m_cells             = cells;
+            hshg->m_grids             = grids;
+            hshg->m_cell_log          = 31 - math::g_countTrailingZeros(_size);
+            hshg->m_grids_len         = compute_max_grids(_side);
+            hshg->m_grid_size         = grid_size;
+            hshg->m_inverse_grid_size = (f32)1.0 / grid_size;
+            hshg->m_quant_scale       = (f32)65536.0 / hshg->m_grid_size;
+            hshg->m_cells_len         = compute_cells_len(_side);
+            hshg->m_cell_size         = _size;
+            hshg->m_old_cache         = 0;
+            hshg->m_new_cache         = 0;
+
+            for (index_t i = 0; i < hshg->m_entities_used; ++i)
+            {
+                hshg->m_entities_grid[i] = hshg->is_span(i) ? hshg->m_grids_len : hshg->get_grid(hshg->m_entities[i].r);
+                hshg->insert_into_grid(i);
+                if (hshg->m_entities_quant != nullptr)
+                    hshg->quantize(i);
+            }
+
+            // the spans are linked into the cells of the new first grid
+            hshg->relink_spans(span_cells);
+            return true;
+        }
+
+        bool hshg_recommend_params(entity_t const* sample, const u32 sample_len, const index_t max_entities, const int_t memory_budget, cell_t& side, u32& size)
+        {
+            // histogram of the cell size (as a power of 2) each entity needs, get_grid() only
+            // puts it in the first grid when 2 * r is below the cell size
+            u32 histogram[32];
+            for (u32 i = 0; i < 32; ++i)
+                histogram[i] = 0;
+
+            f32 min_x = 0.0f, min_y = 0.0f, min_z = 0.0f;
+            f32 max_x = 0.0f, max_y = 0.0f, max_z = 0.0f;
+            for (u32 i = 0; i < sample_len; ++i)
+            {
+                const entity_t& e = sample[i];
+
+                const u32 diameter = (u32)(e.r + e.r);
+                const u32 level    = diameter == 0 ? 0 : 32 - math::g_countLeadingZeros(diameter);
+                ++histogram[math::g_min(level, (u32)31)];
+
+                if (i == 0)
+                {
+                    min_x = max_x = e.x;
+                    min_y = max_y = e.y;
+                    min_z = max_z = e.z;
+                }
+                min_x = math::g_min(min_x, e.x);
+                min_y = math::g_min(min_y, e.y);
+                min_z = math::g_min(min_z, e.z);
+                max_x = math::g_max(max_x, e.x);
+                max_y = math::g_max(max_y, e.y);
+                max_z = math::g_max(max_z, e.z);
+            }
+
+            // the median entity fits a cell of the first grid
+            u32 level = 0;
+            u32 count = 0;
+            while (level < 31 && (count + histogram[level]) * 2 < sample_len)
+            {
+                count += histogram[level];
+                ++level;
+            }
+            size = (u32)1 << level;
+
+            // enough cells for the first grid to cover the spread without folding
+            const f32 extent = math::g_max(max_x - min_x, math::g_max(max_y - min_y, max_z - min_z));
+            const u32 cells  = (u32)math::g_min(extent / (f32)size + 1.0f, (f32)c_max_side);
+            side             = math::ceilpo2(math::g_max(cells, (u32)2));
+
+            // more cells than entities only costs memory and hshg_optimize() time
+            const u64 max_cells = math::g_max((u64)max_entities * 8, (u64)64);
+            while (side > 2 && (u64)side * side * side > max_cells)
+                side >>= 1;
+
+            while (side > 2 && hshg_memory_usage(side, max_entities) > memory_budget)
+                side >>= 1;
+
+            return hshg_memory_usage(side, max_entities) <= memory_budget;
         }
 
         void hshg_free(hshg_t* const hshg)
@@ -319,21 +432,169 @@ namespace ncore
             hshg->m_allocator->deallocate(hshg->m_entities_cell);
             hshg->m_allocator->deallocate(hshg->m_entities_grid);
             hshg->m_allocator->deallocate(hshg->m_entities_ref);
+            hshg->m_allocator->deallocate(hshg->m_entities_flags);
+            hshg->m_allocator->deallocate(hshg->m_entities_vel);
+            hshg->m_allocator->deallocate(hshg->m_entities_half);
+            hshg->m_allocator->deallocate(hshg->m_entities_span);
+            hshg->m_allocator->deallocate(hshg->m_entities_payload);
+            hshg->m_allocator->deallocate(hshg->m_entities_quant);
+            hshg->m_allocator->deallocate(hshg->m_inserted);
+            hshg->m_allocator->deallocate(hshg->m_removed);
+            hshg->m_allocator->deallocate(hshg->m_overflow);
+            hshg->m_allocator->deallocate(hshg->m_crowds);
+            hshg->m_allocator->deallocate(hshg->m_crowd_entries);
+            hshg->m_allocator->deallocate(hshg->m_awake);
+            hshg->m_allocator->deallocate(hshg->m_span_cells);
+            hshg->m_allocator->deallocate(hshg->m_span_nodes);
 
             hshg->m_allocator->deallocate(hshg->m_cells);
             hshg->m_allocator->deallocate(hshg->m_grids);
 
             hshg->m_free_entities.release(hshg->m_allocator);
-            hshg->m_used_entities.release(hshg->m_allocator);
 
+            arena_alloc_t* const arena = hshg->m_arena;
             hshg->m_allocator->deallocate(hshg);
+            if (arena != nullptr)
+            {
+                alloc_t* const parent = arena->m_parent;
+                void* const    base   = arena->m_base;
+                arena->~arena_alloc_t();
+                parent->deallocate(base);
+            }
+        }
+
+        arena_alloc_t::arena_alloc_t(alloc_t* parent, void* base, u8* region, u32 region_size)
+            : m_parent(parent)
+            , m_base(base)
+            , m_region(region)
+            , m_region_size(region_size)
+            , m_blocks_len(1)
+        {
+            m_blocks[0].m_offset = 0;
+            m_blocks[0].m_size   = region_size;
+            m_blocks[0].m_used   = 0;
+        }
+
+        void* arena_alloc_t::v_allocate(u32 size, u32 align)
+        {
+            size = (size + (c_align - 1)) & ~(u32)(c_align - 1);
+            if (align <= c_align)
+            {
+                // first fit, so the same sequence of requests ends up in the same place again
+                for (u32 i = 0; i < m_blocks_len; ++i)
+                {
+                    block_t& block = m_blocks[i];
+                    if (block.m_used || block.m_size < size)
+                        continue;
+
+                    if (block.m_size > size && m_blocks_len < c_max_blocks)
+                    {
+                        for (u32 j = m_blocks_len; j > i + 1; --j)
+                            m_blocks[j] = m_blocks[j - 1];
+                        ++m_blocks_len;
+
+                        m_blocks[i + 1].m_offset = block.m_offset + size;
+                        m_blocks[i + 1].m_size   = block.m_size - size;
+                        m_blocks[i + 1].m_used   = 0;
+                        block.m_size             = size;
+                    }
+                    block.m_used = 1;
+                    return m_region + block.m_offset;
+                }
+            }
+            return m_parent->allocate(size, align);
+        }
+
+        void arena_alloc_t::v_deallocate(void* p)
+        {
+            u8* const ptr = (u8*)p;
+            if (ptr < m_region || ptr >= m_region + m_region_size)
+            {
+                if (p != nullptr)
+                    m_parent->deallocate(p);
+                return;
+            }
+
+            // a region without blocks is owned by the caller (hshg_map())
+            if (m_blocks_len == 0)
+                return;
+
+            const u32 offset = (u32)(ptr - m_region);
+            u32       i      = 0;
+            while (i < m_blocks_len && m_blocks[i].m_offset != offset)
+                ++i;
+            ASSERT(i < m_blocks_len && m_blocks[i].m_used && "not a block of this arena");
+            if (i == m_blocks_len)
+                return;
+
+            m_blocks[i].m_used = 0;
+
+            // merge with the free neighbours
+            u32 first = i;
+            u32 last  = i;
+            if (first > 0 && !m_blocks[first - 1].m_used)
+                --first;
+            if (last + 1 < m_blocks_len && !m_blocks[last + 1].m_used)
+                ++last;
+            if (first != last)
+            {
+                m_blocks[first].m_size = m_blocks[last].m_offset + m_blocks[last].m_size - m_blocks[first].m_offset;
+                const u32 removed      = last - first;
+                for (u32 j = first + 1; j + removed < m_blocks_len; ++j)
+                    m_blocks[j] = m_blocks[j + removed];
+                m_blocks_len -= removed;
+            }
+        }
+
+        static inline int_t arena_round(const int_t size) { return (size + (arena_alloc_t::c_align - 1)) & ~(int_t)(arena_alloc_t::c_align - 1); }
+
+        int_t hshg_memory_usage_arena(const cell_t side, const index_t max_entities)
+        {
+            // every array as it is allocated by hshg_create(), twice for those that are
+            // reallocated by hshg_optimize()
+            const int_t optimized = arena_round(sizeof(entity_t) * max_entities) + arena_round(sizeof(entity_node_t) * max_entities) + arena_round(sizeof(cell_sq_t) * max_entities) + arena_round(sizeof(u8) * max_entities) +
+                                    arena_round(sizeof(index_t) * max_entities) + arena_round(sizeof(u8) * max_entities);
+            const int_t queues  = arena_round(sizeof(index_t) * max_entities) * 2;  // inserted and removed
+            const int_t cells   = arena_round(sizeof(index_t) * compute_cells_len(side));
+            const int_t grids   = arena_round(sizeof(grid_t) * (compute_max_grids(side) + 1));
+            const int_t hshg    = arena_round(sizeof(hshg_t));
+
+            // the binmap has 1 bit per entity on the first level, and less than 1/16th of that on top
+            const int_t binmap = arena_round((max_entities + 7) / 8 + max_entities / 128 + 64);
+
+            return arena_round(sizeof(arena_alloc_t)) + hshg + grids + cells + optimized * 2 + queues + binmap;
+        }
+
+        hshg_t* hshg_create_arena(alloc_t* allocator, const cell_t _side, const u32 _size, const u32 _max_entities, const u32 _alignment)
+        {
+            const int_t size = hshg_memory_usage_arena(_side, _max_entities);
+            ASSERT(size <= (int_t)0xFFFFFFFF && "arena too big, use hshg_create()");
+
+            void* const base = allocator->allocate((u32)size, math::g_max(_alignment, (u32)arena_alloc_t::c_align));
+            if (base == nullptr)
+            {
+                return nullptr;
+            }
+
+            const u32            header = (u32)arena_round(sizeof(arena_alloc_t));
+            arena_alloc_t* const arena  = new (base) arena_alloc_t(allocator, base, (u8*)base + header, (u32)size - header);
+
+            hshg_t* const hshg = hshg_create(arena, _side, _size, _max_entities);
+            if (hshg == nullptr)
+            {
+                arena->~arena_alloc_t();
+                allocator->deallocate(base);
+                return nullptr;
+            }
+            hshg->m_arena = arena;
+            return hshg;
         }
 
         int_t hshg_memory_usage(const cell_t side, const index_t max_entities)
         {
-            const int_t entities = (sizeof(entity_t) + sizeof(entity_node_t) + sizeof(cell_sq_t) + sizeof(u8) + sizeof(index_t)) * max_entities;
-            const int_t cells    = sizeof(index_t) * compute_max_cells(side);
-            const int_t grids    = sizeof(grid_t) * compute_max_grids(side);
+            const int_t entities = (sizeof(entity_t) + sizeof(entity_node_t) + sizeof(cell_sq_t) + sizeof(u8) + sizeof(index_t) + sizeof(u8) + sizeof(index_t) * 2) * max_entities;
+            const int_t cells    = sizeof(index_t) * compute_cells_len(side);
+            const int_t grids    = sizeof(grid_t) * (compute_max_grids(side) + 1);
             const int_t hshg     = sizeof(hshg_t);
             return entities + cells + grids + hshg;
         }
@@ -357,6 +618,11 @@ namespace ncore
             entity_node->m_prev = c_invalid_index;
             *cell               = idx;
 
+            if (is_overflow(idx))
+            {
+                m_overflow_dirty = 1;
+            }
+
             if (grid->m_entities_len == 0)
             {
                 m_new_cache |= ((u32)1 << m_entities_grid[idx]);
@@ -365,28 +631,137 @@ namespace ncore
             ++grid->m_entities_len;
         }
 
+        // Same as insert_into_grid(), but the entity is pushed onto the head of the cell with a
+        // CAS, so that multiple threads can insert into the same cell at the same time.
+        void hshg_t::insert_into_grid_concurrent(const index_t idx)
+        {
+            entity_t* const      entity      = m_entities + idx;
+            entity_node_t* const entity_node = m_entities_node + idx;
+
+            const u8      entity_grid = m_entities_grid[idx];
+            grid_t* const grid        = m_grids + entity_grid;
+
+            m_entities_cell[idx] = grid_get_cell(grid, entity->x, entity->y, entity->z);
+            index_t* const cell  = grid->m_cells + m_entities_cell[idx];
+
+            // m_prev must be set before the entity becomes visible as the head of the cell,
+            // from that moment on only the thread that pushes on top of us may write it.
+            entity_node->m_prev = c_invalid_index;
+
+            index_t head = natomic::load(cell);
+            do
+            {
+                entity_node->m_next = head;
+            } while (!natomic::cas(cell, &head, idx));
+
+            // Only one thread can have replaced 'head', so we are the only writer of its m_prev
+            if (head != c_invalid_index)
+            {
+                m_entities_node[head].m_prev = idx;
+            }
+
+            if (entity_grid == m_grids_len)
+            {
+                natomic::fetch_or(&m_overflow_dirty, (u32)1);
+            }
+
+            if (natomic::fetch_add(&grid->m_entities_len, 1) == 0)
+            {
+                natomic::fetch_or(&m_new_cache, (u32)1 << entity_grid);
+            }
+        }
+
+        // Sets up every entity array for the new entity 'idx', it still has to be linked into its cell
+        void hshg_t::init_entity(const index_t idx, const f32 x, const f32 y, const f32 z, const f32 r, const index_t ref, const u8 grid)
+        {
+            entity_node_t* const ent2 = m_entities_node + idx;
+            ent2->m_next              = c_invalid_index;
+            ent2->m_prev              = c_invalid_index;
+
+            entity_t* const ent = m_entities + idx;
+            ent->x              = x;
+            ent->y              = y;
+            ent->z              = z;
+            ent->r              = r;
+
+            m_entities_cell[idx]  = 0;
+            m_entities_grid[idx]  = grid;
+            m_entities_ref[idx]   = ref;
+            m_entities_flags[idx] = c_entity_dirty;
+
+            if (m_entities_vel != nullptr)
+            {
+                f32* const vel = m_entities_vel + (idx * 3);
+                vel[0]         = 0.0f;
+                vel[1]         = 0.0f;
+                vel[2]         = 0.0f;
+            }
+            if (m_entities_half != nullptr)
+            {
+                f32* const half = m_entities_half + (idx * 3);
+                half[0]         = r;
+                half[1]         = r;
+                half[2]         = r;
+            }
+            if (m_entities_span != nullptr)
+            {
+                m_entities_span[idx].m_nodes = c_invalid_index;
+            }
+            if (m_entities_payload != nullptr)
+            {
+                nmem::memset(m_entities_payload + idx * m_payload_size, 0, m_payload_size);
+            }
+            if (m_entities_quant != nullptr)
+            {
+                m_entities_quant[idx] = quantize_entity(x, y, z, r, m_quant_scale);
+            }
+        }
+
+        // Creates an entity in 'grid' (growing when allowed) and links it into its cell,
+        // returns c_invalid_index when the HSHG is full
+        index_t hshg_t::insert_entity(const f32 x, const f32 y, const f32 z, const f32 r, const index_t ref, const u8 grid)
+        {
+            index_t idx = create_entity();
+            if (idx == c_invalid_index && m_bgrow && reserve(grow_capacity((u32)m_entities_max + 1, m_entities_max, 16)))
+            {
+                idx = create_entity();
+            }
+            if (idx != c_invalid_index)
+            {
+                init_entity(idx, x, y, z, r, ref, grid);
+                insert_into_grid(idx);
+                push_awake(idx);
+            }
+            return idx;
+        }
+
         // insert_into_grid an entity into the grid and return the index of the entity
         index_t hshg_insert(hshg_t* const hshg, const f32 x, const f32 y, const f32 z, const f32 r, const index_t ref)
         {
             ASSERT(!hshg->calling() && "insert() may not be called from any callback");
-            const index_t idx = hshg->create_entity();
+            ASSERT(!hshg->is_viewed() && "insert() may not be called while a view is acquired");
+            const index_t idx = hshg->insert_entity(x, y, z, r, ref, hshg->get_grid(r));
             if (idx != c_invalid_index)
             {
-                entity_node_t* const ent2 = hshg->m_entities_node + idx;
-                ent2->m_next              = c_invalid_index;
-                ent2->m_prev              = c_invalid_index;
-
-                entity_t* const ent = hshg->m_entities + idx;
-                ent->x              = x;
-                ent->y              = y;
-                ent->z              = z;
-                ent->r              = r;
+                hshg->wake_cell(idx);
+                hshg->notify_move(idx);
+            }
+            return idx;
+        }
 
-                hshg->m_entities_cell[idx] = 0;
-                hshg->m_entities_grid[idx] = hshg->get_grid(r);
-                hshg->m_entities_ref[idx]  = ref;
+        index_t hshg_insert_concurrent(hshg_t* const hshg, const f32 x, const f32 y, const f32 z, const f32 r, const index_t ref)
+        {
+            ASSERT(!hshg->calling() && "insert_concurrent() may not be called from any callback");
+            ASSERT(!hshg->is_viewed() && "insert_concurrent() may not be called while a view is acquired");
+            const index_t idx = hshg->create_entity_concurrent();
+            if (idx != c_invalid_index)
+            {
+                hshg->init_entity(idx, x, y, z, r, ref, hshg->get_grid(r));
+                hshg->insert_into_grid_concurrent(idx);
 
-                hshg->insert_into_grid(idx);
+                // the observers are not thread-safe, they see the entity at the next flush
+                const index_t slot     = natomic::fetch_add(&hshg->m_inserted_len, 1);
+                hshg->m_inserted[slot] = idx;
             }
             return idx;
         }
@@ -415,6 +790,11 @@ namespace ncore
                 grid->m_cells[m_entities_cell[idx]] = entity_node->m_next;
             }
 
+            if (entity_grid == m_grids_len)
+            {
+                m_overflow_dirty = 1;
+            }
+
             --grid->m_entities_len;
             if (grid->m_entities_len == 0)
             {
@@ -427,10 +807,19 @@ namespace ncore
         {
             ASSERT(hshg->is_updating() && "remove() may only be called from within update()");
             hshg->set_removed(true);
+            hshg->notify_remove(e);
             hshg->detach_from_grid(e);
             hshg->destroy_entity(e);
         }
 
+        void hshg_remove_concurrent(hshg_t* hshg, index_t e)
+        {
+            ASSERT(e < natomic::load(&hshg->m_entities_used));
+            const index_t slot = natomic::fetch_add(&hshg->m_removed_len, 1);
+            ASSERT(slot < hshg->m_entities_max && "remove_concurrent() called more than once for the same entity?");
+            hshg->m_removed[slot] = e;
+        }
+
         void hshg_move(hshg_t* hshg, index_t e)
         {
             ASSERT(hshg->is_updating() && "move() may only be called from within hshg.update()");
@@ -439,93 +828,405 @@ namespace ncore
             entity_t* const     entity   = hshg->m_entities + e;
             const cell_sq_t     new_cell = grid_get_cell(grid, entity->x, entity->y, entity->z);
 
-            if (new_cell != hshg->m_entities_cell[e])
+            hshg->m_entities_flags[e] |= c_entity_dirty;
+            hshg->wake(e);
+            if (hshg->is_span(e))
+            {
+                hshg->unlink_span(e);
+                if (!hshg->link_span(e))
+                {
+                    ASSERT(false && "out of span nodes, the span is now a plain overflow entity");
+                    hshg->m_overflow_dirty = 1;
+                }
+            }
+            else if (hshg->is_overflow(e))
+            {
+                // the single cell never changes, but the sorted order may
+                hshg->m_overflow_dirty = 1;
+            }
+            else if (new_cell != hshg->m_entities_cell[e])
             {
+                HSHG_STAT(++hshg->m_stats.m_relinks);
                 hshg->detach_from_grid(e);
                 hshg->insert_into_grid(e);
+                hshg->wake_cell(e);
             }
+            hshg->notify_move(e);
         }
 
         void hshg_resize(hshg_t* hshg, index_t e)
         {
             ASSERT(hshg->is_updating() && "resize() may only be called from within hshg.update()");
+            ASSERT(!hshg->is_span(e) && "use resize_span() to resize a span");
+            if (hshg->is_span(e))
+            {
+                return;
+            }
 
             entity_t* const entity   = hshg->m_entities + e;
             const u8        new_grid = hshg->get_grid(entity->r);
 
+            // the entity is a hypercube again, hshg_resize_box() sets the box afterwards
+            if (hshg->m_entities_half != nullptr)
+            {
+                f32* const half = hshg->m_entities_half + (e * 3);
+                half[0]         = entity->r;
+                half[1]         = entity->r;
+                half[2]         = entity->r;
+            }
+
+            hshg->m_entities_flags[e] |= c_entity_dirty;
+            hshg->wake(e);
+            if (hshg->is_overflow(e))
+            {
+                hshg->m_overflow_dirty = 1;
+            }
             if (hshg->m_entities_grid[e] != new_grid)
             {
+                HSHG_STAT(++hshg->m_stats.m_relinks);
                 hshg->detach_from_grid(e);
                 hshg->m_entities_grid[e] = new_grid;
                 hshg->insert_into_grid(e);
+                hshg->wake_cell(e);
             }
+            hshg->notify_move(e);
         }
 
+        // Moves the entity at '_used_entity' to the free slot '_free_entity', fixing up the cell
+        // head and the neighbours in the doubly linked list.
         static void swap_entity(hshg_t* const hshg, index_t _free_entity, index_t _used_entity)
         {
-            entity_t* const      used_entity     = hshg->m_entities + _used_entity;
-            entity_node_t* const used_entity2    = hshg->m_entities_node + _used_entity;
-            index_t* const       used_entity_ref = hshg->m_entities_ref + _used_entity;
+            entity_node_t* const used_entity_node = hshg->m_entities_node + _used_entity;
 
-            // swap entity data, also make sure we remove and insert_into_grid the entity into the cell
-            index_t* cell = hshg->m_cells + hshg->m_entities_cell[_used_entity];
-            if (*cell == _used_entity)
+            if (used_entity_node->m_prev != c_invalid_index)
             {
-                *cell = _free_entity;
+                hshg->m_entities_node[used_entity_node->m_prev].m_next = _free_entity;
+            }
+            else
+            {
+                grid_t* const grid                                     = hshg->m_grids + hshg->m_entities_grid[_used_entity];
+                grid->m_cells[hshg->m_entities_cell[_used_entity]] = _free_entity;
+            }
+            if (used_entity_node->m_next != c_invalid_index)
+            {
+                hshg->m_entities_node[used_entity_node->m_next].m_prev = _free_entity;
+            }
+            if (hshg->is_overflow(_used_entity))
+            {
+                hshg->m_overflow_dirty = 1;
             }
 
-            // remove the used entity from the doubly linked list and insert the free entity
-            hshg->m_entities_node[used_entity2->m_prev].m_next = _free_entity;
-
-            entity_t* const      free_entity  = hshg->m_entities + _free_entity;
-            entity_node_t* const free_entity2 = hshg->m_entities_node + _free_entity;
-            free_entity2->m_prev              = used_entity2->m_prev;
-            free_entity2->m_next              = used_entity2->m_next;
-            free_entity->x                    = used_entity->x;
-            free_entity->y                    = used_entity->y;
-            free_entity->z                    = used_entity->z;
-            free_entity->r                    = used_entity->r;
-
+            hshg->m_entities[_free_entity]      = hshg->m_entities[_used_entity];
+            hshg->m_entities_node[_free_entity] = *used_entity_node;
             hshg->m_entities_cell[_free_entity] = hshg->m_entities_cell[_used_entity];
             hshg->m_entities_ref[_free_entity]  = hshg->m_entities_ref[_used_entity];
-            hshg->m_entities_grid[_free_entity] = hshg->m_entities_grid[_used_entity];
+            hshg->m_entities_grid[_free_entity]  = hshg->m_entities_grid[_used_entity];
+            hshg->m_entities_flags[_free_entity] = hshg->m_entities_flags[_used_entity];
+            if (!hshg->is_sleeping(_free_entity))
+            {
+                hshg->push_awake(_free_entity);
+            }
 
-            // Mark the used entity as free and the free entity as used
-            hshg->m_free_entities.set_free(_used_entity);
-            hshg->m_used_entities.set_used(_free_entity);
+            if (hshg->m_entities_vel != nullptr)
+            {
+                f32* const       free_vel = hshg->m_entities_vel + (_free_entity * 3);
+                f32 const* const used_vel = hshg->m_entities_vel + (_used_entity * 3);
+                free_vel[0]               = used_vel[0];
+                free_vel[1]               = used_vel[1];
+                free_vel[2]               = used_vel[2];
+            }
+
+            if (hshg->m_entities_half != nullptr)
+            {
+                f32* const       free_half = hshg->m_entities_half + (_free_entity * 3);
+                f32 const* const used_half = hshg->m_entities_half + (_used_entity * 3);
+                free_half[0]               = used_half[0];
+                free_half[1]               = used_half[1];
+                free_half[2]               = used_half[2];
+            }
+
+            if (hshg->m_entities_span != nullptr)
+            {
+                hshg->m_entities_span[_free_entity] = hshg->m_entities_span[_used_entity];
+                for (index_t node = hshg->m_entities_span[_free_entity].m_nodes; node != c_invalid_index; node = hshg->m_span_nodes[node].m_own_next)
+                    hshg->m_span_nodes[node].m_entity = _free_entity;
+            }
+
+            if (hshg->m_entities_payload != nullptr)
+            {
+                const u32 size = hshg->m_payload_size;
+                nmem::memcpy(hshg->m_entities_payload + _free_entity * size, hshg->m_entities_payload + _used_entity * size, size);
+            }
+
+            if (hshg->m_entities_quant != nullptr)
+            {
+                hshg->m_entities_quant[_free_entity] = hshg->m_entities_quant[_used_entity];
+            }
+        }
+
+        // Hands the entities inserted by hshg_insert_concurrent() to the observers, the way
+        // hshg_insert() does right away. Their indices are only valid until compact().
+        void hshg_t::flush_inserted()
+        {
+            for (index_t i = 0; i < m_inserted_len; ++i)
+            {
+                const index_t e = m_inserted[i];
+                push_awake(e);
+                wake_cell(e);
+                notify_move(e);
+            }
+            m_inserted_len = 0;
+        }
+
+        // Detaches all entities queued by hshg_remove_concurrent() and marks them as free,
+        // after flushing the inserted ones, which may be among them.
+        void hshg_t::flush_removed()
+        {
+            flush_inserted();
+            for (index_t i = 0; i < m_removed_len; ++i)
+            {
+                const index_t e = m_removed[i];
+                notify_remove(e);
+                detach_from_grid(e);
+                destroy_entity(e);
+            }
+            if (m_removed_len > 0)
+            {
+                m_bremoved = true;
+            }
+            m_removed_len = 0;
+        }
+
+        // Fills the holes left by removed entities with the entities at the top of the array.
+        // The free entities are visited from the highest index down, so the last used entity
+        // is never a free one itself.
+        void hshg_t::compact()
+        {
+            s32 free_entity = m_free_entities.find_upper_and_set();
+            while (free_entity >= 0)
+            {
+                const index_t used_entity = --m_entities_used;
+                if ((index_t)free_entity < used_entity)
+                {
+                    swap_entity(this, free_entity, used_entity);
+                }
+
+                // on to the next free entity
+                free_entity = m_free_entities.find_upper_and_set();
+            }
+        }
+
+        bool hshg_t::reserve(const index_t max_entities)
+        {
+            if (max_entities <= m_entities_max)
+            {
+                return true;
+            }
+
+            for (observer_t* o = m_observers; o != nullptr; o = o->m_next)
+            {
+                if (!o->on_reserve(this, max_entities))
+                    return false;
+            }
+
+            entity_t* const      entities         = g_allocate_array<entity_t>(m_allocator, max_entities);
+            entity_node_t* const entities_node    = g_allocate_array<entity_node_t>(m_allocator, max_entities);
+            cell_sq_t* const     entities_cell    = g_allocate_array<cell_sq_t>(m_allocator, max_entities);
+            u8* const            entities_grid    = g_allocate_array<u8>(m_allocator, max_entities);
+            index_t* const       entities_ref     = g_allocate_array<index_t>(m_allocator, max_entities);
+            u8* const            entities_flags   = g_allocate_array<u8>(m_allocator, max_entities);
+            f32* const           entities_vel     = m_entities_vel != nullptr ? g_allocate_array<f32>(m_allocator, max_entities * 3) : nullptr;
+            f32* const           entities_half    = m_entities_half != nullptr ? g_allocate_array<f32>(m_allocator, max_entities * 3) : nullptr;
+            span_t* const        entities_span    = m_entities_span != nullptr ? g_allocate_array<span_t>(m_allocator, max_entities) : nullptr;
+            u8* const            entities_payload = m_entities_payload != nullptr ? g_allocate_array<u8>(m_allocator, max_entities * m_payload_size) : nullptr;
+            quant_t* const       entities_quant   = m_entities_quant != nullptr ? g_allocate_array<quant_t>(m_allocator, max_entities) : nullptr;
+            index_t* const       inserted         = g_allocate_array<index_t>(m_allocator, max_entities);
+            index_t* const       removed          = g_allocate_array<index_t>(m_allocator, max_entities);
+
+            if (entities == nullptr || entities_node == nullptr || entities_cell == nullptr || entities_grid == nullptr || entities_ref == nullptr || entities_flags == nullptr || (m_entities_vel != nullptr && entities_vel == nullptr) ||
+                (m_entities_half != nullptr && entities_half == nullptr) || (m_entities_span != nullptr && entities_span == nullptr) ||
+                (m_entities_payload != nullptr && entities_payload == nullptr) || (m_entities_quant != nullptr && entities_quant == nullptr) || inserted == nullptr || removed == nullptr)
+            {
+                m_allocator->deallocate(entities);
+                m_allocator->deallocate(entities_node);
+                m_allocator->deallocate(entities_cell);
+                m_allocator->deallocate(entities_grid);
+                m_allocator->deallocate(entities_ref);
+                m_allocator->deallocate(entities_flags);
+                m_allocator->deallocate(entities_vel);
+                m_allocator->deallocate(entities_half);
+                m_allocator->deallocate(entities_span);
+                m_allocator->deallocate(entities_payload);
+                m_allocator->deallocate(entities_quant);
+                m_allocator->deallocate(inserted);
+                m_allocator->deallocate(removed);
+                return false;
+            }
+
+            const index_t used = m_entities_used;
+            nmem::memcpy(entities, m_entities, sizeof(entity_t) * used);
+            nmem::memcpy(entities_node, m_entities_node, sizeof(entity_node_t) * used);
+            nmem::memcpy(entities_cell, m_entities_cell, sizeof(cell_sq_t) * used);
+            nmem::memcpy(entities_grid, m_entities_grid, sizeof(u8) * used);
+            nmem::memcpy(entities_ref, m_entities_ref, sizeof(index_t) * used);
+            nmem::memcpy(entities_flags, m_entities_flags, sizeof(u8) * used);
+            if (entities_vel != nullptr)
+                nmem::memcpy(entities_vel, m_entities_vel, sizeof(f32) * 3 * used);
+            if (entities_half != nullptr)
+                nmem::memcpy(entities_half, m_entities_half, sizeof(f32) * 3 * used);
+            if (entities_span != nullptr)
+                nmem::memcpy(entities_span, m_entities_span, sizeof(span_t) * used);
+            if (entities_payload != nullptr)
+                nmem::memcpy(entities_payload, m_entities_payload, m_payload_size * used);
+            if (entities_quant != nullptr)
+                nmem::memcpy(entities_quant, m_entities_quant, sizeof(quant_t) * used);
+            nmem::memcpy(inserted, m_inserted, sizeof(index_t) * m_inserted_len);
+            nmem::memcpy(removed, m_removed, sizeof(index_t) * m_removed_len);
+
+            HSHG_STAT(++m_stats.m_grows);
+            HSHG_STAT(m_stats.m_grow_bytes += (sizeof(entity_t) + sizeof(entity_node_t) + sizeof(cell_sq_t) + sizeof(u8) + sizeof(index_t) + sizeof(u8) + (entities_vel != nullptr ? sizeof(f32) * 3 : 0) + (entities_half != nullptr ? sizeof(f32) * 3 : 0) + (entities_span != nullptr ? sizeof(span_t) : 0) + (entities_payload != nullptr ? m_payload_size : 0) + (entities_quant != nullptr ? sizeof(quant_t) : 0)) * used + sizeof(index_t) * (m_inserted_len + m_removed_len));
+
+            m_allocator->deallocate(m_entities);
+            m_allocator->deallocate(m_entities_node);
+            m_allocator->deallocate(m_entities_cell);
+            m_allocator->deallocate(m_entities_grid);
+            m_allocator->deallocate(m_entities_ref);
+            m_allocator->deallocate(m_entities_flags);
+            m_allocator->deallocate(m_entities_vel);
+            m_allocator->deallocate(m_entities_half);
+            m_allocator->deallocate(m_entities_span);
+            m_allocator->deallocate(m_entities_payload);
+            m_allocator->deallocate(m_entities_quant);
+            m_allocator->deallocate(m_inserted);
+            m_allocator->deallocate(m_removed);
+
+            m_entities         = entities;
+            m_entities_node    = entities_node;
+            m_entities_cell    = entities_cell;
+            m_entities_grid    = entities_grid;
+            m_entities_ref     = entities_ref;
+            m_entities_flags   = entities_flags;
+            m_entities_vel     = entities_vel;
+            m_entities_half    = entities_half;
+            m_entities_span    = entities_span;
+            m_entities_payload = entities_payload;
+            m_entities_quant   = entities_quant;
+            m_inserted         = inserted;
+            m_removed          = removed;
+
+            // Outside of update() there are no free entities waiting for compact(), so the
+            // new binmap simply starts out with all entities used.
+            m_free_entities.release(m_allocator);
+            binmap_t::config_t cfg = binmap_t::config_t::compute(max_entities);
+            m_free_entities.init_all_used(cfg, m_allocator);
+
+            m_entities_max = max_entities;
+            return true;
+        }
+
+        bool hshg_reserve(hshg_t* const hshg, const index_t max_entities)
+        {
+            ASSERT(!hshg->calling() && "reserve() may not be called from any callback");
+            ASSERT(!hshg->is_viewed() && "reserve() may not be called while a view is acquired");
+            return hshg->reserve(max_entities);
+        }
+
+        void hshg_set_auto_grow(hshg_t* const hshg, const bool enable) { hshg->m_bgrow = enable; }
+
+        void hshg_set_brute_force_threshold(hshg_t* const hshg, const u32 max_entities) { hshg->m_brute_force_threshold = max_entities; }
+
+        void hshg_set_crowd_threshold(hshg_t* const hshg, const u32 threshold) { hshg->m_crowd_threshold = threshold; }
+
+        void hshg_set_sleep_ticks(hshg_t* const hshg, const u8 ticks)
+        {
+            ASSERT(ticks <= (c_entity_idle_mask >> c_entity_idle_shift));
+            hshg->m_sleep_ticks = math::g_min(ticks, (u8)(c_entity_idle_mask >> c_entity_idle_shift));
+
+            // other entities may be awake now, or m_awake was not kept up
+            hshg->m_bawake_lost = 1;
+        }
+
+        bool hshg_is_sleeping(hshg_t const* const hshg, const index_t entity) { return hshg->is_sleeping(entity); }
+        void hshg_wake(hshg_t* const hshg, const index_t entity) { hshg->wake(entity); }
+
+        void hshg_t::add_observer(observer_t* observer)
+        {
+            observer->m_next = m_observers;
+            m_observers      = observer;
+        }
+
+        void hshg_t::remove_observer(observer_t* observer)
+        {
+            observer_t** o = &m_observers;
+            while (*o != nullptr)
+            {
+                if (*o == observer)
+                {
+                    *o               = observer->m_next;
+                    observer->m_next = nullptr;
+                    return;
+                }
+                o = &(*o)->m_next;
+            }
         }
 
         void hshg_update(hshg_t* const hshg, update_func_t* const func)
         {
             ASSERT(!hshg->calling() && "update() may not be called from any callback");
+            ASSERT(!hshg->is_viewed() && "update() may not be called while a view is acquired");
             hshg->set_updating(true);
 
-            // Since the entities that are active are in a contiguous array, we can hand them off to the handler in one go.
-            func->update(0, hshg->m_entities_used, hshg->m_entities, &hshg->m_entities_ref[0], hshg);
-
-            // process the free entities and swap any free entity with an entity at the top of the array.
-            // this means that after this step the array of entities that are valid are contiguous.
-            s32 free_entity = hshg->m_free_entities.find_upper_and_set();
-            while (free_entity >= 0)
             {
-                if (hshg->m_entities_used > 0)
+                HSHG_TRACE_SCOPE(hshg, TRACE_PHASE_UPDATE);
+
+                // Since the entities that are active are in a contiguous array, we can hand them off to the handler in one go.
+                if (hshg->m_ghosts_len == 0)
+                {
+                    func->update(0, hshg->m_entities_used, hshg->m_entities, &hshg->m_entities_ref[0], hshg);
+                }
+                else
                 {
-                    --hshg->m_entities_used;
-                    s32 used_entity = hshg->m_used_entities.find_upper();
-                    if (free_entity < used_entity)
+                    // ghosts are read only, hand out the runs of entities between them
+                    index_t begin = 0;
+                    while (begin < hshg->m_entities_used)
                     {
-                        swap_entity(hshg, free_entity, used_entity);
+                        if (hshg->m_entities_flags[begin] & c_entity_ghost)
+                        {
+                            ++begin;
+                            continue;
+                        }
+                        index_t end = begin + 1;
+                        while (end < hshg->m_entities_used && (hshg->m_entities_flags[end] & c_entity_ghost) == 0)
+                            ++end;
+                        func->update(begin, end, hshg->m_entities, &hshg->m_entities_ref[0], hshg);
+                        begin = end;
                     }
                 }
+            }
 
-                // on to the next free entity
-                free_entity = hshg->m_free_entities.find_upper_and_set();
+            {
+                HSHG_TRACE_SCOPE(hshg, TRACE_PHASE_COMPACT);
+
+                // process the free entities and swap any free entity with an entity at the top of the array.
+                // this means that after this step the array of entities that are valid are contiguous.
+                hshg->flush_removed();
+                hshg->compact();
             }
 
             hshg->set_removed(false);
             hshg->set_updating(false);
         }
 
+        void hshg_flush(hshg_t* const hshg)
+        {
+            ASSERT(!hshg->calling() && "flush() may not be called from any callback");
+            ASSERT(!hshg->is_viewed() && "flush() may not be called while a view is acquired");
+            HSHG_TRACE_SCOPE(hshg, TRACE_PHASE_COMPACT);
+            hshg->flush_removed();
+            hshg->compact();
+            hshg->set_removed(false);
+        }
+
         void hshg_update_multithread(hshg_t* const hshg, const u8 threads, const u8 idx, multi_threaded_update_func_t* const handler)
         {
             const index_t used  = hshg->m_entities_used - 1;
@@ -537,14 +1238,242 @@ namespace ncore
             handler->update(start, end, hshg->m_entities, &hshg->m_entities_ref[start], hshg);
         }
 
+        static void axis_sift_down(axis_entry_t* const entries, index_t root, const index_t len)
+        {
+            while (1)
+            {
+                index_t child = root * 2 + 1;
+                if (child >= len)
+                    return;
+                if (child + 1 < len && entries[child + 1].m_min > entries[child].m_min)
+                    ++child;
+                if (entries[root].m_min >= entries[child].m_min)
+                    return;
+                const axis_entry_t t = entries[root];
+                entries[root]        = entries[child];
+                entries[child]       = t;
+                root                 = child;
+            }
+        }
+
+        // Heap sort on m_min, no extra memory needed
+        void sort_axis_entries(axis_entry_t* const entries, const index_t len)
+        {
+            for (index_t i = len / 2; i > 0; --i)
+                axis_sift_down(entries, i - 1, len);
+            for (index_t end = len; end > 1; --end)
+            {
+                const axis_entry_t t = entries[0];
+                entries[0]           = entries[end - 1];
+                entries[end - 1]     = t;
+                axis_sift_down(entries, 0, end - 1);
+            }
+        }
+
+        // Collects the overflow entities from their cell and sorts them on their minimum x,
+        // which keeps colliding them with each other and with everything else O(n log n).
+        void hshg_t::rebuild_overflow()
+        {
+            m_overflow_dirty = 0;
+            m_overflow_len   = 0;
+            m_overflow_width = 0.0f;
+
+            const grid_t* const grid = overflow_grid();
+            if (grid->m_entities_len > m_overflow_cap)
+            {
+                const index_t       cap      = grow_capacity(grid->m_entities_len, m_overflow_cap, 16);
+                axis_entry_t* const overflow = g_allocate_array<axis_entry_t>(m_allocator, cap);
+                ASSERT(overflow != nullptr);
+                if (overflow == nullptr)
+                {
+                    return;
+                }
+                m_allocator->deallocate(m_overflow);
+                m_overflow     = overflow;
+                m_overflow_cap = cap;
+            }
+
+            for (index_t e = grid->m_cells[0]; e != c_invalid_index; e = m_entities_node[e].m_next)
+            {
+                // spans find their pairs themselves, see visit_span_pairs()
+                if (is_span(e))
+                    continue;
+
+                const entity_t* const entity = m_entities + e;
+                const f32             hx     = m_entities_half != nullptr ? m_entities_half[e * 3] : entity->r;
+                axis_entry_t&         o      = m_overflow[m_overflow_len++];
+                o.m_min                      = entity->x - hx;
+                o.m_max                      = entity->x + hx;
+                o.m_entity                   = e;
+                m_overflow_width             = math::g_max(m_overflow_width, hx + hx);
+            }
+
+            sort_axis_entries(m_overflow, m_overflow_len);
+        }
+
+        // Walking a cell list is fine while cells hold a few entities, but when many pile up
+        // in one cell every pair of them is visited. The members of such a cell are sorted on
+        // the axis on which they are spread the most, so the pairs in the cell cost a sweep
+        // over that axis instead.
+        void hshg_t::build_crowds()
+        {
+            m_crowds_len = 0;
+            if (m_crowd_threshold == 0)
+            {
+                return;
+            }
+
+            index_t entries_len = 0;
+            for (index_t h = 0; h < m_entities_used; ++h)
+            {
+                // only the heads of the lists, which are visited in ascending order
+                if (m_entities_node[h].m_prev != c_invalid_index || is_overflow(h))
+                    continue;
+
+                index_t len = 0;
+                for (index_t e = h; e != c_invalid_index; e = m_entities_node[e].m_next)
+                    ++len;
+                if (len <= m_crowd_threshold)
+                    continue;
+
+                if (m_crowds_len == m_crowds_cap)
+                {
+                    const u32      cap    = math::g_max(m_crowds_cap * 2, (u32)16);
+                    crowd_t* const crowds = g_allocate_array<crowd_t>(m_allocator, cap);
+                    ASSERT(crowds != nullptr);
+                    if (crowds == nullptr)
+                        break;
+                    if (m_crowds != nullptr)
+                    {
+                        nmem::memcpy(crowds, m_crowds, sizeof(crowd_t) * m_crowds_len);
+                        m_allocator->deallocate(m_crowds);
+                    }
+                    m_crowds     = crowds;
+                    m_crowds_cap = cap;
+                }
+                if (entries_len + len > m_crowd_entries_cap)
+                {
+                    const index_t       cap     = math::g_max(entries_len + len, m_crowd_entries_cap * 2);
+                    axis_entry_t* const entries = g_allocate_array<axis_entry_t>(m_allocator, cap);
+                    ASSERT(entries != nullptr);
+                    if (entries == nullptr)
+                        break;
+                    if (m_crowd_entries != nullptr)
+                    {
+                        nmem::memcpy(entries, m_crowd_entries, sizeof(axis_entry_t) * entries_len);
+                        m_allocator->deallocate(m_crowd_entries);
+                    }
+                    m_crowd_entries     = entries;
+                    m_crowd_entries_cap = cap;
+                }
+
+                // the axis on which the centers are spread the most
+                f32 lo[3] = {m_entities[h].x, m_entities[h].y, m_entities[h].z};
+                f32 hi[3] = {lo[0], lo[1], lo[2]};
+                for (index_t e = m_entities_node[h].m_next; e != c_invalid_index; e = m_entities_node[e].m_next)
+                {
+                    const f32* const c = &m_entities[e].x;
+                    for (u32 a = 0; a < 3; ++a)
+                    {
+                        lo[a] = math::g_min(lo[a], c[a]);
+                        hi[a] = math::g_max(hi[a], c[a]);
+                    }
+                }
+                u8 axis = 0;
+                if (hi[1] - lo[1] > hi[axis] - lo[axis])
+                    axis = 1;
+                if (hi[2] - lo[2] > hi[axis] - lo[axis])
+                    axis = 2;
+
+                crowd_t& crowd = m_crowds[m_crowds_len++];
+                crowd.m_head   = h;
+                crowd.m_begin  = entries_len;
+                crowd.m_len    = len;
+                crowd.m_axis   = axis;
+                crowd.m_width  = 0.0f;
+                for (index_t e = h; e != c_invalid_index; e = m_entities_node[e].m_next)
+                {
+                    const entity_t* const entity = m_entities + e;
+                    const f32             c      = (&entity->x)[axis];
+                    axis_entry_t&         entry  = m_crowd_entries[entries_len++];
+                    entry.m_min                  = c - entity->r;
+                    entry.m_max                  = c + entity->r;
+                    entry.m_entity               = e;
+                    crowd.m_width                = math::g_max(crowd.m_width, entity->r + entity->r);
+                    m_entities_flags[e] |= c_entity_crowded;
+                }
+                sort_axis_entries(m_crowd_entries + crowd.m_begin, len);
+                HSHG_STAT(++m_stats.m_crowded_cells);
+            }
+        }
+
+        void hshg_t::clear_crowds()
+        {
+            for (u32 c = 0; c < m_crowds_len; ++c)
+            {
+                const crowd_t&            crowd   = m_crowds[c];
+                const axis_entry_t* const entries = m_crowd_entries + crowd.m_begin;
+                for (index_t e = 0; e < crowd.m_len; ++e)
+                    m_entities_flags[entries[e].m_entity] &= ~c_entity_crowded;
+            }
+            m_crowds_len = 0;
+        }
+
+        void hshg_t::push_awake(const index_t idx)
+        {
+            if (m_sleep_ticks == 0 || m_bawake_lost)
+            {
+                return;
+            }
+            if (m_awake_len == m_awake_cap)
+            {
+                const u32      cap   = math::g_max(m_awake_cap * 2, (u32)64);
+                index_t* const awake = g_allocate_array<index_t>(m_allocator, cap);
+                if (awake == nullptr)
+                {
+                    // not fatal, hshg_collide() scans all entities instead
+                    m_bawake_lost = 1;
+                    return;
+                }
+                nmem::memcpy(awake, m_awake, sizeof(index_t) * m_awake_len);
+                m_allocator->deallocate(m_awake);
+                m_awake     = awake;
+                m_awake_cap = cap;
+            }
+            m_awake[m_awake_len++] = idx;
+        }
+
+        void hshg_t::wake_cell(const index_t idx)
+        {
+            // the overflow cell is not a neighbourhood, it holds all of the overflow entities
+            if (m_sleep_ticks == 0 || is_overflow(idx))
+            {
+                return;
+            }
+
+            const grid_t* const grid = m_grids + m_entities_grid[idx];
+            for (index_t e = grid->m_cells[m_entities_cell[idx]]; e != c_invalid_index; e = m_entities_node[e].m_next)
+            {
+                wake(e);
+            }
+        }
+
         void hshg_t::update_cache()
         {
+            if (this->m_overflow_dirty)
+            {
+                rebuild_overflow();
+            }
+
             if (this->m_old_cache == this->m_new_cache)
             {
                 return;
             }
 
+            HSHG_TRACE_SCOPE(this, TRACE_PHASE_UPDATE_CACHE);
             this->m_old_cache = this->m_new_cache;
+            HSHG_STAT(++this->m_stats.m_cache_rebuilds);
+            HSHG_STAT(this->m_stats.m_active_grids = 0);
 
             grid_t*             old_grid;
             const grid_t* const grid_max = this->m_grids + this->m_grids_len;
@@ -565,6 +1494,7 @@ namespace ncore
 
                 ++old_grid;
             }
+            HSHG_STAT(this->m_stats.m_active_grids = 1);
 
             grid_t* new_grid;
 
@@ -581,309 +1511,485 @@ namespace ncore
                 old_grid->m_shift = shift;
                 old_grid          = new_grid;
                 shift             = 1;
+                HSHG_STAT(++this->m_stats.m_active_grids);
             }
         }
 
-        static void inline loop_over(hshg_t* hshg, const index_t ref, const entity_t* entity, const index_t from, collide_func_t* handler)
+        struct collide_visitor_t
         {
-            index_t n = from;
-            while (n != c_invalid_index)
+            const hshg_t*   m_hshg;
+            collide_func_t* m_handler;
+
+            inline void operator()(const index_t i, const index_t n)
             {
-                handler->collide(entity, ref, &hshg->m_entities[n], hshg->m_entities_ref[n]);
-                n = hshg->m_entities_node[n].m_next;
+                // a pair of two ghosts is reported by the region owning them
+                if (m_hshg->m_entities_flags[i] & m_hshg->m_entities_flags[n] & c_entity_ghost)
+                    return;
+
+                HSHG_STAT(++m_hshg->m_stats.m_pairs_emitted);
+                m_handler->collide(&m_hshg->m_entities[i], m_hshg->m_entities_ref[i], &m_hshg->m_entities[n], m_hshg->m_entities_ref[n]);
             }
-        }
+        };
 
-        void hshg_collide(hshg_t* const hshg, collide_func_t* const handler)
+        // Only hands out the pairs of two awake entities
+        struct awake_collide_visitor_t
         {
-            ASSERT(!hshg->calling() && "collide() may not be called from any callback");
-            hshg->set_colliding(true);
+            const hshg_t*      m_hshg;
+            collide_visitor_t& m_visitor;
 
-            hshg->update_cache();
-
-            for (index_t i = 0; i < hshg->m_entities_used; ++i)
+            inline void operator()(const index_t i, const index_t n)
             {
-                const entity_t*      entity      = hshg->m_entities + i;
-                const entity_node_t* entity_node = hshg->m_entities_node + i;
-                const cell_sq_t      entity_cell = hshg->m_entities_cell[i];
-
-                const grid_t* grid = hshg->m_grids + hshg->m_entities_grid[i];
-
-                cell_t cell_x = idx_get_x(grid, entity_cell);
-                cell_t cell_y = idx_get_y(grid, entity_cell);
-                cell_t cell_z = idx_get_z(grid, entity_cell);
-                if (cell_z != 0)
-                {
-                    if (cell_y != 0)
-                    {
-                        const index_t* const cell = grid->m_cells + (entity_cell - grid->m_cells_sq - grid->m_cells_side);
+                if (!m_hshg->is_sleeping(n))
+                    m_visitor(i, n);
+            }
+        };
 
-                        if (cell_x != 0)
-                        {
-                            loop_over(hshg, i, entity, *(cell - 1), handler);
-                        }
+        // Only hands out the pairs of the awake entity 'i' with a sleeping one
+        struct sleeping_collide_visitor_t
+        {
+            const hshg_t*      m_hshg;
+            collide_visitor_t& m_visitor;
 
-                        loop_over(hshg, i, entity, *cell, handler);
+            inline void operator()(const index_t i, const index_t n)
+            {
+                if (m_hshg->is_sleeping(n))
+                    m_visitor(i, n);
+            }
+        };
 
-                        if (cell_x != grid->m_cells_mask)
-                        {
-                            loop_over(hshg, i, entity, *(cell + 1), handler);
-                        }
-                    }
+        // Hands out the pairs of the awake entity 'i' with the sleeping entities that its box
+        // overlaps. Sleeping entities do not look for their pairs, so this is a query over all
+        // of the grids, the overflow set and the spans, whatever the grid of 'i'.
+        static void visit_sleeping_pairs(const hshg_t* const hshg, const index_t i, sleeping_collide_visitor_t& visitor)
+        {
+            const entity_t* const entity = hshg->m_entities + i;
+            f32                   half[3];
+            entity_half_extents(hshg, i, half);
 
-                    {
-                        const index_t* const cell = grid->m_cells + (entity_cell - grid->m_cells_sq);
+            box_cell_visitor_t<sleeping_collide_visitor_t> cells = {hshg, i, {entity->x - half[0], entity->y - half[1], entity->z - half[2]}, {entity->x + half[0], entity->y + half[1], entity->z + half[2]}, visitor};
 
-                        if (cell_x != 0)
-                        {
-                            loop_over(hshg, i, entity, *(cell - 1), handler);
-                        }
+            const cell_range_t x = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, cells.m_min[0], cells.m_max[0]);
+            const cell_range_t y = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, cells.m_min[1], cells.m_max[1]);
+            const cell_range_t z = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, cells.m_min[2], cells.m_max[2]);
+            visit_query_cells(hshg->m_grids, hshg->m_grids_len, x, y, z, cells);
+            if (hshg->m_overflow_len != 0)
+            {
+                visit_overflow_range(hshg, cells.m_min[0], cells.m_max[0], cells);
+            }
+            if (hshg->m_span_cells != nullptr)
+            {
+                visit_query_spans(hshg, x, y, z, cells.m_min, cells.m_max, cells);
+            }
+        }
 
-                        loop_over(hshg, i, entity, *cell, handler);
+        // Makes m_awake hold every awake entity exactly once. It is rebuilt from all entities
+        // when entries were lost, otherwise the entries of entities that were removed, fell
+        // asleep or were listed twice are dropped. Returns false when m_awake could not be
+        // allocated.
+        static bool gather_awake(hshg_t* const hshg)
+        {
+            // hshg_insert_concurrent() leaves listing to the flush, which may not have happened yet
+            for (index_t i = 0; i < hshg->m_inserted_len; ++i)
+            {
+                hshg->push_awake(hshg->m_inserted[i]);
+            }
 
-                        if (cell_x != grid->m_cells_mask)
-                        {
-                            loop_over(hshg, i, entity, *(cell + 1), handler);
-                        }
+            if (hshg->m_bawake_lost)
+            {
+                if (hshg->m_awake_cap < hshg->m_entities_used)
+                {
+                    const u32      cap   = math::g_max((u32)hshg->m_entities_used, math::g_max(hshg->m_awake_cap * 2, (u32)64));
+                    index_t* const awake = g_allocate_array<index_t>(hshg->m_allocator, cap);
+                    if (awake == nullptr)
+                    {
+                        return false;
                     }
+                    hshg->m_allocator->deallocate(hshg->m_awake);
+                    hshg->m_awake     = awake;
+                    hshg->m_awake_cap = cap;
+                }
+                hshg->m_awake_len = 0;
+                for (index_t i = 0; i < hshg->m_entities_used; ++i)
+                {
+                    if (!hshg->is_sleeping(i))
+                        hshg->m_awake[hshg->m_awake_len++] = i;
+                }
+                hshg->m_bawake_lost = 0;
+                return true;
+            }
 
-                    if (cell_y != grid->m_cells_mask)
-                    {
-                        const index_t* const cell = grid->m_cells + (entity_cell - grid->m_cells_sq + grid->m_cells_side);
+            u8* const      flags = hshg->m_entities_flags;
+            index_t* const awake = hshg->m_awake;
+            u32            len   = 0;
+            for (u32 a = 0; a < hshg->m_awake_len; ++a)
+            {
+                const index_t i = awake[a];
+                if (i >= hshg->m_entities_used || hshg->is_sleeping(i) || (flags[i] & c_entity_listed))
+                    continue;
+                flags[i] |= c_entity_listed;
+                awake[len++] = i;
+            }
+            for (u32 a = 0; a < len; ++a)
+            {
+                flags[awake[a]] &= ~c_entity_listed;
+            }
+            hshg->m_awake_len = len;
+            return true;
+        }
 
-                        if (cell_x != 0)
-                        {
-                            loop_over(hshg, i, entity, *(cell - 1), handler);
-                        }
+        // The awake entities were not moved, resized or woken for one more tick, the ones that
+        // fall asleep leave m_awake
+        static void age_entities(hshg_t* const hshg)
+        {
+            index_t* const awake = hshg->m_awake;
+            u32            len   = 0;
+            for (u32 a = 0; a < hshg->m_awake_len; ++a)
+            {
+                const index_t i = awake[a];
+                hshg->m_entities_flags[i] += (u8)(1 << c_entity_idle_shift);
+                if (!hshg->is_sleeping(i))
+                    awake[len++] = i;
+            }
+            hshg->m_awake_len = len;
+        }
 
-                        loop_over(hshg, i, entity, *cell, handler);
+        // The outer loop of hshg_collide() when entities may sleep, only the awake entities in
+        // m_awake are walked. They visit their pairs with the other awake entities as usual and
+        // query their box for sleeping ones, see visit_sleeping_pairs(). Pairs of two sleeping
+        // entities are not handed out. Returns false when m_awake could not be allocated.
+        static bool collide_sleeping(hshg_t* const hshg, collide_visitor_t& visitor)
+        {
+            if (!gather_awake(hshg))
+            {
+                return false;
+            }
 
-                        if (cell_x != grid->m_cells_mask)
-                        {
-                            loop_over(hshg, i, entity, *(cell + 1), handler);
-                        }
-                    }
-                }
-                loop_over(hshg, i, entity, entity_node->m_next, handler);
+            awake_collide_visitor_t    awake    = {hshg, visitor};
+            sleeping_collide_visitor_t sleeping = {hshg, visitor};
+            for (u32 a = 0; a < hshg->m_awake_len; ++a)
+            {
+                const index_t i = hshg->m_awake[a];
+                visit_collide_pairs(hshg, i, awake);
+                visit_sleeping_pairs(hshg, i, sleeping);
+            }
 
-                if (cell_x != grid->m_cells_mask)
+            age_entities(hshg);
+            return true;
+        }
+
+        // The outer loop of hshg_collide() for at most m_brute_force_threshold entities, every
+        // pair is tested and the ones that overlap are handed out, the grids are not walked.
+        // As in collide_sleeping(), pairs of two sleeping entities are not handed out.
+        static void collide_brute_force(hshg_t* const hshg, collide_visitor_t& visitor)
+        {
+            const entity_t* const entities = hshg->m_entities;
+            const index_t         len      = hshg->m_entities_used;
+            for (index_t i = 0; i < len; ++i)
+            {
+                const entity_t entity = entities[i];
+                const bool     asleep = hshg->is_sleeping(i);
+                for (index_t n = i + 1; n < len; ++n)
                 {
-                    loop_over(hshg, i, entity, grid->m_cells[entity_cell + 1], handler);
+                    // no early outs, pairs rarely overlap and the branches would be mispredicted
+                    const entity_t* const other = entities + n;
+                    const f32             r     = entity.r + other->r;
+                    const bool            hit   = (math::abs(entity.x - other->x) <= r) & (math::abs(entity.y - other->y) <= r) & (math::abs(entity.z - other->z) <= r);
+                    if (hit && !(asleep && hshg->is_sleeping(n)) && (hshg->m_entities_half == nullptr || entity_boxes_overlap(hshg, i, n)))
+                        visitor(i, n);
                 }
+            }
+            HSHG_STAT(hshg->m_stats.m_nodes_walked += len > 1 ? (u64)len * (len - 1) / 2 : 0);
 
-                if (cell_y != grid->m_cells_mask)
-                {
-                    const index_t* const cell = grid->m_cells + (entity_cell + grid->m_cells_side);
+            if (hshg->m_sleep_ticks != 0 && gather_awake(hshg))
+                age_entities(hshg);
+        }
 
-                    if (cell_x != 0)
-                    {
-                        loop_over(hshg, i, entity, *(cell - 1), handler);
-                    }
+        void hshg_collide(hshg_t* const hshg, collide_func_t* const handler)
+        {
+            ASSERT(!hshg->calling() && "collide() may not be called from any callback");
+            hshg->set_colliding(true);
+            HSHG_STAT(++hshg->m_stats.m_collide_calls);
+
+            hshg->update_cache();
 
-                    loop_over(hshg, i, entity, *cell, handler);
+            HSHG_TRACE_SCOPE(hshg, TRACE_PHASE_COLLIDE);
 
-                    if (cell_x != grid->m_cells_mask)
-                    {
-                        loop_over(hshg, i, entity, *(cell + 1), handler);
-                    }
-                }
+            collide_visitor_t visitor = {hshg, handler};
+            if (hshg->m_entities_used <= hshg->m_brute_force_threshold)
+            {
+                collide_brute_force(hshg, visitor);
+                hshg->set_colliding(false);
+                return;
+            }
 
-                while (grid->m_shift)
+            hshg->build_crowds();
+            if (hshg->m_sleep_ticks == 0 || !collide_sleeping(hshg, visitor))
+            {
+                for (index_t i = 0; i < hshg->m_entities_used; ++i)
                 {
-                    cell_x >>= grid->m_shift;
-                    cell_y >>= grid->m_shift;
-                    cell_z >>= grid->m_shift;
+                    visit_collide_pairs(hshg, i, visitor);
+                }
+            }
 
-                    grid += grid->m_shift;
+            hshg->clear_crowds();
+            hshg->set_colliding(false);
+        }
 
-                    const cell_t min_cell_x = cell_x != 0 ? cell_x - 1 : 0;
-                    const cell_t min_cell_y = cell_y != 0 ? cell_y - 1 : 0;
-                    const cell_t min_cell_z = cell_z != 0 ? cell_z - 1 : 0;
+        // Calls the handler for entity 'i' of 'from' and every entity of 'to' in the 3x3x3
+        // neighbourhood of its cell, in each of the grids of 'to' set in 'grids'. Those grids
+        // are never finer than the grid of 'i', and both HSHGs have the same grid layout,
+        // so the cell of 'i' in such a grid is found by shifting its coordinates.
+        static void collide_with_grids(const hshg_t* const from, const index_t i, const hshg_t* const to, u32 grids, const bool from_is_a, collide_func_t* const handler)
+        {
+            const u8            g    = from->m_entities_grid[i];
+            const grid_t* const grid = from->m_grids + g;
+            const cell_sq_t     cell = from->m_entities_cell[i];
+
+            const cell_t cell_x = idx_get_x(grid, cell);
+            const cell_t cell_y = idx_get_y(grid, cell);
+            const cell_t cell_z = idx_get_z(grid, cell);
 
-                    const cell_t max_cell_x = cell_x != grid->m_cells_mask ? cell_x + 1 : cell_x;
-                    const cell_t max_cell_y = cell_y != grid->m_cells_mask ? cell_y + 1 : cell_y;
-                    const cell_t max_cell_z = cell_z != grid->m_cells_mask ? cell_z + 1 : cell_z;
+            // collide_with() is counted on A
+            HSHG_STAT(hshg_stats_t& stats = (from_is_a ? from : to)->m_stats);
 
-                    for (cell_t cur_z = min_cell_z; cur_z <= max_cell_z; ++cur_z)
+            while (grids != 0)
+            {
+                const u8 h = (u8)math::g_countTrailingZeros(grids);
+                grids &= grids - 1;
+
+                const grid_t* const other = to->m_grids + h;
+                const u8            shift = h - g;
+                const cell_t        x     = cell_x >> shift;
+                const cell_t        y     = cell_y >> shift;
+                const cell_t        z     = cell_z >> shift;
+
+                const cell_t min_x = x != 0 ? x - 1 : 0;
+                const cell_t min_y = y != 0 ? y - 1 : 0;
+                const cell_t min_z = z != 0 ? z - 1 : 0;
+                const cell_t max_x = x != other->m_cells_mask ? x + 1 : x;
+                const cell_t max_y = y != other->m_cells_mask ? y + 1 : y;
+                const cell_t max_z = z != other->m_cells_mask ? z + 1 : z;
+
+                for (cell_t cur_z = min_z; cur_z <= max_z; ++cur_z)
+                {
+                    for (cell_t cur_y = min_y; cur_y <= max_y; ++cur_y)
                     {
-                        for (cell_t cur_y = min_cell_y; cur_y <= max_cell_y; ++cur_y)
+                        for (cell_t cur_x = min_x; cur_x <= max_x; ++cur_x)
                         {
-                            for (cell_t cur_x = min_cell_x; cur_x <= max_cell_x; ++cur_x)
+                            HSHG_STAT(++stats.m_cells_visited);
+                            index_t n = other->m_cells[grid_get_idx(other, cur_x, cur_y, cur_z)];
+                            while (n != c_invalid_index)
                             {
-                                const cell_t cell = grid_get_idx(grid, cur_x, cur_y, cur_z);
-                                loop_over(hshg, i, entity, grid->m_cells[cell], handler);
+                                HSHG_STAT(++stats.m_nodes_walked);
+                                if (from_is_a)
+                                    handler->collide(&from->m_entities[i], from->m_entities_ref[i], &to->m_entities[n], to->m_entities_ref[n]);
+                                else
+                                    handler->collide(&to->m_entities[n], to->m_entities_ref[n], &from->m_entities[i], from->m_entities_ref[i]);
+                                n = to->m_entities_node[n].m_next;
                             }
                         }
                     }
                 }
             }
-
-            hshg->set_colliding(false);
         }
 
-        struct cell_range_t
+        // Reports entity 'm_i' of 'm_from' with the overflow entities or the spans of 'm_to'
+        struct collide_with_overflow_t
         {
-            cell_t start;
-            cell_t end;
+            const hshg_t*   m_from;
+            index_t         m_i;
+            const hshg_t*   m_to;
+            bool            m_from_is_a;
+            collide_func_t* m_handler;
+
+            inline void operator()(const index_t n)
+            {
+                HSHG_STAT(++(m_from_is_a ? m_from : m_to)->m_stats.m_nodes_walked);
+                if (m_from_is_a)
+                    m_handler->collide(&m_from->m_entities[m_i], m_from->m_entities_ref[m_i], &m_to->m_entities[n], m_to->m_entities_ref[n]);
+                else
+                    m_handler->collide(&m_to->m_entities[n], m_to->m_entities_ref[n], &m_from->m_entities[m_i], m_from->m_entities_ref[m_i]);
+            }
         };
 
-        static cell_range_t map_pos(const hshg_t* const hshg, const f32 _x1, const f32 _x2)
+        // Reports entity 'i' of 'from' with the spans of 'to' that its box overlaps
+        static void collide_with_spans(const hshg_t* const from, const index_t i, const hshg_t* const to, collide_with_overflow_t& visitor)
         {
-            f32 x1;
-            f32 x2;
-
-            if (_x1 < 0)
+            if (to->m_span_cells == nullptr)
             {
-                const f32 shift = (((cell_t)(-_x1 * hshg->m_inverse_grid_size) << 1) + 2) * hshg->m_grid_size;
-
-                x1 = _x1 + shift;
-                x2 = _x2 + shift;
+                return;
             }
-            else
+
+            const entity_t* const entity = from->m_entities + i;
+            f32                   half[3];
+            entity_half_extents(from, i, half);
+
+            const f32          q1[3] = {entity->x - half[0], entity->y - half[1], entity->z - half[2]};
+            const f32          q2[3] = {entity->x + half[0], entity->y + half[1], entity->z + half[2]};
+            const cell_range_t x     = map_pos(to->m_grids, to->m_grid_size, to->m_inverse_grid_size, q1[0], q2[0]);
+            const cell_range_t y     = map_pos(to->m_grids, to->m_grid_size, to->m_inverse_grid_size, q1[1], q2[1]);
+            const cell_range_t z     = map_pos(to->m_grids, to->m_grid_size, to->m_inverse_grid_size, q1[2], q2[2]);
+            visitor.m_i              = i;
+            visit_query_spans(to, x, y, z, q1, q2, visitor);
+        }
+
+        void hshg_collide_with(hshg_t* const hshg_a, hshg_t* const hshg_b, collide_func_t* const handler)
+        {
+            ASSERT(!hshg_a->calling() && !hshg_b->calling() && "collide_with() may not be called from any callback");
+            ASSERT(hshg_a != hshg_b && "use collide() to collide a HSHG with itself");
+            ASSERT(hshg_a->m_cell_size == hshg_b->m_cell_size && hshg_a->m_grids[0].m_cells_side == hshg_b->m_grids[0].m_cells_side && "collide_with() needs two HSHGs with the same side and size");
+            if (hshg_a->m_cell_size != hshg_b->m_cell_size || hshg_a->m_grids[0].m_cells_side != hshg_b->m_grids[0].m_cells_side)
             {
-                x1 = _x1;
-                x2 = _x2;
+                return;
             }
 
-            cell_t folds = (x2 - (cell_t)(x1 * hshg->m_inverse_grid_size) * hshg->m_grid_size) * hshg->m_inverse_grid_size;
+            hshg_a->set_colliding(true);
+            hshg_b->set_colliding(true);
+            HSHG_STAT(++hshg_a->m_stats.m_collide_calls);
+
+            // after this m_old_cache has a bit set for every grid holding entities
+            hshg_a->update_cache();
+            hshg_b->update_cache();
 
-            const grid_t* const grid = hshg->m_grids;
+            HSHG_TRACE_SCOPE(hshg_a, TRACE_PHASE_COLLIDE);
 
-            cell_t start;
-            cell_t end;
-            switch (folds)
+            // A pair is found by the entity in the finer grid, ties go to the entity of A.
+            // The overflow grids are coarser than any grid, and not part of the mask.
+            const u32 grids    = ((u32)1 << hshg_a->m_grids_len) - 1;
+            const u32 active_a = hshg_a->m_old_cache & grids;
+            const u32 active_b = hshg_b->m_old_cache & grids;
+
+            collide_with_overflow_t overflow_a = {hshg_b, 0, hshg_a, false, handler};  // B with the overflow and the spans of A
+            collide_with_overflow_t overflow_b = {hshg_a, 0, hshg_b, true, handler};   // A with the overflow and the spans of B
+            for (index_t i = 0; i < hshg_a->m_entities_used; ++i)
             {
-                case 0:
-                {
-                    const cell_t cell = grid_get_cell_1d(grid, x1);
+                collide_with_spans(hshg_a, i, hshg_b, overflow_b);
 
-                    end   = grid_get_cell_1d(grid, x2);
-                    start = math::g_min(cell, end);
-                    end   = math::g_max(cell, end);
+                // a span of A meets the other entities of B when those look for the spans of A
+                if (hshg_a->is_span(i))
+                    continue;
 
-                    break;
-                }
-                case 1:
-                {
-                    const cell_t cell = math::abs(x1) * grid->m_inverse_cell_size;
+                const u32 finer = ((u32)1 << hshg_a->m_entities_grid[i]) - 1;
+                collide_with_grids(hshg_a, i, hshg_b, active_b & ~finer, true, handler);
 
-                    end = grid_get_cell_1d(grid, x2);
+                const entity_t* const entity = hshg_a->m_entities + i;
+                overflow_b.m_i               = i;
+                visit_overflow_range(hshg_b, entity->x - entity->r, entity->x + entity->r, overflow_b);
+            }
+            for (index_t i = 0; i < hshg_b->m_entities_used; ++i)
+            {
+                // the spans of B were found by the entities of A above
+                if (hshg_b->is_span(i))
+                    continue;
 
-                    if (cell & grid->m_cells_side)
-                    {
-                        start = 0;
-                        end   = math::g_max(grid->m_cells_mask - (cell & grid->m_cells_mask), end);
-                    }
-                    else
-                    {
-                        start = math::g_min(cell & grid->m_cells_mask, end);
-                        end   = grid->m_cells_mask;
-                    }
+                collide_with_spans(hshg_b, i, hshg_a, overflow_a);
+                if (hshg_b->is_overflow(i))
+                    continue;
 
-                    break;
-                }
-                default:
-                {
-                    start = 0;
-                    end   = grid->m_cells_mask;
+                const u32 finer = ((u32)2 << hshg_b->m_entities_grid[i]) - 1;
+                collide_with_grids(hshg_b, i, hshg_a, active_a & ~finer, false, handler);
 
-                    break;
-                }
+                const entity_t* const entity = hshg_b->m_entities + i;
+                overflow_a.m_i               = i;
+                visit_overflow_range(hshg_a, entity->x - entity->r, entity->x + entity->r, overflow_a);
             }
 
-            return {start, end};
+            hshg_b->set_colliding(false);
+            hshg_a->set_colliding(false);
         }
 
-        static void query_common(const hshg_t* const hshg, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2, query_func_t* const handler)
+        struct query_visitor_t
         {
-            ASSERT(x1 <= x2);
-            ASSERT(y1 <= y2);
-            ASSERT(z1 <= z2);
-
-            cell_range_t x = map_pos(hshg, x1, x2);
-            cell_range_t y = map_pos(hshg, y1, y2);
-            cell_range_t z = map_pos(hshg, z1, z2);
-
-            const grid_t*       grid     = hshg->m_grids;
-            const grid_t* const grid_max = hshg->m_grids + hshg->m_grids_len;
-
-            u8 shift = 0;
-
-            while (1)
+            const hshg_t* m_hshg;
+            f32           m_x1, m_y1, m_z1;
+            f32           m_x2, m_y2, m_z2;
+            query_func_t* m_handler;
+            u64           m_cells;
+            u64           m_nodes;
+            quant_t       m_quant;  // the query box as a hypercube, when the HSHG has a quantized column
+
+            inline void operator()(const grid_t* grid, const cell_sq_t cell)
             {
-                if (grid == grid_max)
+                HSHG_STAT(++m_cells);
+                const quant_t* const quant      = m_hshg->m_entities_quant;
+                index_t              entity_idx = grid->m_cells[cell];
+                while (entity_idx != c_invalid_index)
                 {
-                    return;
+                    HSHG_STAT(++m_nodes);
+                    if ((quant == nullptr || !quant_apart(quant[entity_idx], m_quant)) && entity_box_overlaps(m_hshg, entity_idx, m_x1, m_y1, m_z1, m_x2, m_y2, m_z2))
+                    {
+                        m_handler->query(m_hshg->m_entities + entity_idx, m_hshg->m_entities_ref[entity_idx]);
+                    }
+
+                    const entity_node_t* const entity_node = m_hshg->m_entities_node + entity_idx;
+                    entity_idx                             = entity_node->m_next;
                 }
+            }
 
-                if (grid->m_entities_len != 0)
+            // an overflow entity found by visit_overflow_range()
+            inline void operator()(const index_t entity_idx)
+            {
+                HSHG_STAT(++m_nodes);
+                if (entity_box_overlaps(m_hshg, entity_idx, m_x1, m_y1, m_z1, m_x2, m_y2, m_z2))
                 {
-                    break;
+                    m_handler->query(m_hshg->m_entities + entity_idx, m_hshg->m_entities_ref[entity_idx]);
                 }
-
-                ++grid;
-                ++shift;
             }
+        };
 
-            x.start >>= shift;
-            y.start >>= shift;
-            z.start >>= shift;
-
-            x.end >>= shift;
-            y.end >>= shift;
-            z.end >>= shift;
+        void query_common(const hshg_t* const hshg, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2, query_func_t* const handler, hshg_stats_t* const stats)
+        {
+            ASSERT(x1 <= x2);
+            ASSERT(y1 <= y2);
+            ASSERT(z1 <= z2);
 
-            while (1)
+            if (hshg->m_entities_used <= hshg->m_brute_force_threshold)
             {
-                const cell_t s_x = x.start != 0 ? x.start - 1 : 0;
-                const cell_t s_y = y.start != 0 ? y.start - 1 : 0;
-                const cell_t s_z = z.start != 0 ? z.start - 1 : 0;
-
-                const cell_t e_x = x.end != grid->m_cells_mask ? x.end + 1 : x.end;
-                const cell_t e_y = y.end != grid->m_cells_mask ? y.end + 1 : y.end;
-                const cell_t e_z = z.end != grid->m_cells_mask ? z.end + 1 : z.end;
-
-                for (cell_t z = s_z; z <= e_z; ++z)
+                for (index_t i = 0; i < hshg->m_entities_used; ++i)
                 {
-                    for (cell_t y = s_y; y <= e_y; ++y)
+                    const entity_t* const entity = hshg->m_entities + i;
+                    f32                   half[3];
+                    entity_half_extents(hshg, i, half);
+                    if (entity->x + half[0] >= x1 && entity->x - half[0] <= x2 && entity->y + half[1] >= y1 && entity->y - half[1] <= y2 && entity->z + half[2] >= z1 && entity->z - half[2] <= z2)
                     {
-                        for (cell_t x = s_x; x <= e_x; ++x)
-                        {
-                            const cell_sq_t cell = grid_get_idx(grid, x, y, z);
-
-                            index_t entity_idx = grid->m_cells[cell];
-                            while (entity_idx != c_invalid_index)
-                            {
-                                const entity_t* const entity = hshg->m_entities + entity_idx;
-                                if ((entity->x + entity->r >= x1 && entity->x - entity->r <= x2) && entity->y + entity->r >= y1 && entity->y - entity->r <= y2 && entity->z + entity->r >= z1 && entity->z - entity->r <= z2)
-                                {
-                                    handler->query(entity, hshg->m_entities_ref[entity_idx]);
-                                }
-
-                                const entity_node_t* const entity_node = hshg->m_entities_node + entity_idx;
-                                entity_idx                             = entity_node->m_next;
-                            }
-                        }
+                        handler->query(entity, hshg->m_entities_ref[i]);
                     }
                 }
-
-                if (grid->m_shift)
+#ifdef HSHG_STATS
+                if (stats != nullptr)
                 {
-                    x.start >>= grid->m_shift;
-                    y.start >>= grid->m_shift;
-                    z.start >>= grid->m_shift;
+                    ++stats->m_query_calls;
+                    stats->m_nodes_walked += hshg->m_entities_used;
+                }
+#endif
+                return;
+            }
 
-                    x.end >>= grid->m_shift;
-                    y.end >>= grid->m_shift;
-                    z.end >>= grid->m_shift;
+            cell_range_t x = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, x1, x2);
+            cell_range_t y = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, y1, y2);
+            cell_range_t z = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, z1, z2);
 
-                    grid += grid->m_shift;
-                }
-                else
-                {
-                    break;
-                }
+            query_visitor_t visitor = {hshg, x1, y1, z1, x2, y2, z2, handler, 0, 0, {0, 0, 0, 0}};
+            if (hshg->m_entities_quant != nullptr)
+            {
+                const f32 half = math::g_max(x2 - x1, math::g_max(y2 - y1, z2 - z1)) * 0.5f;
+                visitor.m_quant = quantize_entity((x1 + x2) * 0.5f, (y1 + y2) * 0.5f, (z1 + z2) * 0.5f, half, hshg->m_quant_scale);
             }
+            visit_query_cells(hshg->m_grids, hshg->m_grids_len, x, y, z, visitor);
+            visit_overflow_range(hshg, x1, x2, visitor);
+            if (hshg->m_span_cells != nullptr)
+            {
+                query_spans(hshg, x, y, z, x1, y1, z1, x2, y2, z2, handler);
+            }
+
+#ifdef HSHG_STATS
+            if (stats != nullptr)
+            {
+                ++stats->m_query_calls;
+                stats->m_cells_visited += visitor.m_cells;
+                stats->m_nodes_walked += visitor.m_nodes;
+            }
+#endif
         }
 
         void hshg_query(hshg_t* const hshg, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2, query_func_t* const handler)
@@ -897,31 +2003,70 @@ namespace ncore
 #endif
             hshg->set_querying(true);
             hshg->update_cache();
-            query_common(hshg, x1, y1, z1, x2, y2, z2, handler);
+            HSHG_TRACE_SCOPE(hshg, TRACE_PHASE_QUERY);
+#ifdef HSHG_STATS
+            query_common(hshg, x1, y1, z1, x2, y2, z2, handler, &hshg->m_stats);
+#else
+            query_common(hshg, x1, y1, z1, x2, y2, z2, handler, nullptr);
+#endif
             hshg->set_querying(old_querying);
         }
 
         void hshg_query_multithread(hshg_t* const hshg, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2, query_func_t* const handler)
         {
-            ASSERT(hshg->m_old_cache == hshg->m_new_cache &&
+            ASSERT(hshg->m_old_cache == hshg->m_new_cache && hshg->m_overflow_dirty == 0 &&
                    "You modified an entity's radius. "
                    "Call update_cache() before any query_multithread().");
 
-            query_common(hshg, x1, y1, z1, x2, y2, z2, handler);
+            query_common(hshg, x1, y1, z1, x2, y2, z2, handler, nullptr);
         }
 
         void hshg_optimize(hshg_t* const hshg)
         {
             ASSERT(!hshg->calling() && "hshg_optimize() may not be called from any callback");
+            ASSERT(!hshg->is_viewed() && "hshg_optimize() may not be called while a view is acquired");
+            HSHG_TRACE_SCOPE(hshg, TRACE_PHASE_OPTIMIZE);
 
-            entity_t* const      entities      = (entity_t*)hshg->m_allocator->allocate(sizeof(entity_t) * hshg->m_entities_max);
-            entity_node_t* const entities_node = (entity_node_t*)hshg->m_allocator->allocate(sizeof(entity_node_t) * hshg->m_entities_max);
-            cell_sq_t*           entities_cell = (cell_sq_t*)hshg->m_allocator->allocate(sizeof(cell_sq_t) * hshg->m_entities_max);
-            u8*                  entities_grid = (u8*)hshg->m_allocator->allocate(sizeof(u8) * hshg->m_entities_max);
-            index_t*             entities_ref  = (index_t*)hshg->m_allocator->allocate(sizeof(index_t) * hshg->m_entities_max);
+            // the entities queued by hshg_remove_concurrent() are indices into the old order
+            hshg->flush_removed();
+            hshg->compact();
+            hshg->set_removed(false);
 
-            if (entities == nullptr)
+            entity_t* const      entities         = (entity_t*)hshg->m_allocator->allocate(sizeof(entity_t) * hshg->m_entities_max);
+            entity_node_t* const entities_node    = (entity_node_t*)hshg->m_allocator->allocate(sizeof(entity_node_t) * hshg->m_entities_max);
+            cell_sq_t*           entities_cell    = (cell_sq_t*)hshg->m_allocator->allocate(sizeof(cell_sq_t) * hshg->m_entities_max);
+            u8*                  entities_grid    = (u8*)hshg->m_allocator->allocate(sizeof(u8) * hshg->m_entities_max);
+            index_t*             entities_ref     = (index_t*)hshg->m_allocator->allocate(sizeof(index_t) * hshg->m_entities_max);
+            u8*                  entities_flags   = (u8*)hshg->m_allocator->allocate(sizeof(u8) * hshg->m_entities_max);
+            f32*                 entities_vel     = hshg->m_entities_vel != nullptr ? (f32*)hshg->m_allocator->allocate(sizeof(f32) * 3 * hshg->m_entities_max) : nullptr;
+            f32*                 entities_half    = hshg->m_entities_half != nullptr ? (f32*)hshg->m_allocator->allocate(sizeof(f32) * 3 * hshg->m_entities_max) : nullptr;
+            span_t*              entities_span    = hshg->m_entities_span != nullptr ? (span_t*)hshg->m_allocator->allocate(sizeof(span_t) * hshg->m_entities_max) : nullptr;
+            u8*                  entities_payload = hshg->m_entities_payload != nullptr ? (u8*)hshg->m_allocator->allocate(hshg->m_payload_size * hshg->m_entities_max) : nullptr;
+            quant_t*             entities_quant   = hshg->m_entities_quant != nullptr ? (quant_t*)hshg->m_allocator->allocate(sizeof(quant_t) * hshg->m_entities_max) : nullptr;
+
+            if (entities == nullptr || entities_node == nullptr || entities_cell == nullptr || entities_grid == nullptr || entities_ref == nullptr || entities_flags == nullptr || (hshg->m_entities_vel != nullptr && entities_vel == nullptr) ||
+                (hshg->m_entities_half != nullptr && entities_half == nullptr) || (hshg->m_entities_span != nullptr && entities_span == nullptr) ||
+                (hshg->m_entities_payload != nullptr && entities_payload == nullptr) || (hshg->m_entities_quant != nullptr && entities_quant == nullptr))
+            {
+                hshg->m_allocator->deallocate(entities_vel);
+                hshg->m_allocator->deallocate(entities_half);
+                hshg->m_allocator->deallocate(entities_span);
+                hshg->m_allocator->deallocate(entities_payload);
+                hshg->m_allocator->deallocate(entities_quant);
+                hshg->m_allocator->deallocate(entities);
+                hshg->m_allocator->deallocate(entities_node);
+                hshg->m_allocator->deallocate(entities_cell);
+                hshg->m_allocator->deallocate(entities_grid);
+                hshg->m_allocator->deallocate(entities_ref);
+                hshg->m_allocator->deallocate(entities_flags);
                 return;
+            }
+
+            // the overflow entities get new indices as well
+            if (hshg->overflow_grid()->m_entities_len != 0)
+            {
+                hshg->m_overflow_dirty = 1;
+            }
 
             index_t  new_entity_idx = 0;
             index_t* cell           = hshg->m_cells;
@@ -944,9 +2089,36 @@ namespace ncore
                     *new_entity                   = hshg->m_entities[entity_idx];
                     entities_cell[new_entity_idx] = hshg->m_entities_cell[entity_idx];
                     entities_grid[new_entity_idx] = hshg->m_entities_grid[entity_idx];
-                    entities_ref[new_entity_idx]  = hshg->m_entities_ref[entity_idx];
+                    entities_ref[new_entity_idx]   = hshg->m_entities_ref[entity_idx];
+                    entities_flags[new_entity_idx] = hshg->m_entities_flags[entity_idx];
+                    if (entities_vel != nullptr)
+                    {
+                        entities_vel[new_entity_idx * 3 + 0] = hshg->m_entities_vel[entity_idx * 3 + 0];
+                        entities_vel[new_entity_idx * 3 + 1] = hshg->m_entities_vel[entity_idx * 3 + 1];
+                        entities_vel[new_entity_idx * 3 + 2] = hshg->m_entities_vel[entity_idx * 3 + 2];
+                    }
+                    if (entities_half != nullptr)
+                    {
+                        entities_half[new_entity_idx * 3 + 0] = hshg->m_entities_half[entity_idx * 3 + 0];
+                        entities_half[new_entity_idx * 3 + 1] = hshg->m_entities_half[entity_idx * 3 + 1];
+                        entities_half[new_entity_idx * 3 + 2] = hshg->m_entities_half[entity_idx * 3 + 2];
+                    }
+                    if (entities_span != nullptr)
+                    {
+                        entities_span[new_entity_idx] = hshg->m_entities_span[entity_idx];
+                        for (index_t node = entities_span[new_entity_idx].m_nodes; node != c_invalid_index; node = hshg->m_span_nodes[node].m_own_next)
+                            hshg->m_span_nodes[node].m_entity = new_entity_idx;
+                    }
+                    if (entities_payload != nullptr)
+                    {
+                        nmem::memcpy(entities_payload + new_entity_idx * hshg->m_payload_size, hshg->m_entities_payload + entity_idx * hshg->m_payload_size, hshg->m_payload_size);
+                    }
+                    if (entities_quant != nullptr)
+                    {
+                        entities_quant[new_entity_idx] = hshg->m_entities_quant[entity_idx];
+                    }
 
-                    entity_node_t const* const cur_entity_node = entities_node + new_entity_idx;
+                    entity_node_t const* const cur_entity_node = hshg->m_entities_node + entity_idx;
                     entity_node_t* const       new_entity_node = entities_node + new_entity_idx;
                     if (cur_entity_node->m_prev != c_invalid_index)
                     {
@@ -975,12 +2147,27 @@ namespace ncore
             hshg->m_allocator->deallocate(hshg->m_entities_cell);
             hshg->m_allocator->deallocate(hshg->m_entities_grid);
             hshg->m_allocator->deallocate(hshg->m_entities_ref);
+            hshg->m_allocator->deallocate(hshg->m_entities_flags);
+            hshg->m_allocator->deallocate(hshg->m_entities_vel);
+            hshg->m_allocator->deallocate(hshg->m_entities_half);
+            hshg->m_allocator->deallocate(hshg->m_entities_span);
+            hshg->m_allocator->deallocate(hshg->m_entities_payload);
+            hshg->m_allocator->deallocate(hshg->m_entities_quant);
 
             hshg->m_entities      = entities;
             hshg->m_entities_node = entities_node;
             hshg->m_entities_cell = entities_cell;
             hshg->m_entities_grid = entities_grid;
-            hshg->m_entities_ref  = entities_ref;
+            hshg->m_entities_ref     = entities_ref;
+            hshg->m_entities_flags   = entities_flags;
+            hshg->m_entities_vel     = entities_vel;
+            hshg->m_entities_half    = entities_half;
+            hshg->m_entities_span    = entities_span;
+            hshg->m_entities_payload = entities_payload;
+            hshg->m_entities_quant   = entities_quant;
+
+            // m_awake holds the old indices
+            hshg->m_bawake_lost = 1;
         }
     }  // namespace nhshg
 
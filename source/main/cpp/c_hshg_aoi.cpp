@@ -0,0 +1,541 @@
+#include "cbase/c_allocator.h"
+#include "cbase/c_debug.h"
+#include "cbase/c_integer.h"
+#include "cbase/c_float.h"
+#include "cbase/c_memory.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_aoi.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        // Returned by find_record(), a slot is a u32 whatever the width of index_t
+        const u32 c_no_record = 0xFFFFFFFF;
+
+        // A box, or a sphere of radius m_hx
+        struct aoi_shape_t
+        {
+            f32 m_x, m_y, m_z;
+            f32 m_hx, m_hy, m_hz;
+            u8  m_sphere;
+        };
+
+        struct aoi_observer_t
+        {
+            aoi_shape_t m_shape;        // in effect since the last hshg_aoi_update()
+            aoi_shape_t m_next;         // in effect after the next hshg_aoi_update()
+            u8          m_active;       // m_shape is in effect
+            u8          m_next_active;  // m_next will be in effect
+            u8          m_changed;      // in the list of changed observers
+        };
+
+        // An entity that is inside at least one observer, with the entity as it was at the
+        // last update. A slot is empty when m_inside is 0.
+        struct aoi_record_t
+        {
+            index_t  m_ref;
+            u32      m_inside;  // number of observers it is inside of
+            entity_t m_entity;
+        };
+
+        // An entity that was inserted, moved, resized or removed since the last update
+        struct aoi_change_t
+        {
+            index_t  m_ref;
+            entity_t m_entity;
+            u8       m_removed;
+        };
+
+        // A change slot is only valid when its stamp equals the current tick, so the set is
+        // emptied by just advancing the tick.
+        struct aoi_change_slot_t
+        {
+            index_t m_ref;
+            u32     m_stamp;
+            index_t m_change;  // index in m_changes
+        };
+
+        static inline u32 hash_u32(u32 h)
+        {
+            h ^= h >> 16;
+            h *= 0x85ebca6b;
+            h ^= h >> 13;
+            h *= 0xc2b2ae35;
+            h ^= h >> 16;
+            return h;
+        }
+
+        static inline bool shape_overlaps(const aoi_shape_t& shape, const entity_t* const entity)
+        {
+            if (shape.m_sphere)
+            {
+                const f32 dx = math::g_max(math::abs(shape.m_x - entity->x) - entity->r, 0.0f);
+                const f32 dy = math::g_max(math::abs(shape.m_y - entity->y) - entity->r, 0.0f);
+                const f32 dz = math::g_max(math::abs(shape.m_z - entity->z) - entity->r, 0.0f);
+                return dx * dx + dy * dy + dz * dz <= shape.m_hx * shape.m_hx;
+            }
+            return math::abs(shape.m_x - entity->x) <= shape.m_hx + entity->r && math::abs(shape.m_y - entity->y) <= shape.m_hy + entity->r && math::abs(shape.m_z - entity->z) <= shape.m_hz + entity->r;
+        }
+
+        class hshg_aoi_t : public observer_t
+        {
+        public:
+            DCORE_CLASS_PLACEMENT_NEW_DELETE
+
+            virtual void on_remove(hshg_t* hshg, index_t entity) { queue_change(hshg->m_entities_ref[entity], hshg->m_entities + entity, 1); }
+            virtual void on_move(hshg_t* hshg, index_t entity) { queue_change(hshg->m_entities_ref[entity], hshg->m_entities + entity, 0); }
+
+            // The last change of an entity within a tick wins
+            void queue_change(const index_t ref, const entity_t* const entity, const u8 removed)
+            {
+                u32 slot = hash_u32(ref) & m_change_slots_mask;
+                while (m_change_slots[slot].m_stamp == m_tick)
+                {
+                    if (m_change_slots[slot].m_ref == ref)
+                    {
+                        aoi_change_t& change = m_changes[m_change_slots[slot].m_change];
+                        change.m_entity      = *entity;
+                        change.m_removed     = removed;
+                        return;
+                    }
+                    slot = (slot + 1) & m_change_slots_mask;
+                }
+
+                if (!reserve_changes((u32)m_changes_len + 1))
+                {
+                    m_failed = true;
+                    return;
+                }
+
+                // the slots may have been rehashed
+                slot = hash_u32(ref) & m_change_slots_mask;
+                while (m_change_slots[slot].m_stamp == m_tick)
+                    slot = (slot + 1) & m_change_slots_mask;
+
+                aoi_change_t& change = m_changes[m_changes_len];
+                change.m_ref         = ref;
+                change.m_entity      = *entity;
+                change.m_removed     = removed;
+
+                m_change_slots[slot].m_ref    = ref;
+                m_change_slots[slot].m_stamp  = m_tick;
+                m_change_slots[slot].m_change = m_changes_len++;
+            }
+
+            // Keeps the change slots at most half full
+            bool reserve_changes(const u32 len)
+            {
+                if (len > m_changes_cap)
+                {
+                    const index_t       cap     = grow_capacity(len, m_changes_cap, 64);
+                    aoi_change_t* const changes = cap != 0 ? g_allocate_array<aoi_change_t>(m_allocator, cap) : nullptr;
+                    if (changes == nullptr)
+                        return false;
+                    if (m_changes != nullptr)
+                    {
+                        nmem::memcpy(changes, m_changes, sizeof(aoi_change_t) * m_changes_len);
+                        m_allocator->deallocate(m_changes);
+                    }
+                    m_changes     = changes;
+                    m_changes_cap = cap;
+                }
+
+                if (len * 2 > m_change_slots_mask)
+                {
+                    const u32                cap   = math::ceilpo2(math::g_max(len * 4, (u32)128));
+                    aoi_change_slot_t* const slots = g_allocate_array_and_clear<aoi_change_slot_t>(m_allocator, cap);
+                    if (slots == nullptr)
+                        return false;
+                    const u32 mask = cap - 1;
+                    for (index_t c = 0; c < m_changes_len; ++c)
+                    {
+                        u32 slot = hash_u32(m_changes[c].m_ref) & mask;
+                        while (slots[slot].m_stamp == m_tick)
+                            slot = (slot + 1) & mask;
+                        slots[slot].m_ref    = m_changes[c].m_ref;
+                        slots[slot].m_stamp  = m_tick;
+                        slots[slot].m_change = c;
+                    }
+                    m_allocator->deallocate(m_change_slots);
+                    m_change_slots      = slots;
+                    m_change_slots_mask = mask;
+                }
+                return true;
+            }
+
+            u32 find_record(const index_t ref) const
+            {
+                u32 slot = hash_u32(ref) & m_records_mask;
+                while (m_records[slot].m_inside != 0)
+                {
+                    if (m_records[slot].m_ref == ref)
+                        return slot;
+                    slot = (slot + 1) & m_records_mask;
+                }
+                return c_no_record;
+            }
+
+            bool insert_record(const index_t ref, const u32 inside, const entity_t* const entity)
+            {
+                if ((m_records_len + 1) * 2 > m_records_mask)
+                {
+                    const u32           cap     = math::ceilpo2(math::g_max((m_records_len + 1) * 4, (u32)128));
+                    aoi_record_t* const records = g_allocate_array_and_clear<aoi_record_t>(m_allocator, cap);
+                    if (records == nullptr)
+                        return false;
+                    const u32 mask = cap - 1;
+                    for (u32 r = 0; r <= m_records_mask; ++r)
+                    {
+                        if (m_records[r].m_inside == 0)
+                            continue;
+                        u32 slot = hash_u32(m_records[r].m_ref) & mask;
+                        while (records[slot].m_inside != 0)
+                            slot = (slot + 1) & mask;
+                        records[slot] = m_records[r];
+                    }
+                    m_allocator->deallocate(m_records);
+                    m_records      = records;
+                    m_records_mask = mask;
+                }
+
+                u32 slot = hash_u32(ref) & m_records_mask;
+                while (m_records[slot].m_inside != 0)
+                    slot = (slot + 1) & m_records_mask;
+                m_records[slot].m_ref    = ref;
+                m_records[slot].m_inside = inside;
+                m_records[slot].m_entity = *entity;
+                ++m_records_len;
+                return true;
+            }
+
+            // Linear probing removal by shifting the following entries of the cluster back
+            void erase_record(u32 slot)
+            {
+                u32 next = (slot + 1) & m_records_mask;
+                while (m_records[next].m_inside != 0)
+                {
+                    const u32 home = hash_u32(m_records[next].m_ref) & m_records_mask;
+                    if (((next - home) & m_records_mask) >= ((next - slot) & m_records_mask))
+                    {
+                        m_records[slot] = m_records[next];
+                        slot            = next;
+                    }
+                    next = (next + 1) & m_records_mask;
+                }
+                m_records[slot].m_inside = 0;
+                --m_records_len;
+            }
+
+            // Stores the entity 'ref' that is now inside 'inside' observers, 'slot' is its
+            // record or c_no_record when it had none.
+            void commit(const index_t ref, const u32 slot, const u32 inside, const entity_t* const entity)
+            {
+                if (slot != c_no_record)
+                {
+                    if (inside == 0)
+                    {
+                        erase_record(slot);
+                        return;
+                    }
+                    m_records[slot].m_inside = inside;
+                    m_records[slot].m_entity = *entity;
+                }
+                else if (inside != 0 && !insert_record(ref, inside, entity))
+                {
+                    m_failed = true;
+                }
+            }
+
+            void sort_observers()
+            {
+                m_sorted_len   = 0;
+                m_sorted_width = 0.0f;
+                for (u32 o = 0; o < m_observers_max; ++o)
+                {
+                    const aoi_observer_t& observer = m_observers[o];
+                    if (!observer.m_active)
+                        continue;
+                    axis_entry_t& entry = m_sorted[m_sorted_len++];
+                    entry.m_min         = observer.m_shape.m_x - observer.m_shape.m_hx;
+                    entry.m_max         = observer.m_shape.m_x + observer.m_shape.m_hx;
+                    entry.m_entity      = o;
+                    m_sorted_width      = math::g_max(m_sorted_width, observer.m_shape.m_hx + observer.m_shape.m_hx);
+                }
+                sort_axis_entries(m_sorted, m_sorted_len);
+            }
+
+            index_t add(const aoi_shape_t& shape)
+            {
+                for (u32 o = 0; o < m_observers_max; ++o)
+                {
+                    aoi_observer_t& observer = m_observers[o];
+                    if (observer.m_active || observer.m_changed)
+                        continue;
+                    observer.m_next        = shape;
+                    observer.m_next_active = 1;
+                    observer.m_changed     = 1;
+                    m_changed[m_changed_len++] = o;
+                    return o;
+                }
+                return c_invalid_index;
+            }
+
+            void set(const index_t o, const aoi_shape_t& shape, const u8 active)
+            {
+                ASSERT(o < m_observers_max);
+                aoi_observer_t& observer = m_observers[o];
+                ASSERT((observer.m_active || observer.m_changed) && "not an observer");
+                observer.m_next        = shape;
+                observer.m_next_active = active;
+                if (!observer.m_changed)
+                {
+                    observer.m_changed         = 1;
+                    m_changed[m_changed_len++] = o;
+                }
+            }
+
+            hshg_t*            m_hshg;
+            alloc_t*           m_allocator;
+            aoi_observer_t*    m_observers;
+            u32                m_observers_max;
+            index_t*           m_changed;  // observers that were added, changed or removed
+            u32                m_changed_len;
+            axis_entry_t*      m_sorted;  // the active observers sorted on their extent on x
+            u32                m_sorted_len;
+            f32                m_sorted_width;
+            aoi_record_t*      m_records;
+            u32                m_records_mask;
+            u32                m_records_len;
+            aoi_change_t*      m_changes;
+            index_t            m_changes_len;
+            index_t            m_changes_cap;
+            aoi_change_slot_t* m_change_slots;
+            u32                m_change_slots_mask;
+            u32                m_tick;
+            bool               m_failed;
+        };
+
+        hshg_aoi_t* hshg_aoi_create(alloc_t* allocator, hshg_t* hshg, const u32 max_observers)
+        {
+            void* mem = allocator->allocate(sizeof(hshg_aoi_t));
+            if (mem == nullptr)
+            {
+                return nullptr;
+            }
+
+            hshg_aoi_t* aoi          = new (mem) hshg_aoi_t();
+            aoi->m_hshg              = hshg;
+            aoi->m_allocator         = allocator;
+            aoi->m_observers         = g_allocate_array_and_clear<aoi_observer_t>(allocator, max_observers);
+            aoi->m_observers_max     = max_observers;
+            aoi->m_changed           = g_allocate_array<index_t>(allocator, max_observers);
+            aoi->m_changed_len       = 0;
+            aoi->m_sorted            = g_allocate_array<axis_entry_t>(allocator, max_observers);
+            aoi->m_sorted_len        = 0;
+            aoi->m_sorted_width      = 0.0f;
+            aoi->m_records           = g_allocate_array_and_clear<aoi_record_t>(allocator, 128);
+            aoi->m_records_mask      = 127;
+            aoi->m_records_len       = 0;
+            aoi->m_changes           = nullptr;
+            aoi->m_changes_len       = 0;
+            aoi->m_changes_cap       = 0;
+            aoi->m_change_slots      = nullptr;
+            aoi->m_change_slots_mask = 0;
+            aoi->m_tick              = 1;  // stamp 0 marks an empty change slot
+            aoi->m_failed            = false;
+
+            if (aoi->m_observers == nullptr || aoi->m_changed == nullptr || aoi->m_sorted == nullptr || aoi->m_records == nullptr || !aoi->reserve_changes(1))
+            {
+                hshg_aoi_free(aoi);
+                return nullptr;
+            }
+
+            hshg->add_observer(aoi);
+            return aoi;
+        }
+
+        void hshg_aoi_free(hshg_aoi_t* aoi)
+        {
+            aoi->m_hshg->remove_observer(aoi);
+
+            alloc_t* allocator = aoi->m_allocator;
+            allocator->deallocate(aoi->m_observers);
+            allocator->deallocate(aoi->m_changed);
+            allocator->deallocate(aoi->m_sorted);
+            allocator->deallocate(aoi->m_records);
+            allocator->deallocate(aoi->m_changes);
+            allocator->deallocate(aoi->m_change_slots);
+            allocator->deallocate(aoi);
+        }
+
+        static aoi_shape_t make_box(const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2)
+        {
+            ASSERT(x1 <= x2 && y1 <= y2 && z1 <= z2);
+            const aoi_shape_t shape = {(x1 + x2) * 0.5f, (y1 + y2) * 0.5f, (z1 + z2) * 0.5f, (x2 - x1) * 0.5f, (y2 - y1) * 0.5f, (z2 - z1) * 0.5f, 0};
+            return shape;
+        }
+
+        static aoi_shape_t make_sphere(const f32 x, const f32 y, const f32 z, const f32 r)
+        {
+            const aoi_shape_t shape = {x, y, z, r, r, r, 1};
+            return shape;
+        }
+
+        index_t hshg_aoi_add_box(hshg_aoi_t* aoi, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2) { return aoi->add(make_box(x1, y1, z1, x2, y2, z2)); }
+        index_t hshg_aoi_add_sphere(hshg_aoi_t* aoi, const f32 x, const f32 y, const f32 z, const f32 r) { return aoi->add(make_sphere(x, y, z, r)); }
+        void    hshg_aoi_set_box(hshg_aoi_t* aoi, const index_t observer, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2) { aoi->set(observer, make_box(x1, y1, z1, x2, y2, z2), 1); }
+        void    hshg_aoi_set_sphere(hshg_aoi_t* aoi, const index_t observer, const f32 x, const f32 y, const f32 z, const f32 r) { aoi->set(observer, make_sphere(x, y, z, r), 1); }
+        void    hshg_aoi_remove(hshg_aoi_t* aoi, const index_t observer) { aoi->set(observer, aoi->m_observers[observer].m_next, 0); }
+
+        // The observers a changed entity may have entered or left, those overlapping its
+        // old or its new extent on x
+        struct aoi_change_visitor_t
+        {
+            hshg_aoi_t*         m_aoi;
+            const aoi_record_t* m_record;  // nullptr when it was not inside any observer
+            const aoi_change_t* m_change;
+            u32                 m_inside;
+            aoi_func_t*         m_handler;
+
+            inline void operator()(const index_t o)
+            {
+                const aoi_shape_t& shape = m_aoi->m_observers[o].m_shape;
+                const bool         was   = m_record != nullptr && shape_overlaps(shape, &m_record->m_entity);
+                const bool         now   = !m_change->m_removed && shape_overlaps(shape, &m_change->m_entity);
+                if (was == now)
+                    return;
+
+                if (now)
+                {
+                    ++m_inside;
+                    m_handler->enter(o, m_change->m_ref);
+                }
+                else
+                {
+                    --m_inside;
+                    m_handler->leave(o, m_change->m_ref);
+                }
+            }
+        };
+
+        // The entities a changed observer may have gained or lost, those overlapping its old
+        // or its new shape
+        class aoi_observer_query_t final : public query_func_t
+        {
+        public:
+            void query(entity_t const* entity, index_t ref) override final
+            {
+                const u32           slot   = m_aoi->find_record(ref);
+                const aoi_record_t* record = slot != c_no_record ? m_aoi->m_records + slot : nullptr;
+                const bool          was    = m_observer->m_active && record != nullptr && shape_overlaps(m_observer->m_shape, &record->m_entity);
+                const bool          now    = m_observer->m_next_active && shape_overlaps(m_observer->m_next, entity);
+                if (was == now)
+                    return;
+
+                u32 inside = record != nullptr ? record->m_inside : 0;
+                if (now)
+                {
+                    ++inside;
+                    m_handler->enter(m_index, ref);
+                }
+                else
+                {
+                    --inside;
+                    m_handler->leave(m_index, ref);
+                }
+                m_aoi->commit(ref, slot, inside, entity);
+            }
+
+            hshg_aoi_t*           m_aoi;
+            const aoi_observer_t* m_observer;
+            index_t               m_index;
+            aoi_func_t*           m_handler;
+        };
+
+        static void extend_bounds(const aoi_shape_t& shape, const bool first, f32* const min, f32* const max)
+        {
+            const f32* const c = &shape.m_x;
+            const f32* const h = &shape.m_hx;
+            for (u32 a = 0; a < 3; ++a)
+            {
+                min[a] = first ? c[a] - h[a] : math::g_min(min[a], c[a] - h[a]);
+                max[a] = first ? c[a] + h[a] : math::g_max(max[a], c[a] + h[a]);
+            }
+        }
+
+        bool hshg_aoi_update(hshg_aoi_t* aoi, aoi_func_t* const handler)
+        {
+            hshg_t* const hshg = aoi->m_hshg;
+            ASSERT(!hshg->calling() && "aoi_update() may not be called from any callback");
+
+            // The changed entities against the observers as they were, this leaves every
+            // record at the current state of its entity.
+            for (index_t c = 0; c < aoi->m_changes_len; ++c)
+            {
+                const aoi_change_t* const change = aoi->m_changes + c;
+                const u32                 slot   = aoi->find_record(change->m_ref);
+                const aoi_record_t* const record = slot != c_no_record ? aoi->m_records + slot : nullptr;
+
+                f32 x1 = change->m_entity.x - change->m_entity.r;
+                f32 x2 = change->m_entity.x + change->m_entity.r;
+                if (record != nullptr)
+                {
+                    x1 = math::g_min(x1, record->m_entity.x - record->m_entity.r);
+                    x2 = math::g_max(x2, record->m_entity.x + record->m_entity.r);
+                }
+
+                aoi_change_visitor_t visitor = {aoi, record, change, record != nullptr ? record->m_inside : 0, handler};
+                visit_sorted_range(aoi->m_sorted, aoi->m_sorted_len, aoi->m_sorted_width, x1, x2, visitor);
+                aoi->commit(change->m_ref, slot, visitor.m_inside, &change->m_entity);
+            }
+            aoi->m_changes_len = 0;
+            if (++aoi->m_tick == 0)
+            {
+                nmem::memset(aoi->m_change_slots, 0, sizeof(aoi_change_slot_t) * (aoi->m_change_slots_mask + 1));
+                aoi->m_tick = 1;
+            }
+
+            // Then the changed observers against the entities as they are now
+            if (aoi->m_changed_len != 0)
+            {
+                hshg->update_cache();
+
+                aoi_observer_query_t query;
+                query.m_aoi     = aoi;
+                query.m_handler = handler;
+                for (u32 c = 0; c < aoi->m_changed_len; ++c)
+                {
+                    const index_t   o        = aoi->m_changed[c];
+                    aoi_observer_t& observer = aoi->m_observers[o];
+
+                    if (observer.m_active || observer.m_next_active)
+                    {
+                        f32 min[3];
+                        f32 max[3];
+                        if (observer.m_active)
+                            extend_bounds(observer.m_shape, true, min, max);
+                        if (observer.m_next_active)
+                            extend_bounds(observer.m_next, !observer.m_active, min, max);
+
+                        query.m_observer = &observer;
+                        query.m_index    = o;
+                        query_common(hshg, min[0], min[1], min[2], max[0], max[1], max[2], &query, nullptr);
+                    }
+
+                    observer.m_shape   = observer.m_next;
+                    observer.m_active  = observer.m_next_active;
+                    observer.m_changed = 0;
+                }
+                aoi->m_changed_len = 0;
+                aoi->sort_observers();
+            }
+
+            const bool failed = aoi->m_failed;
+            aoi->m_failed     = false;
+            return !failed;
+        }
+
+    }  // namespace nhshg
+}  // namespace ncore
@@ -0,0 +1,87 @@
+#include "cbase/c_allocator.h"
+#include "cbase/c_debug.h"
+#include "cbase/c_integer.h"
+#include "cbase/c_float.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_box.h"
+#include "chshg/c_hshg_span.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        bool hshg_enable_boxes(hshg_t* const hshg)
+        {
+            ASSERT(!hshg->calling() && "enable_boxes() may not be called from any callback");
+            ASSERT(!hshg->is_viewed() && "enable_boxes() may not be called while a view is acquired");
+            if (hshg->m_entities_half == nullptr)
+            {
+                f32* const half = g_allocate_array<f32>(hshg->m_allocator, hshg->m_entities_max * 3);
+                if (half == nullptr)
+                {
+                    return false;
+                }
+                for (index_t i = 0; i < hshg->m_entities_used; ++i)
+                {
+                    half[i * 3 + 0] = hshg->m_entities[i].r;
+                    half[i * 3 + 1] = hshg->m_entities[i].r;
+                    half[i * 3 + 2] = hshg->m_entities[i].r;
+                }
+                hshg->m_entities_half = half;
+
+                // the sorted overflow set now uses the half extents on x
+                hshg->m_overflow_dirty = 1;
+            }
+            return true;
+        }
+
+        index_t hshg_insert_box(hshg_t* const hshg, const f32 x, const f32 y, const f32 z, const f32 hx, const f32 hy, const f32 hz, const index_t ref)
+        {
+            ASSERT(hx >= 0.0f && hy >= 0.0f && hz >= 0.0f);
+            if (!hshg_enable_boxes(hshg))
+            {
+                return c_invalid_index;
+            }
+
+            const index_t idx = hshg_insert(hshg, x, y, z, math::g_max(hx, math::g_max(hy, hz)), ref);
+            if (idx != c_invalid_index)
+            {
+                f32* const half = hshg->m_entities_half + (idx * 3);
+                half[0]         = hx;
+                half[1]         = hy;
+                half[2]         = hz;
+            }
+            return idx;
+        }
+
+        void hshg_resize_box(hshg_t* const hshg, const index_t entity, const f32 hx, const f32 hy, const f32 hz)
+        {
+            ASSERT(hshg->m_entities_half != nullptr && "call hshg_enable_boxes() first");
+            if (hshg->is_span(entity))
+            {
+                hshg_resize_span(hshg, entity, hx, hy, hz);
+                return;
+            }
+
+            hshg->m_entities[entity].r = math::g_max(hx, math::g_max(hy, hz));
+            hshg_resize(hshg, entity);
+
+            f32* const half = hshg->m_entities_half + (entity * 3);
+            half[0]         = hx;
+            half[1]         = hy;
+            half[2]         = hz;
+        }
+
+        void hshg_get_box(hshg_t const* const hshg, const index_t entity, f32& hx, f32& hy, f32& hz)
+        {
+            ASSERT(entity < hshg->m_entities_used);
+            f32 half[3];
+            entity_half_extents(hshg, entity, half);
+            hx = half[0];
+            hy = half[1];
+            hz = half[2];
+        }
+
+    }  // namespace nhshg
+}  // namespace ncore
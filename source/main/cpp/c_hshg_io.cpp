@@ -0,0 +1,377 @@
+#include "cbase/c_allocator.h"
+#include "cbase/c_debug.h"
+#include "cbase/c_integer.h"
+#include "cbase/c_memory.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_box.h"
+#include "chshg/c_hshg_io.h"
+#include "chshg/c_hshg_payload.h"
+#include "chshg/c_hshg_quantized.h"
+#include "chshg/c_hshg_swept.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        const u32 c_file_magic   = 0x47485348;  // 'HSHG'
+        const u32 c_file_version = 7;
+        const u32 c_file_align   = 64;
+
+        enum
+        {
+            SECTION_GRIDS,  // file_grid_t per grid, the overflow grid last
+            SECTION_CELLS,
+            SECTION_ENTITIES,
+            SECTION_NODE,
+            SECTION_CELL,
+            SECTION_GRID,
+            SECTION_REF,
+            SECTION_FLAGS,
+            SECTION_VEL,      // offset 0 when the HSHG has no velocities
+            SECTION_HALF,     // offset 0 when the HSHG has no boxes
+            SECTION_SPAN,     // offset 0 when the HSHG never had a span
+            SECTION_PAYLOAD,  // offset 0 when the HSHG has no payload
+            SECTION_QUANT,    // offset 0 when the HSHG has no quantized column
+            SECTION_COUNT
+        };
+
+        struct file_grid_t
+        {
+            u32 m_entities_len;
+            u32 m_shift;
+        };
+
+        struct file_header_t
+        {
+            u32 m_magic;
+            u32 m_version;
+            u32 m_header_size;
+            u32 m_side;
+            u32 m_size;
+            u32 m_grids_len;
+            u32 m_cells_len;
+            u32 m_entities_max;
+            u32 m_entities_used;
+            u32 m_old_cache;
+            u32 m_new_cache;
+            u32 m_payload_size;  // 0 when the HSHG has no payload
+            u32 m_ghosts_len;    // so hshg_map() does not count them
+            u64 m_file_size;
+            u64 m_sections[SECTION_COUNT];  // offsets from the start of the image
+            u64 m_sections_size[SECTION_COUNT];
+        };
+
+        static inline u64 file_round(const u64 size) { return (size + (c_file_align - 1)) & ~(u64)(c_file_align - 1); }
+
+        // Assigns the 64 byte aligned offsets of all sections and the size of the image
+        static void layout(file_header_t& header, const bool has_vel, const bool has_half, const bool has_span, const bool has_quant)
+        {
+            const u64 max = header.m_entities_max;
+
+            header.m_sections_size[SECTION_GRIDS]    = sizeof(file_grid_t) * (header.m_grids_len + 1);
+            header.m_sections_size[SECTION_CELLS]    = sizeof(index_t) * (u64)header.m_cells_len;
+            header.m_sections_size[SECTION_ENTITIES] = sizeof(entity_t) * max;
+            header.m_sections_size[SECTION_NODE]     = sizeof(entity_node_t) * max;
+            header.m_sections_size[SECTION_CELL]     = sizeof(cell_sq_t) * max;
+            header.m_sections_size[SECTION_GRID]     = sizeof(u8) * max;
+            header.m_sections_size[SECTION_REF]      = sizeof(index_t) * max;
+            header.m_sections_size[SECTION_FLAGS]    = sizeof(u8) * max;
+            header.m_sections_size[SECTION_VEL]      = has_vel ? sizeof(f32) * 3 * max : 0;
+            header.m_sections_size[SECTION_HALF]     = has_half ? sizeof(f32) * 3 * max : 0;
+            header.m_sections_size[SECTION_SPAN]     = has_span ? sizeof(span_t) * max : 0;
+            header.m_sections_size[SECTION_PAYLOAD]  = (u64)header.m_payload_size * max;
+            header.m_sections_size[SECTION_QUANT]    = has_quant ? sizeof(quant_t) * max : 0;
+
+            u64 offset = file_round(sizeof(file_header_t));
+            for (u32 i = 0; i < SECTION_COUNT; ++i)
+            {
+                header.m_sections[i] = header.m_sections_size[i] > 0 ? offset : 0;
+                offset += file_round(header.m_sections_size[i]);
+            }
+            header.m_file_size = offset;
+        }
+
+        // Returns the header when 'data' holds a complete image that this code can read
+        static const file_header_t* validate(void const* data, const int_t size)
+        {
+            if (data == nullptr || size < (int_t)sizeof(file_header_t))
+                return nullptr;
+
+            const file_header_t* const header = (const file_header_t*)data;
+            if (header->m_magic != c_file_magic || header->m_version != c_file_version || header->m_header_size != sizeof(file_header_t))
+                return nullptr;
+            if (!math::ispo2(header->m_side) || !math::ispo2(header->m_size) || header->m_side < 2)
+                return nullptr;
+
+            // before anything asserts on them, an image of a build with wider types may not fit
+            if (header->m_side > c_max_side || header->m_entities_max > c_invalid_index)
+                return nullptr;
+            if (header->m_grids_len != compute_max_grids(header->m_side) || header->m_cells_len != compute_cells_len(header->m_side))
+                return nullptr;
+            if (header->m_entities_used > header->m_entities_max || header->m_ghosts_len > header->m_entities_used)
+                return nullptr;
+            if ((header->m_payload_size & 3) != 0)
+                return nullptr;
+
+            // the offsets must be exactly those that hshg_save() writes
+            file_header_t expected = *header;
+            layout(expected, header->m_sections_size[SECTION_VEL] != 0, header->m_sections_size[SECTION_HALF] != 0, header->m_sections_size[SECTION_SPAN] != 0, header->m_sections_size[SECTION_QUANT] != 0);
+            if (expected.m_file_size != header->m_file_size || header->m_file_size > (u64)size)
+                return nullptr;
+            for (u32 i = 0; i < SECTION_COUNT; ++i)
+            {
+                if (expected.m_sections[i] != header->m_sections[i] || expected.m_sections_size[i] != header->m_sections_size[i])
+                    return nullptr;
+            }
+            return header;
+        }
+
+        template <typename T>
+        static inline T* section(void const* data, const file_header_t* header, const u32 section)
+        {
+            return header->m_sections[section] == 0 ? nullptr : (T*)((u8*)data + header->m_sections[section]);
+        }
+
+        int_t hshg_save(hshg_t const* hshg, void* buffer, const int_t buffer_size)
+        {
+            ASSERT(!hshg->calling() && "save() may not be called from any callback");
+            ASSERT(hshg->m_removed_len == 0 && "save() does not store the removals of remove_concurrent(), call hshg_flush() first");
+
+            file_header_t header;
+            nmem::memset(&header, 0, sizeof(header));
+            header.m_magic         = c_file_magic;
+            header.m_version       = c_file_version;
+            header.m_header_size   = sizeof(file_header_t);
+            header.m_side          = hshg->m_grids[0].m_cells_side;
+            header.m_size          = hshg->m_cell_size;
+            header.m_grids_len     = hshg->m_grids_len;
+            header.m_cells_len     = hshg->m_cells_len;
+            header.m_entities_max  = hshg->m_entities_max;
+            header.m_entities_used = hshg->m_entities_used;
+            header.m_old_cache     = hshg->m_old_cache;
+            header.m_new_cache     = hshg->m_new_cache;
+            header.m_payload_size  = hshg->m_entities_payload != nullptr ? hshg->m_payload_size : 0;
+            header.m_ghosts_len    = hshg->m_ghosts_len;
+            layout(header, hshg->m_entities_vel != nullptr, hshg->m_entities_half != nullptr, hshg->m_entities_span != nullptr, hshg->m_entities_quant != nullptr);
+
+            if (buffer == nullptr || (u64)buffer_size < header.m_file_size)
+                return (int_t)header.m_file_size;
+
+            // clear first, then the padding and the unused entity slots are deterministic
+            nmem::memset(buffer, 0, (int_t)header.m_file_size);
+            nmem::memcpy(buffer, &header, sizeof(header));
+
+            file_grid_t* const grids = section<file_grid_t>(buffer, &header, SECTION_GRIDS);
+            for (u8 i = 0; i <= hshg->m_grids_len; ++i)
+            {
+                grids[i].m_entities_len = hshg->m_grids[i].m_entities_len;
+                grids[i].m_shift        = hshg->m_grids[i].m_shift;
+            }
+
+            const index_t used = hshg->m_entities_used;
+            nmem::memcpy(section<index_t>(buffer, &header, SECTION_CELLS), hshg->m_cells, sizeof(index_t) * hshg->m_cells_len);
+            nmem::memcpy(section<entity_t>(buffer, &header, SECTION_ENTITIES), hshg->m_entities, sizeof(entity_t) * used);
+            nmem::memcpy(section<entity_node_t>(buffer, &header, SECTION_NODE), hshg->m_entities_node, sizeof(entity_node_t) * used);
+            nmem::memcpy(section<cell_sq_t>(buffer, &header, SECTION_CELL), hshg->m_entities_cell, sizeof(cell_sq_t) * used);
+            nmem::memcpy(section<u8>(buffer, &header, SECTION_GRID), hshg->m_entities_grid, sizeof(u8) * used);
+            nmem::memcpy(section<index_t>(buffer, &header, SECTION_REF), hshg->m_entities_ref, sizeof(index_t) * used);
+            nmem::memcpy(section<u8>(buffer, &header, SECTION_FLAGS), hshg->m_entities_flags, sizeof(u8) * used);
+            if (hshg->m_entities_vel != nullptr)
+                nmem::memcpy(section<f32>(buffer, &header, SECTION_VEL), hshg->m_entities_vel, sizeof(f32) * 3 * used);
+            if (hshg->m_entities_half != nullptr)
+                nmem::memcpy(section<f32>(buffer, &header, SECTION_HALF), hshg->m_entities_half, sizeof(f32) * 3 * used);
+            if (hshg->m_entities_span != nullptr)
+                nmem::memcpy(section<span_t>(buffer, &header, SECTION_SPAN), hshg->m_entities_span, sizeof(span_t) * used);
+            if (hshg->m_entities_payload != nullptr)
+                nmem::memcpy(section<u8>(buffer, &header, SECTION_PAYLOAD), hshg->m_entities_payload, hshg->m_payload_size * used);
+            if (hshg->m_entities_quant != nullptr)
+                nmem::memcpy(section<quant_t>(buffer, &header, SECTION_QUANT), hshg->m_entities_quant, sizeof(quant_t) * used);
+
+            return (int_t)header.m_file_size;
+        }
+
+        // Restores the per grid state and the counters that are not part of any array
+        static void restore_state(hshg_t* const hshg, void const* data, const file_header_t* header)
+        {
+            const file_grid_t* const grids = section<file_grid_t>(data, header, SECTION_GRIDS);
+            for (u8 i = 0; i <= hshg->m_grids_len; ++i)
+            {
+                hshg->m_grids[i].m_entities_len = grids[i].m_entities_len;
+                hshg->m_grids[i].m_shift        = (u8)grids[i].m_shift;
+            }
+            hshg->m_entities_used  = header->m_entities_used;
+            hshg->m_overflow_dirty = 1;
+            hshg->m_old_cache      = header->m_old_cache;
+            hshg->m_new_cache      = header->m_new_cache;
+            hshg->m_ghosts_len     = header->m_ghosts_len;
+        }
+
+        // Checks that every index in the arrays of a loaded image is in range, and that the
+        // grids agree with the entities, so a damaged image can not index out of bounds
+        static bool validate_arrays(const hshg_t* const hshg)
+        {
+            const index_t used = hshg->m_entities_used;
+            for (cell_sq_t c = 0; c < hshg->m_cells_len; ++c)
+            {
+                if (hshg->m_cells[c] != c_invalid_index && hshg->m_cells[c] >= used)
+                    return false;
+            }
+
+            u32 entities_len[32] = {0};
+            u32 ghosts_len       = 0;
+            for (index_t i = 0; i < used; ++i)
+            {
+                if (hshg->m_entities_flags[i] & c_entity_ghost)
+                    ++ghosts_len;
+
+                const entity_node_t& node = hshg->m_entities_node[i];
+                if ((node.m_next != c_invalid_index && node.m_next >= used) || (node.m_prev != c_invalid_index && node.m_prev >= used))
+                    return false;
+
+                const u8 g = hshg->m_entities_grid[i];
+                if (g > hshg->m_grids_len)
+                    return false;
+                const grid_t* const grid = hshg->m_grids + g;
+                if (hshg->m_entities_cell[i] >= (u32)grid->m_cells_sq * grid->m_cells_side)
+                    return false;
+                if (hshg->is_span(i) && g != hshg->m_grids_len)
+                    return false;
+                ++entities_len[g];
+            }
+            if (ghosts_len != hshg->m_ghosts_len)
+                return false;
+
+            // the active grids are chained by m_shift, the chain may not leave the grids
+            for (u8 g = 0; g <= hshg->m_grids_len; ++g)
+            {
+                const grid_t* const grid = hshg->m_grids + g;
+                if (grid->m_entities_len != entities_len[g])
+                    return false;
+                if (grid->m_shift != 0 && (u32)g + grid->m_shift >= hshg->m_grids_len)
+                    return false;
+            }
+            return true;
+        }
+
+        hshg_t* hshg_load(alloc_t* allocator, void const* data, const int_t size)
+        {
+            const file_header_t* const header = validate(data, size);
+            if (header == nullptr)
+            {
+                return nullptr;
+            }
+
+            hshg_t* const hshg = hshg_create(allocator, header->m_side, header->m_size, header->m_entities_max);
+            if (hshg == nullptr)
+            {
+                return nullptr;
+            }
+
+            if ((header->m_sections[SECTION_VEL] != 0 && !hshg_enable_velocities(hshg)) || (header->m_sections[SECTION_HALF] != 0 && !hshg_enable_boxes(hshg)) ||
+                (header->m_sections[SECTION_SPAN] != 0 && !hshg->enable_spans()) || (header->m_payload_size != 0 && !hshg_enable_payload(hshg, header->m_payload_size)) ||
+                (header->m_sections[SECTION_QUANT] != 0 && !hshg_enable_quantized(hshg)))
+            {
+                hshg_free(hshg);
+                return nullptr;
+            }
+
+            const index_t used = header->m_entities_used;
+            nmem::memcpy(hshg->m_cells, section<index_t>(data, header, SECTION_CELLS), sizeof(index_t) * hshg->m_cells_len);
+            nmem::memcpy(hshg->m_entities, section<entity_t>(data, header, SECTION_ENTITIES), sizeof(entity_t) * used);
+            nmem::memcpy(hshg->m_entities_node, section<entity_node_t>(data, header, SECTION_NODE), sizeof(entity_node_t) * used);
+            nmem::memcpy(hshg->m_entities_cell, section<cell_sq_t>(data, header, SECTION_CELL), sizeof(cell_sq_t) * used);
+            nmem::memcpy(hshg->m_entities_grid, section<u8>(data, header, SECTION_GRID), sizeof(u8) * used);
+            nmem::memcpy(hshg->m_entities_ref, section<index_t>(data, header, SECTION_REF), sizeof(index_t) * used);
+            nmem::memcpy(hshg->m_entities_flags, section<u8>(data, header, SECTION_FLAGS), sizeof(u8) * used);
+            if (hshg->m_entities_vel != nullptr)
+                nmem::memcpy(hshg->m_entities_vel, section<f32>(data, header, SECTION_VEL), sizeof(f32) * 3 * used);
+            if (hshg->m_entities_half != nullptr)
+                nmem::memcpy(hshg->m_entities_half, section<f32>(data, header, SECTION_HALF), sizeof(f32) * 3 * used);
+            if (hshg->m_entities_span != nullptr)
+                nmem::memcpy(hshg->m_entities_span, section<span_t>(data, header, SECTION_SPAN), sizeof(span_t) * used);
+            if (hshg->m_entities_payload != nullptr)
+                nmem::memcpy(hshg->m_entities_payload, section<u8>(data, header, SECTION_PAYLOAD), hshg->m_payload_size * used);
+            if (hshg->m_entities_quant != nullptr)
+                nmem::memcpy(hshg->m_entities_quant, section<quant_t>(data, header, SECTION_QUANT), sizeof(quant_t) * used);
+
+            restore_state(hshg, data, header);
+            if (!validate_arrays(hshg) || !hshg->relink_spans())
+            {
+                hshg_free(hshg);
+                return nullptr;
+            }
+            return hshg;
+        }
+
+        hshg_t* hshg_map(alloc_t* allocator, void* data, const int_t size)
+        {
+            ASSERT(((uint_t)data & (c_file_align - 1)) == 0 && "map() wants a 64 byte aligned image");
+            const file_header_t* const header = validate(data, size);
+            if (header == nullptr || ((uint_t)data & (sizeof(u64) - 1)) != 0 || header->m_file_size > (u64)0xFFFFFFFF)
+            {
+                return nullptr;
+            }
+
+            // An arena without blocks over the image, everything is allocated from the parent
+            // and the arrays that point into the image are never freed.
+            void* const mem = allocator->allocate(sizeof(arena_alloc_t));
+            if (mem == nullptr)
+            {
+                return nullptr;
+            }
+            arena_alloc_t* const arena = new (mem) arena_alloc_t(allocator, mem, (u8*)data, (u32)header->m_file_size);
+            arena->m_blocks_len        = 0;
+
+            const cell_t   side      = header->m_side;
+            const u8       grids_len = (u8)header->m_grids_len;
+            index_t* const cells     = section<index_t>(data, header, SECTION_CELLS);
+            grid_t* const  grids     = g_allocate_array<grid_t>(arena, grids_len + 1);
+            void* const    hshg_mem  = arena->allocate(sizeof(hshg_t));
+            if (grids == nullptr || hshg_mem == nullptr)
+            {
+                arena->deallocate(grids);
+                arena->deallocate(hshg_mem);
+                arena->~arena_alloc_t();
+                allocator->deallocate(mem);
+                return nullptr;
+            }
+            init_grids(grids, grids_len, cells, side, header->m_size);
+
+            hshg_t* const hshg       = new (hshg_mem) hshg_t(cells, grids, header->m_size, header->m_cells_len, grids_len, (u32)side * header->m_size, header->m_entities_max);
+            hshg->m_allocator        = arena;
+            hshg->m_arena            = arena;
+            hshg->m_entities         = section<entity_t>(data, header, SECTION_ENTITIES);
+            hshg->m_entities_node    = section<entity_node_t>(data, header, SECTION_NODE);
+            hshg->m_entities_cell    = section<cell_sq_t>(data, header, SECTION_CELL);
+            hshg->m_entities_grid    = section<u8>(data, header, SECTION_GRID);
+            hshg->m_entities_ref     = section<index_t>(data, header, SECTION_REF);
+            hshg->m_entities_flags   = section<u8>(data, header, SECTION_FLAGS);
+            hshg->m_entities_vel     = section<f32>(data, header, SECTION_VEL);
+            hshg->m_entities_half    = section<f32>(data, header, SECTION_HALF);
+            hshg->m_entities_span    = section<span_t>(data, header, SECTION_SPAN);
+            hshg->m_entities_payload = section<u8>(data, header, SECTION_PAYLOAD);
+            hshg->m_entities_quant   = section<quant_t>(data, header, SECTION_QUANT);
+            hshg->m_payload_size     = header->m_payload_size;
+            hshg->m_inserted         = g_allocate_array<index_t>(arena, header->m_entities_max);
+            hshg->m_removed          = g_allocate_array<index_t>(arena, header->m_entities_max);
+            if (hshg->m_inserted == nullptr || hshg->m_removed == nullptr)
+            {
+                hshg_free(hshg);
+                return nullptr;
+            }
+
+            binmap_t::config_t cfg = binmap_t::config_t::compute(header->m_entities_max);
+            hshg->m_free_entities.init_all_used(cfg, arena);
+
+            restore_state(hshg, data, header);
+            if (!hshg->relink_spans())
+            {
+                hshg_free(hshg);
+                return nullptr;
+            }
+            return hshg;
+        }
+
+    }  // namespace nhshg
+}  // namespace ncore
@@ -0,0 +1,280 @@
+#include "cbase/c_allocator.h"
+#include "cbase/c_debug.h"
+#include "cbase/c_integer.h"
+#include "cbase/c_float.h"
+#include "cbase/c_memory.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_neighbor_lists.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        class hshg_neighbor_lists_t
+        {
+        public:
+            DCORE_CLASS_PLACEMENT_NEW_DELETE
+
+            // Makes room for 'len' entities, returns false when out of memory
+            bool reserve_entities(const index_t len)
+            {
+                if (len <= m_entities_cap)
+                    return true;
+
+                index_t* const  offsets  = g_allocate_array<index_t>(m_allocator, len + 1);
+                entity_t* const entities = g_allocate_array<entity_t>(m_allocator, len);
+                index_t* const  refs     = g_allocate_array<index_t>(m_allocator, len);
+                if (offsets == nullptr || entities == nullptr || refs == nullptr)
+                {
+                    m_allocator->deallocate(offsets);
+                    m_allocator->deallocate(entities);
+                    m_allocator->deallocate(refs);
+                    return false;
+                }
+
+                m_allocator->deallocate(m_offsets);
+                m_allocator->deallocate(m_entities);
+                m_allocator->deallocate(m_refs);
+                m_offsets      = offsets;
+                m_entities     = entities;
+                m_refs         = refs;
+                m_entities_cap = len;
+                return true;
+            }
+
+            // Makes room for the half extents of 'len' entities, returns false when out of memory
+            bool reserve_halves(const index_t len)
+            {
+                if (len <= m_halves_cap)
+                    return true;
+
+                f32* const halves = g_allocate_array<f32>(m_allocator, (u32)len * 3);
+                if (halves == nullptr)
+                    return false;
+
+                m_allocator->deallocate(m_halves);
+                m_halves     = halves;
+                m_halves_cap = len;
+                return true;
+            }
+
+            void push(const index_t n)
+            {
+                if (m_neighbors_len == m_neighbors_cap)
+                {
+                    const index_t  cap       = grow_capacity((u32)m_neighbors_len + 1, m_neighbors_cap, 64);
+                    index_t* const neighbors = cap != 0 ? g_allocate_array<index_t>(m_allocator, cap) : nullptr;
+                    if (neighbors == nullptr)
+                    {
+                        m_failed = true;
+                        return;
+                    }
+                    if (m_neighbors != nullptr)
+                    {
+                        nmem::memcpy(neighbors, m_neighbors, sizeof(index_t) * m_neighbors_len);
+                        m_allocator->deallocate(m_neighbors);
+                    }
+                    m_neighbors     = neighbors;
+                    m_neighbors_cap = cap;
+                }
+                m_neighbors[m_neighbors_len++] = n;
+            }
+
+            alloc_t*  m_allocator;
+            index_t   m_len;  // entities at the build
+            index_t   m_entities_cap;
+            index_t*  m_offsets;   // m_len + 1, the neighbours of entity i are [m_offsets[i], m_offsets[i + 1])
+            entity_t* m_entities;  // the entities at the build
+            index_t*  m_refs;      // the refs at the build, to see that the entities were not reordered
+            f32*      m_halves;    // the half extents at the build, when the HSHG has spans
+            index_t   m_halves_cap;
+            bool      m_spans;  // the build copied the half extents
+            index_t*  m_neighbors;
+            index_t   m_neighbors_len;
+            index_t   m_neighbors_cap;
+            f32       m_skin;
+            bool      m_failed;
+        };
+
+        hshg_neighbor_lists_t* hshg_neighbor_lists_create(alloc_t* allocator)
+        {
+            void* mem = allocator->allocate(sizeof(hshg_neighbor_lists_t));
+            if (mem == nullptr)
+            {
+                return nullptr;
+            }
+
+            hshg_neighbor_lists_t* lists = new (mem) hshg_neighbor_lists_t();
+            lists->m_allocator           = allocator;
+            lists->m_len                 = 0;
+            lists->m_entities_cap        = 0;
+            lists->m_offsets             = nullptr;
+            lists->m_entities            = nullptr;
+            lists->m_refs                = nullptr;
+            lists->m_halves              = nullptr;
+            lists->m_halves_cap          = 0;
+            lists->m_spans               = false;
+            lists->m_neighbors           = nullptr;
+            lists->m_neighbors_len       = 0;
+            lists->m_neighbors_cap       = 0;
+            lists->m_skin                = 0.0f;
+            lists->m_failed              = false;
+            return lists;
+        }
+
+        void hshg_neighbor_lists_free(hshg_neighbor_lists_t* lists)
+        {
+            alloc_t* allocator = lists->m_allocator;
+            allocator->deallocate(lists->m_offsets);
+            allocator->deallocate(lists->m_entities);
+            allocator->deallocate(lists->m_refs);
+            allocator->deallocate(lists->m_halves);
+            allocator->deallocate(lists->m_neighbors);
+            allocator->deallocate(lists);
+        }
+
+        // Collects the entities overlapping the box of entity 'i' grown by the skin, which are
+        // those that overlap it when both are grown by half the skin. The box of a span is its
+        // box, that of any other entity its hypercube.
+        struct neighbor_visitor_t
+        {
+            const hshg_t*          m_hshg;
+            hshg_neighbor_lists_t* m_lists;
+            index_t                m_i;
+            f32                    m_x1, m_y1, m_z1;
+            f32                    m_x2, m_y2, m_z2;
+
+            inline void operator()(const grid_t* grid, const cell_sq_t cell)
+            {
+                for (index_t n = grid->m_cells[cell]; n != c_invalid_index; n = m_hshg->m_entities_node[n].m_next)
+                {
+                    (*this)(n);
+                }
+            }
+
+            inline void operator()(const index_t n)
+            {
+                if (n != m_i && entity_overlaps(m_hshg->m_entities + n, m_x1, m_y1, m_z1, m_x2, m_y2, m_z2))
+                {
+                    m_lists->push(n);
+                }
+            }
+        };
+
+        bool hshg_build_neighbor_lists(hshg_t* const hshg, const f32 skin, hshg_neighbor_lists_t* lists)
+        {
+            ASSERT(!hshg->calling() && "build_neighbor_lists() may not be called from any callback");
+            ASSERT(skin >= 0.0f);
+
+            hshg->update_cache();
+            HSHG_TRACE_SCOPE(hshg, TRACE_PHASE_QUERY);
+
+            lists->m_len           = 0;
+            lists->m_neighbors_len = 0;
+            lists->m_failed        = false;
+            if (!lists->reserve_entities(hshg->m_entities_used))
+            {
+                return false;
+            }
+
+            const index_t len = hshg->m_entities_used;
+            nmem::memcpy(lists->m_entities, hshg->m_entities, sizeof(entity_t) * len);
+            nmem::memcpy(lists->m_refs, hshg->m_entities_ref, sizeof(index_t) * len);
+            lists->m_skin = skin;
+
+            // a resized span only expires the lists by the change of its box
+            lists->m_spans = hshg->m_span_cells != nullptr;
+            if (lists->m_spans)
+            {
+                if (!lists->reserve_halves(len))
+                {
+                    lists->m_spans = false;
+                    return false;
+                }
+                nmem::memcpy(lists->m_halves, hshg->m_entities_half, sizeof(f32) * 3 * len);
+            }
+
+            neighbor_visitor_t visitor = {hshg, lists, 0, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+            for (index_t i = 0; i < len; ++i)
+            {
+                const entity_t* const entity  = hshg->m_entities + i;
+                f32                   half[3] = {entity->r, entity->r, entity->r};
+                if (hshg->is_span(i))
+                {
+                    entity_half_extents(hshg, i, half);
+                }
+
+                visitor.m_i  = i;
+                visitor.m_x1 = entity->x - half[0] - skin;
+                visitor.m_y1 = entity->y - half[1] - skin;
+                visitor.m_z1 = entity->z - half[2] - skin;
+                visitor.m_x2 = entity->x + half[0] + skin;
+                visitor.m_y2 = entity->y + half[1] + skin;
+                visitor.m_z2 = entity->z + half[2] + skin;
+
+                cell_range_t rx = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, visitor.m_x1, visitor.m_x2);
+                cell_range_t ry = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, visitor.m_y1, visitor.m_y2);
+                cell_range_t rz = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, visitor.m_z1, visitor.m_z2);
+
+                lists->m_offsets[i] = lists->m_neighbors_len;
+                visit_query_cells(hshg->m_grids, hshg->m_grids_len, rx, ry, rz, visitor);
+                visit_overflow_range(hshg, visitor.m_x1, visitor.m_x2, visitor);
+                if (lists->m_spans)
+                {
+                    const f32 q1[3] = {visitor.m_x1, visitor.m_y1, visitor.m_z1};
+                    const f32 q2[3] = {visitor.m_x2, visitor.m_y2, visitor.m_z2};
+                    visit_query_spans(hshg, rx, ry, rz, q1, q2, visitor);
+                }
+                if (lists->m_failed)
+                {
+                    lists->m_neighbors_len = 0;
+                    return false;
+                }
+            }
+            lists->m_offsets[len] = lists->m_neighbors_len;
+            lists->m_len          = len;
+            return true;
+        }
+
+        bool hshg_neighbor_lists_expired(hshg_t const* const hshg, hshg_neighbor_lists_t const* lists)
+        {
+            if (lists->m_len != hshg->m_entities_used)
+            {
+                return true;
+            }
+
+            // entities are hypercubes, so the largest move along any axis is what counts
+            const f32 half_skin = lists->m_skin * 0.5f;
+            for (index_t i = 0; i < lists->m_len; ++i)
+            {
+                if (lists->m_refs[i] != hshg->m_entities_ref[i])
+                    return true;
+
+                const entity_t* const now   = hshg->m_entities + i;
+                const entity_t* const built = lists->m_entities + i;
+                const f32             moved = math::g_max(math::abs(now->x - built->x), math::g_max(math::abs(now->y - built->y), math::abs(now->z - built->z)));
+                f32 grown = now->r - built->r;
+                if (lists->m_spans && hshg->is_span(i))
+                {
+                    const f32* const now_half   = hshg->m_entities_half + (i * 3);
+                    const f32* const built_half = lists->m_halves + (i * 3);
+                    grown                       = math::g_max(now_half[0] - built_half[0], math::g_max(now_half[1] - built_half[1], now_half[2] - built_half[2]));
+                }
+                if (moved + math::g_max(grown, 0.0f) > half_skin)
+                    return true;
+            }
+            return false;
+        }
+
+        index_t const* hshg_neighbor_list(hshg_neighbor_lists_t const* lists, const index_t entity, index_t& len)
+        {
+            ASSERT(entity < lists->m_len);
+            len = lists->m_offsets[entity + 1] - lists->m_offsets[entity];
+            return lists->m_neighbors + lists->m_offsets[entity];
+        }
+
+        index_t hshg_neighbor_lists_len(hshg_neighbor_lists_t const* lists) { return lists->m_neighbors_len; }
+
+    }  // namespace nhshg
+}  // namespace ncore
@@ -0,0 +1,367 @@
+#include "cbase/c_allocator.h"
+#include "cbase/c_debug.h"
+#include "cbase/c_integer.h"
+#include "cbase/c_memory.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_pair_cache.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        // A pair slot is empty when its stamp is 0, stamps start at 1
+        struct pair_slot_t
+        {
+            index_t m_ref1;  // m_ref1 < m_ref2
+            index_t m_ref2;
+            u32     m_stamp;  // tick in which the pair was last found overlapping
+        };
+
+        // A ref slot is only valid when its stamp equals the current tick, so the set is
+        // emptied by just advancing the tick.
+        struct ref_slot_t
+        {
+            index_t m_ref;
+            u32     m_stamp;
+        };
+
+        static inline u32 hash_u32(u32 h)
+        {
+            h ^= h >> 16;
+            h *= 0x85ebca6b;
+            h ^= h >> 13;
+            h *= 0xc2b2ae35;
+            h ^= h >> 16;
+            return h;
+        }
+
+        static inline u32 hash_pair(const index_t ref1, const index_t ref2) { return hash_u32(ref1 * 0x9e3779b1 ^ hash_u32(ref2)); }
+
+        class hshg_pair_cache_t : public observer_t
+        {
+        public:
+            DCORE_CLASS_PLACEMENT_NEW_DELETE
+
+            // Any number of updates may pass before the next hshg_collide_cached(), every
+            // one of them removing entities, so the dead refs grow on demand.
+            virtual void on_remove(hshg_t* hshg, index_t entity)
+            {
+                if (m_dead_len == m_dead_cap)
+                {
+                    const u32      cap  = math::g_max(m_dead_cap * 2, (u32)64);
+                    index_t* const dead = g_allocate_array<index_t>(m_allocator, cap);
+                    ASSERT(dead != nullptr && "out of memory, the contacts of a removed entity do not end");
+                    if (dead == nullptr)
+                        return;
+                    nmem::memcpy(dead, m_dead, sizeof(index_t) * m_dead_len);
+                    m_allocator->deallocate(m_dead);
+                    m_dead     = dead;
+                    m_dead_cap = cap;
+                }
+                m_dead[m_dead_len++] = hshg->m_entities_ref[entity];
+            }
+
+            // Makes room for 'len' refs, keeping the set at most half full. The set is only
+            // filled within hshg_collide_cached(), so before that it is simply replaced.
+            bool reserve_refs(const u32 len)
+            {
+                if (len * 2 <= m_refs_mask + 1)
+                    return true;
+
+                const u32         cap  = math::ceilpo2(len * 2);
+                ref_slot_t* const refs = g_allocate_array_and_clear<ref_slot_t>(m_allocator, cap);
+                if (refs == nullptr)
+                    return false;
+                m_allocator->deallocate(m_refs);
+                m_refs      = refs;
+                m_refs_mask = cap - 1;
+                return true;
+            }
+
+            // Doubles the pair table, keeping it at most half full, the pairs keep their stamps
+            bool grow_pairs()
+            {
+                const u32          max   = math::g_max(m_pairs_max * 2, (u32)16);
+                const u32          cap   = math::ceilpo2(max * 2);
+                pair_slot_t* const pairs = g_allocate_array_and_clear<pair_slot_t>(m_allocator, cap);
+                if (pairs == nullptr)
+                    return false;
+
+                for (u32 i = 0; i <= m_pairs_mask; ++i)
+                {
+                    if (m_pairs[i].m_stamp == 0)
+                        continue;
+                    u32 slot = hash_pair(m_pairs[i].m_ref1, m_pairs[i].m_ref2) & (cap - 1);
+                    while (pairs[slot].m_stamp != 0)
+                        slot = (slot + 1) & (cap - 1);
+                    pairs[slot] = m_pairs[i];
+                }
+                m_allocator->deallocate(m_pairs);
+                m_pairs      = pairs;
+                m_pairs_mask = cap - 1;
+                m_pairs_max  = max;
+                return true;
+            }
+
+            void mark_ref(const index_t ref)
+            {
+                u32 slot = hash_u32(ref) & m_refs_mask;
+                while (m_refs[slot].m_stamp == m_tick)
+                {
+                    if (m_refs[slot].m_ref == ref)
+                        return;
+                    slot = (slot + 1) & m_refs_mask;
+                }
+                m_refs[slot].m_ref   = ref;
+                m_refs[slot].m_stamp = m_tick;
+            }
+
+            bool is_ref_marked(const index_t ref) const
+            {
+                u32 slot = hash_u32(ref) & m_refs_mask;
+                while (m_refs[slot].m_stamp == m_tick)
+                {
+                    if (m_refs[slot].m_ref == ref)
+                        return true;
+                    slot = (slot + 1) & m_refs_mask;
+                }
+                return false;
+            }
+
+            void found_pair(index_t ref1, index_t ref2, contact_func_t* handler)
+            {
+                if (ref1 > ref2)
+                {
+                    const index_t t = ref1;
+                    ref1            = ref2;
+                    ref2            = t;
+                }
+
+                u32 slot = hash_pair(ref1, ref2) & m_pairs_mask;
+                while (m_pairs[slot].m_stamp != 0)
+                {
+                    pair_slot_t& pair = m_pairs[slot];
+                    if (pair.m_ref1 == ref1 && pair.m_ref2 == ref2)
+                    {
+                        if (pair.m_stamp != m_tick)
+                        {
+                            pair.m_stamp = m_tick;
+                            handler->stay(ref1, ref2);
+                        }
+                        return;
+                    }
+                    slot = (slot + 1) & m_pairs_mask;
+                }
+
+                if (m_pairs_len == m_pairs_max)
+                {
+                    if (!grow_pairs())
+                    {
+                        ASSERT(false && "out of memory, the contact is dropped");
+                        return;
+                    }
+                    slot = hash_pair(ref1, ref2) & m_pairs_mask;
+                    while (m_pairs[slot].m_stamp != 0)
+                        slot = (slot + 1) & m_pairs_mask;
+                }
+
+                m_pairs[slot].m_ref1  = ref1;
+                m_pairs[slot].m_ref2  = ref2;
+                m_pairs[slot].m_stamp = m_tick;
+                ++m_pairs_len;
+                handler->begin(ref1, ref2);
+            }
+
+            // Linear probing removal by shifting the following entries of the cluster back
+            void erase_pair(u32 slot)
+            {
+                u32 next = (slot + 1) & m_pairs_mask;
+                while (m_pairs[next].m_stamp != 0)
+                {
+                    const u32 home = hash_pair(m_pairs[next].m_ref1, m_pairs[next].m_ref2) & m_pairs_mask;
+                    if (((next - home) & m_pairs_mask) >= ((next - slot) & m_pairs_mask))
+                    {
+                        m_pairs[slot] = m_pairs[next];
+                        slot          = next;
+                    }
+                    next = (next + 1) & m_pairs_mask;
+                }
+                m_pairs[slot].m_stamp = 0;
+                --m_pairs_len;
+            }
+
+            // Reports the pairs that were not found this tick, they either ended or were
+            // carried forward because both entities are clean.
+            void sweep(contact_func_t* handler)
+            {
+                // Start right after an empty slot, then no cluster wraps around the start and
+                // erase_pair() only ever shifts entries into the slot we are looking at.
+                u32 start = 0;
+                while (m_pairs[start].m_stamp != 0)
+                    ++start;
+
+                u32 slot = (start + 1) & m_pairs_mask;
+                while (slot != start)
+                {
+                    pair_slot_t& pair = m_pairs[slot];
+                    if (pair.m_stamp != 0 && pair.m_stamp != m_tick)
+                    {
+                        if (is_ref_marked(pair.m_ref1) || is_ref_marked(pair.m_ref2))
+                        {
+                            handler->end(pair.m_ref1, pair.m_ref2);
+                            erase_pair(slot);
+                            continue;
+                        }
+                        handler->stay(pair.m_ref1, pair.m_ref2);
+                    }
+                    slot = (slot + 1) & m_pairs_mask;
+                }
+            }
+
+            hshg_t*      m_hshg;
+            alloc_t*     m_allocator;
+            pair_slot_t* m_pairs;
+            u32          m_pairs_mask;
+            u32          m_pairs_len;
+            u32          m_pairs_max;  // the pairs that fit before the table grows
+            ref_slot_t*  m_refs;       // refs of the dirty and removed entities of this tick
+            u32          m_refs_mask;
+            index_t*     m_dead;  // refs of the entities removed since the last tick
+            u32          m_dead_len;
+            u32          m_dead_cap;
+            u32          m_tick;
+        };
+
+        hshg_pair_cache_t* hshg_pair_cache_create(alloc_t* allocator, hshg_t* hshg, const u32 max_pairs)
+        {
+            void* mem = allocator->allocate(sizeof(hshg_pair_cache_t));
+            if (mem == nullptr)
+            {
+                return nullptr;
+            }
+
+            hshg_pair_cache_t* cache = new (mem) hshg_pair_cache_t();
+            cache->m_hshg            = hshg;
+            cache->m_allocator       = allocator;
+
+            // both tables are kept at most half full and grow when needed
+            const u32 pairs_cap = math::ceilpo2(math::g_max(max_pairs, (u32)1) * 2);
+            const u32 refs_cap  = math::ceilpo2(math::g_max((u32)hshg->m_entities_max, (u32)1) * 4);
+
+            cache->m_pairs      = g_allocate_array_and_clear<pair_slot_t>(allocator, pairs_cap);
+            cache->m_pairs_mask = pairs_cap - 1;
+            cache->m_pairs_len  = 0;
+            cache->m_pairs_max  = max_pairs;
+            cache->m_refs       = g_allocate_array_and_clear<ref_slot_t>(allocator, refs_cap);
+            cache->m_refs_mask  = refs_cap - 1;
+            cache->m_dead       = g_allocate_array<index_t>(allocator, hshg->m_entities_max);
+            cache->m_dead_len   = 0;
+            cache->m_dead_cap   = hshg->m_entities_max;
+            cache->m_tick       = 0;
+
+            if (cache->m_pairs == nullptr || cache->m_refs == nullptr || cache->m_dead == nullptr)
+            {
+                allocator->deallocate(cache->m_pairs);
+                allocator->deallocate(cache->m_refs);
+                allocator->deallocate(cache->m_dead);
+                allocator->deallocate(cache);
+                return nullptr;
+            }
+
+            hshg->add_observer(cache);
+            return cache;
+        }
+
+        void hshg_pair_cache_free(hshg_pair_cache_t* cache)
+        {
+            cache->m_hshg->remove_observer(cache);
+
+            alloc_t* allocator = cache->m_allocator;
+            allocator->deallocate(cache->m_pairs);
+            allocator->deallocate(cache->m_refs);
+            allocator->deallocate(cache->m_dead);
+            allocator->deallocate(cache);
+        }
+
+        u32 hshg_pair_cache_len(hshg_pair_cache_t const* cache) { return cache->m_pairs_len; }
+
+        struct cached_collide_visitor_t
+        {
+            const hshg_t*      m_hshg;
+            hshg_pair_cache_t* m_cache;
+            contact_func_t*    m_handler;
+
+            inline void operator()(const index_t i, const index_t n)
+            {
+                // pairs of two clean entities are carried forward by the sweep
+                if (((m_hshg->m_entities_flags[i] | m_hshg->m_entities_flags[n]) & c_entity_dirty) == 0)
+                    return;
+
+                // a pair of two ghosts is reported by the region owning them
+                if (m_hshg->m_entities_flags[i] & m_hshg->m_entities_flags[n] & c_entity_ghost)
+                    return;
+
+                HSHG_STAT(++m_hshg->m_stats.m_pairs_emitted);
+                if (entity_boxes_overlap_quant(m_hshg, i, n))
+                {
+                    HSHG_STAT(++m_hshg->m_stats.m_pairs_overlapped);
+                    m_cache->found_pair(m_hshg->m_entities_ref[i], m_hshg->m_entities_ref[n], m_handler);
+                }
+            }
+        };
+
+        void hshg_collide_cached(hshg_t* const hshg, hshg_pair_cache_t* cache, contact_func_t* const handler)
+        {
+            ASSERT(!hshg->calling() && "collide_cached() may not be called from any callback");
+            ASSERT(cache->m_hshg == hshg);
+            hshg->set_colliding(true);
+            HSHG_STAT(++hshg->m_stats.m_collide_calls);
+
+            hshg->update_cache();
+
+            HSHG_TRACE_SCOPE(hshg, TRACE_PHASE_COLLIDE);
+
+            // every dead ref and every dirty entity may be marked
+            if (!cache->reserve_refs(cache->m_dead_len + hshg->m_entities_used))
+            {
+                ASSERT(false && "out of memory, collide_cached() is skipped");
+                hshg->set_colliding(false);
+                return;
+            }
+
+            // stamp 0 marks an empty pair slot, skip it when the tick wraps around
+            if (++cache->m_tick == 0)
+                cache->m_tick = 1;
+
+            for (u32 i = 0; i < cache->m_dead_len; ++i)
+            {
+                cache->mark_ref(cache->m_dead[i]);
+            }
+            cache->m_dead_len = 0;
+
+            hshg->build_crowds();
+
+            cached_collide_visitor_t visitor = {hshg, cache, handler};
+            for (index_t i = 0; i < hshg->m_entities_used; ++i)
+            {
+                if (hshg->m_entities_flags[i] & c_entity_dirty)
+                {
+                    cache->mark_ref(hshg->m_entities_ref[i]);
+                }
+                visit_collide_pairs(hshg, i, visitor);
+            }
+
+            hshg->clear_crowds();
+            cache->sweep(handler);
+
+            for (index_t i = 0; i < hshg->m_entities_used; ++i)
+            {
+                hshg->m_entities_flags[i] &= ~c_entity_dirty;
+            }
+
+            hshg->set_colliding(false);
+        }
+
+    }  // namespace nhshg
+}  // namespace ncore
@@ -0,0 +1,50 @@
+#include "cbase/c_allocator.h"
+#include "cbase/c_debug.h"
+#include "cbase/c_integer.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_payload.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        bool hshg_enable_payload(hshg_t* const hshg, const u32 size)
+        {
+            ASSERT(!hshg->calling() && "enable_payload() may not be called from any callback");
+            ASSERT(!hshg->is_viewed() && "enable_payload() may not be called while a view is acquired");
+            ASSERT(size > 0);
+
+            const u32 stride = (size + 3) & ~(u32)3;
+            if (hshg->m_entities_payload != nullptr)
+            {
+                ASSERT(hshg->m_payload_size == stride && "the payload is already enabled with another size");
+                return hshg->m_payload_size == stride;
+            }
+
+            u8* const payload = g_allocate_array_and_clear<u8>(hshg->m_allocator, hshg->m_entities_max * stride);
+            if (payload == nullptr)
+            {
+                return false;
+            }
+            hshg->m_entities_payload = payload;
+            hshg->m_payload_size     = stride;
+            return true;
+        }
+
+        void* hshg_payload(hshg_t* const hshg, const index_t entity)
+        {
+            ASSERT(hshg->m_entities_payload != nullptr && "call hshg_enable_payload() first");
+            ASSERT(entity < hshg->m_entities_used);
+            return hshg->m_entities_payload + (u64)entity * hshg->m_payload_size;
+        }
+
+        void const* hshg_payload_of(hshg_t const* const hshg, entity_t const* const entity)
+        {
+            ASSERT(hshg->m_entities_payload != nullptr && "call hshg_enable_payload() first");
+            ASSERT(entity >= hshg->m_entities && entity < hshg->m_entities + hshg->m_entities_used && "not an entity of this HSHG");
+            return hshg->m_entities_payload + (u64)(entity - hshg->m_entities) * hshg->m_payload_size;
+        }
+
+    }  // namespace nhshg
+}  // namespace ncore
@@ -0,0 +1,38 @@
+#include "cbase/c_allocator.h"
+#include "cbase/c_debug.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_quantized.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        void hshg_t::quantize(const index_t idx)
+        {
+            const entity_t* const entity = m_entities + idx;
+            m_entities_quant[idx]        = quantize_entity(entity->x, entity->y, entity->z, entity->r, m_quant_scale);
+        }
+
+        bool hshg_enable_quantized(hshg_t* const hshg)
+        {
+            ASSERT(!hshg->calling() && "enable_quantized() may not be called from any callback");
+            ASSERT(!hshg->is_viewed() && "enable_quantized() may not be called while a view is acquired");
+            if (hshg->m_entities_quant == nullptr)
+            {
+                quant_t* const quant = g_allocate_array<quant_t>(hshg->m_allocator, hshg->m_entities_max);
+                if (quant == nullptr)
+                {
+                    return false;
+                }
+                hshg->m_entities_quant = quant;
+                for (index_t i = 0; i < hshg->m_entities_used; ++i)
+                {
+                    hshg->quantize(i);
+                }
+            }
+            return true;
+        }
+
+    }  // namespace nhshg
+}  // namespace ncore
@@ -0,0 +1,163 @@
+#include "cbase/c_debug.h"
+#include "cbase/c_integer.h"
+#include "cbase/c_float.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_shard.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        void hshg_shard_init(shard_layout_t& layout, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2, const u32 rx, const u32 ry, const u32 rz, const f32 halo)
+        {
+            ASSERT(x1 < x2 && y1 < y2 && z1 < z2);
+            ASSERT(rx > 0 && ry > 0 && rz > 0);
+            layout.m_min[0]     = x1;
+            layout.m_min[1]     = y1;
+            layout.m_min[2]     = z1;
+            layout.m_max[0]     = x2;
+            layout.m_max[1]     = y2;
+            layout.m_max[2]     = z2;
+            layout.m_regions[0] = rx;
+            layout.m_regions[1] = ry;
+            layout.m_regions[2] = rz;
+            layout.m_halo       = halo;
+        }
+
+        static inline u32 region_coord(shard_layout_t const& layout, const u32 axis, const f32 p)
+        {
+            const f32 t = (p - layout.m_min[axis]) / (layout.m_max[axis] - layout.m_min[axis]) * (f32)layout.m_regions[axis];
+            if (t <= 0.0f)
+                return 0;
+            return math::g_min((u32)t, layout.m_regions[axis] - 1);
+        }
+
+        u32 hshg_shard_region(shard_layout_t const& layout, const f32 x, const f32 y, const f32 z)
+        {
+            const u32 rx = region_coord(layout, 0, x);
+            const u32 ry = region_coord(layout, 1, y);
+            const u32 rz = region_coord(layout, 2, z);
+            return rx + layout.m_regions[0] * (ry + layout.m_regions[1] * rz);
+        }
+
+        void hshg_shard_bounds(shard_layout_t const& layout, const u32 region, f32* min, f32* max)
+        {
+            ASSERT(region < layout.m_regions[0] * layout.m_regions[1] * layout.m_regions[2]);
+            u32 r = region;
+            for (u32 a = 0; a < 3; ++a)
+            {
+                const u32 i    = r % layout.m_regions[a];
+                const f32 size = (layout.m_max[a] - layout.m_min[a]) / (f32)layout.m_regions[a];
+                r /= layout.m_regions[a];
+                min[a] = layout.m_min[a] + size * (f32)i;
+                max[a] = i + 1 == layout.m_regions[a] ? layout.m_max[a] : layout.m_min[a] + size * (f32)(i + 1);
+            }
+        }
+
+        u32 hshg_shard_neighbors(shard_layout_t const& layout, const u32 region, u32* neighbors)
+        {
+            const s32 nx = (s32)layout.m_regions[0];
+            const s32 ny = (s32)layout.m_regions[1];
+            const s32 nz = (s32)layout.m_regions[2];
+            const s32 x  = (s32)(region % nx);
+            const s32 y  = (s32)((region / nx) % ny);
+            const s32 z  = (s32)(region / (nx * ny));
+
+            u32 len = 0;
+            for (s32 cz = z - 1; cz <= z + 1; ++cz)
+            {
+                for (s32 cy = y - 1; cy <= y + 1; ++cy)
+                {
+                    for (s32 cx = x - 1; cx <= x + 1; ++cx)
+                    {
+                        if (cx < 0 || cy < 0 || cz < 0 || cx >= nx || cy >= ny || cz >= nz || (cx == x && cy == y && cz == z))
+                            continue;
+                        neighbors[len++] = (u32)(cx + nx * (cy + ny * cz));
+                    }
+                }
+            }
+            return len;
+        }
+
+        class shard_export_t final : public query_func_t
+        {
+        public:
+            void query(entity_t const* entity, index_t ref) override final
+            {
+                if (m_hshg->m_entities_flags[entity - m_hshg->m_entities] & c_entity_ghost)
+                    return;
+
+                if (m_len < m_max)
+                {
+                    m_ghosts[m_len].m_entity = *entity;
+                    m_ghosts[m_len].m_ref    = ref;
+                }
+                ++m_len;
+            }
+
+            const hshg_t* m_hshg;
+            ghost_t*      m_ghosts;
+            u32           m_max;
+            u32           m_len;
+        };
+
+        u32 hshg_shard_export(hshg_t* const hshg, shard_layout_t const& layout, const u32 neighbor, ghost_t* ghosts, const u32 max_ghosts)
+        {
+            ASSERT(!hshg->calling() && "shard_export() may not be called from any callback");
+
+            f32 min[3];
+            f32 max[3];
+            hshg_shard_bounds(layout, neighbor, min, max);
+
+            hshg->update_cache();
+
+            shard_export_t handler;
+            handler.m_hshg   = hshg;
+            handler.m_ghosts = ghosts;
+            handler.m_max    = max_ghosts;
+            handler.m_len    = 0;
+            query_common(hshg, min[0] - layout.m_halo, min[1] - layout.m_halo, min[2] - layout.m_halo, max[0] + layout.m_halo, max[1] + layout.m_halo, max[2] + layout.m_halo, &handler, nullptr);
+            return handler.m_len;
+        }
+
+        void hshg_clear_ghosts(hshg_t* const hshg)
+        {
+            ASSERT(!hshg->calling() && "clear_ghosts() may not be called from any callback");
+            ASSERT(!hshg->is_viewed() && "clear_ghosts() may not be called while a view is acquired");
+            if (hshg->m_ghosts_len == 0)
+            {
+                return;
+            }
+
+            // the same path as removed entities, queued and then compacted in one go
+            for (index_t i = 0; i < hshg->m_entities_used; ++i)
+            {
+                if (hshg->m_entities_flags[i] & c_entity_ghost)
+                    hshg->m_removed[hshg->m_removed_len++] = i;
+            }
+            hshg->flush_removed();
+            hshg->compact();
+            hshg->set_removed(false);
+            hshg->m_ghosts_len = 0;
+        }
+
+        u32 hshg_import_ghosts(hshg_t* const hshg, ghost_t const* ghosts, const u32 len)
+        {
+            u32 imported = 0;
+            for (; imported < len; ++imported)
+            {
+                const entity_t& entity = ghosts[imported].m_entity;
+                const index_t   idx    = hshg_insert(hshg, entity.x, entity.y, entity.z, entity.r, ghosts[imported].m_ref);
+                if (idx == c_invalid_index)
+                    break;
+                hshg->m_entities_flags[idx] |= c_entity_ghost;
+            }
+            hshg->m_ghosts_len += imported;
+            return imported;
+        }
+
+        bool hshg_is_ghost(hshg_t const* const hshg, const index_t entity) { return (hshg->m_entities_flags[entity] & c_entity_ghost) != 0; }
+
+    }  // namespace nhshg
+}  // namespace ncore
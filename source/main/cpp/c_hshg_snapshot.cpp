@@ -0,0 +1,271 @@
+#include "cbase/c_allocator.h"
+#include "cbase/c_debug.h"
+#include "cbase/c_integer.h"
+#include "cbase/c_memory.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_snapshot.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        const u32 c_no_snapshot = 0xFFFFFFFF;
+
+        class hshg_snapshot_t
+        {
+        public:
+            hshg_snapshot_t();
+
+            bool reserve(alloc_t* allocator, const hshg_t* hshg);
+            void release(alloc_t* allocator);
+            void copy(const hshg_t* hshg);
+
+            entity_t* m_entities;      // entities in cell order
+            index_t*  m_entities_ref;  // refs in cell order
+            index_t*  m_cells;         // cells_len + 1 offsets into m_entities
+            grid_t*   m_grids;         // copies of the grids, m_cells points into the offsets
+
+            index_t   m_entities_len;
+            index_t   m_entities_cap;
+            cell_sq_t m_cells_len;
+            u32       m_grid_size;
+            f32       m_inverse_grid_size;
+            u8        m_grids_len;
+
+            u32 m_sequence;
+            u32 m_readers;  // number of threads that have this snapshot acquired
+        };
+
+        class hshg_snapshot_buffer_t
+        {
+        public:
+            DCORE_CLASS_PLACEMENT_NEW_DELETE
+
+            hshg_snapshot_t m_snapshots[2];
+            u32             m_front;  // index of the published snapshot, or c_no_snapshot
+            u32             m_sequence;
+            alloc_t*        m_allocator;
+        };
+
+        hshg_snapshot_t::hshg_snapshot_t()
+            : m_entities(nullptr)
+            , m_entities_ref(nullptr)
+            , m_cells(nullptr)
+            , m_grids(nullptr)
+            , m_entities_len(0)
+            , m_entities_cap(0)
+            , m_cells_len(0)
+            , m_grid_size(0)
+            , m_inverse_grid_size(0)
+            , m_grids_len(0)
+            , m_sequence(0)
+            , m_readers(0)
+        {
+        }
+
+        bool hshg_snapshot_t::reserve(alloc_t* allocator, const hshg_t* hshg)
+        {
+            if (m_entities_cap < hshg->m_entities_used)
+            {
+                allocator->deallocate(m_entities);
+                allocator->deallocate(m_entities_ref);
+                m_entities_cap = hshg->m_entities_max;
+                m_entities     = g_allocate_array<entity_t>(allocator, m_entities_cap);
+                m_entities_ref = g_allocate_array<index_t>(allocator, m_entities_cap);
+                if (m_entities == nullptr || m_entities_ref == nullptr)
+                {
+                    m_entities_cap = 0;
+                    return false;
+                }
+            }
+
+            if (m_cells_len != hshg->m_cells_len || m_grids_len != hshg->m_grids_len)
+            {
+                allocator->deallocate(m_cells);
+                allocator->deallocate(m_grids);
+                m_cells_len = hshg->m_cells_len;
+                m_grids_len = hshg->m_grids_len;
+                m_cells     = g_allocate_array<index_t>(allocator, m_cells_len + 1);
+                m_grids     = g_allocate_array<grid_t>(allocator, m_grids_len + 1);
+                if (m_cells == nullptr || m_grids == nullptr)
+                {
+                    m_cells_len = 0;
+                    m_grids_len = 0;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void hshg_snapshot_t::release(alloc_t* allocator)
+        {
+            allocator->deallocate(m_entities);
+            allocator->deallocate(m_entities_ref);
+            allocator->deallocate(m_cells);
+            allocator->deallocate(m_grids);
+        }
+
+        // Flattens the cells of the HSHG, the same walk as hshg_optimize() does, but into
+        // ranges instead of linked lists.
+        void hshg_snapshot_t::copy(const hshg_t* hshg)
+        {
+            index_t len = 0;
+            for (cell_sq_t i = 0; i < hshg->m_cells_len; ++i)
+            {
+                m_cells[i] = len;
+
+                index_t entity_idx = hshg->m_cells[i];
+                while (entity_idx != c_invalid_index)
+                {
+                    m_entities[len]     = hshg->m_entities[entity_idx];
+                    m_entities_ref[len] = hshg->m_entities_ref[entity_idx];
+                    ++len;
+
+                    entity_idx = hshg->m_entities_node[entity_idx].m_next;
+                }
+            }
+            m_cells[hshg->m_cells_len] = len;
+
+            // the overflow grid as well
+            for (u8 i = 0; i <= hshg->m_grids_len; ++i)
+            {
+                const grid_t* const grid = hshg->m_grids + i;
+                new (m_grids + i) grid_t(*grid, m_cells + (grid->m_cells - hshg->m_cells));
+            }
+
+            m_entities_len      = len;
+            m_grid_size         = hshg->m_grid_size;
+            m_inverse_grid_size = hshg->m_inverse_grid_size;
+        }
+
+        hshg_snapshot_buffer_t* hshg_snapshot_buffer_create(alloc_t* allocator, hshg_t const* hshg)
+        {
+            void* mem = allocator->allocate(sizeof(hshg_snapshot_buffer_t));
+            if (mem == nullptr)
+            {
+                return nullptr;
+            }
+
+            hshg_snapshot_buffer_t* buffer = new (mem) hshg_snapshot_buffer_t();
+            buffer->m_front                = c_no_snapshot;
+            buffer->m_sequence             = 0;
+            buffer->m_allocator            = allocator;
+
+            if (!buffer->m_snapshots[0].reserve(allocator, hshg) || !buffer->m_snapshots[1].reserve(allocator, hshg))
+            {
+                hshg_snapshot_buffer_free(buffer);
+                return nullptr;
+            }
+            return buffer;
+        }
+
+        void hshg_snapshot_buffer_free(hshg_snapshot_buffer_t* buffer)
+        {
+            ASSERT(buffer->m_snapshots[0].m_readers == 0 && buffer->m_snapshots[1].m_readers == 0 && "snapshot_buffer_free() called while a snapshot is still acquired");
+            buffer->m_snapshots[0].release(buffer->m_allocator);
+            buffer->m_snapshots[1].release(buffer->m_allocator);
+            buffer->m_allocator->deallocate(buffer);
+        }
+
+        bool hshg_snapshot_publish(hshg_snapshot_buffer_t* buffer, hshg_t* hshg)
+        {
+            ASSERT(!hshg->calling() && "snapshot_publish() may not be called from any callback");
+
+            // Only this thread ever changes m_front, readers only pin what they loaded from it.
+            const u32 front = natomic::load(&buffer->m_front);
+            const u32 back  = front == c_no_snapshot ? 0 : (front ^ 1);
+
+            hshg_snapshot_t* const snapshot = buffer->m_snapshots + back;
+            if (natomic::load(&snapshot->m_readers) != 0)
+            {
+                return false;
+            }
+
+            if (!snapshot->reserve(buffer->m_allocator, hshg))
+            {
+                return false;
+            }
+
+            hshg->update_cache();
+            snapshot->copy(hshg);
+            snapshot->m_sequence = ++buffer->m_sequence;
+
+            natomic::store(&buffer->m_front, back);
+            return true;
+        }
+
+        hshg_snapshot_t const* hshg_snapshot_acquire(hshg_snapshot_buffer_t* buffer)
+        {
+            while (1)
+            {
+                const u32 front = natomic::load(&buffer->m_front);
+                if (front == c_no_snapshot)
+                {
+                    return nullptr;
+                }
+
+                hshg_snapshot_t* const snapshot = buffer->m_snapshots + front;
+                natomic::fetch_add(&snapshot->m_readers, 1);
+
+                // If the front is still the same after pinning it, the writer can no longer
+                // pick this snapshot as its back buffer until we release it.
+                if (natomic::load(&buffer->m_front) == front)
+                {
+                    return snapshot;
+                }
+
+                natomic::fetch_add(&snapshot->m_readers, (u32)-1);
+            }
+        }
+
+        void hshg_snapshot_release(hshg_snapshot_buffer_t* buffer, hshg_snapshot_t const* snapshot)
+        {
+            ASSERT(snapshot == buffer->m_snapshots + 0 || snapshot == buffer->m_snapshots + 1);
+            hshg_snapshot_t* const s = buffer->m_snapshots + (snapshot - buffer->m_snapshots);
+            natomic::fetch_add(&s->m_readers, (u32)-1);
+        }
+
+        struct snapshot_query_visitor_t
+        {
+            const hshg_snapshot_t* m_snapshot;
+            f32                    m_x1, m_y1, m_z1;
+            f32                    m_x2, m_y2, m_z2;
+            query_func_t*          m_handler;
+
+            inline void operator()(const grid_t* grid, const cell_sq_t cell)
+            {
+                const index_t end = grid->m_cells[cell + 1];
+                for (index_t i = grid->m_cells[cell]; i < end; ++i)
+                {
+                    const entity_t* const entity = m_snapshot->m_entities + i;
+                    if (entity_overlaps(entity, m_x1, m_y1, m_z1, m_x2, m_y2, m_z2))
+                    {
+                        m_handler->query(entity, m_snapshot->m_entities_ref[i]);
+                    }
+                }
+            }
+        };
+
+        void hshg_snapshot_query(hshg_snapshot_t const* snapshot, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2, query_func_t* const handler)
+        {
+            ASSERT(x1 <= x2);
+            ASSERT(y1 <= y2);
+            ASSERT(z1 <= z2);
+
+            cell_range_t x = map_pos(snapshot->m_grids, snapshot->m_grid_size, snapshot->m_inverse_grid_size, x1, x2);
+            cell_range_t y = map_pos(snapshot->m_grids, snapshot->m_grid_size, snapshot->m_inverse_grid_size, y1, y2);
+            cell_range_t z = map_pos(snapshot->m_grids, snapshot->m_grid_size, snapshot->m_inverse_grid_size, z1, z2);
+
+            snapshot_query_visitor_t visitor = {snapshot, x1, y1, z1, x2, y2, z2, handler};
+            visit_query_cells(snapshot->m_grids, snapshot->m_grids_len, x, y, z, visitor);
+            visit_overflow_cell(snapshot->m_grids, snapshot->m_grids_len, visitor);
+        }
+
+        u32             hshg_snapshot_sequence(hshg_snapshot_t const* snapshot) { return snapshot->m_sequence; }
+        index_t         hshg_snapshot_len(hshg_snapshot_t const* snapshot) { return snapshot->m_entities_len; }
+        entity_t const* hshg_snapshot_entities(hshg_snapshot_t const* snapshot) { return snapshot->m_entities; }
+        index_t const*  hshg_snapshot_refs(hshg_snapshot_t const* snapshot) { return snapshot->m_entities_ref; }
+
+    }  // namespace nhshg
+}  // namespace ncore
@@ -0,0 +1,313 @@
+#include "cbase/c_allocator.h"
+#include "cbase/c_debug.h"
+#include "cbase/c_integer.h"
+#include "cbase/c_float.h"
+#include "cbase/c_memory.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_box.h"
+#include "chshg/c_hshg_span.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        static inline cell_sq_t first_grid_cells(const grid_t* const grid) { return grid->m_cells_sq * grid->m_cells_side; }
+
+        bool hshg_t::enable_spans()
+        {
+            if (!hshg_enable_boxes(this))
+            {
+                return false;
+            }
+            if (m_entities_span == nullptr)
+            {
+                m_entities_span = g_allocate_array<span_t>(m_allocator, m_entities_max);
+                if (m_entities_span == nullptr)
+                {
+                    return false;
+                }
+                for (index_t i = 0; i < m_entities_max; ++i)
+                {
+                    m_entities_span[i].m_nodes = c_invalid_index;
+                }
+            }
+            if (m_span_cells == nullptr)
+            {
+                const cell_sq_t cells = first_grid_cells(m_grids);
+                m_span_cells          = g_allocate_array<index_t>(m_allocator, cells);
+                if (m_span_cells == nullptr)
+                {
+                    return false;
+                }
+                for (cell_sq_t c = 0; c < cells; ++c)
+                {
+                    m_span_cells[c] = c_invalid_index;
+                }
+            }
+            return true;
+        }
+
+        // Makes sure that 'len' nodes fit without growing. Nodes are counted by an index_t
+        // and c_invalid_index ends the lists, so at most c_invalid_index of them fit.
+        static bool reserve_span_nodes(hshg_t* const hshg, const u64 len)
+        {
+            if (len > c_invalid_index)
+            {
+                return false;
+            }
+            if (len <= hshg->m_span_nodes_cap)
+            {
+                return true;
+            }
+
+            const index_t      cap   = grow_capacity((u32)len, hshg->m_span_nodes_cap, 64);
+            span_node_t* const nodes = cap != 0 ? g_allocate_array<span_node_t>(hshg->m_allocator, cap) : nullptr;
+            if (nodes == nullptr)
+            {
+                return false;
+            }
+            if (hshg->m_span_nodes != nullptr)
+            {
+                nmem::memcpy(nodes, hshg->m_span_nodes, sizeof(span_node_t) * hshg->m_span_nodes_len);
+                hshg->m_allocator->deallocate(hshg->m_span_nodes);
+            }
+            hshg->m_span_nodes     = nodes;
+            hshg->m_span_nodes_cap = cap;
+            return true;
+        }
+
+        // The number of cells of the first grid of 'grids' that the box of entity 'idx' overlaps
+        static u64 span_cells_count(const hshg_t* const hshg, const grid_t* const grids, const u32 grid_size, const f32 inverse_grid_size, const index_t idx)
+        {
+            const entity_t* const entity = hshg->m_entities + idx;
+            const f32* const      half   = hshg->m_entities_half + (idx * 3);
+
+            const cell_range_t x = map_pos(grids, grid_size, inverse_grid_size, entity->x - half[0], entity->x + half[0]);
+            const cell_range_t y = map_pos(grids, grid_size, inverse_grid_size, entity->y - half[1], entity->y + half[1]);
+            const cell_range_t z = map_pos(grids, grid_size, inverse_grid_size, entity->z - half[2], entity->z + half[2]);
+            return (u64)(x.end - x.start + 1) * (y.end - y.start + 1) * (z.end - z.start + 1);
+        }
+
+        bool hshg_t::link_span(const index_t idx)
+        {
+            const entity_t* const entity = m_entities + idx;
+            const f32* const      half   = m_entities_half + (idx * 3);
+            span_t&               span   = m_entities_span[idx];
+            span.m_nodes                 = c_invalid_index;
+            span.m_stamp                 = 0;
+
+            const cell_range_t x = map_pos(m_grids, m_grid_size, m_inverse_grid_size, entity->x - half[0], entity->x + half[0]);
+            const cell_range_t y = map_pos(m_grids, m_grid_size, m_inverse_grid_size, entity->y - half[1], entity->y + half[1]);
+            const cell_range_t z = map_pos(m_grids, m_grid_size, m_inverse_grid_size, entity->z - half[2], entity->z + half[2]);
+
+            // the free nodes are taken first
+            const u64 count = span_cells_count(this, m_grids, m_grid_size, m_inverse_grid_size, idx);
+            if (count > m_span_nodes_free_len && !reserve_span_nodes(this, m_span_nodes_len + (count - m_span_nodes_free_len)))
+            {
+                return false;
+            }
+
+            for (cell_t cz = z.start; cz <= z.end; ++cz)
+            {
+                for (cell_t cy = y.start; cy <= y.end; ++cy)
+                {
+                    for (cell_t cx = x.start; cx <= x.end; ++cx)
+                    {
+                        index_t node = m_span_nodes_free;
+                        if (node != c_invalid_index)
+                        {
+                            m_span_nodes_free = m_span_nodes[node].m_next;
+                            --m_span_nodes_free_len;
+                        }
+                        else
+                            node = m_span_nodes_len++;
+
+                        span_node_t& n = m_span_nodes[node];
+                        n.m_entity     = idx;
+                        n.m_cell       = grid_get_idx(m_grids, cx, cy, cz);
+                        n.m_next       = m_span_cells[n.m_cell];
+                        n.m_own_next   = span.m_nodes;
+                        m_span_cells[n.m_cell] = node;
+                        span.m_nodes           = node;
+                    }
+                }
+            }
+            return true;
+        }
+
+        void hshg_t::unlink_span(const index_t idx)
+        {
+            span_t& span = m_entities_span[idx];
+            index_t node = span.m_nodes;
+            while (node != c_invalid_index)
+            {
+                span_node_t& n = m_span_nodes[node];
+
+                // the span lists of the cells are short, a singly linked list will do
+                index_t* link = m_span_cells + n.m_cell;
+                while (*link != node)
+                    link = &m_span_nodes[*link].m_next;
+                *link = n.m_next;
+
+                const index_t own_next = n.m_own_next;
+                n.m_next               = m_span_nodes_free;
+                m_span_nodes_free      = node;
+                node                   = own_next;
+                ++m_span_nodes_free_len;
+            }
+            span.m_nodes = c_invalid_index;
+        }
+
+        bool hshg_t::prepare_spans(const grid_t* const grids, const u32 grid_size, const f32 inverse_grid_size, index_t*& span_cells)
+        {
+            span_cells = nullptr;
+            if (m_entities_span == nullptr)
+            {
+                return true;
+            }
+
+            // every span is relinked from scratch, the nodes it has now are reused
+            u64 count = 0;
+            for (index_t i = 0; i < m_entities_used; ++i)
+            {
+                if (m_entities_span[i].m_nodes != c_invalid_index)
+                    count += span_cells_count(this, grids, grid_size, inverse_grid_size, i);
+            }
+            if (!reserve_span_nodes(this, count))
+            {
+                return false;
+            }
+
+            const cell_sq_t cells = first_grid_cells(grids);
+            span_cells            = g_allocate_array<index_t>(m_allocator, cells);
+            return span_cells != nullptr;
+        }
+
+        void hshg_t::relink_spans(index_t* const span_cells)
+        {
+            if (m_entities_span == nullptr)
+            {
+                return;
+            }
+
+            m_allocator->deallocate(m_span_cells);
+            m_span_cells = span_cells;
+            for (cell_sq_t c = 0, cells = first_grid_cells(m_grids); c < cells; ++c)
+            {
+                m_span_cells[c] = c_invalid_index;
+            }
+            m_span_nodes_len      = 0;
+            m_span_nodes_free     = c_invalid_index;
+            m_span_nodes_free_len = 0;
+
+            // prepare_spans() reserved the nodes, so linking can not fail
+            for (index_t i = 0; i < m_entities_used; ++i)
+            {
+                if (m_entities_span[i].m_nodes != c_invalid_index)
+                    link_span(i);
+            }
+        }
+
+        bool hshg_t::relink_spans()
+        {
+            index_t* span_cells;
+            if (!prepare_spans(m_grids, m_grid_size, m_inverse_grid_size, span_cells))
+            {
+                return false;
+            }
+            relink_spans(span_cells);
+            return true;
+        }
+
+        u32 hshg_t::next_span_stamp() const
+        {
+            // stamp 0 is never current, clear the stamps when it wraps around
+            if (++m_span_stamp == 0)
+            {
+                for (index_t i = 0; i < m_entities_used; ++i)
+                    m_entities_span[i].m_stamp = 0;
+                m_span_stamp = 1;
+            }
+            return m_span_stamp;
+        }
+
+        index_t hshg_insert_span(hshg_t* const hshg, const f32 x, const f32 y, const f32 z, const f32 hx, const f32 hy, const f32 hz, const index_t ref)
+        {
+            ASSERT(!hshg->calling() && "insert_span() may not be called from any callback");
+            ASSERT(!hshg->is_viewed() && "insert_span() may not be called while a view is acquired");
+            ASSERT(hx >= 0.0f && hy >= 0.0f && hz >= 0.0f);
+            if (!hshg->enable_spans())
+            {
+                return c_invalid_index;
+            }
+
+            const index_t idx = hshg->insert_entity(x, y, z, math::g_max(hx, math::g_max(hy, hz)), ref, hshg->m_grids_len);
+            if (idx == c_invalid_index)
+            {
+                return c_invalid_index;
+            }
+
+            f32* const half = hshg->m_entities_half + (idx * 3);
+            half[0]         = hx;
+            half[1]         = hy;
+            half[2]         = hz;
+            if (!hshg->link_span(idx))
+            {
+                // it is the last entity, so it can simply be dropped again
+                hshg->detach_from_grid(idx);
+                --hshg->m_entities_used;
+                return c_invalid_index;
+            }
+
+            hshg->notify_move(idx);
+            return idx;
+        }
+
+        void hshg_resize_span(hshg_t* const hshg, const index_t entity, const f32 hx, const f32 hy, const f32 hz)
+        {
+            ASSERT(hshg->is_updating() && "resize_span() may only be called from within hshg.update()");
+            ASSERT(hshg->is_span(entity));
+            if (!hshg->is_span(entity))
+            {
+                return;
+            }
+
+            hshg->m_entities_flags[entity] |= c_entity_dirty;
+            hshg->wake(entity);
+
+            hshg->unlink_span(entity);
+            f32* const half            = hshg->m_entities_half + (entity * 3);
+            half[0]                    = hx;
+            half[1]                    = hy;
+            half[2]                    = hz;
+            hshg->m_entities[entity].r = math::g_max(hx, math::g_max(hy, hz));
+            if (!hshg->link_span(entity))
+            {
+                ASSERT(false && "out of span nodes, the span is now a plain overflow entity");
+                hshg->m_overflow_dirty = 1;
+            }
+            hshg->notify_move(entity);
+        }
+
+        bool hshg_is_span(hshg_t const* const hshg, const index_t entity) { return hshg->is_span(entity); }
+
+        // Hands the spans of visit_query_spans() to a query handler
+        struct query_spans_visitor_t
+        {
+            const hshg_t* m_hshg;
+            query_func_t* m_handler;
+
+            inline void operator()(const index_t n) { m_handler->query(m_hshg->m_entities + n, m_hshg->m_entities_ref[n]); }
+        };
+
+        void query_spans(const hshg_t* const hshg, const cell_range_t x, const cell_range_t y, const cell_range_t z, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2, query_func_t* const handler)
+        {
+            const f32             q1[3]   = {x1, y1, z1};
+            const f32             q2[3]   = {x2, y2, z2};
+            query_spans_visitor_t visitor = {hshg, handler};
+            visit_query_spans(hshg, x, y, z, q1, q2, visitor);
+        }
+
+    }  // namespace nhshg
+}  // namespace ncore
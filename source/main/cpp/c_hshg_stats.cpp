@@ -0,0 +1,62 @@
+#include "cbase/c_debug.h"
+#include "cbase/c_integer.h"
+#include "cbase/c_memory.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_stats.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        bool hshg_get_stats(hshg_t const* const hshg, hshg_stats_t& stats)
+        {
+            nmem::memset(&stats, 0, sizeof(stats));
+#ifdef HSHG_STATS
+            stats = hshg->m_stats;
+
+            stats.m_grids_len = math::g_min((u32)hshg->m_grids_len, c_stats_max_grids);
+            for (u32 g = 0; g < stats.m_grids_len; ++g)
+            {
+                const grid_t* const grid = hshg->m_grids + g;
+                stats.m_grid_entities[g] = grid->m_entities_len;
+
+                const cell_sq_t cells    = grid->m_cells_sq * grid->m_cells_side;
+                u32             occupied = 0;
+                u32             max_list = 0;
+                for (cell_sq_t c = 0; c < cells; ++c)
+                {
+                    u32 len = 0;
+                    for (index_t e = grid->m_cells[c]; e != c_invalid_index; e = hshg->m_entities_node[e].m_next)
+                        ++len;
+                    if (len == 0)
+                        continue;
+
+                    ++occupied;
+                    max_list = math::g_max(max_list, len);
+
+                    // bin b holds the lengths [2^b, 2^(b+1))
+                    const u32 bin = math::g_min((u32)(31 - math::g_countLeadingZeros(len)), c_stats_list_bins - 1);
+                    ++stats.m_grid_list_histogram[g][bin];
+                }
+                stats.m_grid_occupied_cells[g] = occupied;
+                stats.m_grid_max_list[g]       = max_list;
+            }
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        void hshg_reset_stats(hshg_t* const hshg)
+        {
+#ifdef HSHG_STATS
+            // the number of active grids is state, not a counter
+            const u32 active_grids = hshg->m_stats.m_active_grids;
+            nmem::memset(&hshg->m_stats, 0, sizeof(hshg->m_stats));
+            hshg->m_stats.m_active_grids = active_grids;
+#endif
+        }
+
+    }  // namespace nhshg
+}  // namespace ncore
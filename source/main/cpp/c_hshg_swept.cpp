@@ -0,0 +1,242 @@
+#include "cbase/c_allocator.h"
+#include "cbase/c_debug.h"
+#include "cbase/c_integer.h"
+#include "cbase/c_float.h"
+#include "cbase/c_memory.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_swept.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        bool hshg_enable_velocities(hshg_t* const hshg)
+        {
+            ASSERT(!hshg->calling() && "enable_velocities() may not be called from any callback");
+            ASSERT(!hshg->is_viewed() && "enable_velocities() may not be called while a view is acquired");
+            if (hshg->m_entities_vel == nullptr)
+            {
+                hshg->m_entities_vel = g_allocate_array_and_clear<f32>(hshg->m_allocator, hshg->m_entities_max * 3);
+            }
+            return hshg->m_entities_vel != nullptr;
+        }
+
+        void hshg_set_velocity(hshg_t* const hshg, const index_t entity, const f32 vx, const f32 vy, const f32 vz)
+        {
+            ASSERT(hshg->m_entities_vel != nullptr && "call hshg_enable_velocities() first");
+            ASSERT(entity < hshg->m_entities_used);
+            f32* const vel = hshg->m_entities_vel + (entity * 3);
+            vel[0]         = vx;
+            vel[1]         = vy;
+            vel[2]         = vz;
+        }
+
+        struct swept_pair_t
+        {
+            index_t m_e1;
+            index_t m_e2;
+            f32     m_toi;
+        };
+
+        // Time of impact within [0, 1] of two entities moving with their velocity over 'dt',
+        // found by casting the relative motion of 'a' against the cube of 'b' grown by the
+        // radius of 'a'.
+        static inline bool swept_toi(const hshg_t* const hshg, const index_t a, const index_t b, const f32 dt, f32& toi)
+        {
+            const entity_t* const ea = hshg->m_entities + a;
+            const entity_t* const eb = hshg->m_entities + b;
+            const f32* const      va = hshg->m_entities_vel + (a * 3);
+            const f32* const      vb = hshg->m_entities_vel + (b * 3);
+            const f32             r  = ea->r + eb->r;
+
+            f32 tmin = 0.0f;
+            f32 tmax = 1.0f;
+            if (ray_slab(ea->x, (va[0] - vb[0]) * dt, eb->x, r, tmin, tmax) && ray_slab(ea->y, (va[1] - vb[1]) * dt, eb->y, r, tmin, tmax) && ray_slab(ea->z, (va[2] - vb[2]) * dt, eb->z, r, tmin, tmax))
+            {
+                toi = tmin;
+                return true;
+            }
+            return false;
+        }
+
+        struct swept_collector_t
+        {
+            alloc_t*      m_allocator;
+            swept_pair_t* m_pairs;
+            u32           m_len;
+            u32           m_max;
+
+            bool push(const index_t e1, const index_t e2, const f32 toi)
+            {
+                if (m_len == m_max)
+                {
+                    const u32     max   = math::g_max(m_max * 2, (u32)64);
+                    swept_pair_t* pairs = g_allocate_array<swept_pair_t>(m_allocator, max);
+                    ASSERT(pairs != nullptr);
+                    if (pairs == nullptr)
+                        return false;
+                    if (m_pairs != nullptr)
+                    {
+                        nmem::memcpy(pairs, m_pairs, sizeof(swept_pair_t) * m_len);
+                        m_allocator->deallocate(m_pairs);
+                    }
+                    m_pairs = pairs;
+                    m_max   = max;
+                }
+                m_pairs[m_len].m_e1  = e1;
+                m_pairs[m_len].m_e2  = e2;
+                m_pairs[m_len].m_toi = toi;
+                ++m_len;
+                return true;
+            }
+
+            // heap sort on the time of impact, no extra memory needed
+            void sift_down(u32 root, const u32 len)
+            {
+                while (1)
+                {
+                    u32 child = root * 2 + 1;
+                    if (child >= len)
+                        return;
+                    if (child + 1 < len && m_pairs[child + 1].m_toi > m_pairs[child].m_toi)
+                        ++child;
+                    if (m_pairs[root].m_toi >= m_pairs[child].m_toi)
+                        return;
+                    const swept_pair_t t = m_pairs[root];
+                    m_pairs[root]        = m_pairs[child];
+                    m_pairs[child]       = t;
+                    root                 = child;
+                }
+            }
+
+            void sort()
+            {
+                for (u32 i = m_len / 2; i > 0; --i)
+                    sift_down(i - 1, m_len);
+                for (u32 end = m_len; end > 1; --end)
+                {
+                    const swept_pair_t t = m_pairs[0];
+                    m_pairs[0]           = m_pairs[end - 1];
+                    m_pairs[end - 1]     = t;
+                    sift_down(0, end - 1);
+                }
+            }
+        };
+
+        struct swept_visitor_t
+        {
+            const hshg_t*      m_hshg;
+            swept_collector_t* m_collector;
+            index_t            m_fast;
+            f32                m_dt;
+
+            inline void operator()(const grid_t* grid, const cell_sq_t cell)
+            {
+                index_t entity_idx = grid->m_cells[cell];
+                while (entity_idx != c_invalid_index)
+                {
+                    // pairs of two fast entities are tested separately, a pair of two ghosts is
+                    // reported by the region owning them
+                    const u8 flags = m_hshg->m_entities_flags[entity_idx];
+                    f32      toi;
+                    if ((flags & c_entity_fast) == 0 && (flags & m_hshg->m_entities_flags[m_fast] & c_entity_ghost) == 0 && swept_toi(m_hshg, m_fast, entity_idx, m_dt, toi))
+                    {
+                        m_collector->push(m_fast, entity_idx, toi);
+                    }
+                    entity_idx = m_hshg->m_entities_node[entity_idx].m_next;
+                }
+            }
+        };
+
+        void hshg_collide_swept(hshg_t* const hshg, const f32 dt, swept_func_t* const handler)
+        {
+            ASSERT(!hshg->calling() && "collide_swept() may not be called from any callback");
+            ASSERT(hshg->m_entities_vel != nullptr && "call hshg_enable_velocities() first");
+            ASSERT(dt >= 0.0f);
+            hshg->set_colliding(true);
+
+            hshg->update_cache();
+
+            HSHG_TRACE_SCOPE(hshg, TRACE_PHASE_COLLIDE);
+
+            index_t* const fast = g_allocate_array<index_t>(hshg->m_allocator, math::g_max(hshg->m_entities_used, (index_t)1));
+            if (fast == nullptr)
+            {
+                hshg->set_colliding(false);
+                return;
+            }
+
+            // Find the fast entities, and how far the slow ones move at most. A fast entity
+            // has to look that much further to find every slow entity it can meet.
+            index_t fast_len  = 0;
+            f32     slow_disp = 0.0f;
+            for (index_t i = 0; i < hshg->m_entities_used; ++i)
+            {
+                const f32* const vel  = hshg->m_entities_vel + (i * 3);
+                const f32        disp = math::g_max(math::abs(vel[0]), math::g_max(math::abs(vel[1]), math::abs(vel[2]))) * dt;
+                if (disp > hshg->m_entities[i].r)
+                {
+                    hshg->m_entities_flags[i] |= c_entity_fast;
+                    fast[fast_len++] = i;
+                }
+                else
+                {
+                    slow_disp = math::g_max(slow_disp, disp);
+                }
+            }
+
+            swept_collector_t collector = {hshg->m_allocator, nullptr, 0, 0};
+
+            for (index_t f = 0; f < fast_len; ++f)
+            {
+                const index_t         i      = fast[f];
+                const entity_t* const entity = hshg->m_entities + i;
+                const f32* const      vel    = hshg->m_entities_vel + (i * 3);
+                const f32             r      = entity->r + slow_disp;
+
+                // the box swept by the cube of the entity, covering its start and end position
+                const f32 x1 = entity->x + math::g_min(vel[0] * dt, 0.0f) - r;
+                const f32 y1 = entity->y + math::g_min(vel[1] * dt, 0.0f) - r;
+                const f32 z1 = entity->z + math::g_min(vel[2] * dt, 0.0f) - r;
+                const f32 x2 = entity->x + math::g_max(vel[0] * dt, 0.0f) + r;
+                const f32 y2 = entity->y + math::g_max(vel[1] * dt, 0.0f) + r;
+                const f32 z2 = entity->z + math::g_max(vel[2] * dt, 0.0f) + r;
+
+                cell_range_t rx = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, x1, x2);
+                cell_range_t ry = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, y1, y2);
+                cell_range_t rz = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, z1, z2);
+
+                swept_visitor_t visitor = {hshg, &collector, i, dt};
+                visit_query_cells(hshg->m_grids, hshg->m_grids_len, rx, ry, rz, visitor);
+                visit_overflow_cell(hshg->m_grids, hshg->m_grids_len, visitor);
+
+                for (index_t g = f + 1; g < fast_len; ++g)
+                {
+                    f32 toi;
+                    if ((hshg->m_entities_flags[i] & hshg->m_entities_flags[fast[g]] & c_entity_ghost) == 0 && swept_toi(hshg, i, fast[g], dt, toi))
+                    {
+                        collector.push(i, fast[g], toi);
+                    }
+                }
+            }
+
+            for (index_t f = 0; f < fast_len; ++f)
+            {
+                hshg->m_entities_flags[fast[f]] &= ~c_entity_fast;
+            }
+            hshg->m_allocator->deallocate(fast);
+
+            collector.sort();
+            for (u32 p = 0; p < collector.m_len; ++p)
+            {
+                const swept_pair_t& pair = collector.m_pairs[p];
+                handler->swept(hshg->m_entities + pair.m_e1, hshg->m_entities_ref[pair.m_e1], hshg->m_entities + pair.m_e2, hshg->m_entities_ref[pair.m_e2], pair.m_toi);
+            }
+            hshg->m_allocator->deallocate(collector.m_pairs);
+
+            hshg->set_colliding(false);
+        }
+
+    }  // namespace nhshg
+}  // namespace ncore
@@ -0,0 +1,135 @@
+#include "cbase/c_allocator.h"
+#include "cbase/c_debug.h"
+#include "cbase/c_integer.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_trace.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        static const char* s_phase_names[TRACE_PHASE_COUNT] = {"update", "compact", "update_cache", "collide", "query", "optimize"};
+
+        hshg_trace_t* hshg_trace_create(alloc_t* allocator, hshg_t* hshg, const u32 capacity, clock_func_t* clock)
+        {
+#ifdef HSHG_TRACE
+            ASSERT(hshg->m_trace == nullptr && "only one trace can be attached to a HSHG");
+
+            void* mem = allocator->allocate(sizeof(hshg_trace_t));
+            if (mem == nullptr)
+            {
+                return nullptr;
+            }
+
+            const u32     events_cap = math::ceilpo2(math::g_max(capacity, (u32)1));
+            hshg_trace_t* trace      = new (mem) hshg_trace_t();
+            trace->m_hshg            = hshg;
+            trace->m_allocator       = allocator;
+            trace->m_clock           = clock;
+            trace->m_events          = g_allocate_array<trace_event_t>(allocator, events_cap);
+            trace->m_mask            = events_cap - 1;
+            trace->m_written         = 0;
+
+            if (trace->m_events == nullptr)
+            {
+                allocator->deallocate(trace);
+                return nullptr;
+            }
+
+            hshg->m_trace = trace;
+            return trace;
+#else
+            return nullptr;
+#endif
+        }
+
+        void hshg_trace_free(hshg_trace_t* trace)
+        {
+#ifdef HSHG_TRACE
+            trace->m_hshg->m_trace = nullptr;
+#endif
+            alloc_t* allocator = trace->m_allocator;
+            allocator->deallocate(trace->m_events);
+            allocator->deallocate(trace);
+        }
+
+        u32 hshg_trace_len(hshg_trace_t const* trace) { return math::g_min(trace->m_written, trace->m_mask + 1); }
+
+        void hshg_trace_clear(hshg_trace_t* trace) { trace->m_written = 0; }
+
+        // Appends to a buffer that may be too small (or nullptr), but keeps counting
+        struct json_writer_t
+        {
+            char* m_buffer;
+            u32   m_size;
+            u32   m_len;
+
+            void put(const char c)
+            {
+                if (m_buffer != nullptr && m_len + 1 < m_size)
+                    m_buffer[m_len] = c;
+                ++m_len;
+            }
+
+            void put(const char* str)
+            {
+                while (*str != '\0')
+                    put(*str++);
+            }
+
+            void put_u64(u64 value)
+            {
+                char digits[20];
+                s32  n = 0;
+                do
+                {
+                    digits[n++] = (char)('0' + (value % 10));
+                    value /= 10;
+                } while (value != 0);
+                while (n > 0)
+                    put(digits[--n]);
+            }
+
+            // trace-event timestamps are in microseconds, keep the nanoseconds as decimals
+            void put_us(const u64 ns)
+            {
+                put_u64(ns / 1000);
+                const u32 frac = (u32)(ns % 1000);
+                put('.');
+                put((char)('0' + frac / 100));
+                put((char)('0' + (frac / 10) % 10));
+                put((char)('0' + frac % 10));
+            }
+        };
+
+        u32 hshg_trace_export(hshg_trace_t const* trace, char* buffer, const u32 buffer_size)
+        {
+            json_writer_t writer = {buffer, buffer_size, 0};
+
+            const u32 len   = hshg_trace_len(trace);
+            const u32 first = trace->m_written - len;
+
+            writer.put("{\"traceEvents\":[");
+            for (u32 i = 0; i < len; ++i)
+            {
+                const trace_event_t& event = trace->m_events[(first + i) & trace->m_mask];
+                if (i != 0)
+                    writer.put(',');
+                writer.put("\n{\"name\":\"");
+                writer.put(s_phase_names[event.m_phase]);
+                writer.put("\",\"cat\":\"hshg\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":");
+                writer.put_us(event.m_start);
+                writer.put(",\"dur\":");
+                writer.put_us(event.m_duration);
+                writer.put('}');
+            }
+            writer.put("\n],\"displayTimeUnit\":\"ms\"}");
+
+            if (buffer != nullptr && buffer_size > 0)
+                buffer[math::g_min(writer.m_len, buffer_size - 1)] = '\0';
+            return writer.m_len;
+        }
+
+    }  // namespace nhshg
+}  // namespace ncore
@@ -0,0 +1,212 @@
+#include "cbase/c_debug.h"
+#include "cbase/c_integer.h"
+#include "cbase/c_float.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_view.h"
+#include "chshg/private/c_hierarchical_spatial_hashgrid_internal.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        hshg_view_t hshg_view_acquire(hshg_t* const hshg)
+        {
+            ASSERT(!hshg->is_updating() && "view_acquire() may not be called from update()");
+
+            // After this the cache is clean, so update_cache() calls made by hshg_collide()
+            // while the view is acquired return without writing anything.
+            hshg->update_cache();
+            ++hshg->m_views;
+
+            hshg_view_t view;
+            view.m_hshg = hshg;
+            return view;
+        }
+
+        void hshg_view_release(hshg_t* const hshg, hshg_view_t& view)
+        {
+            ASSERT(view.m_hshg == hshg && hshg->m_views > 0);
+            --hshg->m_views;
+            view.m_hshg = nullptr;
+        }
+
+        void hshg_view_query(hshg_view_t const& view, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2, query_func_t* const handler)
+        {
+            ASSERT(view.m_hshg != nullptr);
+            query_common(view.m_hshg, x1, y1, z1, x2, y2, z2, handler, nullptr);
+        }
+
+        // Index of the first grid that holds entities, the overflow grid (m_grids_len) included,
+        // or m_grids_len + 1 when the HSHG is empty.
+        static u8 first_active_grid(const hshg_t* const hshg)
+        {
+            u8 g = 0;
+            while (g <= hshg->m_grids_len && hshg->m_grids[g].m_entities_len == 0)
+                ++g;
+            return g;
+        }
+
+        static inline f32 box_dist_sq(const entity_t* const entity, const f32* const half, const f32 x, const f32 y, const f32 z)
+        {
+            const f32 dx = math::g_max(math::abs(x - entity->x) - half[0], 0.0f);
+            const f32 dy = math::g_max(math::abs(y - entity->y) - half[1], 0.0f);
+            const f32 dz = math::g_max(math::abs(z - entity->z) - half[2], 0.0f);
+            return dx * dx + dy * dy + dz * dz;
+        }
+
+        struct knn_visitor_t
+        {
+            const hshg_t* m_hshg;
+            f32           m_x, m_y, m_z;
+            f32           m_max_dist_sq;
+            knn_result_t* m_results;
+            u32           m_k;
+            u32           m_len;
+
+            inline void operator()(const grid_t* grid, const cell_sq_t cell)
+            {
+                index_t entity_idx = grid->m_cells[cell];
+                while (entity_idx != c_invalid_index)
+                {
+                    const entity_t* const entity = m_hshg->m_entities + entity_idx;
+                    f32                   half[3];
+                    entity_half_extents(m_hshg, entity_idx, half);
+                    const f32 dist_sq = box_dist_sq(entity, half, m_x, m_y, m_z);
+                    if (dist_sq <= m_max_dist_sq && (m_len < m_k || dist_sq < m_results[m_len - 1].m_dist_sq))
+                    {
+                        // insertion into the sorted results, dropping the farthest when full
+                        u32 i = m_len < m_k ? m_len++ : m_len - 1;
+                        while (i > 0 && m_results[i - 1].m_dist_sq > dist_sq)
+                        {
+                            m_results[i] = m_results[i - 1];
+                            --i;
+                        }
+                        m_results[i].m_entity  = entity;
+                        m_results[i].m_ref     = m_hshg->m_entities_ref[entity_idx];
+                        m_results[i].m_dist_sq = dist_sq;
+                    }
+                    entity_idx = m_hshg->m_entities_node[entity_idx].m_next;
+                }
+            }
+        };
+
+        u32 hshg_view_knn(hshg_view_t const& view, const f32 x, const f32 y, const f32 z, const f32 max_dist, knn_result_t* results, const u32 k)
+        {
+            ASSERT(view.m_hshg != nullptr);
+            const hshg_t* const hshg = view.m_hshg;
+            if (k == 0 || first_active_grid(hshg) > hshg->m_grids_len)
+            {
+                return 0;
+            }
+
+            knn_visitor_t visitor = {hshg, x, y, z, max_dist * max_dist, results, k, 0};
+
+            // Search in a growing box, entities outside of a box with half extent 'r' are
+            // farther away than 'r', so we are done as soon as the k-th result is within it.
+            f32 r = (f32)hshg->m_cell_size;
+            while (1)
+            {
+                r = math::g_min(r, max_dist);
+
+                cell_range_t rx = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, x - r, x + r);
+                cell_range_t ry = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, y - r, y + r);
+                cell_range_t rz = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, z - r, z + r);
+
+                visitor.m_len = 0;
+                visit_query_cells(hshg->m_grids, hshg->m_grids_len, rx, ry, rz, visitor);
+                visit_overflow_cell(hshg->m_grids, hshg->m_grids_len, visitor);
+
+                if (visitor.m_len == k && results[k - 1].m_dist_sq <= r * r)
+                    break;
+
+                // A box this big covers all of the (folded) cells, so every entity was seen.
+                if (r >= max_dist || r >= (f32)hshg->m_grid_size)
+                    break;
+
+                r += r;
+            }
+            return visitor.m_len;
+        }
+
+        struct raycast_visitor_t
+        {
+            const hshg_t*   m_hshg;
+            f32             m_ox, m_oy, m_oz;
+            f32             m_dx, m_dy, m_dz;
+            f32             m_seg_t0;  // this segment reports entities entered in [t0, t1)
+            f32             m_seg_t1;
+            bool            m_last;  // the last segment also reports entries at t1
+            bool            m_stop;
+            f32             m_max_t;
+            raycast_func_t* m_handler;
+
+            inline void operator()(const grid_t* grid, const cell_sq_t cell)
+            {
+                index_t entity_idx = grid->m_cells[cell];
+                while (entity_idx != c_invalid_index && !m_stop)
+                {
+                    const entity_t* const entity = m_hshg->m_entities + entity_idx;
+                    f32                   half[3];
+                    entity_half_extents(m_hshg, entity_idx, half);
+
+                    f32 tmin = 0.0f;
+                    f32 tmax = m_max_t;
+                    if (ray_slab(m_ox, m_dx, entity->x, half[0], tmin, tmax) && ray_slab(m_oy, m_dy, entity->y, half[1], tmin, tmax) && ray_slab(m_oz, m_dz, entity->z, half[2], tmin, tmax))
+                    {
+                        if (tmin >= m_seg_t0 && (tmin < m_seg_t1 || (m_last && tmin == m_seg_t1)))
+                        {
+                            const f32 max_t = m_handler->hit(entity, m_hshg->m_entities_ref[entity_idx], tmin);
+                            if (max_t <= 0.0f)
+                                m_stop = true;
+                            m_max_t = math::g_min(m_max_t, max_t);
+                        }
+                    }
+                    entity_idx = m_hshg->m_entities_node[entity_idx].m_next;
+                }
+            }
+        };
+
+        void hshg_view_raycast(hshg_view_t const& view, const f32 ox, const f32 oy, const f32 oz, const f32 dx, const f32 dy, const f32 dz, const f32 max_t, raycast_func_t* const handler)
+        {
+            ASSERT(view.m_hshg != nullptr);
+            const hshg_t* const hshg = view.m_hshg;
+
+            const u8  grid    = first_active_grid(hshg);
+            const f32 dir_len = math::sqrt(dx * dx + dy * dy + dz * dz);
+            if (grid > hshg->m_grids_len || dir_len == 0.0f || max_t <= 0.0f)
+            {
+                return;
+            }
+
+            // March along the ray in segments about one cell of the finest active grid long,
+            // querying the bounds of every segment. Every entity is only reported by the
+            // segment that contains its entry point, so it is never reported twice.
+            const f32 cell_size = (f32)((u32)hshg->m_cell_size << grid);
+            const f32 seg_t     = math::g_max(cell_size / dir_len, max_t / 1024.0f);
+
+            raycast_visitor_t visitor = {hshg, ox, oy, oz, dx, dy, dz, 0.0f, 0.0f, false, false, max_t, handler};
+            while (!visitor.m_stop && visitor.m_seg_t0 < visitor.m_max_t)
+            {
+                visitor.m_seg_t1 = math::g_min(visitor.m_seg_t0 + seg_t, visitor.m_max_t);
+                visitor.m_last   = visitor.m_seg_t1 >= visitor.m_max_t;
+
+                const f32 x0 = ox + dx * visitor.m_seg_t0;
+                const f32 y0 = oy + dy * visitor.m_seg_t0;
+                const f32 z0 = oz + dz * visitor.m_seg_t0;
+                const f32 x1 = ox + dx * visitor.m_seg_t1;
+                const f32 y1 = oy + dy * visitor.m_seg_t1;
+                const f32 z1 = oz + dz * visitor.m_seg_t1;
+
+                cell_range_t rx = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, math::g_min(x0, x1), math::g_max(x0, x1));
+                cell_range_t ry = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, math::g_min(y0, y1), math::g_max(y0, y1));
+                cell_range_t rz = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, math::g_min(z0, z1), math::g_max(z0, z1));
+
+                visit_query_cells(hshg->m_grids, hshg->m_grids_len, rx, ry, rz, visitor);
+                visit_overflow_cell(hshg->m_grids, hshg->m_grids_len, visitor);
+
+                visitor.m_seg_t0 = visitor.m_seg_t1;
+            }
+        }
+
+    }  // namespace nhshg
+}  // namespace ncore
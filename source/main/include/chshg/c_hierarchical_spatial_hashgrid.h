@@ -11,22 +11,42 @@ namespace ncore
 
     namespace nhshg
     {
+        //
+        // The entity index, the cell heads and the list nodes are 32 bit. A small world can
+        // compile the library with HSHG_INDEX_16 defined, which halves the list nodes and the
+        // cell heads and limits a HSHG to 65535 entities (c_invalid_index is the largest value
+        // of index_t). Everything that includes these headers must see the same definition.
+        //
+#ifdef HSHG_INDEX_16
+        typedef u16 index_t;
+#else
         typedef u32 index_t;
+#endif
         typedef u32 ref_t;
-        typedef u32 cell_t;
 
-        const index_t c_invalid_index = 0xFFFFFFFF;
+        const index_t c_invalid_index = (index_t)~(index_t)0;
 
         //
-        // A type that will be able to hold the total number of cells in a HSHG. To get
-        // an upper bound of that number, calculate:
+        // 'cell_t' holds a side, 'cell_sq_t' the total number of cells in a HSHG. To get an
+        // upper bound of that number, calculate:
         //
         // ( side ** dimension ) * [ 2, 1.333, 1.143 ][ dimension ]
         //
-        // For 2D, you would do: side * side * 1.333.
+        // For 2D, you would do: side * side * 1.333. With HSHG_CELL_16 defined both are 16
+        // bit, which halves the cell of every entity and allows a side of up to 32.
         //
+#ifdef HSHG_CELL_16
+        typedef u16 cell_t;
+        typedef u16 cell_sq_t;
+
+        const cell_t c_max_side = 32;
+#else
+        typedef u32 cell_t;
         typedef u32 cell_sq_t;
 
+        const cell_t c_max_side = 1024;
+#endif
+
         struct entity_t
         {
             f32 x;
@@ -62,6 +82,18 @@ namespace ncore
         };
 
         hshg_t* hshg_create(alloc_t* allocator, const cell_t side, const u32 size, const u32 max_entities);
+
+        //
+        // Creates a HSHG of which all storage (the HSHG, grids, cells, entity arrays and
+        // room for hshg_optimize()) is carved from a single allocation, with every array
+        // aligned to 64 bytes. 'alignment' is passed to the allocator for that one block,
+        // e.g. the huge page size for an allocator that backs such requests with huge pages.
+        // Only the optional columns (hshg_enable_velocities(), hshg_enable_payload(), ...) and
+        // growth (hshg_reserve()) may still allocate outside of it. hshg_memory_usage_arena()
+        // returns the exact size.
+        //
+        hshg_t* hshg_create_arena(alloc_t* allocator, const cell_t side, const u32 size, const u32 max_entities, const u32 alignment);
+        int_t   hshg_memory_usage_arena(const cell_t side, const index_t max_entities);
         void    hshg_free(hshg_t* const hshg);
 
         void    hshg_remove(hshg_t* hshg, index_t entity_index);
@@ -75,6 +107,71 @@ namespace ncore
         void    hshg_query_multithread(hshg_t* const hshg, const f32 min_x, const f32 min_y, const f32 min_z, const f32 max_x, const f32 max_y, const f32 max_z, query_func_t* const handler);
         void    hshg_optimize(hshg_t* const hshg);
 
+        //
+        // Collides the entities of 'hshg_a' with those of 'hshg_b', only pairs of one entity
+        // of each are reported, with the entity of A first. Both HSHGs must have been
+        // created with the same side and size.
+        //
+        void hshg_collide_with(hshg_t* const hshg_a, hshg_t* const hshg_b, collide_func_t* const handler);
+
+        //
+        // Thread-safe variants of insert and remove, these may be called from any number of
+        // threads at the same time, but not at the same time as any other hshg_ function.
+        //
+        // hshg_insert_concurrent() reserves a slot and pushes the entity onto its cell without
+        // taking a lock, the returned index is valid immediately. The modules watching the
+        // HSHG, such as the AOI, learn about it at the next hshg_flush(), hshg_update() or
+        // hshg_optimize(). hshg_remove_concurrent() only queues the entity, it stays visible
+        // until then, they detach all queued entities and compact the entity array. An
+        // entity may only be queued for removal once.
+        //
+        index_t hshg_insert_concurrent(hshg_t* const hshg, const f32 x, const f32 y, const f32 z, const f32 r, const index_t ref);
+        void    hshg_remove_concurrent(hshg_t* hshg, index_t entity_index);
+        void    hshg_flush(hshg_t* const hshg);
+
+        //
+        // The capacity given to hshg_create() can be grown, all entity arrays are moved in
+        // one go and the entity indices stay the same. hshg_reserve() grows to at least
+        // 'max_entities', with auto grow enabled hshg_insert() doubles the capacity when it
+        // is full instead of returning c_invalid_index. Growing is not possible from within
+        // a callback, while a view is acquired or with hshg_insert_concurrent().
+        //
+        bool hshg_reserve(hshg_t* const hshg, const index_t max_entities);
+        void hshg_set_auto_grow(hshg_t* const hshg, const bool enable);
+
+        //
+        // Walking the grids does not pay off for a handful of entities, a room or the inside
+        // of a vehicle. Up to 'max_entities' entities, hshg_collide() tests every pair and
+        // hshg_query() every entity against the query box instead. The handlers are called
+        // the same way, but hshg_collide() then only hands out the pairs whose hypercubes
+        // (boxes after hshg_enable_boxes()) overlap, which the grids hand out as well. 0, the
+        // default, turns this off, use the benchmark with '--small' to find the break even
+        // point on the target hardware.
+        //
+        void hshg_set_brute_force_threshold(hshg_t* const hshg, const u32 max_entities);
+
+        //
+        // When many entities end up in one cell, for example a crowd standing on one spot,
+        // walking that cell visits every pair of them. With a threshold set, hshg_collide()
+        // and hshg_collide_cached() sort the members of every cell holding more than
+        // 'threshold' entities on the axis they are spread the most, and only hand out the
+        // pairs of that cell that overlap on it. 0, the default, turns this off.
+        //
+        void hshg_set_crowd_threshold(hshg_t* const hshg, const u32 threshold);
+
+        //
+        // With sleep ticks set, an entity that was not moved, resized or woken during the
+        // last 'ticks' hshg_collide() calls falls asleep (at most 15, 0 turns sleeping off).
+        // hshg_collide() only walks the awake entities, each one finds the sleeping entities
+        // whose box (or hypercube) overlaps its own with a query, so a pair of two sleeping
+        // entities is not reported. An entity that moves into another cell, or is inserted,
+        // wakes all entities in that cell. Sleeping is ignored by the other collide functions.
+        // hshg_is_sleeping() and hshg_wake() may be called from update().
+        //
+        void hshg_set_sleep_ticks(hshg_t* const hshg, const u8 ticks);
+        bool hshg_is_sleeping(hshg_t const* const hshg, const index_t entity);
+        void hshg_wake(hshg_t* const hshg, const index_t entity);
+
         //
         // Returns the maximum amount of memory a HSHG with given parameters will use,
         // NOT including the usage of `hshg_optimize()`. If you also need to take that
@@ -92,6 +189,23 @@ namespace ncore
         //
         int_t hshg_memory_usage(const cell_t side, const index_t entities_max);
 
+        //
+        // Suggests the 'side' and 'size' to pass to hshg_create() from a sample of the
+        // entities that will be inserted. The cell size is picked from the histogram of
+        // the radii such that at least half of the entities fit the cells of the first
+        // grid, the number of cells from the spread of the positions. The number of cells
+        // is limited to about 8 per entity and to what fits in 'memory_budget' bytes (see
+        // hshg_memory_usage()). Returns false when even the smallest HSHG does not fit.
+        //
+        bool hshg_recommend_params(entity_t const* sample, const u32 sample_len, const index_t max_entities, const int_t memory_budget, cell_t& side, u32& size);
+
+        //
+        // Rebuilds the grids of a HSHG for a different 'side' and 'size', the entities
+        // and their indices stay as they are. Pending removals are processed first.
+        // Returns false (and leaves the HSHG as it was) when out of memory.
+        //
+        bool hshg_retune(hshg_t* const hshg, const cell_t side, const u32 size);
+
     }  // namespace nhshg
 }  // namespace ncore
 
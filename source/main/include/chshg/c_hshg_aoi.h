@@ -0,0 +1,65 @@
+#ifndef __C_HSHG_AOI_H__
+#define __C_HSHG_AOI_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+namespace ncore
+{
+    class alloc_t;
+
+    namespace nhshg
+    {
+        //
+        // Area of interest events reported by hshg_aoi_update(). An entity is inside an
+        // observer while its hypercube overlaps the box or the sphere of the observer.
+        //
+        class aoi_func_t
+        {
+        public:
+            virtual void enter(index_t observer, index_t e_ref) = 0;
+            virtual void leave(index_t observer, index_t e_ref) = 0;
+        };
+
+        //
+        // Keeps track of which entities are inside which observer, for example the clients of
+        // a game server, and reports only the changes. The work of hshg_aoi_update() follows
+        // the entities that were inserted, moved, resized or removed since the previous call
+        // and the observers that were added, changed or removed, not the number of entities
+        // that are visible. Entities are identified by their 'ref', which must be unique.
+        //
+        // Entities inserted with hshg_insert_concurrent() are seen after the next hshg_flush(),
+        // and the entities may not be moved from hshg_update_multithread().
+        // Only one AOI can be attached to a HSHG, and it must be freed before the HSHG.
+        //
+        class hshg_aoi_t;
+
+        hshg_aoi_t* hshg_aoi_create(alloc_t* allocator, hshg_t* hshg, const u32 max_observers);
+        void        hshg_aoi_free(hshg_aoi_t* aoi);
+
+        //
+        // Observers are identified by the index returned when adding them, c_invalid_index
+        // when all 'max_observers' are in use. Adding, changing and removing observers takes
+        // effect in the next hshg_aoi_update(), a new observer then enters all entities
+        // inside of it and a removed one leaves them.
+        //
+        index_t hshg_aoi_add_box(hshg_aoi_t* aoi, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2);
+        index_t hshg_aoi_add_sphere(hshg_aoi_t* aoi, const f32 x, const f32 y, const f32 z, const f32 r);
+        void    hshg_aoi_set_box(hshg_aoi_t* aoi, const index_t observer, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2);
+        void    hshg_aoi_set_sphere(hshg_aoi_t* aoi, const index_t observer, const f32 x, const f32 y, const f32 z, const f32 r);
+        void    hshg_aoi_remove(hshg_aoi_t* aoi, const index_t observer);
+
+        //
+        // Reports the entities that entered or left an observer since the previous call, call
+        // it once per tick after hshg_update(). May not be called from any callback.
+        // Returns false when out of memory, the events that could not be tracked are lost.
+        //
+        bool hshg_aoi_update(hshg_aoi_t* aoi, aoi_func_t* const handler);
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HSHG_AOI_H__
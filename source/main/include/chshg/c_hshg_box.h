@@ -0,0 +1,36 @@
+#ifndef __C_HSHG_BOX_H__
+#define __C_HSHG_BOX_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        //
+        // Gives every entity a half extent per axis, this costs another 12 bytes per entity.
+        // The entities that are already in the HSHG, and those inserted by hshg_insert(), get
+        // 'r' on every axis. Without it every entity is a hypercube of radius 'r'.
+        // Returns false when out of memory.
+        //
+        bool hshg_enable_boxes(hshg_t* const hshg);
+
+        //
+        // An entity with a box, its entity_t holds the center and the largest half extent as
+        // 'r', which also picks its grid. hshg_query(), the views, hshg_collide_cached(), the
+        // brute force and sleeping paths of hshg_collide() and the overflow set test the box,
+        // the other parts (swept collide, neighbour lists, AOI, snapshots, ghosts) its
+        // hypercube. hshg_resize() turns it into a hypercube of the new 'r' again.
+        //
+        index_t hshg_insert_box(hshg_t* const hshg, const f32 x, const f32 y, const f32 z, const f32 hx, const f32 hy, const f32 hz, const index_t ref);
+        void    hshg_resize_box(hshg_t* const hshg, const index_t entity, const f32 hx, const f32 hy, const f32 hz);
+        void    hshg_get_box(hshg_t const* const hshg, const index_t entity, f32& hx, f32& hy, f32& hz);
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HSHG_BOX_H__
@@ -0,0 +1,52 @@
+#ifndef __C_HSHG_IO_H__
+#define __C_HSHG_IO_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+namespace ncore
+{
+    class alloc_t;
+
+    namespace nhshg
+    {
+        //
+        // Writes the complete state of the HSHG, the grid parameters, the cells and the
+        // entity arrays, into 'buffer'. The image holds no pointers, only offsets relative
+        // to its start, every array starts at a 64 byte aligned offset and the entity arrays
+        // are stored at full capacity. Values are stored in the byte order of the machine.
+        //
+        // Returns the size of the image, nothing is written when that is more than
+        // 'buffer_size'. Call it with a nullptr buffer to get the size needed.
+        // May not be called from any callback. Entities queued by hshg_remove_concurrent()
+        // are not stored as removed, call hshg_flush() before saving.
+        //
+        int_t hshg_save(hshg_t const* hshg, void* buffer, const int_t buffer_size);
+
+        //
+        // Creates a new HSHG from an image written by hshg_save(), the image is copied.
+        // Returns nullptr when 'data' is not a valid image or an allocation failed, the
+        // header and every index in the arrays are checked.
+        //
+        hshg_t* hshg_load(alloc_t* allocator, void const* data, const int_t size);
+
+        //
+        // Creates a HSHG that uses the cells and the entity arrays of the image in place, for
+        // example a file mapped into memory (writable, or private copy-on-write). Only the
+        // HSHG object, its grids and the free list are allocated, so this does not depend on
+        // the number of entities. 'data' should be 64 byte aligned and must stay valid until
+        // hshg_free(), which does not free it. When the HSHG grows (hshg_reserve) or is
+        // optimized (hshg_optimize) its arrays move out of the image.
+        // Returns nullptr when the header of 'data' is not valid or an allocation failed.
+        // Only the header is validated, the arrays are used as they are, so only map images
+        // that hshg_save() wrote and that were not changed since.
+        //
+        hshg_t* hshg_map(alloc_t* allocator, void* data, const int_t size);
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HSHG_IO_H__
@@ -0,0 +1,53 @@
+#ifndef __C_HSHG_NEIGHBOR_LISTS_H__
+#define __C_HSHG_NEIGHBOR_LISTS_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+namespace ncore
+{
+    class alloc_t;
+
+    namespace nhshg
+    {
+        //
+        // Verlet neighbour lists, for every entity the entities whose hypercubes overlap its
+        // own when both are grown by 'skin' / 2, stored back to back (CSR). A span takes part
+        // with its box instead of its hypercube. As long as no entity moved or grew by more
+        // than 'skin' / 2 since the build, every overlapping pair is still in the lists, so
+        // they can be reused for several ticks.
+        //
+        // Lists are indexed by entity index, the same index that update() hands out, and hold
+        // entity indices. Every pair is in the lists of both of its entities.
+        //
+        class hshg_neighbor_lists_t;
+
+        hshg_neighbor_lists_t* hshg_neighbor_lists_create(alloc_t* allocator);
+        void                   hshg_neighbor_lists_free(hshg_neighbor_lists_t* lists);
+
+        //
+        // Builds the lists of all entities, returns false when out of memory. May not be
+        // called from any callback.
+        //
+        bool hshg_build_neighbor_lists(hshg_t* const hshg, const f32 skin, hshg_neighbor_lists_t* lists);
+
+        //
+        // True when the lists have to be rebuilt, because an entity moved or grew by more than
+        // 'skin' / 2 since the build, or entities were inserted, removed or reordered
+        // (hshg_optimize). This only reads the entities and the copy taken by the build.
+        //
+        bool hshg_neighbor_lists_expired(hshg_t const* const hshg, hshg_neighbor_lists_t const* lists);
+
+        //
+        // The neighbours of 'entity', 'len' is set to their number.
+        //
+        index_t const* hshg_neighbor_list(hshg_neighbor_lists_t const* lists, const index_t entity, index_t& len);
+        index_t        hshg_neighbor_lists_len(hshg_neighbor_lists_t const* lists);  // all neighbours of all entities
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HSHG_NEIGHBOR_LISTS_H__
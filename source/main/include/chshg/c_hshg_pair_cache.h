@@ -0,0 +1,50 @@
+#ifndef __C_HSHG_PAIR_CACHE_H__
+#define __C_HSHG_PAIR_CACHE_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+namespace ncore
+{
+    class alloc_t;
+
+    namespace nhshg
+    {
+        //
+        // Contact events reported by hshg_collide_cached(), pairs are identified by the
+        // 'ref' of both entities. A pair is in contact while the hypercubes of the two
+        // entities overlap, their boxes after hshg_enable_boxes().
+        //
+        class contact_func_t
+        {
+        public:
+            virtual void begin(nhshg::index_t e1_ref, nhshg::index_t e2_ref) = 0;  // started overlapping this tick
+            virtual void stay(nhshg::index_t e1_ref, nhshg::index_t e2_ref)  = 0;  // was and still is overlapping
+            virtual void end(nhshg::index_t e1_ref, nhshg::index_t e2_ref)   = 0;  // stopped overlapping, or one of them was removed
+        };
+
+        //
+        // Keeps the overlapping pairs of the previous hshg_collide_cached() call. Pairs of
+        // two entities that were neither inserted, moved (hshg_move) nor resized (hshg_resize)
+        // since then are carried forward without being tested again.
+        //
+        // 'max_pairs' is the number of pairs in contact that fit at first, the cache grows
+        // beyond that when needed, as it does for any number of entities removed between
+        // two calls. Only one pair cache can be attached to a HSHG, and it must be freed
+        // before the HSHG.
+        //
+        class hshg_pair_cache_t;
+
+        hshg_pair_cache_t* hshg_pair_cache_create(alloc_t* allocator, hshg_t* hshg, const u32 max_pairs);
+        void               hshg_pair_cache_free(hshg_pair_cache_t* cache);
+        u32                hshg_pair_cache_len(hshg_pair_cache_t const* cache);
+
+        void hshg_collide_cached(hshg_t* const hshg, hshg_pair_cache_t* cache, contact_func_t* const handler);
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HSHG_PAIR_CACHE_H__
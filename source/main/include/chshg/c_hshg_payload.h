@@ -0,0 +1,34 @@
+#ifndef __C_HSHG_PAYLOAD_H__
+#define __C_HSHG_PAYLOAD_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        //
+        // Gives every entity 'size' bytes of user data (rounded up to a multiple of 4), stored
+        // next to the entities and moved along with them by hshg_remove(), hshg_optimize() and
+        // hshg_save()/hshg_load(). A callback can then read the data of the entities it is
+        // handed without a lookup through 'ref'. The payload of a new entity is zeroed.
+        // Returns false when out of memory.
+        //
+        bool hshg_enable_payload(hshg_t* const hshg, const u32 size);
+
+        //
+        // The payload of the entity at index 'entity', or of an entity_t* as passed to the
+        // collide, query and view callbacks. hshg_payload_of() only accepts pointers into the
+        // HSHG itself, not copies such as those of the snapshots and neighbour lists.
+        //
+        void*       hshg_payload(hshg_t* const hshg, const index_t entity);
+        void const* hshg_payload_of(hshg_t const* const hshg, entity_t const* const entity);
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HSHG_PAYLOAD_H__
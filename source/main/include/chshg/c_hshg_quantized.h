@@ -0,0 +1,29 @@
+#ifndef __C_HSHG_QUANTIZED_H__
+#define __C_HSHG_QUANTIZED_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        //
+        // Keeps a copy of the position and radius of every entity in 16 bit fixed point, this
+        // costs another 8 bytes per entity. hshg_query() and hshg_collide_cached() then reject
+        // most of the candidates from these 8 bytes instead of the 16 of the entity_t (and the
+        // half extents), which fits four times as many of them in a cache line. The copy is
+        // rounded such that it never rejects a pair that overlaps, the results are the same.
+        // hshg_move(), hshg_resize() and their box and span variants keep it up to date, as
+        // they do the cells.
+        // Returns false when out of memory.
+        //
+        bool hshg_enable_quantized(hshg_t* const hshg);
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HSHG_QUANTIZED_H__
@@ -0,0 +1,71 @@
+#ifndef __C_HSHG_SHARD_H__
+#define __C_HSHG_SHARD_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        //
+        // Splits the bounds of a world into a grid of regions, every region is owned by one
+        // worker with its own HSHG. Positions outside of the bounds belong to the nearest
+        // region. Regions are numbered x first, then y, then z.
+        //
+        struct shard_layout_t
+        {
+            f32 m_min[3];
+            f32 m_max[3];
+            u32 m_regions[3];  // number of regions along x, y and z
+            f32 m_halo;        // entities this close to a region are exported to it
+        };
+
+        void hshg_shard_init(shard_layout_t& layout, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2, const u32 rx, const u32 ry, const u32 rz, const f32 halo);
+        u32  hshg_shard_region(shard_layout_t const& layout, const f32 x, const f32 y, const f32 z);
+        void hshg_shard_bounds(shard_layout_t const& layout, const u32 region, f32* min, f32* max);
+
+        // Writes the (at most 26) regions around 'region' to 'neighbors', returns their number
+        u32 hshg_shard_neighbors(shard_layout_t const& layout, const u32 region, u32* neighbors);
+
+        //
+        // A compact copy of an entity, as sent to the worker of a neighbouring region
+        //
+        struct ghost_t
+        {
+            entity_t m_entity;
+            index_t  m_ref;
+        };
+
+        //
+        // Writes the entities of 'hshg' (not its ghosts) that overlap the bounds of region
+        // 'neighbor' grown by the halo into 'ghosts'. Returns their number, only the first
+        // 'max_ghosts' are written when that is more.
+        //
+        u32 hshg_shard_export(hshg_t* const hshg, shard_layout_t const& layout, const u32 neighbor, ghost_t* ghosts, const u32 max_ghosts);
+
+        //
+        // Ghosts are read only members of the HSHG, they take part in collide and query but
+        // hshg_update() skips them, so they are never moved or removed by the owner of the
+        // HSHG. hshg_update_multithread() does hand them out, see hshg_is_ghost().
+        // Pairs of two ghosts are not reported by hshg_collide(), hshg_collide_cached() or
+        // hshg_collide_swept(), their own region does that, pairs of an entity and a ghost
+        // are reported by both regions. Give ghosts refs that tell them apart from the own
+        // entities.
+        //
+        // Every tick, clear the ghosts of the previous tick and import the ghosts exported by
+        // each of the neighbours. hshg_import_ghosts() returns the number of ghosts imported,
+        // which is less than 'len' when the HSHG is full.
+        // Neither may be called from any callback.
+        //
+        void hshg_clear_ghosts(hshg_t* const hshg);
+        u32  hshg_import_ghosts(hshg_t* const hshg, ghost_t const* ghosts, const u32 len);
+        bool hshg_is_ghost(hshg_t const* const hshg, const index_t entity);
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HSHG_SHARD_H__
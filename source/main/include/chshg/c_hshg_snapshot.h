@@ -0,0 +1,57 @@
+#ifndef __C_HSHG_SNAPSHOT_H__
+#define __C_HSHG_SNAPSHOT_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+namespace ncore
+{
+    class alloc_t;
+
+    namespace nhshg
+    {
+        //
+        // An immutable, compact copy of the spatial structure of a HSHG, the entities are
+        // stored in cell order and every cell is a range into that array.
+        //
+        class hshg_snapshot_t;
+
+        //
+        // A double buffer of snapshots. The thread that owns the HSHG publishes a new snapshot
+        // after each tick, any number of other threads can acquire the latest published
+        // snapshot and query it without a lock while the next tick mutates the live HSHG.
+        //
+        class hshg_snapshot_buffer_t;
+
+        hshg_snapshot_buffer_t* hshg_snapshot_buffer_create(alloc_t* allocator, hshg_t const* hshg);
+        void                    hshg_snapshot_buffer_free(hshg_snapshot_buffer_t* buffer);
+
+        //
+        // Copies the current state of the HSHG into the back buffer and makes it the front.
+        // Must be called from the thread that owns the HSHG, outside of any callback.
+        // Returns false when the back buffer is still acquired by a reader, in which case
+        // nothing is published and the previous snapshot stays the front.
+        //
+        bool hshg_snapshot_publish(hshg_snapshot_buffer_t* buffer, hshg_t* hshg);
+
+        //
+        // Returns the latest published snapshot, or nullptr when nothing was published yet.
+        // Every acquire must be paired with a release, a snapshot that is acquired will not
+        // be overwritten.
+        //
+        hshg_snapshot_t const* hshg_snapshot_acquire(hshg_snapshot_buffer_t* buffer);
+        void                   hshg_snapshot_release(hshg_snapshot_buffer_t* buffer, hshg_snapshot_t const* snapshot);
+
+        void            hshg_snapshot_query(hshg_snapshot_t const* snapshot, const f32 min_x, const f32 min_y, const f32 min_z, const f32 max_x, const f32 max_y, const f32 max_z, query_func_t* const handler);
+        u32             hshg_snapshot_sequence(hshg_snapshot_t const* snapshot);  // increases by one on every publish
+        index_t         hshg_snapshot_len(hshg_snapshot_t const* snapshot);
+        entity_t const* hshg_snapshot_entities(hshg_snapshot_t const* snapshot);
+        index_t const*  hshg_snapshot_refs(hshg_snapshot_t const* snapshot);
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HSHG_SNAPSHOT_H__
@@ -0,0 +1,41 @@
+#ifndef __C_HSHG_SPAN_H__
+#define __C_HSHG_SPAN_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        //
+        // An elongated shape, a wall or a long pipe, ends up in a grid as coarse as its
+        // longest side when inserted as a hypercube, where it is a candidate of everything
+        // around it. A span is an entity with a box, linked into every cell of the first
+        // grid that the box overlaps, so it only meets the entities along it. Every cell
+        // costs 16 bytes, so only use it for shapes that are long in one or two directions.
+        //
+        // The entity_t of a span holds the center of the box and its largest half extent as
+        // 'r', update() hands it out like any other entity. After changing x, y or z call
+        // hshg_move(), to change the box call hshg_resize_span() instead of hshg_resize().
+        // hshg_remove() removes it.
+        //
+        // hshg_collide(), hshg_collide_cached(), hshg_collide_with(), the neighbour lists and
+        // all queries (views included) hand out a span once per pair or query, however many
+        // cells it shares with the other entity, and only when its box overlaps.
+        // hshg_collide_swept() and snapshots see its bounding hypercube.
+        //
+        // Returns c_invalid_index when the HSHG is full or out of memory, or when the span
+        // nodes of all spans would not fit in an index_t (HSHG_INDEX_16 allows 65535).
+        //
+        index_t hshg_insert_span(hshg_t* const hshg, const f32 x, const f32 y, const f32 z, const f32 hx, const f32 hy, const f32 hz, const index_t ref);
+        void    hshg_resize_span(hshg_t* const hshg, const index_t entity, const f32 hx, const f32 hy, const f32 hz);
+        bool    hshg_is_span(hshg_t const* const hshg, const index_t entity);
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HSHG_SPAN_H__
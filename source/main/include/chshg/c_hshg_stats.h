@@ -0,0 +1,59 @@
+#ifndef __C_HSHG_STATS_H__
+#define __C_HSHG_STATS_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        const u32 c_stats_max_grids = 32;
+        const u32 c_stats_list_bins = 8;  // list lengths 1, 2-3, 4-7, ..., 128+
+
+        //
+        // Counters of the hot paths, only maintained when the library is compiled with
+        // HSHG_STATS defined, otherwise all of the counting code is compiled out.
+        //
+        struct hshg_stats_t
+        {
+            // accumulated since the last hshg_reset_stats()
+            u64 m_collide_calls;
+            u64 m_query_calls;
+            u64 m_cells_visited;     // cells looked at by collide and query
+            u64 m_nodes_walked;      // entities visited in the lists of those cells, or tested by a brute force path
+            u64 m_pairs_emitted;     // candidate pairs handed out by collide
+            u64 m_pairs_overlapped;  // candidate pairs that really overlapped, where that is tested (hshg_collide_cached)
+            u64 m_relinks;           // hshg_move() and hshg_resize() calls that changed the cell of an entity
+            u64 m_cache_rebuilds;    // update_cache() calls that had to rebuild the active grid chain
+            u64 m_grows;             // times the entity capacity was grown
+            u64 m_grow_bytes;        // bytes copied while growing
+            u64 m_crowded_cells;     // cells that collide found over the crowd threshold and sorted
+            u32 m_active_grids;      // grids holding entities at the last rebuild
+
+            // the state of the grids, taken by hshg_get_stats()
+            u32 m_grids_len;
+            u32 m_grid_entities[c_stats_max_grids];
+            u32 m_grid_occupied_cells[c_stats_max_grids];
+            u32 m_grid_max_list[c_stats_max_grids];
+            u32 m_grid_list_histogram[c_stats_max_grids][c_stats_list_bins];
+        };
+
+        //
+        // Copies the counters and walks all cells of all grids to fill in the occupancy
+        // and list length histograms, so this is not something to call every tick on a
+        // big HSHG. Returns false (with all values zero) when the stats are compiled out.
+        //
+        // hshg_query_multithread() and the hshg_view_ functions are not counted, since
+        // they may run on other threads.
+        //
+        bool hshg_get_stats(hshg_t const* const hshg, hshg_stats_t& stats);
+        void hshg_reset_stats(hshg_t* const hshg);
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HSHG_STATS_H__
@@ -0,0 +1,45 @@
+#ifndef __C_HSHG_SWEPT_H__
+#define __C_HSHG_SWEPT_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        //
+        // Candidates reported by hshg_collide_swept(), in order of increasing time of impact.
+        // 'toi' is the fraction of the tick [0, 1] at which the hypercubes of the two entities,
+        // moving linearly with their velocity, start to overlap (0 when they already do).
+        //
+        class swept_func_t
+        {
+        public:
+            virtual void swept(nhshg::entity_t const* e1, nhshg::index_t e1_ref, nhshg::entity_t const* e2, nhshg::index_t e2_ref, f32 toi) = 0;
+        };
+
+        //
+        // Adds a velocity to every entity, this costs another 12 bytes per entity. Inserted
+        // entities start with a zero velocity. Returns false when out of memory.
+        //
+        bool hshg_enable_velocities(hshg_t* const hshg);
+        void hshg_set_velocity(hshg_t* const hshg, const index_t entity, const f32 vx, const f32 vy, const f32 vz);
+
+        //
+        // Swept broad phase, an entity is 'fast' when it moves further than its radius
+        // within 'dt'. Every fast entity is tested with its swept box against the grids it
+        // is already in, it is not re-inserted into a coarser grid to cover the sweep.
+        // Only pairs with at least one fast entity are reported, the others are the job
+        // of hshg_collide(). Fast entities are tested against each other directly, so they
+        // are expected to be few.
+        //
+        void hshg_collide_swept(hshg_t* const hshg, const f32 dt, swept_func_t* const handler);
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HSHG_SWEPT_H__
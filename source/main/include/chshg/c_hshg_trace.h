@@ -0,0 +1,60 @@
+#ifndef __C_HSHG_TRACE_H__
+#define __C_HSHG_TRACE_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+namespace ncore
+{
+    class alloc_t;
+
+    namespace nhshg
+    {
+        enum trace_phase_e
+        {
+            TRACE_PHASE_UPDATE,        // the update callback
+            TRACE_PHASE_COMPACT,       // processing removals and compacting the entity array
+            TRACE_PHASE_UPDATE_CACHE,  // rebuilding the chain of active grids
+            TRACE_PHASE_COLLIDE,
+            TRACE_PHASE_QUERY,
+            TRACE_PHASE_OPTIMIZE,
+            TRACE_PHASE_COUNT
+        };
+
+        // The time source of a trace, in nanoseconds
+        class clock_func_t
+        {
+        public:
+            virtual u64 now_ns() = 0;
+        };
+
+        //
+        // Records the start and duration of every phase into a ring buffer holding the
+        // last 'capacity' events, which can be exported as Chrome trace-event JSON (load it
+        // in chrome://tracing or Perfetto).
+        //
+        // Only available when the library is compiled with HSHG_TRACE defined, otherwise
+        // hshg_trace_create() returns nullptr and the phases are not timed at all.
+        // One trace can be attached to a HSHG, and it must be freed before the HSHG.
+        //
+        class hshg_trace_t;
+
+        hshg_trace_t* hshg_trace_create(alloc_t* allocator, hshg_t* hshg, const u32 capacity, clock_func_t* clock);
+        void          hshg_trace_free(hshg_trace_t* trace);
+        u32           hshg_trace_len(hshg_trace_t const* trace);
+        void          hshg_trace_clear(hshg_trace_t* trace);
+
+        //
+        // Writes the recorded events, oldest first, as zero terminated JSON into 'buffer'.
+        // Returns the length of the complete JSON, when that is not less than 'buffer_size'
+        // the output was truncated. Call it with a nullptr buffer to get the length needed.
+        //
+        u32 hshg_trace_export(hshg_trace_t const* trace, char* buffer, const u32 buffer_size);
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HSHG_TRACE_H__
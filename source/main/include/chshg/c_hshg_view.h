@@ -0,0 +1,68 @@
+#ifndef __C_HSHG_VIEW_H__
+#define __C_HSHG_VIEW_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        //
+        // A read-only view of a HSHG, acquired once per phase by the thread that owns the
+        // HSHG. Acquiring refreshes the active-grid chain and freezes the structure: until
+        // the view is released the HSHG may not be modified (insert, update, flush and
+        // optimize assert on this), hshg_collide() is still allowed.
+        //
+        // The hshg_view_ functions never write to the HSHG, so any number of threads may
+        // use the same view at the same time, for example to fan queries out over a thread
+        // pool during hshg_collide().
+        //
+        struct hshg_view_t
+        {
+            hshg_t const* m_hshg;
+        };
+
+        struct knn_result_t
+        {
+            entity_t const* m_entity;
+            index_t         m_ref;
+            f32             m_dist_sq;  // squared distance from the point to the entity's hypercube, or box after hshg_enable_boxes()
+        };
+
+        class raycast_func_t
+        {
+        public:
+            //
+            // Called for every entity the ray enters at 't' (0 when the origin is inside the
+            // entity), in no particular order. Return the new maximum 't' of the ray, that is
+            // 't' itself for a closest-hit search, the current maximum to collect all hits,
+            // or 0 to stop.
+            //
+            virtual f32 hit(nhshg::entity_t const* e, nhshg::index_t e_ref, f32 t) = 0;
+        };
+
+        hshg_view_t hshg_view_acquire(hshg_t* const hshg);
+        void        hshg_view_release(hshg_t* const hshg, hshg_view_t& view);
+
+        void hshg_view_query(hshg_view_t const& view, const f32 min_x, const f32 min_y, const f32 min_z, const f32 max_x, const f32 max_y, const f32 max_z, query_func_t* const handler);
+
+        //
+        // Finds the (at most) 'k' entities nearest to the point within 'max_dist', sorted
+        // from nearest to farthest, and returns how many were found.
+        //
+        u32 hshg_view_knn(hshg_view_t const& view, const f32 x, const f32 y, const f32 z, const f32 max_dist, knn_result_t* results, const u32 k);
+
+        //
+        // Casts a ray from the origin along 'dir' (need not be normalized, 't' is in units
+        // of its length) up to 'max_t', every entity is reported at most once.
+        //
+        void hshg_view_raycast(hshg_view_t const& view, const f32 ox, const f32 oy, const f32 oz, const f32 dx, const f32 dy, const f32 dz, const f32 max_t, raycast_func_t* const handler);
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HSHG_VIEW_H__
@@ -0,0 +1,1233 @@
+#ifndef __C_HIERARCHICAL_SPATIAL_HASHGRID_INTERNAL_H__
+#define __C_HIERARCHICAL_SPATIAL_HASHGRID_INTERNAL_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+    #pragma once
+#endif
+
+#include "cbase/c_allocator.h"
+#include "cbase/c_binmap.h"
+#include "cbase/c_integer.h"
+#include "cbase/c_float.h"
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_stats.h"
+#include "chshg/c_hshg_trace.h"
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+// Statements that only exist when the library is compiled with HSHG_STATS
+#ifdef HSHG_STATS
+    #define HSHG_STAT(statement) statement
+#else
+    #define HSHG_STAT(statement)
+#endif
+
+//
+// Internal representation of the HSHG, shared by the translation units of this library.
+// Not part of the public API.
+//
+
+namespace ncore
+{
+    namespace nhshg
+    {
+        // Minimal set of sequentially consistent atomic operations on plain u32's and u16's, used
+        // by the concurrent insert/remove paths and the snapshot buffer. These only need to be
+        // atomic with respect to each other, the non-concurrent API is still single threaded.
+        namespace natomic
+        {
+#if defined(_MSC_VER)
+            inline u32  load(u32 const* p) { return (u32)_InterlockedOr((long volatile*)p, 0); }
+            inline void store(u32* p, u32 v) { _InterlockedExchange((long volatile*)p, (long)v); }
+            inline u32  fetch_add(u32* p, u32 v) { return (u32)_InterlockedExchangeAdd((long volatile*)p, (long)v); }
+            inline u32  fetch_or(u32* p, u32 v) { return (u32)_InterlockedOr((long volatile*)p, (long)v); }
+            inline bool cas(u32* p, u32* expected, u32 desired)
+            {
+                const u32 prev = (u32)_InterlockedCompareExchange((long volatile*)p, (long)desired, (long)*expected);
+                if (prev == *expected)
+                    return true;
+                *expected = prev;
+                return false;
+            }
+
+            // index_t is a u16 with HSHG_INDEX_16
+            inline u16  load(u16 const* p) { return (u16)_InterlockedOr16((short volatile*)p, 0); }
+            inline u16  fetch_add(u16* p, u16 v) { return (u16)_InterlockedExchangeAdd16((short volatile*)p, (short)v); }
+            inline bool cas(u16* p, u16* expected, u16 desired)
+            {
+                const u16 prev = (u16)_InterlockedCompareExchange16((short volatile*)p, (short)desired, (short)*expected);
+                if (prev == *expected)
+                    return true;
+                *expected = prev;
+                return false;
+            }
+#else
+            inline u32  load(u32 const* p) { return __atomic_load_n(p, __ATOMIC_SEQ_CST); }
+            inline void store(u32* p, u32 v) { __atomic_store_n(p, v, __ATOMIC_SEQ_CST); }
+            inline u32  fetch_add(u32* p, u32 v) { return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST); }
+            inline u32  fetch_or(u32* p, u32 v) { return __atomic_fetch_or(p, v, __ATOMIC_SEQ_CST); }
+            inline bool cas(u32* p, u32* expected, u32 desired) { return __atomic_compare_exchange_n(p, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); }
+
+            // index_t is a u16 with HSHG_INDEX_16
+            inline u16  load(u16 const* p) { return __atomic_load_n(p, __ATOMIC_SEQ_CST); }
+            inline u16  fetch_add(u16* p, u16 v) { return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST); }
+            inline bool cas(u16* p, u16* expected, u16 desired) { return __atomic_compare_exchange_n(p, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); }
+#endif
+        }  // namespace natomic
+
+        struct grid_t
+        {
+            grid_t();
+            grid_t(index_t* const _cells, const cell_t _cells_side, const u32 _cell_size);
+            grid_t(const grid_t& _grid, index_t* const _cells);
+
+            DCORE_CLASS_PLACEMENT_NEW_DELETE
+
+            index_t* const  m_cells;
+            cell_t const    m_cells_side;
+            cell_sq_t const m_cells_sq;
+            cell_t const    m_cells_mask;   // for masking index_t to wrap around grid
+            u8 const        m_cells2d_log;  // number of bits to shift y
+            u8 const        m_cells3d_log;  // number of bits to shift z
+            u8              m_shift;
+            f32 const       m_inverse_cell_size;
+            index_t         m_entities_len;
+        };
+
+        // A cell will hold a doubly linked list of entities, this is a part of an entity
+        // used as a node in the doubly linked list.
+        struct entity_node_t
+        {
+            index_t m_next;
+            index_t m_prev;
+        };
+
+        // Per entity flags, stored in hshg_t::m_entities_flags
+        const u8 c_entity_dirty   = 0x01;  // moved, resized or inserted since the dirty flags were last cleared
+        const u8 c_entity_fast    = 0x02;  // only valid during hshg_collide_swept()
+        const u8 c_entity_crowded = 0x04;  // in a crowded cell, only valid during collide
+        const u8 c_entity_ghost   = 0x08;  // read only copy of an entity of another region, see hshg_import_ghosts()
+        const u8 c_entity_listed  = 0x02;  // shares the bit of c_entity_fast, only set while m_awake is gathered
+
+        // The upper 4 bits count the hshg_collide() calls since the entity was last moved,
+        // resized or woken, until it falls asleep, see hshg_t::is_sleeping()
+        const u8 c_entity_idle_shift = 4;
+        const u8 c_entity_idle_mask  = 0xF0;
+
+        // Links an entity inserted by hshg_insert_span() to its cells, for every other entity
+        // m_nodes is c_invalid_index. Its box is in m_entities_half.
+        struct span_t
+        {
+            index_t     m_nodes;  // first of the span nodes of the entity, chained by m_own_next
+            mutable u32 m_stamp;  // dedups the pairs of spans, see visit_span_pairs()
+        };
+
+        // The position and radius of an entity at a lower precision, see hshg_enable_quantized().
+        // A coordinate is in 1/65536th of the folding period (hshg_t::m_grid_size) and wraps
+        // along with it, the radius is rounded up.
+        struct quant_t
+        {
+            u16 m_x;
+            u16 m_y;
+            u16 m_z;
+            u16 m_r;
+        };
+
+        // Membership of a span in one of the cells of the first grid that its box overlaps
+        struct span_node_t
+        {
+            index_t   m_entity;
+            index_t   m_next;      // next span node in the cell, or in the free list
+            index_t   m_own_next;  // next span node of the same entity
+            cell_sq_t m_cell;
+        };
+
+        class hshg_t;
+
+        //
+        // Allocator handing out 64 byte aligned blocks from one big allocation, used as the
+        // allocator of a HSHG created by hshg_create_arena(). Freed blocks are merged with
+        // their free neighbours and reused, requests that do not fit (or a pointer that is
+        // not from the arena) go to the parent allocator.
+        //
+        // hshg_map() uses it with a region without any blocks, the memory of the caller,
+        // then everything is allocated by the parent and pointers into the region are
+        // never freed.
+        //
+        class arena_alloc_t : public alloc_t
+        {
+        public:
+            DCORE_CLASS_PLACEMENT_NEW_DELETE
+
+            enum
+            {
+                c_align      = 64,
+                c_max_blocks = 32
+            };
+
+            arena_alloc_t(alloc_t* parent, void* base, u8* region, u32 region_size);
+
+            struct block_t
+            {
+                u32 m_offset;
+                u32 m_size;
+                u32 m_used;
+            };
+
+            alloc_t* m_parent;
+            void*    m_base;  // the allocation from the parent, this object lives at its start
+            u8*      m_region;
+            u32      m_region_size;
+            u32      m_blocks_len;
+            block_t  m_blocks[c_max_blocks];  // sorted on offset, covering the whole region
+
+        protected:
+            virtual void* v_allocate(u32 size, u32 align);
+            virtual void  v_deallocate(void* p);
+        };
+
+        //
+        // Internal hook for modules that need to know about structural changes of a HSHG,
+        // observers are registered in a singly linked list on the HSHG.
+        //
+        class observer_t
+        {
+        public:
+            observer_t()
+                : m_next(nullptr)
+            {
+            }
+
+            // Called before the entity is detached from its grid and freed.
+            virtual void on_remove(hshg_t* hshg, index_t entity) {}
+
+            // Called after the entity was inserted (hshg_insert), moved or resized.
+            virtual void on_move(hshg_t* hshg, index_t entity) {}
+
+            // Called before the entity capacity grows to 'max_entities', returning false
+            // (out of memory) cancels the growth.
+            virtual bool on_reserve(hshg_t* hshg, index_t max_entities) { return true; }
+
+            observer_t* m_next;
+        };
+
+        // The extent of an entity on one axis, arrays of these are sorted on m_min for sweep
+        // and prune, see hshg_t::rebuild_overflow() and hshg_t::build_crowds()
+        struct axis_entry_t
+        {
+            f32     m_min;
+            f32     m_max;
+            index_t m_entity;
+        };
+
+        void sort_axis_entries(axis_entry_t* const entries, const index_t len);
+
+        // A cell holding more entities than the crowd threshold, its members are sorted on
+        // the axis on which they are spread the most
+        struct crowd_t
+        {
+            index_t m_head;   // first entity of the list of the cell
+            index_t m_begin;  // first member in m_crowd_entries
+            index_t m_len;
+            u8      m_axis;   // 0 = x, 1 = y, 2 = z
+            f32     m_width;  // the widest member, 2 * r
+        };
+
+        class hshg_t
+        {
+        public:
+            hshg_t();
+            hshg_t(index_t* _cells, grid_t* _grids, u32 _size, cell_sq_t _cells_len, u8 _grids_len, u32 _grid_size, u32 _max_entities);
+
+            DCORE_CLASS_PLACEMENT_NEW_DELETE
+
+            //
+            //  Creates a new HSHG.
+            //
+            // \param side; the number of cells on the smallest grid's edge (must be a power of two!)
+            // \param size; smallest cell size in world units, e.g. 8 = 8 meters (must be a power of two!)
+            //
+            inline u8 calling() const { return m_bupdating | m_bcolliding | m_bquerying; }
+
+            inline void set_updating(bool value) { m_bupdating = value; }
+            inline void set_colliding(bool value) { m_bcolliding = value; }
+            inline void set_querying(bool value) { m_bquerying = value; }
+            inline void set_removed(bool value) { m_bremoved = value; }
+
+            inline bool is_updating() const { return m_bupdating; }
+            inline bool is_colliding() const { return m_bcolliding; }
+            inline bool is_querying() const { return m_bquerying; }
+            inline bool is_removed() const { return m_bremoved; }
+            inline bool is_viewed() const { return m_views != 0; }
+
+            void update_cache();
+
+            inline u8 get_grid(const f32 r) const
+            {
+                const u32 rounded = r + r;
+                if (rounded < m_cell_size)
+                {
+                    return 0;
+                }
+                const u8 grid = m_cell_log - math::g_countLeadingZeros(rounded) + 1;
+                return math::g_min(grid, m_grids_len);
+            }
+
+            // Entities too big for a cell of the top grid live in the overflow grid, a grid
+            // of a single cell that is stored after the real grids (m_grids[m_grids_len]).
+            inline bool is_overflow(const index_t idx) const { return m_entities_grid[idx] == m_grids_len; }
+            inline const grid_t* overflow_grid() const { return m_grids + m_grids_len; }
+
+            void rebuild_overflow();
+
+            // Finds the cells with more than m_crowd_threshold entities and sorts their members,
+            // which visit_collide_pairs() then sweeps instead of walking the whole list.
+            void build_crowds();
+            void clear_crowds();
+
+            inline bool is_sleeping(const index_t idx) const { return m_sleep_ticks != 0 && (m_entities_flags[idx] >> c_entity_idle_shift) >= m_sleep_ticks; }
+            inline void wake(const index_t idx)
+            {
+                if (is_sleeping(idx))
+                    push_awake(idx);
+                m_entities_flags[idx] &= ~c_entity_idle_mask;
+            }
+
+            // Adds an entity that is awake to m_awake, see hshg_collide()
+            void push_awake(const index_t idx);
+
+            // Wakes all entities in the cell of entity 'idx', after it entered that cell
+            void wake_cell(const index_t idx);
+
+            // Spans live in the overflow grid, so every entity array keeps working for them,
+            // but are not part of the sorted overflow set. Instead they are linked into all of
+            // the cells of the first grid that their box overlaps, see c_hshg_span.cpp.
+            inline bool is_span(const index_t idx) const { return m_entities_span != nullptr && m_entities_span[idx].m_nodes != c_invalid_index; }
+
+            bool enable_spans();
+            bool link_span(const index_t idx);
+            void unlink_span(const index_t idx);
+            bool relink_spans();  // after the grids were loaded
+            bool prepare_spans(const grid_t* const grids, const u32 grid_size, const f32 inverse_grid_size, index_t*& span_cells);
+            void relink_spans(index_t* const span_cells);  // after the grids were replaced, with the cells of prepare_spans()
+            void quantize(const index_t idx);
+            u32  next_span_stamp() const;
+
+            index_t create_entity()
+            {
+                if (m_entities_used < m_entities_max)
+                    return m_entities_used++;
+
+                // No more free entities available
+                return c_invalid_index;
+            }
+
+            // Lock-free slot reservation, the entity array stays contiguous since the
+            // counter only moves forward while there is room.
+            index_t create_entity_concurrent()
+            {
+                index_t used = natomic::load(&m_entities_used);
+                while (used < m_entities_max)
+                {
+                    if (natomic::cas(&m_entities_used, &used, used + 1))
+                        return used;
+                }
+
+                // No more free entities available
+                return c_invalid_index;
+            }
+
+            index_t insert_entity(const f32 x, const f32 y, const f32 z, const f32 r, const index_t ref, const u8 grid);
+            void    init_entity(const index_t idx, const f32 x, const f32 y, const f32 z, const f32 r, const index_t ref, const u8 grid);
+            void    insert_into_grid(const index_t entity_id);
+            void insert_into_grid_concurrent(const index_t entity_id);
+            void detach_from_grid(index_t entity_id);
+
+            // Marks the entity as free, the slot is reclaimed by compact().
+            void destroy_entity(index_t entity_id)
+            {
+                if (is_span(entity_id))
+                    unlink_span(entity_id);
+                m_free_entities.set_free(entity_id);
+            }
+
+            void flush_inserted();
+            void flush_removed();
+            void compact();
+
+            void add_observer(observer_t* observer);
+            void remove_observer(observer_t* observer);
+
+            bool reserve(index_t max_entities);
+
+            inline void notify_remove(index_t entity_id)
+            {
+                for (observer_t* o = m_observers; o != nullptr; o = o->m_next)
+                    o->on_remove(this, entity_id);
+            }
+
+            inline void notify_move(index_t entity_id)
+            {
+                if (m_entities_quant != nullptr)
+                    quantize(entity_id);
+                for (observer_t* o = m_observers; o != nullptr; o = o->m_next)
+                    o->on_move(this, entity_id);
+            }
+
+            entity_t*      m_entities;         // entities * 16 bytes
+            entity_node_t* m_entities_node;    // entities * 8 bytes
+            cell_sq_t*     m_entities_cell;    // entities * 4 bytes
+            u8*            m_entities_grid;    // entities * 1 byte
+            index_t*       m_entities_ref;     // entities * 4 bytes
+            u8*            m_entities_flags;   // entities * 1 byte
+            f32*           m_entities_vel;     // entities * 12 bytes, optional (see hshg_enable_velocities)
+            f32*           m_entities_half;    // entities * 12 bytes, optional (see hshg_enable_boxes)
+            span_t*        m_entities_span;    // entities * 8 bytes, optional (see hshg_insert_span)
+            u8*            m_entities_payload; // entities * m_payload_size bytes, optional (see hshg_enable_payload)
+            u32            m_payload_size;
+            quant_t*       m_entities_quant;   // entities * 8 bytes, optional (see hshg_enable_quantized)
+
+            index_t* m_cells;
+
+            u8 m_cell_log;
+            u8 m_grids_len;
+
+            u8 m_bupdating : 1;
+            u8 m_bcolliding : 1;
+            u8 m_bquerying : 1;
+            u8 m_bremoved : 1;
+            u8 m_bgrow : 1;        // hshg_insert() grows the capacity when full
+            u8 m_bawake_lost : 1;  // m_awake misses entities, the next hshg_collide() rebuilds it
+
+            u32 m_old_cache;
+            u32 m_new_cache;
+            u32 m_views;  // number of acquired views, the structure is frozen while > 0
+
+            u32       m_grid_size;    // side * size, not a number of cells
+            f32       m_inverse_grid_size;
+            f32       m_quant_scale;  // 65536 / m_grid_size, see quant_t
+            cell_sq_t m_cells_len;
+            u32       m_cell_size;
+
+            binmap_t      m_free_entities;
+            index_t       m_entities_used;
+            index_t       m_entities_max;
+
+            index_t* m_inserted;      // entities inserted by hshg_insert_concurrent(), see flush_inserted()
+            index_t  m_inserted_len;  // number of queued entities
+            index_t* m_removed;       // entities queued by hshg_remove_concurrent()
+            index_t  m_removed_len;   // number of queued entities
+            index_t  m_ghosts_len;   // entities flagged c_entity_ghost
+
+            axis_entry_t* m_overflow;        // the overflow entities sorted on their extent on x
+            index_t       m_overflow_len;
+            index_t       m_overflow_cap;
+            f32           m_overflow_width;  // the widest overflow entity, 2 * r
+            u32           m_overflow_dirty;  // an overflow entity was added, removed, moved or resized
+
+            u32           m_brute_force_threshold;  // collide and query test all pairs up to this many entities
+
+            u32           m_crowd_threshold;  // 0 when crowded cells are not detected
+            crowd_t*      m_crowds;           // the crowded cells found by build_crowds(), sorted on m_head
+            u32           m_crowds_len;
+            u32           m_crowds_cap;
+            axis_entry_t* m_crowd_entries;  // the members of all crowded cells
+            index_t       m_crowd_entries_cap;
+
+            index_t*     m_span_cells;       // per cell of the first grid the first span node, nullptr without spans
+            span_node_t* m_span_nodes;
+            index_t      m_span_nodes_len;       // nodes ever used, the free ones are in m_span_nodes_free
+            index_t      m_span_nodes_cap;
+            index_t      m_span_nodes_free;      // free list through m_next
+            index_t      m_span_nodes_free_len;  // nodes in m_span_nodes_free
+            mutable u32  m_span_stamp;
+
+            u8       m_sleep_ticks;  // 0 when entities do not fall asleep
+            index_t* m_awake;        // every awake entity, plus the stale entries that hshg_collide() drops
+            u32      m_awake_len;
+            u32      m_awake_cap;
+
+            grid_t*        m_grids;
+            observer_t*    m_observers;
+            alloc_t*       m_allocator;
+            arena_alloc_t* m_arena;  // == m_allocator when created by hshg_create_arena()
+
+#ifdef HSHG_STATS
+            mutable hshg_stats_t m_stats;  // counted from const paths as well, never by views
+#endif
+#ifdef HSHG_TRACE
+            hshg_trace_t* m_trace;  // nullptr when no trace is attached
+#endif
+        };
+
+        struct trace_event_t
+        {
+            u64 m_start;  // ns
+            u64 m_duration;
+            u32 m_phase;
+        };
+
+        class hshg_trace_t
+        {
+        public:
+            DCORE_CLASS_PLACEMENT_NEW_DELETE
+
+            inline void record(const u32 phase, const u64 start, const u64 end)
+            {
+                trace_event_t& event = m_events[m_written & m_mask];
+                event.m_start        = start;
+                event.m_duration     = end - start;
+                event.m_phase        = phase;
+                ++m_written;
+            }
+
+            hshg_t*        m_hshg;
+            alloc_t*       m_allocator;
+            clock_func_t*  m_clock;
+            trace_event_t* m_events;  // ring buffer, power of 2 number of events
+            u32            m_mask;
+            u32            m_written;  // total number of events recorded
+        };
+
+        // Times the enclosing scope, does nothing when no trace is attached
+        struct trace_scope_t
+        {
+            inline trace_scope_t(hshg_trace_t* trace, const u32 phase)
+                : m_trace(trace)
+                , m_phase(phase)
+                , m_start(trace != nullptr ? trace->m_clock->now_ns() : 0)
+            {
+            }
+            inline ~trace_scope_t()
+            {
+                if (m_trace != nullptr)
+                    m_trace->record(m_phase, m_start, m_trace->m_clock->now_ns());
+            }
+
+            hshg_trace_t* const m_trace;
+            u32 const           m_phase;
+            u64 const           m_start;
+        };
+
+// Times the rest of the enclosing scope as 'phase', only when compiled with HSHG_TRACE
+#ifdef HSHG_TRACE
+    #define HSHG_TRACE_SCOPE(hshg, phase) trace_scope_t trace_scope_##phase((hshg)->m_trace, phase)
+#else
+    #define HSHG_TRACE_SCOPE(hshg, phase)
+#endif
+
+        inline cell_t grid_get_cell_1d(const grid_t* const grid, const f32 x)
+        {
+            const cell_t cell = math::abs(x) * grid->m_inverse_cell_size;
+            if (cell & grid->m_cells_side)
+            {
+                return grid->m_cells_mask - (cell & grid->m_cells_mask);
+            }
+            return cell & grid->m_cells_mask;
+        }
+
+        inline cell_sq_t grid_get_idx(const grid_t* const grid, const cell_sq_t x, const cell_sq_t y, const cell_sq_t z) { return x | (y << grid->m_cells2d_log) | (z << grid->m_cells3d_log); }
+        inline cell_t    idx_get_x(const grid_t* const grid, const cell_sq_t cell) { return cell & grid->m_cells_mask; }
+        inline cell_t    idx_get_y(const grid_t* const grid, const cell_sq_t cell) { return (cell >> grid->m_cells2d_log) & grid->m_cells_mask; }
+        inline cell_t    idx_get_z(const grid_t* const grid, const cell_sq_t cell) { return cell >> grid->m_cells3d_log; }
+
+        inline cell_sq_t grid_get_cell(const grid_t* const grid, const f32 x, const f32 y, const f32 z)
+        {
+            const cell_t cell_x = grid_get_cell_1d(grid, x);
+            const cell_t cell_y = grid_get_cell_1d(grid, y);
+            const cell_t cell_z = grid_get_cell_1d(grid, z);
+
+            return grid_get_idx(grid, cell_x, cell_y, cell_z);
+        }
+
+        struct cell_range_t
+        {
+            cell_t start;
+            cell_t end;
+        };
+
+        inline cell_range_t map_pos(const grid_t* const grid, const u32 grid_size, const f32 inverse_grid_size, const f32 _x1, const f32 _x2)
+        {
+            f32 x1;
+            f32 x2;
+
+            if (_x1 < 0)
+            {
+                const f32 shift = (((cell_t)(-_x1 * inverse_grid_size) << 1) + 2) * grid_size;
+
+                x1 = _x1 + shift;
+                x2 = _x2 + shift;
+            }
+            else
+            {
+                x1 = _x1;
+                x2 = _x2;
+            }
+
+            cell_t folds = (x2 - (cell_t)(x1 * inverse_grid_size) * grid_size) * inverse_grid_size;
+
+            cell_t start;
+            cell_t end;
+            switch (folds)
+            {
+                case 0:
+                {
+                    const cell_t cell = grid_get_cell_1d(grid, x1);
+
+                    end   = grid_get_cell_1d(grid, x2);
+                    start = math::g_min(cell, end);
+                    end   = math::g_max(cell, end);
+
+                    break;
+                }
+                case 1:
+                {
+                    const cell_t cell = math::abs(x1) * grid->m_inverse_cell_size;
+
+                    end = grid_get_cell_1d(grid, x2);
+
+                    if (cell & grid->m_cells_side)
+                    {
+                        start = 0;
+                        end   = math::g_max((cell_t)(grid->m_cells_mask - (cell & grid->m_cells_mask)), end);
+                    }
+                    else
+                    {
+                        start = math::g_min((cell_t)(cell & grid->m_cells_mask), end);
+                        end   = grid->m_cells_mask;
+                    }
+
+                    break;
+                }
+                default:
+                {
+                    start = 0;
+                    end   = grid->m_cells_mask;
+
+                    break;
+                }
+            }
+
+            return {start, end};
+        }
+
+        //
+        // Walks the cells of all active grids that may hold an entity overlapping the
+        // given cell ranges (as returned by map_pos() for the first grid), calling
+        // 'visitor(grid, cell)' for every one of them. The active grids are found by
+        // following the m_shift chain that update_cache() maintains. The overflow grid is
+        // not part of the chain, see visit_overflow_cell() and visit_overflow_range().
+        //
+        template <typename visitor_t>
+        inline void visit_query_cells(const grid_t* grid, const u8 grids_len, cell_range_t x, cell_range_t y, cell_range_t z, visitor_t& visitor)
+        {
+            const grid_t* const grid_max = grid + grids_len;
+
+            u8 shift = 0;
+
+            while (1)
+            {
+                if (grid == grid_max)
+                {
+                    return;
+                }
+
+                if (grid->m_entities_len != 0)
+                {
+                    break;
+                }
+
+                ++grid;
+                ++shift;
+            }
+
+            x.start >>= shift;
+            y.start >>= shift;
+            z.start >>= shift;
+
+            x.end >>= shift;
+            y.end >>= shift;
+            z.end >>= shift;
+
+            while (1)
+            {
+                const cell_t s_x = x.start != 0 ? x.start - 1 : 0;
+                const cell_t s_y = y.start != 0 ? y.start - 1 : 0;
+                const cell_t s_z = z.start != 0 ? z.start - 1 : 0;
+
+                const cell_t e_x = x.end != grid->m_cells_mask ? x.end + 1 : x.end;
+                const cell_t e_y = y.end != grid->m_cells_mask ? y.end + 1 : y.end;
+                const cell_t e_z = z.end != grid->m_cells_mask ? z.end + 1 : z.end;
+
+                for (cell_t cz = s_z; cz <= e_z; ++cz)
+                {
+                    for (cell_t cy = s_y; cy <= e_y; ++cy)
+                    {
+                        for (cell_t cx = s_x; cx <= e_x; ++cx)
+                        {
+                            visitor(grid, grid_get_idx(grid, cx, cy, cz));
+                        }
+                    }
+                }
+
+                if (grid->m_shift)
+                {
+                    x.start >>= grid->m_shift;
+                    y.start >>= grid->m_shift;
+                    z.start >>= grid->m_shift;
+
+                    x.end >>= grid->m_shift;
+                    y.end >>= grid->m_shift;
+                    z.end >>= grid->m_shift;
+
+                    grid += grid->m_shift;
+                }
+                else
+                {
+                    break;
+                }
+            }
+        }
+
+        // Calls 'visitor(grid, cell)' for the single cell of the overflow grid when it holds
+        // entities, for visitors that walk every overflow entity.
+        template <typename visitor_t>
+        inline void visit_overflow_cell(const grid_t* grids, const u8 grids_len, visitor_t& visitor)
+        {
+            if (grids[grids_len].m_entities_len != 0)
+            {
+                visitor(grids + grids_len, 0);
+            }
+        }
+
+        // First entry of the sorted 'entries' with m_min >= 'min'
+        inline index_t lower_bound(const axis_entry_t* const entries, const index_t len, const f32 min)
+        {
+            index_t lo = 0;
+            index_t hi = len;
+            while (lo < hi)
+            {
+                const index_t mid = (lo + hi) >> 1;
+                if (entries[mid].m_min < min)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return lo;
+        }
+
+        // Calls 'visitor(n)' for every entity 'n' of the sorted 'entries' whose extent overlaps
+        // [x1, x2]. Everything that can overlap starts within [x1 - width, x2], where 'width'
+        // is the widest entity.
+        template <typename visitor_t>
+        inline void visit_sorted_range(const axis_entry_t* const entries, const index_t len, const f32 width, const f32 x1, const f32 x2, visitor_t& visitor)
+        {
+            for (index_t i = lower_bound(entries, len, x1 - width); i < len && entries[i].m_min <= x2; ++i)
+            {
+                if (entries[i].m_max >= x1)
+                {
+                    visitor(entries[i].m_entity);
+                }
+            }
+        }
+
+        // Entity 'i', with the extent [min, max], visits the entities after it in the sorted
+        // 'entries' that it overlaps, so every pair of them is visited once (sweep and prune).
+        template <typename pair_visitor_t>
+        inline void visit_sorted_pairs(const hshg_t* hshg, const axis_entry_t* const entries, const index_t len, const index_t i, const f32 min, const f32 max, pair_visitor_t& visitor)
+        {
+            index_t p = lower_bound(entries, len, min);
+            while (p < len && entries[p].m_entity != i)
+                ++p;
+
+            for (index_t n = p + 1; n < len && entries[n].m_min <= max; ++n)
+            {
+                HSHG_STAT(++hshg->m_stats.m_nodes_walked);
+                visitor(i, entries[n].m_entity);
+            }
+        }
+
+        // Calls 'visitor(n)' for every overflow entity 'n' whose extent on x overlaps [x1, x2].
+        template <typename visitor_t>
+        inline void visit_overflow_range(const hshg_t* hshg, const f32 x1, const f32 x2, visitor_t& visitor)
+        {
+            visit_sorted_range(hshg->m_overflow, hshg->m_overflow_len, hshg->m_overflow_width, x1, x2, visitor);
+        }
+
+        // Adapts a pair visitor to visit_sorted_range()
+        template <typename pair_visitor_t>
+        struct sorted_pair_visitor_t
+        {
+            const hshg_t*   m_hshg;
+            index_t         m_i;
+            pair_visitor_t& m_visitor;
+
+            inline void operator()(const index_t n)
+            {
+                HSHG_STAT(++m_hshg->m_stats.m_nodes_walked);
+                m_visitor(m_i, n);
+            }
+        };
+
+        // The crowded cell whose list starts with entity 'head', the crowds are sorted on it
+        inline const crowd_t* find_crowd(const hshg_t* hshg, const index_t head)
+        {
+            u32 lo = 0;
+            u32 hi = hshg->m_crowds_len;
+            while (lo < hi)
+            {
+                const u32 mid = (lo + hi) >> 1;
+                if (hshg->m_crowds[mid].m_head < head)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            ASSERT(lo < hshg->m_crowds_len && hshg->m_crowds[lo].m_head == head);
+            return hshg->m_crowds + lo;
+        }
+
+        // Calls 'visitor(i, n)' for every entity 'n' in the list starting at 'from'. When that
+        // is the list of a crowded cell only its members that overlap 'i' on the sorted axis
+        // are visited.
+        template <typename pair_visitor_t>
+        inline void visit_list(const hshg_t* hshg, const index_t i, index_t n, pair_visitor_t& visitor)
+        {
+            HSHG_STAT(++hshg->m_stats.m_cells_visited);
+            if (n != c_invalid_index && (hshg->m_entities_flags[n] & c_entity_crowded))
+            {
+                const crowd_t* const                  crowd  = find_crowd(hshg, n);
+                const entity_t* const                 entity = hshg->m_entities + i;
+                const f32                             c      = (&entity->x)[crowd->m_axis];
+                sorted_pair_visitor_t<pair_visitor_t> sorted = {hshg, i, visitor};
+                visit_sorted_range(hshg->m_crowd_entries + crowd->m_begin, crowd->m_len, crowd->m_width, c - entity->r, c + entity->r, sorted);
+                return;
+            }
+
+            while (n != c_invalid_index)
+            {
+                HSHG_STAT(++hshg->m_stats.m_nodes_walked);
+                visitor(i, n);
+                n = hshg->m_entities_node[n].m_next;
+            }
+        }
+
+        // The half extents of entity 'idx', those of its box when boxes are enabled and r on every axis otherwise
+        inline void entity_half_extents(const hshg_t* hshg, const index_t idx, f32* half)
+        {
+            if (hshg->m_entities_half != nullptr)
+            {
+                const f32* const box = hshg->m_entities_half + (idx * 3);
+                half[0]              = box[0];
+                half[1]              = box[1];
+                half[2]              = box[2];
+                return;
+            }
+            half[0] = half[1] = half[2] = hshg->m_entities[idx].r;
+        }
+
+        // True when the box [min, max] overlaps the box of entity 'idx'
+        inline bool box_overlaps(const hshg_t* hshg, const f32* const min, const f32* const max, const index_t idx)
+        {
+            const entity_t* const entity = hshg->m_entities + idx;
+            f32                   half[3];
+            entity_half_extents(hshg, idx, half);
+            return entity->x + half[0] >= min[0] && entity->x - half[0] <= max[0] && entity->y + half[1] >= min[1] && entity->y - half[1] <= max[1] && entity->z + half[2] >= min[2] && entity->z - half[2] <= max[2];
+        }
+
+        // Hands out the entities of the grids and of the overflow set that the box [m_min, m_max]
+        // of entity 'm_i' overlaps
+        template <typename pair_visitor_t>
+        struct box_cell_visitor_t
+        {
+            const hshg_t*   m_hshg;
+            index_t         m_i;
+            f32             m_min[3];
+            f32             m_max[3];
+            pair_visitor_t& m_visitor;
+
+            inline void operator()(const grid_t* grid, const cell_sq_t cell)
+            {
+                HSHG_STAT(++m_hshg->m_stats.m_cells_visited);
+                for (index_t n = grid->m_cells[cell]; n != c_invalid_index; n = m_hshg->m_entities_node[n].m_next)
+                {
+                    HSHG_STAT(++m_hshg->m_stats.m_nodes_walked);
+                    if (box_overlaps(m_hshg, m_min, m_max, n))
+                        m_visitor(m_i, n);
+                }
+            }
+
+            inline void operator()(const index_t n)
+            {
+                HSHG_STAT(++m_hshg->m_stats.m_nodes_walked);
+                if (box_overlaps(m_hshg, m_min, m_max, n))
+                    m_visitor(m_i, n);
+            }
+        };
+
+        //
+        // Visits the collision candidates of span 'i'. Neither the entities in the grids nor
+        // those in the overflow set ever visit a span, so it visits all of them that its box
+        // overlaps, like a query. Two spans that overlap share a cell of the first grid, the
+        // pair is visited by the one with the lower index and the stamps make sure it is
+        // only visited once, however many cells they share.
+        //
+        template <typename pair_visitor_t>
+        inline void visit_span_pairs(const hshg_t* hshg, const index_t i, pair_visitor_t& visitor)
+        {
+            const entity_t* const entity = hshg->m_entities + i;
+            const span_t* const   spans  = hshg->m_entities_span;
+            const f32* const      half   = hshg->m_entities_half + (i * 3);
+
+            box_cell_visitor_t<pair_visitor_t> cells = {hshg, i, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, visitor};
+            for (u32 a = 0; a < 3; ++a)
+            {
+                cells.m_min[a] = (&entity->x)[a] - half[a];
+                cells.m_max[a] = (&entity->x)[a] + half[a];
+            }
+
+            const cell_range_t x = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, cells.m_min[0], cells.m_max[0]);
+            const cell_range_t y = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, cells.m_min[1], cells.m_max[1]);
+            const cell_range_t z = map_pos(hshg->m_grids, hshg->m_grid_size, hshg->m_inverse_grid_size, cells.m_min[2], cells.m_max[2]);
+            visit_query_cells(hshg->m_grids, hshg->m_grids_len, x, y, z, cells);
+            if (hshg->m_overflow_len != 0)
+            {
+                visit_overflow_range(hshg, cells.m_min[0], cells.m_max[0], cells);
+            }
+
+            const u32 stamp = hshg->next_span_stamp();
+            for (index_t node = spans[i].m_nodes; node != c_invalid_index; node = hshg->m_span_nodes[node].m_own_next)
+            {
+                for (index_t other = hshg->m_span_cells[hshg->m_span_nodes[node].m_cell]; other != c_invalid_index; other = hshg->m_span_nodes[other].m_next)
+                {
+                    const index_t n = hshg->m_span_nodes[other].m_entity;
+                    if (n <= i || spans[n].m_stamp == stamp)
+                        continue;
+                    spans[n].m_stamp = stamp;
+
+                    HSHG_STAT(++hshg->m_stats.m_nodes_walked);
+                    if (box_overlaps(hshg, cells.m_min, cells.m_max, n))
+                        visitor(i, n);
+                }
+            }
+        }
+
+        //
+        // Calls 'visitor(n)' once for every span 'n' whose box overlaps the box [q1, q2],
+        // 'x', 'y' and 'z' are the cell ranges of that box in the first grid. Only the cell
+        // holding the lowest corner of the overlap reports the span, that corner is in both
+        // boxes, so it is one of the cells of both. No stamps are needed, which keeps queries
+        // from several threads possible.
+        //
+        template <typename visitor_t>
+        inline void visit_query_spans(const hshg_t* hshg, const cell_range_t x, const cell_range_t y, const cell_range_t z, const f32* const q1, const f32* const q2, visitor_t& visitor)
+        {
+            const grid_t* const grid = hshg->m_grids;
+            for (cell_t cz = z.start; cz <= z.end; ++cz)
+            {
+                for (cell_t cy = y.start; cy <= y.end; ++cy)
+                {
+                    for (cell_t cx = x.start; cx <= x.end; ++cx)
+                    {
+                        const cell_t cell[3] = {cx, cy, cz};
+                        for (index_t node = hshg->m_span_cells[grid_get_idx(grid, cx, cy, cz)]; node != c_invalid_index; node = hshg->m_span_nodes[node].m_next)
+                        {
+                            const index_t         n      = hshg->m_span_nodes[node].m_entity;
+                            const entity_t* const entity = hshg->m_entities + n;
+                            const f32* const      half   = hshg->m_entities_half + (n * 3);
+
+                            bool report = true;
+                            for (u32 a = 0; a < 3 && report; ++a)
+                            {
+                                const f32 c  = (&entity->x)[a];
+                                const f32 lo = math::g_max(q1[a], c - half[a]);
+                                const f32 hi = math::g_min(q2[a], c + half[a]);
+                                report       = lo <= hi && grid_get_cell_1d(grid, lo) == cell[a];
+                            }
+                            if (report)
+                            {
+                                visitor(n);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        //
+        // Visits all the collision candidates of entity 'i', calling 'visitor(i, n)' for
+        // every one of them. In its own grid only half of the neighbourhood is visited (and
+        // only the entities after 'i' in its own cell), in the coarser active grids the full
+        // 3x3x3 neighbourhood is. Doing this for all entities visits every pair exactly once.
+        //
+        template <typename pair_visitor_t>
+        inline void visit_collide_pairs(const hshg_t* hshg, const index_t i, pair_visitor_t& visitor)
+        {
+            if (hshg->is_overflow(i))
+            {
+                if (hshg->is_span(i))
+                {
+                    visit_span_pairs(hshg, i, visitor);
+                    return;
+                }
+                const entity_t* const entity = hshg->m_entities + i;
+                HSHG_STAT(++hshg->m_stats.m_cells_visited);
+                visit_sorted_pairs(hshg, hshg->m_overflow, hshg->m_overflow_len, i, entity->x - entity->r, entity->x + entity->r, visitor);
+                return;
+            }
+
+            const entity_node_t* entity_node = hshg->m_entities_node + i;
+            const cell_sq_t      entity_cell = hshg->m_entities_cell[i];
+
+            const grid_t* grid = hshg->m_grids + hshg->m_entities_grid[i];
+
+            cell_t cell_x = idx_get_x(grid, entity_cell);
+            cell_t cell_y = idx_get_y(grid, entity_cell);
+            cell_t cell_z = idx_get_z(grid, entity_cell);
+            if (cell_z != 0)
+            {
+                if (cell_y != 0)
+                {
+                    const index_t* const cell = grid->m_cells + (entity_cell - grid->m_cells_sq - grid->m_cells_side);
+
+                    if (cell_x != 0)
+                    {
+                        visit_list(hshg, i, *(cell - 1), visitor);
+                    }
+
+                    visit_list(hshg, i, *cell, visitor);
+
+                    if (cell_x != grid->m_cells_mask)
+                    {
+                        visit_list(hshg, i, *(cell + 1), visitor);
+                    }
+                }
+
+                {
+                    const index_t* const cell = grid->m_cells + (entity_cell - grid->m_cells_sq);
+
+                    if (cell_x != 0)
+                    {
+                        visit_list(hshg, i, *(cell - 1), visitor);
+                    }
+
+                    visit_list(hshg, i, *cell, visitor);
+
+                    if (cell_x != grid->m_cells_mask)
+                    {
+                        visit_list(hshg, i, *(cell + 1), visitor);
+                    }
+                }
+
+                if (cell_y != grid->m_cells_mask)
+                {
+                    const index_t* const cell = grid->m_cells + (entity_cell - grid->m_cells_sq + grid->m_cells_side);
+
+                    if (cell_x != 0)
+                    {
+                        visit_list(hshg, i, *(cell - 1), visitor);
+                    }
+
+                    visit_list(hshg, i, *cell, visitor);
+
+                    if (cell_x != grid->m_cells_mask)
+                    {
+                        visit_list(hshg, i, *(cell + 1), visitor);
+                    }
+                }
+            }
+            if (hshg->m_entities_flags[i] & c_entity_crowded)
+            {
+                // the rest of its own crowded cell by a sweep over the sorted members
+                const crowd_t* const  crowd  = find_crowd(hshg, grid->m_cells[entity_cell]);
+                const entity_t* const entity = hshg->m_entities + i;
+                const f32             c      = (&entity->x)[crowd->m_axis];
+                HSHG_STAT(++hshg->m_stats.m_cells_visited);
+                visit_sorted_pairs(hshg, hshg->m_crowd_entries + crowd->m_begin, crowd->m_len, i, c - entity->r, c + entity->r, visitor);
+            }
+            else
+            {
+                visit_list(hshg, i, entity_node->m_next, visitor);
+            }
+
+            if (cell_x != grid->m_cells_mask)
+            {
+                visit_list(hshg, i, grid->m_cells[entity_cell + 1], visitor);
+            }
+
+            if (cell_y != grid->m_cells_mask)
+            {
+                const index_t* const cell = grid->m_cells + (entity_cell + grid->m_cells_side);
+
+                if (cell_x != 0)
+                {
+                    visit_list(hshg, i, *(cell - 1), visitor);
+                }
+
+                visit_list(hshg, i, *cell, visitor);
+
+                if (cell_x != grid->m_cells_mask)
+                {
+                    visit_list(hshg, i, *(cell + 1), visitor);
+                }
+            }
+
+            while (grid->m_shift)
+            {
+                cell_x >>= grid->m_shift;
+                cell_y >>= grid->m_shift;
+                cell_z >>= grid->m_shift;
+
+                grid += grid->m_shift;
+
+                const cell_t min_cell_x = cell_x != 0 ? cell_x - 1 : 0;
+                const cell_t min_cell_y = cell_y != 0 ? cell_y - 1 : 0;
+                const cell_t min_cell_z = cell_z != 0 ? cell_z - 1 : 0;
+
+                const cell_t max_cell_x = cell_x != grid->m_cells_mask ? cell_x + 1 : cell_x;
+                const cell_t max_cell_y = cell_y != grid->m_cells_mask ? cell_y + 1 : cell_y;
+                const cell_t max_cell_z = cell_z != grid->m_cells_mask ? cell_z + 1 : cell_z;
+
+                for (cell_t cur_z = min_cell_z; cur_z <= max_cell_z; ++cur_z)
+                {
+                    for (cell_t cur_y = min_cell_y; cur_y <= max_cell_y; ++cur_y)
+                    {
+                        for (cell_t cur_x = min_cell_x; cur_x <= max_cell_x; ++cur_x)
+                        {
+                            const cell_t cell = grid_get_idx(grid, cur_x, cur_y, cur_z);
+                            visit_list(hshg, i, grid->m_cells[cell], visitor);
+                        }
+                    }
+                }
+            }
+
+            // every overflow entity is coarser than any grid
+            if (hshg->m_overflow_len != 0)
+            {
+                const entity_t* const                 entity           = hshg->m_entities + i;
+                sorted_pair_visitor_t<pair_visitor_t> overflow_visitor = {hshg, i, visitor};
+                visit_overflow_range(hshg, entity->x - entity->r, entity->x + entity->r, overflow_visitor);
+            }
+        }
+
+        u8        compute_max_grids(cell_t side);
+        cell_sq_t compute_max_cells(cell_t side);
+
+        // The cells of all grids and the single cell of the overflow grid
+        inline cell_sq_t compute_cells_len(cell_t side) { return compute_max_cells(side) + 1; }
+
+        // The capacity to grow an array that is counted by an index_t to, so that it holds at
+        // least 'len' entries: twice 'cap' but at least 'min'. Returns 0 when index_t can not
+        // count 'len' entries, which only happens with HSHG_INDEX_16.
+        inline index_t grow_capacity(const u32 len, const index_t cap, const index_t min)
+        {
+            if (len > (u32)c_invalid_index)
+                return 0;
+            const u32 grown = math::g_max(len, math::g_max((u32)cap * 2, (u32)min));
+            return (index_t)math::g_min(grown, (u32)c_invalid_index);
+        }
+
+        void      init_grids(grid_t* const grids, const u8 grids_len, index_t* const cells, const cell_t side, const u32 size);
+
+        // 'stats' receives the visited cells and nodes, nullptr when called from a view
+        void query_common(const hshg_t* const hshg, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2, query_func_t* const handler, hshg_stats_t* const stats);
+
+        // The spans part of query_common(), 'x', 'y' and 'z' are the cell ranges of the query in the first grid
+        void query_spans(const hshg_t* const hshg, const cell_range_t x, const cell_range_t y, const cell_range_t z, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2, query_func_t* const handler);
+
+        inline bool entity_overlaps(const entity_t* const entity, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2)
+        {
+            return (entity->x + entity->r >= x1 && entity->x - entity->r <= x2) && entity->y + entity->r >= y1 && entity->y - entity->r <= y2 && entity->z + entity->r >= z1 && entity->z - entity->r <= z2;
+        }
+
+        // True when the hypercubes of the two entities overlap
+        inline bool entities_overlap(const entity_t* const a, const entity_t* const b)
+        {
+            const f32 r = a->r + b->r;
+            return math::abs(a->x - b->x) <= r && math::abs(a->y - b->y) <= r && math::abs(a->z - b->z) <= r;
+        }
+
+        // entity_overlaps() and entities_overlap() for the boxes of the entities when boxes are enabled
+        inline bool entity_box_overlaps(const hshg_t* const hshg, const index_t idx, const f32 x1, const f32 y1, const f32 z1, const f32 x2, const f32 y2, const f32 z2)
+        {
+            const f32 min[3] = {x1, y1, z1};
+            const f32 max[3] = {x2, y2, z2};
+            return hshg->m_entities_half == nullptr ? entity_overlaps(hshg->m_entities + idx, x1, y1, z1, x2, y2, z2) : box_overlaps(hshg, min, max, idx);
+        }
+
+        inline bool entity_boxes_overlap(const hshg_t* const hshg, const index_t i, const index_t n)
+        {
+            const entity_t* const a = hshg->m_entities + i;
+            const entity_t* const b = hshg->m_entities + n;
+            if (hshg->m_entities_half == nullptr)
+            {
+                return entities_overlap(a, b);
+            }
+            const f32* const ha = hshg->m_entities_half + (i * 3);
+            const f32* const hb = hshg->m_entities_half + (n * 3);
+            return math::abs(a->x - b->x) <= ha[0] + hb[0] && math::abs(a->y - b->y) <= ha[1] + hb[1] && math::abs(a->z - b->z) <= ha[2] + hb[2];
+        }
+
+        // Truncating moves a coordinate by less than a unit, the radius is rounded up. The product
+        // of two f32 is exact in a f64, so this also holds far away from the origin.
+        inline quant_t quantize_entity(const f32 x, const f32 y, const f32 z, const f32 r, const f32 scale)
+        {
+            const f32 qr = r * scale + 1.0f;
+            quant_t   q;
+            q.m_x = (u16)(s64)((f64)x * scale);
+            q.m_y = (u16)(s64)((f64)y * scale);
+            q.m_z = (u16)(s64)((f64)z * scale);
+            q.m_r = qr < 65535.0f ? (u16)qr : (u16)0xFFFF;
+            return q;
+        }
+
+        //
+        // True when the hypercubes of 'a' and 'b' certainly do not overlap. Both positions are
+        // off by less than a unit, so only a distance of more than the radii plus 2 units
+        // rejects. The distance wraps at 65536 units, which is never more than the real one.
+        //
+        inline bool quant_apart(const quant_t a, const quant_t b)
+        {
+            const s32 r  = (s32)a.m_r + (s32)b.m_r + 2;
+            const s32 dx = (s16)(u16)(a.m_x - b.m_x);
+            const s32 dy = (s16)(u16)(a.m_y - b.m_y);
+            const s32 dz = (s16)(u16)(a.m_z - b.m_z);
+
+            // no early outs, like the brute force pair test
+            return (dx > r) | (dx < -r) | (dy > r) | (dy < -r) | (dz > r) | (dz < -r);
+        }
+
+        // The quantized column first, m_entities only for the pairs that it can not reject
+        inline bool entity_boxes_overlap_quant(const hshg_t* const hshg, const index_t i, const index_t n)
+        {
+            const quant_t* const quant = hshg->m_entities_quant;
+            return (quant == nullptr || !quant_apart(quant[i], quant[n])) && entity_boxes_overlap(hshg, i, n);
+        }
+
+        // Clips [tmin, tmax] against the slab of one axis, false when the ray misses it.
+        inline bool ray_slab(const f32 o, const f32 d, const f32 c, const f32 r, f32& tmin, f32& tmax)
+        {
+            if (d == 0.0f)
+            {
+                return o >= c - r && o <= c + r;
+            }
+
+            const f32 inv = 1.0f / d;
+            f32       ta  = (c - r - o) * inv;
+            f32       tb  = (c + r - o) * inv;
+            if (ta > tb)
+            {
+                const f32 t = ta;
+                ta          = tb;
+                tb          = t;
+            }
+            tmin = math::g_max(tmin, ta);
+            tmax = math::g_min(tmax, tb);
+            return tmin <= tmax;
+        }
+
+    }  // namespace nhshg
+}  // namespace ncore
+
+#endif  // __C_HIERARCHICAL_SPATIAL_HASHGRID_INTERNAL_H__
@@ -1,5 +1,7 @@
 #include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_stats.h"
 #include "chshg/test_allocator.h"
+#include "chshg/test_handlers.h"
 
 #include "cunittest/cunittest.h"
 
@@ -130,6 +132,63 @@ public:
     s32 collide_count = 0;
 };
 
+// Moves the entity with ref 'm_ref' to x = 'm_x'
+class my_overflow_move_handler_t final : public nhshg::update_func_t
+{
+public:
+    void update(nhshg::index_t begin, nhshg::index_t end, nhshg::entity_t* e, nhshg::index_t const* ref, nhshg::hshg_t* hshg) override final
+    {
+        for (nhshg::index_t i = begin; i < end; ++i)
+        {
+            if (ref[i] == m_ref)
+            {
+                e[i].x = m_x;
+                nhshg::hshg_move(hshg, i);
+            }
+        }
+    }
+
+    nhshg::index_t m_ref = 0;
+    f32            m_x   = 0.0f;
+};
+
+// Counts the overlapping pairs reported by hshg_collide_with(), entities of A have a ref
+// below 100 and those of B one from 100 up
+class my_collide_with_handler_t final : public nhshg::collide_func_t
+{
+public:
+    void collide(const nhshg::entity_t* e1, nhshg::index_t e1_ref, const nhshg::entity_t* e2, nhshg::index_t e2_ref) override final
+    {
+        if (e1_ref >= 100 || e2_ref < 100)
+            ++wrong_count;
+
+        const f32 dx = e1->x - e2->x;
+        const f32 dy = e1->y - e2->y;
+        const f32 dz = e1->z - e2->z;
+        const f32 sr = e1->r + e2->r;
+        if (dx * dx + dy * dy + dz * dz <= sr * sr)
+            ++collide_count;
+    }
+
+    s32 collide_count = 0;
+    s32 wrong_count   = 0;
+};
+
+// Forwards to another allocator, counting the calls
+class counting_alloc_t final : public alloc_t
+{
+public:
+    alloc_t* m_allocator   = nullptr;
+    s32      m_allocations = 0;
+
+    void* v_allocate(u32 size, u32 align) override final
+    {
+        ++m_allocations;
+        return m_allocator->allocate(size, align);
+    }
+    void v_deallocate(void* p) override final { m_allocator->deallocate(p); }
+};
+
 UNITTEST_SUITE_BEGIN(test_hierarchical_spatial_hashgrid)
 {
     UNITTEST_FIXTURE(main)
@@ -153,7 +212,9 @@ UNITTEST_SUITE_BEGIN(test_hierarchical_spatial_hashgrid)
 
         UNITTEST_TEST(create_destroy)
         {
-            for (u32 i = 1; i <= 128; i = i << 1)
+            // with HSHG_CELL_16 the side is limited to 32
+            const u32 max_side = nhshg::c_max_side < 128 ? nhshg::c_max_side : 128;
+            for (u32 i = 1; i <= max_side; i = i << 1)
             {
                 for (u32 s = 1; s <= 128; s = s << 1)
                 {
@@ -175,6 +236,39 @@ UNITTEST_SUITE_BEGIN(test_hierarchical_spatial_hashgrid)
             nhshg::hshg_free(hshg);
         }
 
+        UNITTEST_TEST(index_limit)
+        {
+            // with HSHG_INDEX_16 these are all the indices there are, c_invalid_index itself
+            // is never handed out
+            const u32      max  = 0xFFFF;
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 32, 4, max);
+            CHECK_NOT_NULL(hshg);
+
+            s32 misplaced = 0;
+            for (u32 i = 0; i < max; ++i)
+            {
+                const f32            x   = (f32)(i % 128);
+                const f32            y   = (f32)((i / 128) % 128);
+                const f32            z   = (f32)(i / (128 * 128)) * 8.0f;
+                const nhshg::index_t idx = nhshg::hshg_insert(hshg, x, y, z, 0.25f, (nhshg::index_t)i);
+                if (idx != (nhshg::index_t)i)
+                    ++misplaced;
+            }
+            CHECK_EQUAL(0, misplaced);
+            CHECK_EQUAL(nhshg::c_invalid_index, nhshg::hshg_insert(hshg, 1.0f, 1.0f, 1.0f, 0.25f, 0));
+
+            test_query_handler_t query;
+            nhshg::hshg_query(hshg, 0.0f, 0.0f, 0.0f, 128.0f, 128.0f, 128.0f, &query);
+            CHECK_EQUAL((s32)max, query.query_count);
+
+            // growing can not go past c_invalid_index either
+            nhshg::hshg_set_auto_grow(hshg, true);
+            const bool grows = max < (u32)nhshg::c_invalid_index;
+            CHECK_EQUAL(grows, nhshg::hshg_insert(hshg, 1.0f, 1.0f, 1.0f, 0.25f, 0) != nhshg::c_invalid_index);
+
+            nhshg::hshg_free(hshg);
+        }
+
         static bool insert_object(nhshg::hshg_t * hshg, f32 x, f32 y, f32 z, f32 r)
         {
             s32            index        = s_objects.get();
@@ -259,6 +353,447 @@ UNITTEST_SUITE_BEGIN(test_hierarchical_spatial_hashgrid)
 
             nhshg::hshg_free(hshg);
         }
+
+        UNITTEST_TEST(insert_remove_concurrent)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 32, 32, 32);
+            CHECK_NOT_NULL(hshg);
+
+            s_objects.reset();
+
+            CHECK_EQUAL(0, nhshg::hshg_insert_concurrent(hshg, 0.0f, 0.0f, 0.0f, 1.0f, s_objects.get()));
+            CHECK_EQUAL(1, nhshg::hshg_insert_concurrent(hshg, 0.0f, 5.0f, 0.0f, 3.0f, s_objects.get()));
+            CHECK_EQUAL(2, nhshg::hshg_insert_concurrent(hshg, 2.0f, 1.0f, 2.0f, 2.0f, s_objects.get()));
+            CHECK_EQUAL(2, do_check_collisions(hshg));
+
+            // removal is deferred until the flush
+            nhshg::hshg_remove_concurrent(hshg, 0);
+            CHECK_EQUAL(2, do_check_collisions(hshg));
+
+            nhshg::hshg_flush(hshg);
+            CHECK_EQUAL(1, do_check_collisions(hshg));
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(remove_concurrent_optimize)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 32, 32, 32);
+            nhshg::hshg_insert(hshg, 40.0f, 0.0f, 0.0f, 1.0f, 10);
+            nhshg::hshg_insert(hshg, 0.0f, 0.0f, 0.0f, 1.0f, 11);
+            nhshg::hshg_insert(hshg, 20.0f, 0.0f, 0.0f, 1.0f, 12);
+
+            // optimize reorders the entities, the queued index still removes ref 10
+            nhshg::hshg_remove_concurrent(hshg, 0);
+            nhshg::hshg_optimize(hshg);
+            nhshg::hshg_flush(hshg);
+
+            test_query_handler_t query;
+            nhshg::hshg_query(hshg, -100.0f, -100.0f, -100.0f, 100.0f, 100.0f, 100.0f, &query);
+            CHECK_EQUAL(2, query.query_count);
+            CHECK_EQUAL(11 + 12, query.ref_sum);
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(recommend_params_retune)
+        {
+            // radii of 3 (cells of 8) spread over 500 units
+            nhshg::entity_t sample[64];
+            for (s32 i = 0; i < 64; ++i)
+            {
+                sample[i].x = (f32)((i * 37) % 500);
+                sample[i].y = (f32)((i * 91) % 400);
+                sample[i].z = (f32)((i * 13) % 300);
+                sample[i].r = i < 48 ? 3.0f : 20.0f;
+            }
+
+            nhshg::cell_t side;
+            u32           size;
+            CHECK_TRUE(nhshg::hshg_recommend_params(sample, 64, 4096, 64 * 1024 * 1024, side, size));
+            CHECK_EQUAL(8, size);
+            CHECK_EQUAL(32, side);  // 500 / 8 -> 64 cells, limited to 8 cells per entity
+
+            CHECK_TRUE(nhshg::hshg_recommend_params(sample, 64, 4096, 256 * 1024, side, size));
+            CHECK_TRUE(nhshg::hshg_memory_usage(side, 4096) <= 256 * 1024);
+            CHECK_FALSE(nhshg::hshg_recommend_params(sample, 64, 4096, 1024, side, size));
+
+            // a diameter that is a power of 2 only fits a cell of the first grid twice as big
+            for (s32 i = 0; i < 64; ++i)
+                sample[i].r = 4.0f;
+            CHECK_TRUE(nhshg::hshg_recommend_params(sample, 64, 4096, 64 * 1024 * 1024, side, size));
+            CHECK_EQUAL(16, size);
+            for (s32 i = 0; i < 64; ++i)
+                sample[i].r = 0.5f;
+            CHECK_TRUE(nhshg::hshg_recommend_params(sample, 64, 4096, 64 * 1024 * 1024, side, size));
+            CHECK_EQUAL(2, size);
+
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 32, 32, 32);
+
+            s_objects.reset();
+            nhshg::hshg_insert(hshg, 0.0f, 0.0f, 0.0f, 1.0f, s_objects.get());
+            nhshg::hshg_insert(hshg, 0.0f, 5.0f, 0.0f, 3.0f, s_objects.get());
+            nhshg::hshg_insert(hshg, 2.0f, 1.0f, 2.0f, 2.0f, s_objects.get());
+            nhshg::hshg_insert(hshg, 100.0f, 1.0f, 2.0f, 2.0f, s_objects.get());
+            CHECK_EQUAL(2, do_check_collisions(hshg));
+
+            const nhshg::cell_t side_large = nhshg::c_max_side < 64 ? nhshg::c_max_side : 64;
+            CHECK_TRUE(nhshg::hshg_retune(hshg, side_large, 4));
+            CHECK_EQUAL(2, do_check_collisions(hshg));
+
+            CHECK_TRUE(nhshg::hshg_retune(hshg, 4, 64));
+            CHECK_EQUAL(2, do_check_collisions(hshg));
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(reserve_auto_grow)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 32, 32, 2);
+
+            s_objects.reset();
+            CHECK_EQUAL(0, nhshg::hshg_insert(hshg, 0.0f, 0.0f, 0.0f, 1.0f, s_objects.get()));
+            CHECK_EQUAL(1, nhshg::hshg_insert(hshg, 0.0f, 5.0f, 0.0f, 3.0f, s_objects.get()));
+            CHECK_EQUAL(nhshg::c_invalid_index, nhshg::hshg_insert(hshg, 2.0f, 1.0f, 2.0f, 2.0f, 99));
+
+            CHECK_TRUE(nhshg::hshg_reserve(hshg, 3));
+            CHECK_EQUAL(2, nhshg::hshg_insert(hshg, 2.0f, 1.0f, 2.0f, 2.0f, s_objects.get()));
+            CHECK_EQUAL(2, do_check_collisions(hshg));
+
+            // the indices of the existing entities stay the same
+            nhshg::hshg_set_auto_grow(hshg, true);
+            CHECK_EQUAL(3, nhshg::hshg_insert(hshg, 100.0f, 1.0f, 2.0f, 2.0f, s_objects.get()));
+            CHECK_EQUAL(4, nhshg::hshg_insert(hshg, 200.0f, 1.0f, 2.0f, 2.0f, s_objects.get()));
+            CHECK_EQUAL(2, do_check_collisions(hshg));
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(create_arena)
+        {
+            counting_alloc_t counting;
+            counting.m_allocator = Allocator;
+
+            nhshg::hshg_t* hshg = nhshg::hshg_create_arena(&counting, 32, 32, 32, 64);
+            CHECK_NOT_NULL(hshg);
+            CHECK_EQUAL(1, counting.m_allocations);
+
+            s_objects.reset();
+            nhshg::hshg_insert(hshg, 0.0f, 0.0f, 0.0f, 1.0f, s_objects.get());
+            nhshg::hshg_insert(hshg, 0.0f, 5.0f, 0.0f, 3.0f, s_objects.get());
+            nhshg::hshg_insert(hshg, 2.0f, 1.0f, 2.0f, 2.0f, s_objects.get());
+            CHECK_EQUAL(2, do_check_collisions(hshg));
+
+            // optimize reuses the room in the arena, over and over
+            for (s32 i = 0; i < 3; ++i)
+            {
+                nhshg::hshg_optimize(hshg);
+                CHECK_EQUAL(2, do_check_collisions(hshg));
+            }
+            CHECK_EQUAL(1, counting.m_allocations);
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(overflow)
+        {
+            // the top grid has cells of 16, entities wider than that go to the overflow set
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 16, 2, 32);
+
+            s_objects.reset();
+            CHECK_TRUE(insert_object(hshg, 0.0f, 0.0f, 0.0f, 100.0f));
+            CHECK_TRUE(insert_object(hshg, 500.0f, 0.0f, 0.0f, 100.0f));
+            CHECK_TRUE(insert_object(hshg, 50.0f, 0.0f, 0.0f, 1.0f));
+            CHECK_TRUE(insert_object(hshg, 1000.0f, 0.0f, 0.0f, 1.0f));
+            CHECK_EQUAL(1, do_check_collisions(hshg));
+
+            // the two big ones meet, and both reach the small one at 50
+            my_overflow_move_handler_t move;
+            move.m_ref = 1;
+            move.m_x   = 150.0f;
+            nhshg::hshg_update(hshg, &move);
+            CHECK_EQUAL(3, do_check_collisions(hshg));
+
+            test_query_handler_t query;
+            nhshg::hshg_query(hshg, 45.0f, -1.0f, -1.0f, 55.0f, 1.0f, 1.0f, &query);
+            CHECK_EQUAL(3, query.query_count);
+
+            nhshg::hshg_optimize(hshg);
+            CHECK_EQUAL(3, do_check_collisions(hshg));
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(collide_with)
+        {
+            nhshg::hshg_t* a = nhshg::hshg_create(Allocator, 16, 8, 64);
+            nhshg::hshg_t* b = nhshg::hshg_create(Allocator, 16, 8, 64);
+
+            // random entities of all sizes, spread over more than one fold of the grids
+            nhshg::entity_t entities[128];
+            u32             seed = 0x12345678;
+            for (s32 i = 0; i < 128; ++i)
+            {
+                f32* values = &entities[i].x;
+                for (s32 j = 0; j < 4; ++j)
+                {
+                    seed ^= seed << 13;
+                    seed ^= seed >> 17;
+                    seed ^= seed << 5;
+                    values[j] = (f32)(seed % 4000) * 0.1f - 200.0f;
+                }
+                entities[i].r = 0.5f + (f32)(seed % 300) * (i % 3 == 0 ? 0.1f : 0.01f);
+
+                if (i < 64)
+                    nhshg::hshg_insert(a, entities[i].x, entities[i].y, entities[i].z, entities[i].r, i);
+                else
+                    nhshg::hshg_insert(b, entities[i].x, entities[i].y, entities[i].z, entities[i].r, 100 + i);
+            }
+
+            s32 expected = 0;
+            for (s32 i = 0; i < 64; ++i)
+            {
+                for (s32 j = 64; j < 128; ++j)
+                {
+                    const f32 dx = entities[i].x - entities[j].x;
+                    const f32 dy = entities[i].y - entities[j].y;
+                    const f32 dz = entities[i].z - entities[j].z;
+                    const f32 sr = entities[i].r + entities[j].r;
+                    if (dx * dx + dy * dy + dz * dz <= sr * sr)
+                        ++expected;
+                }
+            }
+            CHECK_TRUE(expected > 0);
+
+            my_collide_with_handler_t handler;
+            nhshg::hshg_collide_with(a, b, &handler);
+            CHECK_EQUAL(expected, handler.collide_count);
+            CHECK_EQUAL(0, handler.wrong_count);
+
+            nhshg::hshg_free(b);
+            nhshg::hshg_free(a);
+        }
+
+        UNITTEST_TEST(crowded_cells)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 16, 8, 256);
+
+            // a crowd piled up in a few cells, spread out along y, and some entities around it
+            nhshg::entity_t entities[200];
+            u32             seed = 0x9e3779b9;
+            for (s32 i = 0; i < 200; ++i)
+            {
+                f32* values = &entities[i].x;
+                for (s32 j = 0; j < 4; ++j)
+                {
+                    seed ^= seed << 13;
+                    seed ^= seed >> 17;
+                    seed ^= seed << 5;
+                    values[j] = (f32)(seed % 1000) * 0.001f;
+                }
+                entities[i].x = entities[i].x * (i < 160 ? 12.0f : 100.0f);
+                entities[i].y = entities[i].y * (i < 160 ? 60.0f : 100.0f);
+                entities[i].z = entities[i].z * (i < 160 ? 4.0f : 100.0f);
+                entities[i].r = 0.25f + entities[i].r * (i % 10 == 0 ? 6.0f : 1.0f);
+                nhshg::hshg_insert(hshg, entities[i].x, entities[i].y, entities[i].z, entities[i].r, i);
+            }
+
+            s32 expected = 0;
+            for (s32 i = 0; i < 200; ++i)
+            {
+                for (s32 j = i + 1; j < 200; ++j)
+                {
+                    const f32 dx = entities[i].x - entities[j].x;
+                    const f32 dy = entities[i].y - entities[j].y;
+                    const f32 dz = entities[i].z - entities[j].z;
+                    const f32 sr = entities[i].r + entities[j].r;
+                    if (dx * dx + dy * dy + dz * dz <= sr * sr)
+                        ++expected;
+                }
+            }
+            CHECK_TRUE(expected > 0);
+
+            test_collide_handler_t walked;
+            nhshg::hshg_collide(hshg, &walked);
+            CHECK_EQUAL(expected, walked.collide_count);
+
+            // the same pairs overlap, but fewer candidates are handed out
+            nhshg::hshg_set_crowd_threshold(hshg, 8);
+            test_collide_handler_t sorted;
+            nhshg::hshg_collide(hshg, &sorted);
+            CHECK_EQUAL(expected, sorted.collide_count);
+            CHECK_TRUE(sorted.pair_count < walked.pair_count);
+
+            // and again, the crowd flags were cleared
+            test_collide_handler_t again;
+            nhshg::hshg_collide(hshg, &again);
+            CHECK_EQUAL(expected, again.collide_count);
+            CHECK_EQUAL(sorted.pair_count, again.pair_count);
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(sleeping)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 16, 8, 32);
+            nhshg::hshg_set_sleep_ticks(hshg, 2);
+            nhshg::hshg_insert(hshg, 1.0f, 1.0f, 1.0f, 1.0f, 0);
+            nhshg::hshg_insert(hshg, 2.5f, 1.0f, 1.0f, 1.0f, 1);
+
+            // both fall asleep after two ticks without moving
+            test_collide_handler_t handler;
+            nhshg::hshg_collide(hshg, &handler);
+            nhshg::hshg_collide(hshg, &handler);
+            CHECK_EQUAL(2, handler.collide_count);
+            nhshg::hshg_collide(hshg, &handler);
+            CHECK_EQUAL(2, handler.collide_count);
+
+            // a sleeping entity is still handed out with an awake one
+            my_overflow_move_handler_t move;
+            move.m_ref = 1;
+            move.m_x   = 2.75f;
+            nhshg::hshg_update(hshg, &move);
+            nhshg::hshg_collide(hshg, &handler);
+            nhshg::hshg_collide(hshg, &handler);
+            CHECK_EQUAL(4, handler.collide_count);
+            nhshg::hshg_collide(hshg, &handler);
+            CHECK_EQUAL(4, handler.collide_count);
+
+            // entering their cell wakes them up
+            nhshg::hshg_insert(hshg, 3.0f, 6.0f, 1.0f, 0.5f, 2);
+            nhshg::hshg_collide(hshg, &handler);
+            CHECK_EQUAL(5, handler.collide_count);
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(sleeping_overflow)
+        {
+            // the top grid has cells of 64, the overflow entity covers [-40, 40] of the 128 wide world
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 32, 4, 64);
+            nhshg::hshg_set_sleep_ticks(hshg, 1);
+            nhshg::hshg_insert(hshg, 0.0f, 0.0f, 0.0f, 40.0f, 0);
+            nhshg::hshg_insert(hshg, 30.0f, 0.0f, 0.0f, 1.0f, 1);
+            for (s32 i = 0; i < 16; ++i)
+            {
+                const f32 x = 52.0f + 8.0f * (i & 3);
+                const f32 y = 52.0f + 8.0f * (i >> 2);
+                nhshg::hshg_insert(hshg, x, y, 64.0f, 1.0f, 2 + i * 2);
+                nhshg::hshg_insert(hshg, x + 1.5f, y, 64.0f, 1.0f, 3 + i * 2);
+            }
+
+            test_collide_handler_t handler;
+            nhshg::hshg_collide(hshg, &handler);
+            CHECK_EQUAL(17, handler.collide_count);
+            nhshg::hshg_collide(hshg, &handler);
+            CHECK_EQUAL(17, handler.collide_count);
+
+            // the awake overflow entity finds its sleeping partner, the other sleepers stay untouched
+            my_overflow_move_handler_t move;
+            move.m_ref = 0;
+            move.m_x   = 1.0f;
+            nhshg::hshg_update(hshg, &move);
+            nhshg::hshg_reset_stats(hshg);
+            nhshg::hshg_collide(hshg, &handler);
+            CHECK_EQUAL(18, handler.collide_count);
+
+            nhshg::hshg_stats_t stats;
+            if (nhshg::hshg_get_stats(hshg, stats))
+            {
+                CHECK_TRUE(stats.m_nodes_walked < 8);
+            }
+
+            // waking one of them from update() hands out its pair again
+            move.m_ref = 2;
+            move.m_x   = 52.0f;
+            nhshg::hshg_update(hshg, &move);
+            nhshg::hshg_collide(hshg, &handler);
+            CHECK_EQUAL(19, handler.collide_count);
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(brute_force)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 16, 4, 64);
+
+            nhshg::entity_t entities[41];
+            u32             seed = 0x2545f491;
+            for (s32 i = 0; i < 41; ++i)
+            {
+                f32* values = &entities[i].x;
+                for (s32 j = 0; j < 4; ++j)
+                {
+                    seed ^= seed << 13;
+                    seed ^= seed >> 17;
+                    seed ^= seed << 5;
+                    values[j] = (f32)(seed % 1000) * 0.001f;
+                }
+                entities[i].x = entities[i].x * 30.0f;
+                entities[i].y = entities[i].y * 30.0f;
+                entities[i].z = entities[i].z * 30.0f;
+                entities[i].r = 0.5f + entities[i].r * 3.0f;
+            }
+
+            // the first 40 go in, the last one pushes the count over the threshold
+            s32 expected[2] = {0, 0};
+            for (s32 i = 0; i < 41; ++i)
+            {
+                for (s32 j = i + 1; j < 41; ++j)
+                {
+                    const f32 dx = entities[i].x - entities[j].x;
+                    const f32 dy = entities[i].y - entities[j].y;
+                    const f32 dz = entities[i].z - entities[j].z;
+                    const f32 sr = entities[i].r + entities[j].r;
+                    if (dx * dx + dy * dy + dz * dz <= sr * sr)
+                        expected[j < 40 ? 0 : 1] += 1;
+                }
+            }
+            expected[1] += expected[0];
+            CHECK_TRUE(expected[0] > 0);
+
+            for (s32 i = 0; i < 40; ++i)
+                nhshg::hshg_insert(hshg, entities[i].x, entities[i].y, entities[i].z, entities[i].r, i);
+
+            test_collide_handler_t walked;
+            nhshg::hshg_collide(hshg, &walked);
+            CHECK_EQUAL(expected[0], walked.collide_count);
+            test_query_handler_t walked_query;
+            nhshg::hshg_query(hshg, 5.0f, 5.0f, 5.0f, 20.0f, 20.0f, 20.0f, &walked_query);
+
+            // the same pairs and query results, only the overlapping candidates are handed out
+            nhshg::hshg_set_brute_force_threshold(hshg, 40);
+            test_collide_handler_t brute;
+            nhshg::hshg_collide(hshg, &brute);
+            CHECK_EQUAL(expected[0], brute.collide_count);
+            CHECK_TRUE(brute.pair_count <= walked.pair_count);
+            test_query_handler_t brute_query;
+            nhshg::hshg_query(hshg, 5.0f, 5.0f, 5.0f, 20.0f, 20.0f, 20.0f, &brute_query);
+            CHECK_EQUAL(walked_query.query_count, brute_query.query_count);
+
+            // back to the grids above the threshold
+            nhshg::hshg_insert(hshg, entities[40].x, entities[40].y, entities[40].z, entities[40].r, 40);
+            test_collide_handler_t more;
+            nhshg::hshg_collide(hshg, &more);
+            CHECK_EQUAL(expected[1], more.collide_count);
+
+            nhshg::hshg_free(hshg);
+
+            // sleeping works the same way without the grids
+            hshg = nhshg::hshg_create(Allocator, 16, 8, 32);
+            nhshg::hshg_set_brute_force_threshold(hshg, 32);
+            nhshg::hshg_set_sleep_ticks(hshg, 2);
+            nhshg::hshg_insert(hshg, 1.0f, 1.0f, 1.0f, 1.0f, 0);
+            nhshg::hshg_insert(hshg, 2.5f, 1.0f, 1.0f, 1.0f, 1);
+
+            test_collide_handler_t handler;
+            nhshg::hshg_collide(hshg, &handler);
+            nhshg::hshg_collide(hshg, &handler);
+            nhshg::hshg_collide(hshg, &handler);
+            CHECK_EQUAL(2, handler.collide_count);
+
+            nhshg::hshg_free(hshg);
+        }
     }
 }
 UNITTEST_SUITE_END
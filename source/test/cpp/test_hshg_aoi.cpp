@@ -0,0 +1,143 @@
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_aoi.h"
+#include "chshg/test_allocator.h"
+#include "chshg/test_handlers.h"
+
+#include "cunittest/cunittest.h"
+
+using namespace ncore;
+
+class my_aoi_handler_t final : public nhshg::aoi_func_t
+{
+public:
+    void enter(nhshg::index_t observer, nhshg::index_t e_ref) override final
+    {
+        ++enter_count;
+        last_observer = observer;
+        last_ref      = e_ref;
+    }
+    void leave(nhshg::index_t observer, nhshg::index_t e_ref) override final
+    {
+        ++leave_count;
+        last_observer = observer;
+        last_ref      = e_ref;
+    }
+
+    void reset()
+    {
+        enter_count = 0;
+        leave_count = 0;
+    }
+
+    s32            enter_count   = 0;
+    s32            leave_count   = 0;
+    nhshg::index_t last_observer = 0;
+    nhshg::index_t last_ref      = 0;
+};
+
+UNITTEST_SUITE_BEGIN(test_hshg_aoi)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        UNITTEST_TEST(enter_leave)
+        {
+            nhshg::hshg_t*     hshg = nhshg::hshg_create(Allocator, 16, 4, 32);
+            nhshg::hshg_aoi_t* aoi  = nhshg::hshg_aoi_create(Allocator, hshg, 4);
+
+            nhshg::hshg_insert(hshg, 0.0f, 0.0f, 0.0f, 1.0f, 0);
+            nhshg::hshg_insert(hshg, 5.0f, 0.0f, 0.0f, 1.0f, 1);
+            nhshg::hshg_insert(hshg, 30.0f, 0.0f, 0.0f, 1.0f, 2);
+
+            // a new observer enters everything inside of it
+            my_aoi_handler_t handler;
+            const nhshg::index_t box    = nhshg::hshg_aoi_add_box(aoi, -2.0f, -2.0f, -2.0f, 8.0f, 2.0f, 2.0f);
+            const nhshg::index_t sphere = nhshg::hshg_aoi_add_sphere(aoi, 30.0f, 0.0f, 0.0f, 2.0f);
+            CHECK_TRUE(nhshg::hshg_aoi_update(aoi, &handler));
+            CHECK_EQUAL(3, handler.enter_count);
+            CHECK_EQUAL(0, handler.leave_count);
+
+            // nothing changed, nothing to report
+            handler.reset();
+            CHECK_TRUE(nhshg::hshg_aoi_update(aoi, &handler));
+            CHECK_EQUAL(0, handler.enter_count);
+            CHECK_EQUAL(0, handler.leave_count);
+
+            // moving within the box is no event, moving out of it is
+            test_move_handler_t move;
+            move.m_ref = 1;
+            move.m_dx  = 1.0f;
+            nhshg::hshg_update(hshg, &move);
+            CHECK_TRUE(nhshg::hshg_aoi_update(aoi, &handler));
+            CHECK_EQUAL(0, handler.enter_count + handler.leave_count);
+
+            move.m_dx = 20.0f;
+            nhshg::hshg_update(hshg, &move);
+            CHECK_TRUE(nhshg::hshg_aoi_update(aoi, &handler));
+            CHECK_EQUAL(0, handler.enter_count);
+            CHECK_EQUAL(1, handler.leave_count);
+            CHECK_EQUAL(box, handler.last_observer);
+            CHECK_EQUAL(1, handler.last_ref);
+
+            // and into the sphere
+            handler.reset();
+            move.m_dx = 3.0f;
+            nhshg::hshg_update(hshg, &move);
+            CHECK_TRUE(nhshg::hshg_aoi_update(aoi, &handler));
+            CHECK_EQUAL(1, handler.enter_count);
+            CHECK_EQUAL(sphere, handler.last_observer);
+
+            // moving the observer, removing an entity and removing the observer
+            handler.reset();
+            nhshg::hshg_aoi_set_box(aoi, box, 20.0f, -2.0f, -2.0f, 40.0f, 2.0f, 2.0f);
+            CHECK_TRUE(nhshg::hshg_aoi_update(aoi, &handler));
+            CHECK_EQUAL(2, handler.enter_count);
+            CHECK_EQUAL(1, handler.leave_count);
+
+            handler.reset();
+            move.m_ref    = 2;
+            move.m_remove = true;
+            nhshg::hshg_update(hshg, &move);
+            CHECK_TRUE(nhshg::hshg_aoi_update(aoi, &handler));
+            CHECK_EQUAL(2, handler.leave_count);
+
+            handler.reset();
+            nhshg::hshg_aoi_remove(aoi, sphere);
+            CHECK_TRUE(nhshg::hshg_aoi_update(aoi, &handler));
+            CHECK_EQUAL(1, handler.leave_count);
+
+            nhshg::hshg_aoi_free(aoi);
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(insert_concurrent)
+        {
+            nhshg::hshg_t*     hshg = nhshg::hshg_create(Allocator, 16, 4, 32);
+            nhshg::hshg_aoi_t* aoi  = nhshg::hshg_aoi_create(Allocator, hshg, 4);
+
+            my_aoi_handler_t     handler;
+            const nhshg::index_t box = nhshg::hshg_aoi_add_box(aoi, -2.0f, -2.0f, -2.0f, 8.0f, 2.0f, 2.0f);
+            CHECK_TRUE(nhshg::hshg_aoi_update(aoi, &handler));
+            CHECK_EQUAL(0, handler.enter_count);
+
+            // the AOI sees the inserted entities at the flush, one of them is gone again by then
+            nhshg::hshg_insert_concurrent(hshg, 0.0f, 0.0f, 0.0f, 1.0f, 0);
+            nhshg::hshg_insert_concurrent(hshg, 5.0f, 0.0f, 0.0f, 1.0f, 1);
+            const nhshg::index_t gone = nhshg::hshg_insert_concurrent(hshg, 6.0f, 0.0f, 0.0f, 1.0f, 2);
+            nhshg::hshg_remove_concurrent(hshg, gone);
+            nhshg::hshg_flush(hshg);
+            CHECK_TRUE(nhshg::hshg_aoi_update(aoi, &handler));
+            CHECK_EQUAL(2, handler.enter_count);
+            CHECK_EQUAL(0, handler.leave_count);
+            CHECK_EQUAL(box, handler.last_observer);
+
+            nhshg::hshg_aoi_free(aoi);
+            nhshg::hshg_free(hshg);
+        }
+    }
+}
+UNITTEST_SUITE_END
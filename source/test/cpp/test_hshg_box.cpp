@@ -0,0 +1,174 @@
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_box.h"
+#include "chshg/c_hshg_io.h"
+#include "chshg/c_hshg_pair_cache.h"
+#include "chshg/test_allocator.h"
+#include "chshg/test_handlers.h"
+
+#include "cunittest/cunittest.h"
+
+using namespace ncore;
+
+// Gives the entity with ref 'm_ref' the box 'm_half', or the radius 'm_r' when it is not 0
+class my_box_resize_handler_t final : public nhshg::update_func_t
+{
+public:
+    void update(nhshg::index_t begin, nhshg::index_t end, nhshg::entity_t* e, nhshg::index_t const* ref, nhshg::hshg_t* hshg) override final
+    {
+        for (nhshg::index_t i = begin; i < end; ++i)
+        {
+            if (ref[i] != m_ref)
+                continue;
+            if (m_r != 0.0f)
+            {
+                e[i].r = m_r;
+                nhshg::hshg_resize(hshg, i);
+            }
+            else
+            {
+                nhshg::hshg_resize_box(hshg, i, m_half[0], m_half[1], m_half[2]);
+            }
+        }
+    }
+
+    nhshg::index_t m_ref     = 0;
+    f32            m_r       = 0.0f;
+    f32            m_half[3] = {0.0f, 0.0f, 0.0f};
+};
+
+UNITTEST_SUITE_BEGIN(test_hshg_box)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static s32 do_query(nhshg::hshg_t * hshg, f32 x1, f32 y1, f32 z1, f32 x2, f32 y2, f32 z2)
+        {
+            test_query_handler_t handler;
+            nhshg::hshg_query(hshg, x1, y1, z1, x2, y2, z2, &handler);
+            return handler.query_count;
+        }
+
+        static nhshg::index_t find(nhshg::hshg_t * hshg, f32 x, f32 y, f32 z)
+        {
+            test_query_handler_t handler;
+            nhshg::hshg_query(hshg, x, y, z, x, y, z, &handler);
+            return handler.query_count == 1 ? handler.last_ref : nhshg::c_invalid_index;
+        }
+
+        // A floor with entities standing on it and entities floating above it
+        static nhshg::hshg_t* create_floor()
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 16, 8, 32);
+            nhshg::hshg_insert_box(hshg, 32.0f, 1.0f, 32.0f, 24.0f, 1.0f, 24.0f, 0);
+            for (s32 i = 0; i < 4; ++i)
+            {
+                nhshg::hshg_insert(hshg, 16.0f + 10.0f * i, 3.0f, 32.0f, 1.0f, 1 + i);
+                nhshg::hshg_insert(hshg, 16.0f + 10.0f * i, 10.0f, 32.0f, 1.0f, 5 + i);
+            }
+            return hshg;
+        }
+
+        UNITTEST_TEST(query_and_pairs)
+        {
+            nhshg::hshg_t* hshg = create_floor();
+
+            f32 hx, hy, hz;
+            nhshg::hshg_get_box(hshg, 0, hx, hy, hz);
+            CHECK_EQUAL(24.0f, hx);
+            CHECK_EQUAL(1.0f, hy);
+            nhshg::hshg_get_box(hshg, 1, hx, hy, hz);
+            CHECK_EQUAL(1.0f, hx);
+            CHECK_EQUAL(1.0f, hy);
+
+            // as a hypercube the floor would reach up to y = 25
+            CHECK_EQUAL(4, do_query(hshg, 0.0f, 5.0f, 0.0f, 64.0f, 20.0f, 64.0f));
+            CHECK_EQUAL(0, do_query(hshg, 30.0f, 4.5f, 30.0f, 34.0f, 20.0f, 34.0f));
+            CHECK_EQUAL(1, do_query(hshg, 30.0f, 0.0f, 30.0f, 34.0f, 1.5f, 34.0f));
+
+            // only the entities standing on the floor touch it
+            nhshg::hshg_pair_cache_t* cache = nhshg::hshg_pair_cache_create(Allocator, hshg, 64);
+            test_contact_handler_t    contact;
+            nhshg::hshg_collide_cached(hshg, cache, &contact);
+            CHECK_EQUAL(4, contact.begin_count);
+            nhshg::hshg_pair_cache_free(cache);
+
+            // so does testing every pair
+            nhshg::hshg_set_brute_force_threshold(hshg, 32);
+            test_collide_handler_t collide;
+            nhshg::hshg_collide(hshg, &collide);
+            CHECK_EQUAL(4, collide.pair_count);
+            CHECK_EQUAL(0, do_query(hshg, 30.0f, 4.5f, 30.0f, 34.0f, 20.0f, 34.0f));
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(overflow)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 16, 4, 32);
+            CHECK_TRUE(nhshg::hshg_enable_boxes(hshg));
+
+            // a wall too long for the top grid, the overflow set sorts it on its x extent
+            nhshg::hshg_insert_box(hshg, 10.0f, 32.0f, 32.0f, 1.0f, 200.0f, 1.0f, 0);
+            nhshg::hshg_insert(hshg, 14.0f, 32.0f, 32.0f, 1.0f, 1);
+            nhshg::hshg_insert(hshg, 10.5f, 100.0f, 32.0f, 1.0f, 2);
+            CHECK_EQUAL(1, do_query(hshg, 12.0f, 0.0f, 0.0f, 16.0f, 64.0f, 64.0f));
+            CHECK_EQUAL(2, do_query(hshg, 9.0f, 90.0f, 30.0f, 12.0f, 110.0f, 34.0f));
+
+            nhshg::hshg_pair_cache_t* cache = nhshg::hshg_pair_cache_create(Allocator, hshg, 64);
+            test_contact_handler_t    contact;
+            nhshg::hshg_collide_cached(hshg, cache, &contact);
+            CHECK_EQUAL(1, contact.begin_count);
+            nhshg::hshg_pair_cache_free(cache);
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(resize_remove_optimize)
+        {
+            nhshg::hshg_t* hshg = create_floor();
+
+            // a plain resize turns the box into a hypercube
+            my_box_resize_handler_t resize;
+            resize.m_ref = 0;
+            resize.m_r   = 24.0f;
+            nhshg::hshg_update(hshg, &resize);
+            CHECK_EQUAL(5, do_query(hshg, 0.0f, 5.0f, 0.0f, 64.0f, 20.0f, 64.0f));
+
+            // and resize_box back into a (thinner) box
+            resize.m_r       = 0.0f;
+            resize.m_half[0] = 24.0f;
+            resize.m_half[1] = 0.5f;
+            resize.m_half[2] = 24.0f;
+            nhshg::hshg_update(hshg, &resize);
+            CHECK_EQUAL(4, do_query(hshg, 0.0f, 5.0f, 0.0f, 64.0f, 20.0f, 64.0f));
+            CHECK_EQUAL(0, do_query(hshg, 30.0f, 1.6f, 30.0f, 34.0f, 1.9f, 34.0f));
+
+            // removing an entity moves the last one into its slot, the boxes move along
+            test_move_handler_t remove;
+            remove.m_ref    = 1;
+            remove.m_remove = true;
+            nhshg::hshg_update(hshg, &remove);
+            nhshg::hshg_optimize(hshg);
+            CHECK_EQUAL(4, do_query(hshg, 0.0f, 5.0f, 0.0f, 64.0f, 20.0f, 64.0f));
+            CHECK_EQUAL(1, do_query(hshg, 30.0f, 0.0f, 30.0f, 34.0f, 1.0f, 34.0f));
+
+            // and so they do through an image
+            const int_t size  = nhshg::hshg_save(hshg, nullptr, 0);
+            void*       image = Allocator->allocate((u32)size, 64);
+            nhshg::hshg_save(hshg, image, size);
+            nhshg::hshg_t* loaded = nhshg::hshg_load(Allocator, image, size);
+            CHECK_NOT_NULL(loaded);
+            CHECK_EQUAL(4, do_query(loaded, 0.0f, 5.0f, 0.0f, 64.0f, 20.0f, 64.0f));
+            CHECK_EQUAL(0u, find(loaded, 50.0f, 1.2f, 50.0f));
+            nhshg::hshg_free(loaded);
+            Allocator->deallocate(image);
+
+            nhshg::hshg_free(hshg);
+        }
+    }
+}
+UNITTEST_SUITE_END
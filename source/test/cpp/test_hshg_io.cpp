@@ -0,0 +1,176 @@
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_io.h"
+#include "chshg/c_hshg_shard.h"
+#include "chshg/test_allocator.h"
+#include "chshg/test_handlers.h"
+
+#include "cunittest/cunittest.h"
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(test_hshg_io)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static s32 do_collide(nhshg::hshg_t * hshg)
+        {
+            test_collide_handler_t handler;
+            nhshg::hshg_collide(hshg, &handler);
+            return handler.collide_count;
+        }
+
+        static s32 do_query(nhshg::hshg_t * hshg)
+        {
+            test_query_handler_t handler;
+            nhshg::hshg_query(hshg, -4.0f, -4.0f, -4.0f, 4.0f, 4.0f, 4.0f, &handler);
+            return handler.query_count;
+        }
+
+        static nhshg::hshg_t* create_sample()
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 16, 8, 32);
+            nhshg::hshg_insert(hshg, 0.0f, 0.0f, 0.0f, 1.0f, 0);
+            nhshg::hshg_insert(hshg, 1.5f, 0.0f, 0.0f, 1.0f, 1);
+            nhshg::hshg_insert(hshg, 3.0f, 0.0f, 0.0f, 1.0f, 2);
+            nhshg::hshg_insert(hshg, 100.0f, 20.0f, 0.0f, 20.0f, 3);
+            nhshg::hshg_insert(hshg, 90.0f, 20.0f, 0.0f, 1.0f, 4);
+            return hshg;
+        }
+
+        UNITTEST_TEST(save_load)
+        {
+            nhshg::hshg_t* hshg = create_sample();
+            CHECK_EQUAL(3, do_collide(hshg));
+
+            const int_t size = nhshg::hshg_save(hshg, nullptr, 0);
+            CHECK_TRUE(size > 0);
+            void* image = Allocator->allocate((u32)size, 64);
+            CHECK_EQUAL(size, nhshg::hshg_save(hshg, image, size));
+            nhshg::hshg_free(hshg);
+
+            nhshg::hshg_t* loaded = nhshg::hshg_load(Allocator, image, size);
+            CHECK_NOT_NULL(loaded);
+            CHECK_EQUAL(3, do_collide(loaded));
+            CHECK_EQUAL(3, do_query(loaded));
+
+            // the loaded HSHG is a normal one
+            nhshg::hshg_insert(loaded, 0.5f, 1.5f, 0.0f, 1.0f, 5);
+            CHECK_EQUAL(5, do_collide(loaded));
+            nhshg::hshg_free(loaded);
+
+            // truncated or damaged images are refused
+            CHECK_NULL(nhshg::hshg_load(Allocator, image, size - 1));
+
+            // as are those with a side or capacity this build can not hold (m_side and m_entities_max)
+            u32* const fields = (u32*)image;
+            const u32  side   = fields[3];
+            fields[3]         = nhshg::c_max_side * 2;
+            CHECK_NULL(nhshg::hshg_load(Allocator, image, size));
+            fields[3] = side;
+            if (nhshg::c_invalid_index != 0xFFFFFFFF)
+            {
+                const u32 max = fields[7];
+                fields[7]     = (u32)nhshg::c_invalid_index + 1;
+                CHECK_NULL(nhshg::hshg_load(Allocator, image, size));
+                fields[7] = max;
+            }
+
+            // and those with an index out of range in a cell head, a node or the grid column,
+            // the section offsets follow the thirteen u32 fields, padding and the size of the image
+            u8* const             bytes    = (u8*)image;
+            const u64* const      sections = (const u64*)(bytes + 64);
+            nhshg::index_t* const heads    = (nhshg::index_t*)(bytes + sections[1]);
+            nhshg::index_t* const nodes    = (nhshg::index_t*)(bytes + sections[3]);
+            u8* const             grids    = bytes + sections[5];
+
+            const nhshg::index_t head = heads[0];
+            heads[0]                  = 6;
+            CHECK_NULL(nhshg::hshg_load(Allocator, image, size));
+            heads[0] = head;
+
+            const nhshg::index_t next = nodes[0];
+            nodes[0]                  = 7;
+            CHECK_NULL(nhshg::hshg_load(Allocator, image, size));
+            nodes[0] = next;
+
+            const u8 grid = grids[0];
+            grids[0]      = 200;
+            CHECK_NULL(nhshg::hshg_load(Allocator, image, size));
+            grids[0] = grid;
+
+            loaded = nhshg::hshg_load(Allocator, image, size);
+            CHECK_NOT_NULL(loaded);
+            CHECK_EQUAL(3, do_collide(loaded));
+            nhshg::hshg_free(loaded);
+
+            ((u32*)image)[0] ^= 1;
+            CHECK_NULL(nhshg::hshg_load(Allocator, image, size));
+            CHECK_NULL(nhshg::hshg_map(Allocator, image, size));
+
+            Allocator->deallocate(image);
+        }
+
+        UNITTEST_TEST(map)
+        {
+            nhshg::hshg_t* hshg  = create_sample();
+            const int_t    size  = nhshg::hshg_save(hshg, nullptr, 0);
+            void*          image = Allocator->allocate((u32)size, 64);
+            nhshg::hshg_save(hshg, image, size);
+            nhshg::hshg_free(hshg);
+
+            nhshg::hshg_t* mapped = nhshg::hshg_map(Allocator, image, size);
+            CHECK_NOT_NULL(mapped);
+            CHECK_EQUAL(3, do_collide(mapped));
+
+            // the mapped HSHG writes into the image
+            nhshg::hshg_insert(mapped, 0.5f, 1.5f, 0.0f, 1.0f, 5);
+            test_move_handler_t remove;
+            remove.m_ref    = 0;
+            remove.m_remove = true;
+            nhshg::hshg_update(mapped, &remove);
+            CHECK_EQUAL(3, do_collide(mapped));
+
+            // the arrays move out of the image, which is not freed
+            nhshg::hshg_optimize(mapped);
+            CHECK_EQUAL(3, do_collide(mapped));
+            nhshg::hshg_free(mapped);
+
+            Allocator->deallocate(image);
+        }
+
+        UNITTEST_TEST(map_ghosts)
+        {
+            nhshg::hshg_t* hshg = create_sample();
+
+            nhshg::ghost_t ghost;
+            ghost.m_entity.x = 0.5f;
+            ghost.m_entity.y = 1.5f;
+            ghost.m_entity.z = 0.0f;
+            ghost.m_entity.r = 1.0f;
+            ghost.m_ref      = 5;
+            CHECK_EQUAL(1, nhshg::hshg_import_ghosts(hshg, &ghost, 1));
+            CHECK_EQUAL(5, do_collide(hshg));
+
+            const int_t size  = nhshg::hshg_save(hshg, nullptr, 0);
+            void*       image = Allocator->allocate((u32)size, 64);
+            nhshg::hshg_save(hshg, image, size);
+            nhshg::hshg_free(hshg);
+
+            // the image knows it holds a ghost, without looking at the flags
+            nhshg::hshg_t* mapped = nhshg::hshg_map(Allocator, image, size);
+            CHECK_NOT_NULL(mapped);
+            CHECK_EQUAL(5, do_collide(mapped));
+            nhshg::hshg_clear_ghosts(mapped);
+            CHECK_EQUAL(3, do_collide(mapped));
+            nhshg::hshg_free(mapped);
+
+            Allocator->deallocate(image);
+        }
+    }
+}
+UNITTEST_SUITE_END
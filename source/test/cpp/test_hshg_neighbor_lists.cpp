@@ -0,0 +1,99 @@
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_neighbor_lists.h"
+#include "chshg/test_allocator.h"
+#include "chshg/test_handlers.h"
+
+#include "cunittest/cunittest.h"
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(test_hshg_neighbor_lists)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static bool in_list(nhshg::hshg_neighbor_lists_t * lists, nhshg::index_t entity, nhshg::index_t neighbor)
+        {
+            nhshg::index_t              len;
+            nhshg::index_t const* const list = nhshg::hshg_neighbor_list(lists, entity, len);
+            for (nhshg::index_t i = 0; i < len; ++i)
+            {
+                if (list[i] == neighbor)
+                    return true;
+            }
+            return false;
+        }
+
+        UNITTEST_TEST(build)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 16, 4, 128);
+
+            // no entity is removed, so the entity indices are the refs
+            nhshg::entity_t entities[96];
+            u32             seed = 0x2545f491;
+            for (s32 i = 0; i < 96; ++i)
+            {
+                f32* values = &entities[i].x;
+                for (s32 j = 0; j < 4; ++j)
+                {
+                    seed ^= seed << 13;
+                    seed ^= seed >> 17;
+                    seed ^= seed << 5;
+                    values[j] = (f32)(seed % 1000) * 0.04f;
+                }
+                entities[i].r = 0.5f + entities[i].r * (i % 8 == 0 ? 0.2f : 0.02f);
+                nhshg::hshg_insert(hshg, entities[i].x, entities[i].y, entities[i].z, entities[i].r, i);
+            }
+
+            const f32                     skin  = 1.0f;
+            nhshg::hshg_neighbor_lists_t* lists = nhshg::hshg_neighbor_lists_create(Allocator);
+            CHECK_TRUE(nhshg::hshg_build_neighbor_lists(hshg, skin, lists));
+            CHECK_FALSE(nhshg::hshg_neighbor_lists_expired(hshg, lists));
+
+            s32 expected = 0;
+            s32 missing  = 0;
+            for (s32 i = 0; i < 96; ++i)
+            {
+                for (s32 j = i + 1; j < 96; ++j)
+                {
+                    const f32 r = entities[i].r + entities[j].r + skin;
+                    const f32 dx = entities[i].x - entities[j].x;
+                    const f32 dy = entities[i].y - entities[j].y;
+                    const f32 dz = entities[i].z - entities[j].z;
+                    if ((dx < 0 ? -dx : dx) <= r && (dy < 0 ? -dy : dy) <= r && (dz < 0 ? -dz : dz) <= r)
+                    {
+                        expected += 2;
+                        if (!in_list(lists, i, j) || !in_list(lists, j, i))
+                            ++missing;
+                    }
+                }
+            }
+            CHECK_TRUE(expected > 0);
+            CHECK_EQUAL(0, missing);
+            CHECK_EQUAL(expected, (s32)nhshg::hshg_neighbor_lists_len(lists));
+
+            // the lists hold until an entity moved more than half the skin
+            test_move_handler_t move;
+            move.m_ref = 5;
+            move.m_dx  = 0.375f;
+            nhshg::hshg_update(hshg, &move);
+            CHECK_FALSE(nhshg::hshg_neighbor_lists_expired(hshg, lists));
+            nhshg::hshg_update(hshg, &move);
+            CHECK_TRUE(nhshg::hshg_neighbor_lists_expired(hshg, lists));
+
+            CHECK_TRUE(nhshg::hshg_build_neighbor_lists(hshg, skin, lists));
+            CHECK_FALSE(nhshg::hshg_neighbor_lists_expired(hshg, lists));
+
+            nhshg::hshg_insert(hshg, 1.0f, 1.0f, 1.0f, 1.0f, 96);
+            CHECK_TRUE(nhshg::hshg_neighbor_lists_expired(hshg, lists));
+
+            nhshg::hshg_neighbor_lists_free(lists);
+            nhshg::hshg_free(hshg);
+        }
+    }
+}
+UNITTEST_SUITE_END
@@ -0,0 +1,137 @@
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_pair_cache.h"
+#include "chshg/test_allocator.h"
+#include "chshg/test_handlers.h"
+
+#include "cunittest/cunittest.h"
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(test_hshg_pair_cache)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        static test_contact_handler_t s_contact_handler;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static void do_collide(nhshg::hshg_t * hshg, nhshg::hshg_pair_cache_t * cache)
+        {
+            s_contact_handler.reset();
+            nhshg::hshg_collide_cached(hshg, cache, &s_contact_handler);
+        }
+
+        UNITTEST_TEST(begin_stay_end)
+        {
+            nhshg::hshg_t*            hshg  = nhshg::hshg_create(Allocator, 32, 16, 32);
+            nhshg::hshg_pair_cache_t* cache = nhshg::hshg_pair_cache_create(Allocator, hshg, 64);
+            CHECK_NOT_NULL(cache);
+
+            nhshg::hshg_insert(hshg, 0.0f, 0.0f, 0.0f, 1.0f, 10);
+            nhshg::hshg_insert(hshg, 1.5f, 0.0f, 0.0f, 1.0f, 11);
+            nhshg::hshg_insert(hshg, 3.0f, 0.0f, 0.0f, 1.0f, 12);
+            nhshg::hshg_insert(hshg, 50.0f, 0.0f, 0.0f, 1.0f, 13);
+
+            do_collide(hshg, cache);
+            CHECK_EQUAL(2, s_contact_handler.begin_count);
+            CHECK_EQUAL(0, s_contact_handler.stay_count);
+            CHECK_EQUAL(0, s_contact_handler.end_count);
+            CHECK_EQUAL(2, nhshg::hshg_pair_cache_len(cache));
+
+            // nothing moved, both pairs are carried forward
+            do_collide(hshg, cache);
+            CHECK_EQUAL(0, s_contact_handler.begin_count);
+            CHECK_EQUAL(2, s_contact_handler.stay_count);
+            CHECK_EQUAL(0, s_contact_handler.end_count);
+
+            // move 12 away from 11 and next to 13
+            test_move_handler_t move;
+            move.m_ref = 12;
+            move.m_dx  = 46.0f;
+            nhshg::hshg_update(hshg, &move);
+
+            do_collide(hshg, cache);
+            CHECK_EQUAL(1, s_contact_handler.begin_count);
+            CHECK_EQUAL(1, s_contact_handler.stay_count);
+            CHECK_EQUAL(1, s_contact_handler.end_count);
+            CHECK_EQUAL(11, s_contact_handler.last_end_ref1);
+            CHECK_EQUAL(12, s_contact_handler.last_end_ref2);
+
+            // removing 10 ends its pair with 11
+            move.m_ref    = 10;
+            move.m_remove = true;
+            nhshg::hshg_update(hshg, &move);
+
+            do_collide(hshg, cache);
+            CHECK_EQUAL(0, s_contact_handler.begin_count);
+            CHECK_EQUAL(1, s_contact_handler.stay_count);
+            CHECK_EQUAL(1, s_contact_handler.end_count);
+            CHECK_EQUAL(10, s_contact_handler.last_end_ref1);
+            CHECK_EQUAL(1, nhshg::hshg_pair_cache_len(cache));
+
+            nhshg::hshg_pair_cache_free(cache);
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(removed_between_collides)
+        {
+            nhshg::hshg_t*            hshg  = nhshg::hshg_create(Allocator, 32, 16, 8);
+            nhshg::hshg_pair_cache_t* cache = nhshg::hshg_pair_cache_create(Allocator, hshg, 64);
+
+            // four times the capacity is removed before the contacts of the first round end
+            test_move_handler_t remove;
+            remove.m_remove = true;
+            s32 pairs       = 0;
+            for (s32 round = 0; round < 4; ++round)
+            {
+                for (s32 i = 0; i < 8; ++i)
+                    nhshg::hshg_insert(hshg, 0.5f * i, 0.0f, 0.0f, 1.0f, (nhshg::index_t)(round * 8 + i));
+                if (round == 0)
+                {
+                    do_collide(hshg, cache);
+                    pairs = s_contact_handler.begin_count;
+                }
+                for (s32 i = 0; i < 8; ++i)
+                {
+                    remove.m_ref = (nhshg::index_t)(round * 8 + i);
+                    nhshg::hshg_update(hshg, &remove);
+                }
+            }
+            CHECK_EQUAL(22, pairs);
+
+            do_collide(hshg, cache);
+            CHECK_EQUAL(0, s_contact_handler.begin_count);
+            CHECK_EQUAL(pairs, s_contact_handler.end_count);
+            CHECK_EQUAL(0, nhshg::hshg_pair_cache_len(cache));
+
+            nhshg::hshg_pair_cache_free(cache);
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(grow_pairs)
+        {
+            nhshg::hshg_t*            hshg  = nhshg::hshg_create(Allocator, 32, 16, 8);
+            nhshg::hshg_pair_cache_t* cache = nhshg::hshg_pair_cache_create(Allocator, hshg, 2);
+
+            // all 28 pairs overlap, far more than the 2 asked for
+            for (s32 i = 0; i < 8; ++i)
+                nhshg::hshg_insert(hshg, 0.1f * i, 0.0f, 0.0f, 1.0f, (nhshg::index_t)i);
+
+            do_collide(hshg, cache);
+            CHECK_EQUAL(28, s_contact_handler.begin_count);
+            CHECK_EQUAL(28, nhshg::hshg_pair_cache_len(cache));
+
+            do_collide(hshg, cache);
+            CHECK_EQUAL(0, s_contact_handler.begin_count);
+            CHECK_EQUAL(28, s_contact_handler.stay_count);
+            CHECK_EQUAL(0, s_contact_handler.end_count);
+
+            nhshg::hshg_pair_cache_free(cache);
+            nhshg::hshg_free(hshg);
+        }
+    }
+}
+UNITTEST_SUITE_END
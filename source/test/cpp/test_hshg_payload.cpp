@@ -0,0 +1,174 @@
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_io.h"
+#include "chshg/c_hshg_payload.h"
+#include "chshg/test_allocator.h"
+
+#include "cunittest/cunittest.h"
+
+using namespace ncore;
+
+struct my_payload_t
+{
+    nhshg::index_t m_id;
+    u16            m_team;
+    u8             m_flags;
+};
+
+// Counts the pairs of which both entities are on the same team, reading the team from the payload
+class my_payload_collide_handler_t final : public nhshg::collide_func_t
+{
+public:
+    void collide(const nhshg::entity_t* e1, nhshg::index_t e1_ref, const nhshg::entity_t* e2, nhshg::index_t e2_ref) override final
+    {
+        my_payload_t const* p1 = (my_payload_t const*)nhshg::hshg_payload_of(hshg, e1);
+        my_payload_t const* p2 = (my_payload_t const*)nhshg::hshg_payload_of(hshg, e2);
+        if (p1->m_id != e1_ref || p2->m_id != e2_ref)
+            ++wrong_count;
+        if (p1->m_team == p2->m_team)
+            ++same_team_count;
+        ++collide_count;
+    }
+
+    nhshg::hshg_t* hshg            = nullptr;
+    s32            collide_count   = 0;
+    s32            same_team_count = 0;
+    s32            wrong_count     = 0;
+};
+
+// Checks that the payload of every entity still belongs to its ref
+class my_payload_query_handler_t final : public nhshg::query_func_t
+{
+public:
+    void query(nhshg::entity_t const* e, nhshg::index_t e_ref) override final
+    {
+        my_payload_t const* p = (my_payload_t const*)nhshg::hshg_payload_of(hshg, e);
+        if (p->m_id != e_ref || p->m_team != (u16)(e_ref & 1))
+            ++wrong_count;
+        ++query_count;
+    }
+
+    nhshg::hshg_t* hshg        = nullptr;
+    s32            query_count = 0;
+    s32            wrong_count = 0;
+};
+
+// Removes every entity with a ref that is a multiple of 3
+class my_payload_remove_handler_t final : public nhshg::update_func_t
+{
+public:
+    void update(nhshg::index_t begin, nhshg::index_t end, nhshg::entity_t* e, nhshg::index_t const* ref, nhshg::hshg_t* hshg) override final
+    {
+        for (nhshg::index_t i = begin; i < end; ++i)
+        {
+            if ((ref[i] % 3) == 0)
+                nhshg::hshg_remove(hshg, i);
+        }
+    }
+};
+
+UNITTEST_SUITE_BEGIN(test_hshg_payload)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static void insert(nhshg::hshg_t * hshg, nhshg::index_t ref)
+        {
+            const nhshg::index_t idx = nhshg::hshg_insert(hshg, 4.0f + 3.0f * (ref % 8), 4.0f + 3.0f * (ref / 8), 8.0f, 2.0f, ref);
+            my_payload_t* const  p   = (my_payload_t*)nhshg::hshg_payload(hshg, idx);
+            p->m_id                  = ref;
+            p->m_team                = (u16)(ref & 1);
+        }
+
+        static s32 check(nhshg::hshg_t * hshg, s32 & wrong)
+        {
+            my_payload_query_handler_t handler;
+            handler.hshg = hshg;
+            nhshg::hshg_query(hshg, 0.0f, 0.0f, 0.0f, 128.0f, 128.0f, 128.0f, &handler);
+            wrong = handler.wrong_count;
+            return handler.query_count;
+        }
+
+        UNITTEST_TEST(insert_and_collide)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 16, 8, 64);
+            CHECK_TRUE(nhshg::hshg_enable_payload(hshg, sizeof(my_payload_t)));
+            CHECK_TRUE(nhshg::hshg_enable_payload(hshg, sizeof(my_payload_t)));
+
+            // a new entity starts out with a zeroed payload, this one is far away from the others
+            const nhshg::index_t idx = nhshg::hshg_insert(hshg, 100.0f, 100.0f, 100.0f, 1.0f, 100);
+            my_payload_t const*  p   = (my_payload_t const*)nhshg::hshg_payload(hshg, idx);
+            CHECK_EQUAL(0u, p->m_id);
+            CHECK_EQUAL(0, p->m_team);
+            CHECK_EQUAL(0, p->m_flags);
+
+            for (nhshg::index_t i = 0; i < 16; ++i)
+                insert(hshg, i);
+
+            // two rows of 8, each entity touches its neighbours on its row and on the other row
+            // (also diagonally), of which only those straight across are on the same team, testing
+            // every pair only hands out the pairs that touch
+            nhshg::hshg_set_brute_force_threshold(hshg, 32);
+            my_payload_collide_handler_t collide;
+            collide.hshg = hshg;
+            nhshg::hshg_collide(hshg, &collide);
+            CHECK_EQUAL(36, collide.collide_count);
+            CHECK_EQUAL(8, collide.same_team_count);
+            CHECK_EQUAL(0, collide.wrong_count);
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(remove_optimize_reserve_save_load)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 16, 8, 32);
+            CHECK_TRUE(nhshg::hshg_enable_payload(hshg, sizeof(my_payload_t)));
+            for (nhshg::index_t i = 0; i < 32; ++i)
+                insert(hshg, i);
+
+            s32 wrong = 0;
+            CHECK_EQUAL(32, check(hshg, wrong));
+            CHECK_EQUAL(0, wrong);
+
+            // removing moves the last entities into the freed slots, their payload moves along
+            my_payload_remove_handler_t remove;
+            nhshg::hshg_update(hshg, &remove);
+            CHECK_EQUAL(21, check(hshg, wrong));
+            CHECK_EQUAL(0, wrong);
+
+            nhshg::hshg_optimize(hshg);
+            CHECK_EQUAL(21, check(hshg, wrong));
+            CHECK_EQUAL(0, wrong);
+
+            CHECK_TRUE(nhshg::hshg_reserve(hshg, 64));
+            for (nhshg::index_t i = 32; i < 48; ++i)
+                insert(hshg, i);
+            CHECK_EQUAL(37, check(hshg, wrong));
+            CHECK_EQUAL(0, wrong);
+
+            // and through an image, both loaded and mapped
+            const int_t size  = nhshg::hshg_save(hshg, nullptr, 0);
+            void*       image = Allocator->allocate((u32)size, 64);
+            nhshg::hshg_save(hshg, image, size);
+
+            nhshg::hshg_t* loaded = nhshg::hshg_load(Allocator, image, size);
+            CHECK_NOT_NULL(loaded);
+            CHECK_EQUAL(37, check(loaded, wrong));
+            CHECK_EQUAL(0, wrong);
+            nhshg::hshg_free(loaded);
+
+            nhshg::hshg_t* mapped = nhshg::hshg_map(Allocator, image, size);
+            CHECK_NOT_NULL(mapped);
+            CHECK_EQUAL(37, check(mapped, wrong));
+            CHECK_EQUAL(0, wrong);
+            nhshg::hshg_free(mapped);
+
+            Allocator->deallocate(image);
+            nhshg::hshg_free(hshg);
+        }
+    }
+}
+UNITTEST_SUITE_END
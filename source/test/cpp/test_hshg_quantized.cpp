@@ -0,0 +1,205 @@
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_io.h"
+#include "chshg/c_hshg_pair_cache.h"
+#include "chshg/c_hshg_quantized.h"
+#include "chshg/test_allocator.h"
+#include "chshg/test_handlers.h"
+
+#include "cunittest/cunittest.h"
+
+using namespace ncore;
+
+// Moves every entity by 'm_dx' on x and gives every other one the radius 'm_r'
+class my_quant_move_handler_t final : public nhshg::update_func_t
+{
+public:
+    void update(nhshg::index_t begin, nhshg::index_t end, nhshg::entity_t* e, nhshg::index_t const* ref, nhshg::hshg_t* hshg) override final
+    {
+        for (nhshg::index_t i = begin; i < end; ++i)
+        {
+            e[i].x += m_dx;
+            nhshg::hshg_move(hshg, i);
+            if ((ref[i] & 1) == 0)
+            {
+                e[i].r = m_r;
+                nhshg::hshg_resize(hshg, i);
+            }
+        }
+    }
+
+    f32 m_dx = 0.0f;
+    f32 m_r  = 1.0f;
+};
+
+UNITTEST_SUITE_BEGIN(test_hshg_quantized)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static u32 next(u32 & seed)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            return seed >> 8;
+        }
+
+        // The same scattered entities, of which some fall outside of the folding period
+        static void fill(nhshg::hshg_t * hshg, s32 count)
+        {
+            u32 seed = 12345;
+            for (s32 i = 0; i < count; ++i)
+            {
+                const f32 x = (f32)(next(seed) % 3000) * 0.1f;
+                const f32 y = (f32)(next(seed) % 1280) * 0.1f;
+                const f32 z = (f32)(next(seed) % 1280) * 0.1f;
+                const f32 r = 0.5f + (f32)(next(seed) % 40) * 0.1f;
+                nhshg::hshg_insert(hshg, x, y, z, r, (nhshg::index_t)i);
+            }
+        }
+
+        static void query(nhshg::hshg_t * hshg, f32 x1, f32 y1, f32 z1, f32 x2, f32 y2, f32 z2, s32 & count, s32 & sum)
+        {
+            test_query_handler_t handler;
+            nhshg::hshg_query(hshg, x1, y1, z1, x2, y2, z2, &handler);
+            count = handler.query_count;
+            sum   = handler.ref_sum;
+        }
+
+        // Runs the same queries against both, every one of them has to give the same entities
+        static s32 compare_queries(nhshg::hshg_t * a, nhshg::hshg_t * b)
+        {
+            s32 mismatches = 0;
+            u32 seed       = 777;
+            for (s32 i = 0; i < 64; ++i)
+            {
+                const f32 x = (f32)(next(seed) % 3000) * 0.1f;
+                const f32 y = (f32)(next(seed) % 1280) * 0.1f;
+                const f32 z = (f32)(next(seed) % 1280) * 0.1f;
+                const f32 w = 1.0f + (f32)(next(seed) % 200) * 0.1f;
+                s32       count_a, count_b;
+                s32       sum_a, sum_b;
+                query(a, x, y, z, x + w, y + w * 0.5f, z + w, count_a, sum_a);
+                query(b, x, y, z, x + w, y + w * 0.5f, z + w, count_b, sum_b);
+                if (count_a != count_b || sum_a != sum_b)
+                    ++mismatches;
+            }
+            return mismatches;
+        }
+
+        UNITTEST_TEST(same_results)
+        {
+            nhshg::hshg_t* plain = nhshg::hshg_create(Allocator, 16, 8, 256);
+            nhshg::hshg_t* quant = nhshg::hshg_create(Allocator, 16, 8, 256);
+            nhshg::hshg_t* brute = nhshg::hshg_create(Allocator, 16, 8, 256);
+            fill(plain, 200);
+            fill(quant, 200);
+            fill(brute, 200);
+            CHECK_TRUE(nhshg::hshg_enable_quantized(quant));
+            CHECK_TRUE(nhshg::hshg_enable_quantized(quant));
+            nhshg::hshg_set_brute_force_threshold(brute, 256);
+
+            CHECK_EQUAL(0, compare_queries(plain, quant));
+            CHECK_EQUAL(0, compare_queries(brute, quant));
+
+            nhshg::hshg_pair_cache_t* plain_cache = nhshg::hshg_pair_cache_create(Allocator, plain, 1024);
+            nhshg::hshg_pair_cache_t* quant_cache = nhshg::hshg_pair_cache_create(Allocator, quant, 1024);
+            test_contact_handler_t    plain_contact;
+            test_contact_handler_t    quant_contact;
+            nhshg::hshg_collide_cached(plain, plain_cache, &plain_contact);
+            nhshg::hshg_collide_cached(quant, quant_cache, &quant_contact);
+            CHECK_NOT_EQUAL(0, plain_contact.begin_count);
+            CHECK_EQUAL(plain_contact.begin_count, quant_contact.begin_count);
+
+            // moving and resizing keeps the quantized column up to date
+            my_quant_move_handler_t move;
+            move.m_dx = 3.5f;
+            move.m_r  = 2.5f;
+            nhshg::hshg_update(plain, &move);
+            nhshg::hshg_update(quant, &move);
+            nhshg::hshg_update(brute, &move);
+            CHECK_EQUAL(0, compare_queries(plain, quant));
+            CHECK_EQUAL(0, compare_queries(brute, quant));
+
+            nhshg::hshg_collide_cached(plain, plain_cache, &plain_contact);
+            nhshg::hshg_collide_cached(quant, quant_cache, &quant_contact);
+            CHECK_EQUAL(plain_contact.begin_count, quant_contact.begin_count);
+            CHECK_EQUAL(plain_contact.stay_count, quant_contact.stay_count);
+            CHECK_EQUAL(plain_contact.end_count, quant_contact.end_count);
+
+            nhshg::hshg_pair_cache_free(quant_cache);
+            nhshg::hshg_pair_cache_free(plain_cache);
+            nhshg::hshg_free(brute);
+            nhshg::hshg_free(quant);
+            nhshg::hshg_free(plain);
+        }
+
+        UNITTEST_TEST(wrap)
+        {
+            // the folding period is 16 * 8 = 128, an entity just below it and one just above
+            // it are far apart in the quantized column, but touch
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 16, 8, 32);
+            CHECK_TRUE(nhshg::hshg_enable_quantized(hshg));
+            nhshg::hshg_insert(hshg, 127.5f, 10.0f, 10.0f, 1.0f, 1);
+            nhshg::hshg_insert(hshg, 129.0f, 10.0f, 10.0f, 1.0f, 2);
+            nhshg::hshg_insert(hshg, 1.5f, 10.0f, 10.0f, 1.0f, 4);
+
+            s32 count;
+            s32 sum;
+            query(hshg, 127.0f, 9.0f, 9.0f, 128.5f, 11.0f, 11.0f, count, sum);
+            CHECK_EQUAL(2, count);
+            CHECK_EQUAL(3, sum);
+            query(hshg, -1.0f, 9.0f, 9.0f, 1.0f, 11.0f, 11.0f, count, sum);
+            CHECK_EQUAL(1, count);
+            CHECK_EQUAL(4, sum);
+
+            nhshg::hshg_pair_cache_t* cache = nhshg::hshg_pair_cache_create(Allocator, hshg, 64);
+            test_contact_handler_t    contact;
+            nhshg::hshg_collide_cached(hshg, cache, &contact);
+            CHECK_EQUAL(1, contact.begin_count);
+            nhshg::hshg_pair_cache_free(cache);
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(optimize_reserve_save_load)
+        {
+            nhshg::hshg_t* plain = nhshg::hshg_create(Allocator, 16, 8, 128);
+            nhshg::hshg_t* quant = nhshg::hshg_create(Allocator, 16, 8, 128);
+            CHECK_TRUE(nhshg::hshg_enable_quantized(quant));
+            fill(plain, 100);
+            fill(quant, 100);
+
+            nhshg::hshg_optimize(plain);
+            nhshg::hshg_optimize(quant);
+            CHECK_EQUAL(0, compare_queries(plain, quant));
+
+            CHECK_TRUE(nhshg::hshg_reserve(plain, 512));
+            CHECK_TRUE(nhshg::hshg_reserve(quant, 512));
+            fill(plain, 200);
+            fill(quant, 200);
+            CHECK_EQUAL(0, compare_queries(plain, quant));
+
+            const int_t size  = nhshg::hshg_save(quant, nullptr, 0);
+            void*       image = Allocator->allocate((u32)size, 64);
+            nhshg::hshg_save(quant, image, size);
+
+            nhshg::hshg_t* loaded = nhshg::hshg_load(Allocator, image, size);
+            CHECK_NOT_NULL(loaded);
+            CHECK_EQUAL(0, compare_queries(plain, loaded));
+            nhshg::hshg_free(loaded);
+
+            nhshg::hshg_t* mapped = nhshg::hshg_map(Allocator, image, size);
+            CHECK_NOT_NULL(mapped);
+            CHECK_EQUAL(0, compare_queries(plain, mapped));
+            nhshg::hshg_free(mapped);
+
+            Allocator->deallocate(image);
+            nhshg::hshg_free(quant);
+            nhshg::hshg_free(plain);
+        }
+    }
+}
+UNITTEST_SUITE_END
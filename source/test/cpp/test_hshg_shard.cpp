@@ -0,0 +1,162 @@
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_pair_cache.h"
+#include "chshg/c_hshg_shard.h"
+#include "chshg/c_hshg_swept.h"
+#include "chshg/test_allocator.h"
+#include "chshg/test_handlers.h"
+
+#include "cunittest/cunittest.h"
+
+using namespace ncore;
+
+// Counts the entities handed out, none of them may be a ghost
+class my_shard_update_handler_t final : public nhshg::update_func_t
+{
+public:
+    void update(nhshg::index_t begin, nhshg::index_t end, nhshg::entity_t* e, nhshg::index_t const* ref, nhshg::hshg_t* hshg) override final
+    {
+        for (nhshg::index_t i = begin; i < end; ++i)
+        {
+            ++update_count;
+            if (nhshg::hshg_is_ghost(hshg, i))
+                ++ghost_count;
+        }
+    }
+
+    s32 update_count = 0;
+    s32 ghost_count  = 0;
+};
+
+class my_shard_swept_handler_t final : public nhshg::swept_func_t
+{
+public:
+    void swept(nhshg::entity_t const* e1, nhshg::index_t e1_ref, nhshg::entity_t const* e2, nhshg::index_t e2_ref, f32 toi) override final { ++swept_count; }
+
+    s32 swept_count = 0;
+};
+
+UNITTEST_SUITE_BEGIN(test_hshg_shard)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static s32 do_collide(nhshg::hshg_t * hshg)
+        {
+            test_collide_handler_t handler;
+            nhshg::hshg_collide(hshg, &handler);
+            return handler.collide_count;
+        }
+
+        UNITTEST_TEST(layout)
+        {
+            nhshg::shard_layout_t layout;
+            nhshg::hshg_shard_init(layout, 0.0f, 0.0f, 0.0f, 90.0f, 60.0f, 30.0f, 3, 2, 1, 4.0f);
+
+            CHECK_EQUAL(0, nhshg::hshg_shard_region(layout, 10.0f, 10.0f, 10.0f));
+            CHECK_EQUAL(2, nhshg::hshg_shard_region(layout, 70.0f, 10.0f, 10.0f));
+            CHECK_EQUAL(4, nhshg::hshg_shard_region(layout, 40.0f, 40.0f, 10.0f));
+            CHECK_EQUAL(5, nhshg::hshg_shard_region(layout, 200.0f, 200.0f, -5.0f));
+
+            f32 min[3];
+            f32 max[3];
+            nhshg::hshg_shard_bounds(layout, 4, min, max);
+            CHECK_EQUAL(30.0f, min[0]);
+            CHECK_EQUAL(60.0f, max[0]);
+            CHECK_EQUAL(30.0f, min[1]);
+            CHECK_EQUAL(60.0f, max[1]);
+
+            u32 neighbors[26];
+            CHECK_EQUAL(3, nhshg::hshg_shard_neighbors(layout, 0, neighbors));
+            CHECK_EQUAL(5, nhshg::hshg_shard_neighbors(layout, 4, neighbors));
+        }
+
+        UNITTEST_TEST(ghosts)
+        {
+            nhshg::shard_layout_t layout;
+            nhshg::hshg_shard_init(layout, 0.0f, 0.0f, 0.0f, 100.0f, 10.0f, 10.0f, 2, 1, 1, 4.0f);
+
+            // region 0 and 1 each have their own HSHG, one entity of each is near the border
+            nhshg::hshg_t* a = nhshg::hshg_create(Allocator, 16, 8, 32);
+            nhshg::hshg_t* b = nhshg::hshg_create(Allocator, 16, 8, 32);
+            nhshg::hshg_insert(a, 49.0f, 5.0f, 5.0f, 1.0f, 0);
+            nhshg::hshg_insert(a, 10.0f, 5.0f, 5.0f, 1.0f, 1);
+            nhshg::hshg_insert(b, 50.5f, 5.0f, 5.0f, 1.0f, 100);
+            CHECK_EQUAL(0, nhshg::hshg_shard_region(layout, 49.0f, 5.0f, 5.0f));
+            CHECK_EQUAL(1, nhshg::hshg_shard_region(layout, 50.5f, 5.0f, 5.0f));
+
+            nhshg::ghost_t to_b[4];
+            nhshg::ghost_t to_a[4];
+            CHECK_EQUAL(1, nhshg::hshg_shard_export(a, layout, 1, to_b, 4));
+            CHECK_EQUAL(1, nhshg::hshg_shard_export(b, layout, 0, to_a, 4));
+            CHECK_EQUAL(0, to_b[0].m_ref);
+            CHECK_EQUAL(100, to_a[0].m_ref);
+
+            CHECK_EQUAL(1, nhshg::hshg_import_ghosts(a, to_a, 1));
+            CHECK_EQUAL(1, nhshg::hshg_import_ghosts(b, to_b, 1));
+            CHECK_EQUAL(1, do_collide(a));
+            CHECK_EQUAL(1, do_collide(b));
+
+            // ghosts are not exported again and not handed to update
+            CHECK_EQUAL(1, nhshg::hshg_shard_export(a, layout, 1, to_b, 4));
+            my_shard_update_handler_t update;
+            nhshg::hshg_update(a, &update);
+            CHECK_EQUAL(2, update.update_count);
+            CHECK_EQUAL(0, update.ghost_count);
+
+            nhshg::hshg_clear_ghosts(a);
+            nhshg::hshg_clear_ghosts(b);
+            CHECK_EQUAL(0, do_collide(a));
+            CHECK_EQUAL(0, do_collide(b));
+
+            nhshg::hshg_free(b);
+            nhshg::hshg_free(a);
+        }
+
+        UNITTEST_TEST(ghost_pairs)
+        {
+            // two ghosts that overlap each other and the one own entity
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 16, 8, 32);
+            CHECK_TRUE(nhshg::hshg_enable_velocities(hshg));
+            nhshg::hshg_insert(hshg, 10.0f, 5.0f, 5.0f, 1.0f, 0);
+
+            nhshg::ghost_t ghosts[2];
+            ghosts[0].m_entity.x = 11.0f;
+            ghosts[0].m_entity.y = 5.0f;
+            ghosts[0].m_entity.z = 5.0f;
+            ghosts[0].m_entity.r = 1.0f;
+            ghosts[0].m_ref      = 100;
+            ghosts[1].m_entity   = ghosts[0].m_entity;
+            ghosts[1].m_entity.x = 12.0f;
+            ghosts[1].m_ref      = 101;
+            CHECK_EQUAL(2, nhshg::hshg_import_ghosts(hshg, ghosts, 2));
+
+            // the pair of the two ghosts belongs to their own region, the cached collide skips it as well
+            CHECK_EQUAL(2, do_collide(hshg));
+            nhshg::hshg_pair_cache_t* cache = nhshg::hshg_pair_cache_create(Allocator, hshg, 64);
+            test_contact_handler_t    contact;
+            nhshg::hshg_collide_cached(hshg, cache, &contact);
+            CHECK_EQUAL(2, contact.begin_count);
+            nhshg::hshg_pair_cache_free(cache);
+
+            // and so does the swept collide, also when both ghosts are fast
+            for (nhshg::index_t i = 0; i < 3; ++i)
+                nhshg::hshg_set_velocity(hshg, i, 4.0f, 0.0f, 0.0f);
+            my_shard_swept_handler_t swept;
+            nhshg::hshg_collide_swept(hshg, 1.0f, &swept);
+            CHECK_EQUAL(2, swept.swept_count);
+
+            nhshg::hshg_set_velocity(hshg, 0, 0.0f, 0.0f, 0.0f);
+            nhshg::hshg_set_velocity(hshg, 2, 0.0f, 0.0f, 0.0f);
+            swept.swept_count = 0;
+            nhshg::hshg_collide_swept(hshg, 1.0f, &swept);
+            CHECK_EQUAL(1, swept.swept_count);
+
+            nhshg::hshg_free(hshg);
+        }
+    }
+}
+UNITTEST_SUITE_END
@@ -0,0 +1,116 @@
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_snapshot.h"
+#include "chshg/test_allocator.h"
+#include "chshg/test_handlers.h"
+
+#include "cunittest/cunittest.h"
+
+using namespace ncore;
+
+class my_remove_all_handler_t final : public nhshg::update_func_t
+{
+public:
+    void update(nhshg::index_t begin, nhshg::index_t end, nhshg::entity_t* e, nhshg::index_t const* ref, nhshg::hshg_t* hshg) override final
+    {
+        for (nhshg::index_t i = begin; i < end; ++i)
+            nhshg::hshg_remove(hshg, i);
+    }
+};
+
+UNITTEST_SUITE_BEGIN(test_hshg_snapshot)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        static test_query_handler_t s_query_handler;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static s32 do_query(nhshg::hshg_snapshot_t const* snapshot, f32 x1, f32 y1, f32 z1, f32 x2, f32 y2, f32 z2)
+        {
+            s_query_handler.reset();
+            nhshg::hshg_snapshot_query(snapshot, x1, y1, z1, x2, y2, z2, &s_query_handler);
+            return s_query_handler.query_count;
+        }
+
+        UNITTEST_TEST(create_destroy)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 32, 32, 32);
+            CHECK_NOT_NULL(hshg);
+
+            nhshg::hshg_snapshot_buffer_t* buffer = nhshg::hshg_snapshot_buffer_create(Allocator, hshg);
+            CHECK_NOT_NULL(buffer);
+            CHECK_NULL(nhshg::hshg_snapshot_acquire(buffer));
+
+            nhshg::hshg_snapshot_buffer_free(buffer);
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(publish_query)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 32, 32, 32);
+            CHECK_NOT_NULL(hshg);
+
+            nhshg::hshg_insert(hshg, 0.0f, 0.0f, 0.0f, 1.0f, 1);
+            nhshg::hshg_insert(hshg, 100.0f, 0.0f, 0.0f, 4.0f, 2);
+            nhshg::hshg_insert(hshg, 500.0f, 500.0f, 500.0f, 80.0f, 4);
+
+            nhshg::hshg_snapshot_buffer_t* buffer = nhshg::hshg_snapshot_buffer_create(Allocator, hshg);
+            CHECK_TRUE(nhshg::hshg_snapshot_publish(buffer, hshg));
+
+            nhshg::hshg_snapshot_t const* snapshot = nhshg::hshg_snapshot_acquire(buffer);
+            CHECK_NOT_NULL(snapshot);
+            CHECK_EQUAL(1, nhshg::hshg_snapshot_sequence(snapshot));
+            CHECK_EQUAL(3, nhshg::hshg_snapshot_len(snapshot));
+
+            CHECK_EQUAL(1, do_query(snapshot, -2.0f, -2.0f, -2.0f, 2.0f, 2.0f, 2.0f));
+            CHECK_EQUAL(1, s_query_handler.ref_sum);
+            CHECK_EQUAL(2, do_query(snapshot, -2.0f, -2.0f, -2.0f, 120.0f, 2.0f, 2.0f));
+            CHECK_EQUAL(3, s_query_handler.ref_sum);
+            CHECK_EQUAL(1, do_query(snapshot, 400.0f, 400.0f, 400.0f, 450.0f, 450.0f, 450.0f));
+            CHECK_EQUAL(4, s_query_handler.ref_sum);
+
+            nhshg::hshg_snapshot_release(buffer, snapshot);
+
+            nhshg::hshg_snapshot_buffer_free(buffer);
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(acquired_snapshot_is_not_overwritten)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 32, 32, 32);
+            CHECK_NOT_NULL(hshg);
+
+            nhshg::hshg_insert(hshg, 0.0f, 0.0f, 0.0f, 1.0f, 1);
+            nhshg::hshg_insert(hshg, 3.0f, 0.0f, 0.0f, 1.0f, 2);
+
+            nhshg::hshg_snapshot_buffer_t* buffer = nhshg::hshg_snapshot_buffer_create(Allocator, hshg);
+            CHECK_TRUE(nhshg::hshg_snapshot_publish(buffer, hshg));
+            nhshg::hshg_snapshot_t const* first = nhshg::hshg_snapshot_acquire(buffer);
+
+            // mutate the live HSHG, the acquired snapshot keeps the old state
+            my_remove_all_handler_t remove_all;
+            nhshg::hshg_update(hshg, &remove_all);
+            CHECK_EQUAL(2, do_query(first, -8.0f, -8.0f, -8.0f, 8.0f, 8.0f, 8.0f));
+
+            // the back buffer is free, the front buffer is pinned by 'first'
+            CHECK_TRUE(nhshg::hshg_snapshot_publish(buffer, hshg));
+            CHECK_FALSE(nhshg::hshg_snapshot_publish(buffer, hshg));
+
+            nhshg::hshg_snapshot_t const* second = nhshg::hshg_snapshot_acquire(buffer);
+            CHECK_EQUAL(2, nhshg::hshg_snapshot_sequence(second));
+            CHECK_EQUAL(0, do_query(second, -8.0f, -8.0f, -8.0f, 8.0f, 8.0f, 8.0f));
+            CHECK_EQUAL(2, do_query(first, -8.0f, -8.0f, -8.0f, 8.0f, 8.0f, 8.0f));
+
+            nhshg::hshg_snapshot_release(buffer, first);
+            CHECK_TRUE(nhshg::hshg_snapshot_publish(buffer, hshg));
+            nhshg::hshg_snapshot_release(buffer, second);
+
+            nhshg::hshg_snapshot_buffer_free(buffer);
+            nhshg::hshg_free(hshg);
+        }
+    }
+}
+UNITTEST_SUITE_END
@@ -0,0 +1,526 @@
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_io.h"
+#include "chshg/c_hshg_neighbor_lists.h"
+#include "chshg/c_hshg_span.h"
+#include "chshg/test_allocator.h"
+
+#include "cunittest/cunittest.h"
+
+using namespace ncore;
+
+static const s32 c_span_test_max = 64;
+
+static inline f32 span_abs(f32 x) { return x < 0.0f ? -x : x; }
+static inline f32 span_max(f32 a, f32 b) { return a > b ? a : b; }
+
+// Half extents of every ref, spans have a box, all others a hypercube of radius 'r'
+struct span_shapes_t
+{
+    f32  m_x[c_span_test_max];
+    f32  m_y[c_span_test_max];
+    f32  m_z[c_span_test_max];
+    f32  m_half[c_span_test_max][3];
+    bool m_alive[c_span_test_max];
+
+    bool overlap(s32 a, s32 b) const
+    {
+        return span_abs(m_x[a] - m_x[b]) <= m_half[a][0] + m_half[b][0] && span_abs(m_y[a] - m_y[b]) <= m_half[a][1] + m_half[b][1] && span_abs(m_z[a] - m_z[b]) <= m_half[a][2] + m_half[b][2];
+    }
+};
+
+// Counts how often every pair is handed out, a pair is only counted when it overlaps
+class my_span_collide_handler_t final : public nhshg::collide_func_t
+{
+public:
+    void collide(const nhshg::entity_t* e1, nhshg::index_t e1_ref, const nhshg::entity_t* e2, nhshg::index_t e2_ref) override final
+    {
+        if (e1_ref > e2_ref)
+        {
+            const nhshg::index_t t = e1_ref;
+            e1_ref                 = e2_ref;
+            e2_ref                 = t;
+        }
+        ++m_seen[e1_ref][e2_ref];
+        if (m_shapes->overlap(e1_ref, e2_ref))
+            ++collide_count;
+    }
+
+    const span_shapes_t* m_shapes      = nullptr;
+    s32                  m_seen[c_span_test_max][c_span_test_max] = {};
+    s32                  collide_count = 0;
+};
+
+class my_span_query_handler_t final : public nhshg::query_func_t
+{
+public:
+    void query(nhshg::entity_t const* e, nhshg::index_t e_ref) override final { ++m_seen[e_ref]; }
+
+    s32 m_seen[c_span_test_max] = {};
+};
+
+// Moves the entity with ref 'm_ref' to the shape, and resizes it when it is a span
+class my_span_move_handler_t final : public nhshg::update_func_t
+{
+public:
+    void update(nhshg::index_t begin, nhshg::index_t end, nhshg::entity_t* e, nhshg::index_t const* ref, nhshg::hshg_t* hshg) override final
+    {
+        for (nhshg::index_t i = begin; i < end; ++i)
+        {
+            if (ref[i] != m_ref)
+                continue;
+            if (m_remove)
+            {
+                nhshg::hshg_remove(hshg, i);
+                continue;
+            }
+            e[i].x = m_shapes->m_x[m_ref];
+            e[i].y = m_shapes->m_y[m_ref];
+            e[i].z = m_shapes->m_z[m_ref];
+            nhshg::hshg_move(hshg, i);
+            if (nhshg::hshg_is_span(hshg, i))
+                nhshg::hshg_resize_span(hshg, i, m_shapes->m_half[m_ref][0], m_shapes->m_half[m_ref][1], m_shapes->m_half[m_ref][2]);
+        }
+    }
+
+    const span_shapes_t* m_shapes = nullptr;
+    nhshg::index_t       m_ref    = 0;
+    bool                 m_remove = false;
+};
+
+// Forwards to another allocator, failing once 'm_allowed' allocations were made
+class my_span_limited_alloc_t final : public alloc_t
+{
+public:
+    alloc_t* m_allocator = nullptr;
+    s32      m_allowed   = 0x7FFFFFFF;
+
+    void* v_allocate(u32 size, u32 align) override final
+    {
+        if (m_allowed <= 0)
+            return nullptr;
+        --m_allowed;
+        return m_allocator->allocate(size, align);
+    }
+    void v_deallocate(void* p) override final { m_allocator->deallocate(p); }
+};
+
+static u32 s_span_seed = 1;
+static f32 rnd(f32 lo, f32 hi)
+{
+    s_span_seed = s_span_seed * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (f32)(s_span_seed >> 8) / (f32)(1 << 24);
+}
+
+UNITTEST_SUITE_BEGIN(test_hshg_span)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static void set_shape(span_shapes_t & shapes, s32 ref, f32 x, f32 y, f32 z, f32 hx, f32 hy, f32 hz)
+        {
+            shapes.m_x[ref]       = x;
+            shapes.m_y[ref]       = y;
+            shapes.m_z[ref]       = z;
+            shapes.m_half[ref][0] = hx;
+            shapes.m_half[ref][1] = hy;
+            shapes.m_half[ref][2] = hz;
+            shapes.m_alive[ref]   = true;
+        }
+
+        static void insert(nhshg::hshg_t * hshg, span_shapes_t & shapes, s32 ref, f32 x, f32 y, f32 z, f32 hx, f32 hy, f32 hz, bool span)
+        {
+            set_shape(shapes, ref, x, y, z, hx, hy, hz);
+            if (span)
+                nhshg::hshg_insert_span(hshg, x, y, z, hx, hy, hz, ref);
+            else
+                nhshg::hshg_insert(hshg, x, y, z, hx, ref);
+        }
+
+        // Every overlapping pair must be handed out exactly once, and so must every
+        // overlapping entity by a query.
+        static bool check(nhshg::hshg_t * hshg, const span_shapes_t& shapes)
+        {
+            my_span_collide_handler_t collide;
+            collide.m_shapes = &shapes;
+            nhshg::hshg_collide(hshg, &collide);
+
+            for (s32 a = 0; a < c_span_test_max; ++a)
+            {
+                for (s32 b = a + 1; b < c_span_test_max; ++b)
+                {
+                    const bool expected = shapes.m_alive[a] && shapes.m_alive[b] && shapes.overlap(a, b);
+                    if (collide.m_seen[a][b] > 1 || (expected && collide.m_seen[a][b] != 1))
+                        return false;
+                }
+            }
+
+            for (s32 q = 0; q < 8; ++q)
+            {
+                const f32 x1 = rnd(0.0f, 200.0f), y1 = rnd(0.0f, 200.0f), z1 = rnd(0.0f, 40.0f);
+                const f32 x2 = x1 + rnd(0.0f, 60.0f), y2 = y1 + rnd(0.0f, 60.0f), z2 = z1 + rnd(0.0f, 20.0f);
+
+                my_span_query_handler_t query;
+                nhshg::hshg_query(hshg, x1, y1, z1, x2, y2, z2, &query);
+                for (s32 i = 0; i < c_span_test_max; ++i)
+                {
+                    const bool expected = shapes.m_alive[i] && shapes.m_x[i] + shapes.m_half[i][0] >= x1 && shapes.m_x[i] - shapes.m_half[i][0] <= x2 && shapes.m_y[i] + shapes.m_half[i][1] >= y1 && shapes.m_y[i] - shapes.m_half[i][1] <= y2 &&
+                                          shapes.m_z[i] + shapes.m_half[i][2] >= z1 && shapes.m_z[i] - shapes.m_half[i][2] <= z2;
+                    if (query.m_seen[i] != (expected ? 1 : 0))
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        static bool in_list(nhshg::hshg_neighbor_lists_t * lists, nhshg::index_t entity, nhshg::index_t neighbor)
+        {
+            nhshg::index_t              len;
+            nhshg::index_t const* const list = nhshg::hshg_neighbor_list(lists, entity, len);
+            for (nhshg::index_t i = 0; i < len; ++i)
+            {
+                if (list[i] == neighbor)
+                    return true;
+            }
+            return false;
+        }
+
+        UNITTEST_TEST(wall)
+        {
+            nhshg::hshg_t* hshg   = nhshg::hshg_create(Allocator, 32, 8, c_span_test_max);
+            span_shapes_t  shapes = {};
+
+            // a long wall along x with small entities along it and a few just beside it
+            insert(hshg, shapes, 0, 64.0f, 4.0f, 4.0f, 60.0f, 1.0f, 1.0f, true);
+            for (s32 i = 0; i < 6; ++i)
+            {
+                insert(hshg, shapes, 1 + i, 10.0f + 20.0f * i, 4.0f, 4.0f, 1.0f, 1.0f, 1.0f, false);
+                insert(hshg, shapes, 7 + i, 10.0f + 20.0f * i, 8.0f, 4.0f, 1.0f, 1.0f, 1.0f, false);
+            }
+            CHECK_TRUE(nhshg::hshg_is_span(hshg, 0));
+            CHECK_FALSE(nhshg::hshg_is_span(hshg, 1));
+
+            my_span_collide_handler_t collide;
+            collide.m_shapes = &shapes;
+            nhshg::hshg_collide(hshg, &collide);
+            CHECK_EQUAL(6, collide.collide_count);
+
+            // the wall never meets the entities beside it, as a hypercube it would meet all
+            for (s32 i = 7; i < 13; ++i)
+                CHECK_EQUAL(0, collide.m_seen[0][i]);
+
+            // a second wall across the first one, the pair is found once
+            insert(hshg, shapes, 13, 64.0f, 40.0f, 4.0f, 1.0f, 40.0f, 1.0f, true);
+            CHECK_TRUE(check(hshg, shapes));
+
+            my_span_query_handler_t query;
+            nhshg::hshg_query(hshg, 50.0f, 0.0f, 0.0f, 80.0f, 5.0f, 8.0f, &query);
+            CHECK_EQUAL(1, query.m_seen[0]);
+            CHECK_EQUAL(1, query.m_seen[13]);
+            CHECK_EQUAL(1, query.m_seen[3]);
+            CHECK_EQUAL(1, query.m_seen[4]);
+            CHECK_EQUAL(0, query.m_seen[9]);
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(move_resize_remove)
+        {
+            nhshg::hshg_t* hshg   = nhshg::hshg_create(Allocator, 32, 8, c_span_test_max);
+            span_shapes_t  shapes = {};
+
+            insert(hshg, shapes, 0, 64.0f, 4.0f, 4.0f, 60.0f, 1.0f, 1.0f, true);
+            insert(hshg, shapes, 1, 64.0f, 40.0f, 4.0f, 1.0f, 40.0f, 1.0f, true);
+            for (s32 i = 0; i < 6; ++i)
+                insert(hshg, shapes, 2 + i, 10.0f + 20.0f * i, 4.0f, 4.0f, 1.0f, 1.0f, 1.0f, false);
+            CHECK_TRUE(check(hshg, shapes));
+
+            my_span_move_handler_t move;
+            move.m_shapes = &shapes;
+
+            // move the wall away from the small entities, then grow it back over them
+            set_shape(shapes, 0, 64.0f, 34.0f, 4.0f, 60.0f, 1.0f, 1.0f);
+            move.m_ref = 0;
+            nhshg::hshg_update(hshg, &move);
+            CHECK_TRUE(check(hshg, shapes));
+
+            set_shape(shapes, 0, 64.0f, 34.0f, 4.0f, 60.0f, 30.0f, 1.0f);
+            nhshg::hshg_update(hshg, &move);
+            CHECK_TRUE(check(hshg, shapes));
+
+            // removing the first entity swaps the last one into its place
+            move.m_remove = true;
+            shapes.m_alive[0] = false;
+            nhshg::hshg_update(hshg, &move);
+            CHECK_TRUE(check(hshg, shapes));
+
+            insert(hshg, shapes, 8, 100.0f, 60.0f, 4.0f, 1.0f, 50.0f, 2.0f, true);
+            nhshg::hshg_optimize(hshg);
+            CHECK_TRUE(check(hshg, shapes));
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(random)
+        {
+            nhshg::hshg_t* hshg   = nhshg::hshg_create(Allocator, 32, 8, c_span_test_max);
+            span_shapes_t  shapes = {};
+            s_span_seed           = 7;
+
+            for (s32 i = 0; i < c_span_test_max; ++i)
+            {
+                const f32 x = rnd(0.0f, 200.0f), y = rnd(0.0f, 200.0f), z = rnd(0.0f, 40.0f);
+                if ((i % 4) == 0)
+                {
+                    const bool along_x = (i % 8) == 0;
+                    insert(hshg, shapes, i, x, y, z, along_x ? rnd(8.0f, 60.0f) : rnd(0.5f, 3.0f), along_x ? rnd(0.5f, 3.0f) : rnd(8.0f, 60.0f), rnd(0.5f, 3.0f), true);
+                }
+                else
+                {
+                    const f32 r = rnd(0.5f, 6.0f);
+                    insert(hshg, shapes, i, x, y, z, r, r, r, false);
+                }
+            }
+            CHECK_TRUE(check(hshg, shapes));
+
+            my_span_move_handler_t move;
+            move.m_shapes = &shapes;
+            for (s32 step = 0; step < 32; ++step)
+            {
+                move.m_ref = (nhshg::index_t)(step * 5) % c_span_test_max;
+                const s32 ref = (s32)move.m_ref;
+                f32       h[3];
+                for (s32 a = 0; a < 3; ++a)
+                    h[a] = shapes.m_half[ref][a];
+                if ((ref % 4) == 0)
+                {
+                    h[0] = span_max(0.5f, h[0] + rnd(-4.0f, 4.0f));
+                    h[1] = span_max(0.5f, h[1] + rnd(-4.0f, 4.0f));
+                }
+                set_shape(shapes, ref, rnd(0.0f, 200.0f), rnd(0.0f, 200.0f), rnd(0.0f, 40.0f), h[0], h[1], h[2]);
+                nhshg::hshg_update(hshg, &move);
+                CHECK_TRUE(check(hshg, shapes));
+            }
+
+            // testing every pair hands out the same
+            nhshg::hshg_set_brute_force_threshold(hshg, c_span_test_max);
+            CHECK_TRUE(check(hshg, shapes));
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(save_load)
+        {
+            nhshg::hshg_t* hshg   = nhshg::hshg_create(Allocator, 32, 8, c_span_test_max);
+            span_shapes_t  shapes = {};
+
+            insert(hshg, shapes, 0, 64.0f, 4.0f, 4.0f, 60.0f, 1.0f, 1.0f, true);
+            insert(hshg, shapes, 1, 64.0f, 40.0f, 4.0f, 1.0f, 40.0f, 1.0f, true);
+            for (s32 i = 0; i < 6; ++i)
+                insert(hshg, shapes, 2 + i, 10.0f + 20.0f * i, 4.0f, 4.0f, 1.0f, 1.0f, 1.0f, false);
+
+            const int_t size  = nhshg::hshg_save(hshg, nullptr, 0);
+            void*       image = Allocator->allocate((u32)size, 64);
+            CHECK_EQUAL(size, nhshg::hshg_save(hshg, image, size));
+            nhshg::hshg_free(hshg);
+
+            nhshg::hshg_t* loaded = nhshg::hshg_load(Allocator, image, size);
+            CHECK_NOT_NULL(loaded);
+            CHECK_TRUE(nhshg::hshg_is_span(loaded, 0));
+            CHECK_TRUE(check(loaded, shapes));
+            nhshg::hshg_free(loaded);
+
+            nhshg::hshg_t* mapped = nhshg::hshg_map(Allocator, image, size);
+            CHECK_NOT_NULL(mapped);
+            CHECK_TRUE(check(mapped, shapes));
+            nhshg::hshg_free(mapped);
+
+            Allocator->deallocate(image);
+        }
+
+        UNITTEST_TEST(retune)
+        {
+            my_span_limited_alloc_t limited;
+            limited.m_allocator = Allocator;
+
+            nhshg::hshg_t* hshg   = nhshg::hshg_create(&limited, 32, 8, c_span_test_max);
+            span_shapes_t  shapes = {};
+
+            insert(hshg, shapes, 0, 64.0f, 4.0f, 4.0f, 60.0f, 1.0f, 1.0f, true);
+            insert(hshg, shapes, 1, 64.0f, 40.0f, 4.0f, 1.0f, 40.0f, 1.0f, true);
+            for (s32 i = 0; i < 6; ++i)
+                insert(hshg, shapes, 2 + i, 10.0f + 20.0f * i, 4.0f, 4.0f, 1.0f, 1.0f, 1.0f, false);
+            CHECK_TRUE(check(hshg, shapes));
+
+            // smaller cells need more span nodes, without them the HSHG stays as it was
+            limited.m_allowed = 2;
+            CHECK_FALSE(nhshg::hshg_retune(hshg, 32, 2));
+            limited.m_allowed = 0x7FFFFFFF;
+            CHECK_TRUE(nhshg::hshg_is_span(hshg, 0));
+            CHECK_TRUE(check(hshg, shapes));
+
+            CHECK_TRUE(nhshg::hshg_retune(hshg, 32, 2));
+            CHECK_TRUE(nhshg::hshg_is_span(hshg, 0));
+            CHECK_TRUE(check(hshg, shapes));
+
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(node_limit)
+        {
+            nhshg::hshg_t* hshg   = nhshg::hshg_create(Allocator, 32, 1, 16);
+            span_shapes_t  shapes = {};
+
+            // every span covers all 32768 cells, with HSHG_INDEX_16 the second one does not fit
+            const bool fits = (u64)2 * 32 * 32 * 32 <= (u64)nhshg::c_invalid_index;
+            insert(hshg, shapes, 0, 16.0f, 16.0f, 16.0f, 15.9f, 15.9f, 15.9f, true);
+            CHECK_TRUE(nhshg::hshg_is_span(hshg, 0));
+
+            const nhshg::index_t second = nhshg::hshg_insert_span(hshg, 16.0f, 16.0f, 16.0f, 15.9f, 15.9f, 15.9f, 1);
+            CHECK_EQUAL(fits, second != nhshg::c_invalid_index);
+            if (fits)
+                set_shape(shapes, 1, 16.0f, 16.0f, 16.0f, 15.9f, 15.9f, 15.9f);
+
+            my_span_query_handler_t query;
+            nhshg::hshg_query(hshg, 0.0f, 0.0f, 0.0f, 32.0f, 32.0f, 32.0f, &query);
+            CHECK_EQUAL(1, query.m_seen[0]);
+            CHECK_EQUAL(fits ? 1 : 0, query.m_seen[1]);
+
+            // the nodes of a removed span are taken again
+            my_span_move_handler_t move;
+            move.m_shapes = &shapes;
+            move.m_ref    = 0;
+            move.m_remove = true;
+            nhshg::hshg_update(hshg, &move);
+            CHECK_NOT_EQUAL(nhshg::c_invalid_index, nhshg::hshg_insert_span(hshg, 16.0f, 16.0f, 16.0f, 15.9f, 15.9f, 15.9f, 2));
+            nhshg::hshg_free(hshg);
+
+            // 262144 cells, a count that an index_t of 16 bits would wrap to 0
+            if (nhshg::c_max_side >= 64)
+            {
+                hshg = nhshg::hshg_create(Allocator, 64, 1, 16);
+                const nhshg::index_t idx = nhshg::hshg_insert_span(hshg, 32.0f, 32.0f, 32.0f, 31.5f, 31.5f, 31.5f, 0);
+                CHECK_EQUAL((u64)64 * 64 * 64 <= (u64)nhshg::c_invalid_index, idx != nhshg::c_invalid_index);
+                nhshg::hshg_free(hshg);
+            }
+        }
+
+        UNITTEST_TEST(collide_with)
+        {
+            // refs below 32 go into A, the others into B
+            nhshg::hshg_t* hshg_a = nhshg::hshg_create(Allocator, 32, 8, c_span_test_max);
+            nhshg::hshg_t* hshg_b = nhshg::hshg_create(Allocator, 32, 8, c_span_test_max);
+            span_shapes_t  shapes = {};
+            s_span_seed           = 11;
+
+            insert(hshg_a, shapes, 0, 64.0f, 4.0f, 4.0f, 60.0f, 1.0f, 1.0f, true);
+            insert(hshg_b, shapes, 32, 64.0f, 40.0f, 4.0f, 1.0f, 40.0f, 1.0f, true);
+            for (s32 i = 1; i < c_span_test_max; ++i)
+            {
+                if (i == 32)
+                    continue;
+                nhshg::hshg_t* const hshg = i < 32 ? hshg_a : hshg_b;
+                const f32            x = rnd(0.0f, 200.0f), y = rnd(0.0f, 200.0f), z = rnd(0.0f, 40.0f);
+                if ((i % 4) == 0)
+                {
+                    const bool along_x = (i % 8) == 0;
+                    insert(hshg, shapes, i, x, y, z, along_x ? rnd(8.0f, 60.0f) : rnd(0.5f, 3.0f), along_x ? rnd(0.5f, 3.0f) : rnd(8.0f, 60.0f), rnd(0.5f, 3.0f), true);
+                }
+                else
+                {
+                    const f32 r = rnd(0.5f, (i % 16) == 1 ? 80.0f : 6.0f);
+                    insert(hshg, shapes, i, x, y, z, r, r, r, false);
+                }
+            }
+
+            my_span_collide_handler_t collide;
+            collide.m_shapes = &shapes;
+            nhshg::hshg_collide_with(hshg_a, hshg_b, &collide);
+
+            s32 expected = 0;
+            for (s32 a = 0; a < c_span_test_max; ++a)
+            {
+                for (s32 b = a + 1; b < c_span_test_max; ++b)
+                {
+                    // pairs within A or within B are never handed out
+                    if ((a < 32) == (b < 32))
+                    {
+                        CHECK_EQUAL(0, collide.m_seen[a][b]);
+                        continue;
+                    }
+                    CHECK_TRUE(collide.m_seen[a][b] <= 1);
+                    if (shapes.overlap(a, b))
+                    {
+                        ++expected;
+                        CHECK_EQUAL(1, collide.m_seen[a][b]);
+                    }
+                }
+            }
+            CHECK_TRUE(expected > 0);
+            CHECK_EQUAL(1, collide.m_seen[0][32]);
+            CHECK_EQUAL(expected, collide.collide_count);
+
+            nhshg::hshg_free(hshg_b);
+            nhshg::hshg_free(hshg_a);
+        }
+
+        UNITTEST_TEST(neighbor_lists)
+        {
+            nhshg::hshg_t* hshg   = nhshg::hshg_create(Allocator, 32, 8, c_span_test_max);
+            span_shapes_t  shapes = {};
+            s_span_seed           = 13;
+
+            // no entity is removed, so the entity indices are the refs
+            insert(hshg, shapes, 0, 64.0f, 4.0f, 4.0f, 60.0f, 1.0f, 1.0f, true);
+            for (s32 i = 1; i < c_span_test_max; ++i)
+            {
+                const f32 x = rnd(0.0f, 200.0f), y = rnd(0.0f, 200.0f), z = rnd(0.0f, 40.0f);
+                if ((i % 4) == 0)
+                {
+                    insert(hshg, shapes, i, x, y, z, rnd(0.5f, 3.0f), rnd(8.0f, 60.0f), rnd(0.5f, 3.0f), true);
+                }
+                else
+                {
+                    const f32 r = rnd(0.5f, 6.0f);
+                    insert(hshg, shapes, i, x, y, z, r, r, r, false);
+                }
+            }
+
+            const f32                     skin  = 2.0f;
+            nhshg::hshg_neighbor_lists_t* lists = nhshg::hshg_neighbor_lists_create(Allocator);
+            CHECK_TRUE(nhshg::hshg_build_neighbor_lists(hshg, skin, lists));
+
+            s32 expected = 0;
+            for (s32 a = 0; a < c_span_test_max; ++a)
+            {
+                for (s32 b = a + 1; b < c_span_test_max; ++b)
+                {
+                    const bool near = span_abs(shapes.m_x[a] - shapes.m_x[b]) <= shapes.m_half[a][0] + shapes.m_half[b][0] + skin &&
+                                      span_abs(shapes.m_y[a] - shapes.m_y[b]) <= shapes.m_half[a][1] + shapes.m_half[b][1] + skin &&
+                                      span_abs(shapes.m_z[a] - shapes.m_z[b]) <= shapes.m_half[a][2] + shapes.m_half[b][2] + skin;
+                    CHECK_EQUAL(near, in_list(lists, (nhshg::index_t)a, (nhshg::index_t)b));
+                    CHECK_EQUAL(near, in_list(lists, (nhshg::index_t)b, (nhshg::index_t)a));
+                    if (near)
+                        expected += 2;
+                }
+            }
+            CHECK_TRUE(expected > 0);
+            CHECK_EQUAL(expected, (s32)nhshg::hshg_neighbor_lists_len(lists));
+            CHECK_FALSE(nhshg::hshg_neighbor_lists_expired(hshg, lists));
+
+            // growing the wall across, which leaves its largest half extent as it was
+            my_span_move_handler_t move;
+            move.m_shapes = &shapes;
+            set_shape(shapes, 0, 64.0f, 4.0f, 4.0f, 60.0f, 1.0f + skin, 1.0f);
+            nhshg::hshg_update(hshg, &move);
+            CHECK_TRUE(nhshg::hshg_neighbor_lists_expired(hshg, lists));
+
+            nhshg::hshg_neighbor_lists_free(lists);
+            nhshg::hshg_free(hshg);
+        }
+    }
+}
+UNITTEST_SUITE_END
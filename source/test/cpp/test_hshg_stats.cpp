@@ -0,0 +1,97 @@
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_pair_cache.h"
+#include "chshg/c_hshg_stats.h"
+#include "chshg/test_allocator.h"
+#include "chshg/test_handlers.h"
+
+#include "cunittest/cunittest.h"
+
+using namespace ncore;
+
+class my_stats_move_handler_t final : public nhshg::update_func_t
+{
+public:
+    void update(nhshg::index_t begin, nhshg::index_t end, nhshg::entity_t* e, nhshg::index_t const* ref, nhshg::hshg_t* hshg) override final
+    {
+        for (nhshg::index_t i = begin; i < end; ++i)
+        {
+            e[i].x += 100.0f;
+            nhshg::hshg_move(hshg, i);
+        }
+    }
+};
+
+UNITTEST_SUITE_BEGIN(test_hshg_stats)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        UNITTEST_TEST(counters)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 32, 16, 32);
+
+            // three small entities in one cell, one big one in a coarser grid
+            nhshg::hshg_insert(hshg, 1.0f, 1.0f, 1.0f, 1.0f, 0);
+            nhshg::hshg_insert(hshg, 2.0f, 1.0f, 1.0f, 1.0f, 1);
+            nhshg::hshg_insert(hshg, 3.0f, 1.0f, 1.0f, 1.0f, 2);
+            nhshg::hshg_insert(hshg, 3.0f, 1.0f, 1.0f, 30.0f, 3);
+
+            test_collide_handler_t collide;
+            nhshg::hshg_collide(hshg, &collide);
+
+            nhshg::hshg_stats_t stats;
+            if (!nhshg::hshg_get_stats(hshg, stats))
+            {
+                // compiled without HSHG_STATS
+                CHECK_EQUAL(0, (s32)stats.m_collide_calls);
+                nhshg::hshg_free(hshg);
+                return;
+            }
+
+            CHECK_EQUAL(1, (s32)stats.m_collide_calls);
+            CHECK_EQUAL(collide.pair_count, (s32)stats.m_pairs_emitted);
+            CHECK_TRUE(stats.m_cells_visited > 0);
+            CHECK_TRUE(stats.m_nodes_walked >= stats.m_pairs_emitted);
+            CHECK_EQUAL(2, (s32)stats.m_active_grids);
+            CHECK_EQUAL(3, (s32)stats.m_grid_entities[0]);
+            CHECK_EQUAL(1, (s32)stats.m_grid_occupied_cells[0]);
+            CHECK_EQUAL(3, (s32)stats.m_grid_max_list[0]);
+            CHECK_EQUAL(1, (s32)stats.m_grid_list_histogram[0][1]);
+
+            my_stats_move_handler_t move;
+            nhshg::hshg_update(hshg, &move);
+            nhshg::hshg_get_stats(hshg, stats);
+            CHECK_EQUAL(4, (s32)stats.m_relinks);
+
+            nhshg::hshg_reset_stats(hshg);
+            nhshg::hshg_get_stats(hshg, stats);
+            CHECK_EQUAL(0, (s32)stats.m_collide_calls);
+            CHECK_EQUAL(0, (s32)stats.m_relinks);
+            CHECK_EQUAL(2, (s32)stats.m_active_grids);
+
+            // the cached collide walks the same cells
+            nhshg::hshg_pair_cache_t* cache = nhshg::hshg_pair_cache_create(Allocator, hshg, 64);
+            test_contact_handler_t    contact;
+            nhshg::hshg_collide_cached(hshg, cache, &contact);
+            nhshg::hshg_get_stats(hshg, stats);
+            CHECK_EQUAL(1, (s32)stats.m_collide_calls);
+            CHECK_TRUE(stats.m_cells_visited > 0);
+            CHECK_TRUE(stats.m_nodes_walked > 0);
+            nhshg::hshg_pair_cache_free(cache);
+
+            // and testing every pair counts them as walked
+            nhshg::hshg_reset_stats(hshg);
+            nhshg::hshg_set_brute_force_threshold(hshg, 32);
+            nhshg::hshg_collide(hshg, &collide);
+            nhshg::hshg_get_stats(hshg, stats);
+            CHECK_EQUAL(6, (s32)stats.m_nodes_walked);
+
+            nhshg::hshg_free(hshg);
+        }
+    }
+}
+UNITTEST_SUITE_END
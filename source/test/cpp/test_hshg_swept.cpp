@@ -0,0 +1,79 @@
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_swept.h"
+#include "chshg/test_allocator.h"
+
+#include "cunittest/cunittest.h"
+
+using namespace ncore;
+
+class my_swept_handler_t final : public nhshg::swept_func_t
+{
+public:
+    void swept(nhshg::entity_t const* e1, nhshg::index_t e1_ref, nhshg::entity_t const* e2, nhshg::index_t e2_ref, f32 toi) override final
+    {
+        if (count < 8)
+        {
+            refs[count] = e2_ref;
+            tois[count] = toi;
+        }
+        ++count;
+    }
+
+    s32            count = 0;
+    nhshg::index_t refs[8];
+    f32            tois[8];
+};
+
+UNITTEST_SUITE_BEGIN(test_hshg_swept)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        UNITTEST_TEST(tunnelling)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 32, 4, 64);
+            CHECK_TRUE(nhshg::hshg_enable_velocities(hshg));
+
+            // a small projectile that crosses three walls within one tick, and misses a fourth
+            nhshg::hshg_insert(hshg, 0.0f, 0.0f, 0.0f, 0.5f, 100);
+            nhshg::hshg_insert(hshg, 60.0f, 0.0f, 0.0f, 1.0f, 3);
+            nhshg::hshg_insert(hshg, 20.0f, 0.0f, 0.0f, 1.0f, 1);
+            nhshg::hshg_insert(hshg, 40.0f, 0.0f, 0.0f, 1.0f, 2);
+            nhshg::hshg_insert(hshg, 40.0f, 10.0f, 0.0f, 1.0f, 4);
+            nhshg::hshg_set_velocity(hshg, 0, 80.0f, 0.0f, 0.0f);
+
+            my_swept_handler_t handler;
+            nhshg::hshg_collide_swept(hshg, 1.0f, &handler);
+            CHECK_EQUAL(3, handler.count);
+            CHECK_EQUAL(1, handler.refs[0]);
+            CHECK_EQUAL(2, handler.refs[1]);
+            CHECK_EQUAL(3, handler.refs[2]);
+            CHECK_CLOSE(18.5f / 80.0f, handler.tois[0], 0.0001f);
+            CHECK_CLOSE(58.5f / 80.0f, handler.tois[2], 0.0001f);
+
+            // a quarter of the time step only reaches the first wall
+            my_swept_handler_t half;
+            nhshg::hshg_collide_swept(hshg, 0.25f, &half);
+            CHECK_EQUAL(1, half.count);
+
+            // a second projectile flying head-on into the first one, after crossing the first wall
+            nhshg::hshg_insert(hshg, 30.0f, 0.0f, 0.0f, 0.5f, 101);
+            nhshg::hshg_set_velocity(hshg, 5, -40.0f, 0.0f, 0.0f);
+            my_swept_handler_t both;
+            nhshg::hshg_collide_swept(hshg, 1.0f, &both);
+            CHECK_EQUAL(5, both.count);
+            CHECK_EQUAL(1, both.refs[0]);
+            CHECK_CLOSE(8.5f / 40.0f, both.tois[0], 0.0001f);
+            CHECK_EQUAL(1, both.refs[1]);
+            CHECK_EQUAL(101, both.refs[2]);
+            CHECK_CLOSE(29.0f / 120.0f, both.tois[2], 0.0001f);
+
+            nhshg::hshg_free(hshg);
+        }
+    }
+}
+UNITTEST_SUITE_END
@@ -0,0 +1,90 @@
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_trace.h"
+#include "chshg/test_allocator.h"
+
+#include "cunittest/cunittest.h"
+
+using namespace ncore;
+
+// Every reading advances the clock by 1.5 microseconds
+class my_fake_clock_t final : public nhshg::clock_func_t
+{
+public:
+    u64 now_ns() override final { return m_now += 1500; }
+
+    u64 m_now = 0;
+};
+
+class my_trace_update_handler_t final : public nhshg::update_func_t
+{
+public:
+    void update(nhshg::index_t begin, nhshg::index_t end, nhshg::entity_t* e, nhshg::index_t const* ref, nhshg::hshg_t* hshg) override final {}
+};
+
+class my_trace_collide_handler_t final : public nhshg::collide_func_t
+{
+public:
+    void collide(const nhshg::entity_t* e1, nhshg::index_t e1_ref, const nhshg::entity_t* e2, nhshg::index_t e2_ref) override final {}
+};
+
+UNITTEST_SUITE_BEGIN(test_hshg_trace)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        UNITTEST_TEST(ring_buffer_and_export)
+        {
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 32, 16, 32);
+
+            my_fake_clock_t      clock;
+            nhshg::hshg_trace_t* trace = nhshg::hshg_trace_create(Allocator, hshg, 4, &clock);
+            if (trace == nullptr)
+            {
+                // compiled without HSHG_TRACE
+                nhshg::hshg_free(hshg);
+                return;
+            }
+
+            nhshg::hshg_insert(hshg, 1.0f, 1.0f, 1.0f, 1.0f, 0);
+
+            my_trace_update_handler_t update;
+            nhshg::hshg_update(hshg, &update);
+            CHECK_EQUAL(2, nhshg::hshg_trace_len(trace));  // update, compact
+
+            my_trace_collide_handler_t collide;
+            nhshg::hshg_collide(hshg, &collide);
+            CHECK_EQUAL(4, nhshg::hshg_trace_len(trace));  // + update_cache, collide
+
+            // the ring buffer only keeps the last 4 events
+            nhshg::hshg_collide(hshg, &collide);
+            CHECK_EQUAL(4, nhshg::hshg_trace_len(trace));
+
+            const u32 len = nhshg::hshg_trace_export(trace, nullptr, 0);
+            char      json[1024];
+            CHECK_TRUE(len < sizeof(json));
+            CHECK_EQUAL(len, nhshg::hshg_trace_export(trace, json, sizeof(json)));
+
+            // oldest first: update_cache is gone, compact is still there
+            const char* expected_start = "{\"traceEvents\":[\n{\"name\":\"compact\",\"cat\":\"hshg\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":4.500,\"dur\":1.500}";
+            for (s32 i = 0; expected_start[i] != '\0'; ++i)
+            {
+                CHECK_EQUAL(expected_start[i], json[i]);
+                if (expected_start[i] != json[i])
+                    break;
+            }
+
+            // a small buffer is truncated but still zero terminated
+            char small[8];
+            CHECK_EQUAL(len, nhshg::hshg_trace_export(trace, small, sizeof(small)));
+            CHECK_EQUAL('\0', small[7]);
+
+            nhshg::hshg_trace_free(trace);
+            nhshg::hshg_free(hshg);
+        }
+    }
+}
+UNITTEST_SUITE_END
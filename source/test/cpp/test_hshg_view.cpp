@@ -0,0 +1,146 @@
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_view.h"
+#include "chshg/test_allocator.h"
+#include "chshg/test_handlers.h"
+
+#include "cunittest/cunittest.h"
+
+using namespace ncore;
+
+class my_raycast_handler_t final : public nhshg::raycast_func_t
+{
+public:
+    f32 hit(nhshg::entity_t const* e, nhshg::index_t e_ref, f32 t) override final
+    {
+        ++hit_count;
+        if (t < closest_t)
+        {
+            closest_t   = t;
+            closest_ref = e_ref;
+        }
+        return closest_only ? t : max_t;
+    }
+
+    void reset(bool _closest_only, f32 _max_t)
+    {
+        closest_only = _closest_only;
+        max_t        = _max_t;
+        hit_count    = 0;
+        closest_t    = _max_t;
+        closest_ref  = nhshg::c_invalid_index;
+    }
+
+    bool           closest_only = false;
+    f32            max_t        = 0.0f;
+    s32            hit_count    = 0;
+    f32            closest_t    = 0.0f;
+    nhshg::index_t closest_ref  = nhshg::c_invalid_index;
+};
+
+class my_collide_with_view_handler_t final : public nhshg::collide_func_t
+{
+public:
+    nhshg::hshg_view_t const* m_view;
+
+    void collide(const nhshg::entity_t* e1, nhshg::index_t e1_ref, const nhshg::entity_t* e2, nhshg::index_t e2_ref) override final
+    {
+        test_query_handler_t query_handler;
+        nhshg::hshg_view_query(*m_view, e1->x - 1.0f, e1->y - 1.0f, e1->z - 1.0f, e1->x + 1.0f, e1->y + 1.0f, e1->z + 1.0f, &query_handler);
+        query_count += query_handler.query_count;
+    }
+
+    s32 query_count = 0;
+};
+
+UNITTEST_SUITE_BEGIN(test_hshg_view)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static nhshg::hshg_t* create_line(s32 count)
+        {
+            // entities on the x axis at 0, 10, 20, ... with radius 1 and ref = index
+            nhshg::hshg_t* hshg = nhshg::hshg_create(Allocator, 32, 16, 64);
+            for (s32 i = 0; i < count; ++i)
+                nhshg::hshg_insert(hshg, 10.0f * i, 0.0f, 0.0f, 1.0f, i);
+            return hshg;
+        }
+
+        UNITTEST_TEST(query)
+        {
+            nhshg::hshg_t*     hshg = create_line(8);
+            nhshg::hshg_view_t view = nhshg::hshg_view_acquire(hshg);
+
+            test_query_handler_t handler;
+            nhshg::hshg_view_query(view, 5.0f, -1.0f, -1.0f, 31.0f, 1.0f, 1.0f, &handler);
+            CHECK_EQUAL(3, handler.query_count);
+
+            // collide is allowed while the view is acquired
+            my_collide_with_view_handler_t collide_handler;
+            collide_handler.m_view = &view;
+            nhshg::hshg_collide(hshg, &collide_handler);
+
+            nhshg::hshg_view_release(hshg, view);
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(knn)
+        {
+            nhshg::hshg_t*     hshg = create_line(8);
+            nhshg::hshg_view_t view = nhshg::hshg_view_acquire(hshg);
+
+            nhshg::knn_result_t results[4];
+            CHECK_EQUAL(3, nhshg::hshg_view_knn(view, 42.0f, 0.0f, 0.0f, 1000.0f, results, 3));
+            CHECK_EQUAL(4, results[0].m_ref);
+            CHECK_EQUAL(5, results[1].m_ref);
+            CHECK_EQUAL(3, results[2].m_ref);
+            CHECK_CLOSE(1.0f, results[0].m_dist_sq, 0.0001f);
+            CHECK_CLOSE(49.0f, results[1].m_dist_sq, 0.0001f);
+            CHECK_CLOSE(121.0f, results[2].m_dist_sq, 0.0001f);
+
+            // limited by the maximum distance
+            CHECK_EQUAL(2, nhshg::hshg_view_knn(view, 42.0f, 0.0f, 0.0f, 10.0f, results, 4));
+
+            // far away from everything
+            CHECK_EQUAL(4, nhshg::hshg_view_knn(view, 5000.0f, 0.0f, 0.0f, 100000.0f, results, 4));
+            CHECK_EQUAL(7, results[0].m_ref);
+
+            nhshg::hshg_view_release(hshg, view);
+            nhshg::hshg_free(hshg);
+        }
+
+        UNITTEST_TEST(raycast)
+        {
+            nhshg::hshg_t*     hshg = create_line(8);
+            nhshg::hshg_view_t view = nhshg::hshg_view_acquire(hshg);
+
+            my_raycast_handler_t handler;
+
+            // all hits along the x axis
+            handler.reset(false, 1000.0f);
+            nhshg::hshg_view_raycast(view, -5.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1000.0f, &handler);
+            CHECK_EQUAL(8, handler.hit_count);
+            CHECK_EQUAL(0, handler.closest_ref);
+            CHECK_CLOSE(4.0f, handler.closest_t, 0.0001f);
+
+            // closest hit going backwards
+            handler.reset(true, 1000.0f);
+            nhshg::hshg_view_raycast(view, 100.0f, 0.0f, 0.0f, -2.0f, 0.0f, 0.0f, 1000.0f, &handler);
+            CHECK_EQUAL(7, handler.closest_ref);
+            CHECK_CLOSE(14.5f, handler.closest_t, 0.0001f);
+
+            // misses everything
+            handler.reset(false, 1000.0f);
+            nhshg::hshg_view_raycast(view, 0.0f, 5.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1000.0f, &handler);
+            CHECK_EQUAL(0, handler.hit_count);
+
+            nhshg::hshg_view_release(hshg, view);
+            nhshg::hshg_free(hshg);
+        }
+    }
+}
+UNITTEST_SUITE_END
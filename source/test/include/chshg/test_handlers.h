@@ -0,0 +1,105 @@
+#ifndef __TEST_HANDLERS_H__
+#define __TEST_HANDLERS_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+#    pragma once
+#endif
+
+#include "chshg/c_hierarchical_spatial_hashgrid.h"
+#include "chshg/c_hshg_pair_cache.h"
+
+// Counts the entities handed out and sums their refs
+class test_query_handler_t final : public ncore::nhshg::query_func_t
+{
+public:
+    void query(ncore::nhshg::entity_t const* e, ncore::nhshg::index_t e_ref) override final
+    {
+        ++query_count;
+        ref_sum += (ncore::s32)e_ref;
+        last_ref = e_ref;
+    }
+
+    void reset()
+    {
+        query_count = 0;
+        ref_sum     = 0;
+    }
+
+    ncore::s32            query_count = 0;
+    ncore::s32            ref_sum     = 0;
+    ncore::nhshg::index_t last_ref    = 0;
+};
+
+// Counts the pairs handed out, and those of them of which the spheres overlap
+class test_collide_handler_t final : public ncore::nhshg::collide_func_t
+{
+public:
+    void collide(const ncore::nhshg::entity_t* e1, ncore::nhshg::index_t e1_ref, const ncore::nhshg::entity_t* e2, ncore::nhshg::index_t e2_ref) override final
+    {
+        ++pair_count;
+
+        const ncore::f32 dx = e1->x - e2->x;
+        const ncore::f32 dy = e1->y - e2->y;
+        const ncore::f32 dz = e1->z - e2->z;
+        const ncore::f32 sr = e1->r + e2->r;
+        if (dx * dx + dy * dy + dz * dz <= sr * sr)
+            ++collide_count;
+    }
+
+    ncore::s32 pair_count    = 0;
+    ncore::s32 collide_count = 0;
+};
+
+// Counts the contact events of hshg_collide_cached()
+class test_contact_handler_t final : public ncore::nhshg::contact_func_t
+{
+public:
+    void begin(ncore::nhshg::index_t e1_ref, ncore::nhshg::index_t e2_ref) override final { ++begin_count; }
+    void stay(ncore::nhshg::index_t e1_ref, ncore::nhshg::index_t e2_ref) override final { ++stay_count; }
+    void end(ncore::nhshg::index_t e1_ref, ncore::nhshg::index_t e2_ref) override final
+    {
+        ++end_count;
+        last_end_ref1 = e1_ref;
+        last_end_ref2 = e2_ref;
+    }
+
+    void reset()
+    {
+        begin_count = 0;
+        stay_count  = 0;
+        end_count   = 0;
+    }
+
+    ncore::s32            begin_count   = 0;
+    ncore::s32            stay_count    = 0;
+    ncore::s32            end_count     = 0;
+    ncore::nhshg::index_t last_end_ref1 = 0;
+    ncore::nhshg::index_t last_end_ref2 = 0;
+};
+
+// Moves the entity with ref 'm_ref' along x by 'm_dx', removes it when 'm_remove' is set
+class test_move_handler_t final : public ncore::nhshg::update_func_t
+{
+public:
+    void update(ncore::nhshg::index_t begin, ncore::nhshg::index_t end, ncore::nhshg::entity_t* e, ncore::nhshg::index_t const* ref, ncore::nhshg::hshg_t* hshg) override final
+    {
+        for (ncore::nhshg::index_t i = begin; i < end; ++i)
+        {
+            if (ref[i] != m_ref)
+                continue;
+            if (m_remove)
+            {
+                ncore::nhshg::hshg_remove(hshg, i);
+                continue;
+            }
+            e[i].x += m_dx;
+            ncore::nhshg::hshg_move(hshg, i);
+        }
+    }
+
+    ncore::nhshg::index_t m_ref    = 0;
+    ncore::f32            m_dx     = 0.0f;
+    bool                  m_remove = false;
+};
+
+#endif  // __TEST_HANDLERS_H__